@@ -0,0 +1,51 @@
+#define NOBUILD_IMPLEMENTATION
+#include "../nobuild.h"
+
+#define ITERATIONS 100000
+
+// The kind of garbage a recipe makes for every source file
+void make_garbage(size_t i)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "file%zu.c", i);
+    Cstr object = CONCAT(NOEXT(name), ".o");
+    Cmd cmd = {
+        .line = CSTR_ARRAY_MAKE("cc", "-c", PATH("src", "module", name), "-o", PATH("build", object)),
+    };
+    (void) cmd_show(cmd);
+}
+
+int main(void)
+{
+    Arena_Mark start = temp_mark();
+    for (size_t i = 0; i < ITERATIONS; ++i) {
+        make_garbage(i);
+    }
+    INFO("Without a reset: %zu KiB in use after %d iterations", temp_used() / 1024, ITERATIONS);
+    temp_reset(start);
+
+    size_t peak = 0;
+    for (size_t i = 0; i < ITERATIONS; ++i) {
+        Arena_Mark mark = temp_mark();
+        make_garbage(i);
+        if (temp_used() > peak) {
+            peak = temp_used();
+        }
+        temp_reset(mark);
+    }
+    INFO("With a reset per iteration: %zu bytes at most, %zu bytes in use after %d iterations",
+         peak, temp_used(), ITERATIONS);
+
+    // Private arenas are not shared with the library and are freed as a whole
+    Arena arena = {0};
+    Cstr_Array copies = {0};
+    FOREACH_FILE_IN_DIR(file, "examples", {
+        if (ENDS_WITH(file, ".c")) {
+            copies = cstr_array_append(copies, arena_strdup(&arena, file));
+        }
+    });
+    INFO("%zu examples in %zu bytes of a private arena", copies.count, arena_used(&arena));
+    arena_free(&arena);
+
+    return 0;
+}
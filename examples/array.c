@@ -0,0 +1,80 @@
+#define NOBUILD_IMPLEMENTATION
+#include "../nobuild.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif // _WIN32
+
+#define ELEMS_COUNT 1000000
+
+double now(void)
+{
+#ifndef _WIN32
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#else
+    return (double) GetTickCount() / 1e3;
+#endif // _WIN32
+}
+
+void report(Cstr name, Cstr_Array cstrs, double start)
+{
+    double secs = now() - start;
+    INFO("%s: %zu elements in %.2fms, %.1fM appends/s, capacity %zu",
+         name, cstrs.count, secs * 1e3, (double) cstrs.count / secs / 1e6, cstrs.capacity);
+}
+
+int main(void)
+{
+    Arena_Mark mark = temp_mark();
+    double start = now();
+    Cstr_Array cstrs = {0};
+    for (size_t i = 0; i < ELEMS_COUNT; ++i) {
+        cstrs = cstr_array_append(cstrs, "main.c");
+    }
+    report("cstr_array_append()", cstrs, start);
+    temp_reset(mark);
+
+    start = now();
+    cstrs = cstr_array_reserve((Cstr_Array) {0}, ELEMS_COUNT);
+    for (size_t i = 0; i < ELEMS_COUNT; ++i) {
+        cstrs = cstr_array_append(cstrs, "main.c");
+    }
+    report("cstr_array_reserve() and cstr_array_append()", cstrs, start);
+    temp_reset(mark);
+
+    // The paths are allocated in between, so every time the array grows it is copied
+    start = now();
+    cstrs = (Cstr_Array) {0};
+    for (size_t i = 0; i < ELEMS_COUNT; ++i) {
+        cstrs = cstr_array_append(cstrs, PATH("src", "main.c"));
+    }
+    report("cstr_array_append() of PATH()", cstrs, start);
+    cstrs = cstr_array_shrink_to_fit(cstrs);
+    INFO("cstr_array_shrink_to_fit(): capacity %zu", cstrs.capacity);
+    temp_reset(mark);
+
+    Cmd cc = { .line = CSTR_ARRAY_MAKE("cc", "-c", "main.c") };
+    start = now();
+    Cmd_Array cmds = {0};
+    for (size_t i = 0; i < ELEMS_COUNT; ++i) {
+        da_append(&cmds, cc);
+    }
+    INFO("da_append() of Cmd: %zu elements in %.2fms, capacity %zu",
+         cmds.count, (now() - start) * 1e3, cmds.capacity);
+
+    // Takes the commands of a recipe off a work list until it runs out
+    da_free(&cmds);
+    da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", "main.c") }));
+    da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", "util.c") }));
+    Cstr_Array objects = CSTR_ARRAY_MAKE("main.o", "util.o");
+    da_append(&cmds, ((Cmd) { .line = cstr_array_concat(CSTR_ARRAY_MAKE("cc", "-o", "main"), objects) }));
+    FOREACH_ARRAY(Cmd, cmd, cmds, INFO("Queued: %s", cmd_show(*cmd)));
+    while (cmds.count > 0) {
+        INFO("Popped: %s", cmd_show(da_pop(&cmds)));
+    }
+    temp_reset(mark);
+
+    return 0;
+}
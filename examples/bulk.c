@@ -0,0 +1,111 @@
+// Compare the io_uring backend against plain syscalls where it is available
+#define NOBUILD_IO_URING
+#define NOBUILD_IMPLEMENTATION
+#include "../nobuild.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+#define FILES_COUNT 4000
+
+double now(void)
+{
+#ifndef _WIN32
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#else
+    return (double) GetTickCount() / 1e3;
+#endif // _WIN32
+}
+
+unsigned long long fnv1a(const char *data, size_t size)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int main(void)
+{
+    INFO("io_uring: %s", bulk_uses_io_uring() ? "yes" : "no");
+
+    MKDIRS("bulk", "a");
+    MKDIRS("bulk", "b");
+    static Bulk_Stat stats[FILES_COUNT];
+    static Bulk_Read reads[FILES_COUNT];
+    for (size_t i = 0; i < FILES_COUNT; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "%zu.txt", i);
+        Cstr path = PATH("bulk", i % 2 ? "a" : "b", name);
+
+        Fd fd = fd_open_for_write(path);
+        for (size_t j = 0; j <= i % 64; ++j) {
+            fd_printf(fd, "line %zu of %s\n", j, path);
+        }
+        fd_close(fd);
+
+        stats[i].path = path;
+        reads[i].path = path;
+    }
+
+    double start = now();
+    bulk_stat(stats, FILES_COUNT);
+    INFO("bulk_stat() of %d files: %.2fms", FILES_COUNT, (now() - start) * 1e3);
+
+#ifndef _WIN32
+    start = now();
+    for (size_t i = 0; i < FILES_COUNT; ++i) {
+        struct stat statbuf;
+        if (stat(stats[i].path, &statbuf) < 0 || (unsigned long long) statbuf.st_size != stats[i].size) {
+            PANIC("bulk_stat() disagrees with stat() about %s", stats[i].path);
+        }
+    }
+    INFO("stat() of %d files: %.2fms", FILES_COUNT, (now() - start) * 1e3);
+#endif // _WIN32
+
+    start = now();
+    bulk_read(reads, FILES_COUNT);
+    unsigned long long bulk_hash = 0;
+    for (size_t i = 0; i < FILES_COUNT; ++i) {
+        if (reads[i].error) {
+            PANIC("Could not read %s: %s", reads[i].path, nobuild__strerror(reads[i].error));
+        }
+        bulk_hash ^= fnv1a(reads[i].data, reads[i].size);
+        free(reads[i].data);
+    }
+    INFO("bulk_read() of %d files: %.2fms", FILES_COUNT, (now() - start) * 1e3);
+
+    start = now();
+    unsigned long long hash = 0;
+    static char buffer[64 * 1024];
+    for (size_t i = 0; i < FILES_COUNT; ++i) {
+        Fd fd = fd_open_for_read(reads[i].path);
+        size_t size = fd_read(fd, buffer, sizeof(buffer));
+        fd_close(fd);
+        hash ^= fnv1a(buffer, size);
+    }
+    INFO("fd_read() of %d files: %.2fms", FILES_COUNT, (now() - start) * 1e3);
+
+    if (hash != bulk_hash) {
+        PANIC("bulk_read() hashed to %llx instead of %llx", bulk_hash, hash);
+    }
+
+    Bulk_Stat missing[] = { { .path = PATH_LIT("bulk", "missing") }, { .path = PATH_LIT("bulk", "a") } };
+    bulk_stat(missing, 2);
+    if (missing[0].error != ENOENT || missing[1].error != 0 || !missing[1].is_dir) {
+        PANIC("bulk_stat() got a missing file or a directory wrong%s", "");
+    }
+
+    // The whole tree is stat'ed in batches to find its newest file
+    start = now();
+    int newer = IS_NEWER("bulk", PATH_LIT("examples", "bulk.c"));
+    INFO("IS_NEWER(bulk, examples/bulk.c) = %d in %.2fms", newer, (now() - start) * 1e3);
+
+    RM("bulk");
+    return 0;
+}
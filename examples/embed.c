@@ -0,0 +1,151 @@
+#define NOBUILD_IMPLEMENTATION
+#include "../nobuild.h"
+
+#include <time.h>
+
+#define ASSET_SIZE (8 * 1024 * 1024)
+
+static unsigned char asset[ASSET_SIZE];
+
+void make_asset(Cstr path, size_t size)
+{
+    unsigned int seed = 69;
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345;
+        asset[i] = (unsigned char) (seed >> 16);
+    }
+
+    Fd fd = fd_open_for_write(path);
+    fd_write(fd, asset, (unsigned long) size);
+    fd_close(fd);
+}
+
+// Links the generated source or object against a program that compares it with the asset
+void check_embedded(Cstr embedded, size_t size)
+{
+    unsigned long hash = 5381;
+    for (size_t i = 0; i < size; ++i) {
+        hash = hash * 33 + asset[i];
+    }
+
+    Fd check = fd_open_for_write("check.c");
+    fd_printf(check,
+              "#include <stdio.h>\n"
+              "extern unsigned char asset[];\n"
+              "extern unsigned long asset_len;\n"
+              "int main(void)\n"
+              "{\n"
+              "    unsigned long hash = 5381;\n"
+              "    for (unsigned long i = 0; i + 1 < asset_len; ++i) hash = hash * 33 + asset[i];\n"
+              "    if (asset_len != %lu || hash != %luul || asset[asset_len - 1] != 0) return 1;\n"
+              "    return 0;\n"
+              "}\n",
+              (unsigned long) size + 1, hash);
+    fd_close(check);
+
+    CMD("cc", "-o", "check", "check.c", embedded);
+    CMD(PATH_LIT(".", "check"));
+
+    RM(embedded);
+    RM("check.c");
+    RM("check");
+}
+
+void check_format(Cstr name, C_Array_Format format, size_t size)
+{
+    Cstr source = CONCAT("asset_", name, ".c");
+    FILE_TO_C_ARRAY_FORMAT("asset.bin", source, "asset", format);
+    check_embedded(source, size);
+}
+
+void write_file(Cstr path, char *content)
+{
+    Fd fd = fd_open_for_write(path);
+    fd_write(fd, content, (unsigned long) strlen(content));
+    fd_close(fd);
+}
+
+// Packs a small tree and looks every member up from a linked program
+void check_pack(Cstr pack)
+{
+    MKDIRS("assets", "shaders");
+    write_file(PATH_LIT("assets", "hello.txt"), "Hello, World!\n");
+    write_file(PATH_LIT("assets", "empty"), "");
+    write_file(PATH_LIT("assets", "shaders", "main.glsl"), "void main() {}\n");
+
+    int lookup = !ENDS_WITH(pack, ".o");
+    dir_to_pack("assets", pack, "assets", lookup ? PACK_LOOKUP : PACK_DEFAULT);
+
+    Fd check = fd_open_for_write("check.c");
+    fd_printf(check,
+              "#include <string.h>\n"
+              "extern const unsigned char assets[];\n"
+              "extern const char assets_names[];\n"
+              "extern const unsigned long assets_entries[][4];\n"
+              "extern const unsigned long assets_count;\n"
+              "long assets_find(const char *name);\n"
+              "static long find(const char *name)\n"
+              "{\n"
+              "%s"
+              "    for (unsigned long i = 0; i < assets_count; ++i)\n"
+              "        if (strcmp(assets_names + assets_entries[i][0], name) == 0) return (long) i;\n"
+              "    return -1;\n"
+              "}\n"
+              "static int check(const char *name, const char *content)\n"
+              "{\n"
+              "    long i = find(name);\n"
+              "    if (i < 0 || assets_entries[i][3] != strlen(content) || assets_entries[i][2] %% 16 != 0) return 0;\n"
+              "    return memcmp(assets + assets_entries[i][2], content, strlen(content) + 1) == 0;\n"
+              "}\n"
+              "int main(void)\n"
+              "{\n"
+              "    if (assets_count != 3 || find(\"missing\") != -1) return 1;\n"
+              "    if (!check(\"empty\", \"\") || !check(\"hello.txt\", \"Hello, World!\\n\")) return 1;\n"
+              "    return !check(\"shaders/main.glsl\", \"void main() {}\\n\");\n"
+              "}\n",
+              lookup ? "    return assets_find(name);\n" : "");
+    fd_close(check);
+
+    CMD("cc", "-o", "check", "check.c", pack);
+    CMD(PATH_LIT(".", "check"));
+
+    RM(pack);
+    RM("assets");
+    RM("check.c");
+    RM("check");
+}
+
+int main(void)
+{
+    make_asset("asset.bin", ASSET_SIZE);
+
+    clock_t start = clock();
+    FILE_TO_C_ARRAY("asset.bin", "asset.c", "asset");
+    double secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+    INFO("    Embedded %d MiB in %.3fs (%.1f MiB/s)",
+         ASSET_SIZE / (1024 * 1024), secs, secs > 0 ? ASSET_SIZE / (1024.0 * 1024.0) / secs : 0.0);
+    RM("asset.c");
+
+#ifndef _WIN32
+    make_asset("asset.bin", 64 * 1024 + 3);
+    check_format("bytes", C_ARRAY_BYTES, 64 * 1024 + 3);
+    check_format("string", C_ARRAY_STRING, 64 * 1024 + 3);
+    check_format("incbin", C_ARRAY_INCBIN, 64 * 1024 + 3);
+    check_format("embed", C_ARRAY_EMBED, 64 * 1024 + 3);
+#endif
+
+#ifdef __ELF__
+    FILE_TO_OBJECT("asset.bin", "asset.o", "asset");
+    check_embedded("asset.o", 64 * 1024 + 3);
+#endif
+
+#ifndef _WIN32
+    check_pack("assets.c");
+#endif
+#ifdef __ELF__
+    check_pack("assets.o");
+#endif
+
+    RM("asset.bin");
+    return 0;
+}
@@ -18,6 +18,18 @@ void print_file_recursively(const char *path)
     }
 }
 
+void make_file(Cstr path, size_t size)
+{
+    static char chunk[64 * 1024];
+    memset(chunk, 'a', sizeof(chunk));
+
+    Fd fd = fd_open_for_write(path);
+    for (size_t i = 0; i < size; i += sizeof(chunk)) {
+        fd_write(fd, chunk, (unsigned long) sizeof(chunk));
+    }
+    fd_close(fd);
+}
+
 int main(void)
 {
     DEMO(IS_DIR("./nobuild.c"));
@@ -38,5 +50,37 @@ int main(void)
     RM("foo");
     DEMO(IS_DIR("foo"));
 
+    INFO("Copying");
+    MKDIRS("copy_src", "assets");
+    make_file(PATH_LIT("copy_src", "assets", "data.bin"), 32 * 1024 * 1024);
+    for (int i = 0; i < 64; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "small_%d.bin", i);
+        make_file(PATH("copy_src", name), 64 * 1024);
+    }
+    log_set_level(LOG_TRACE);
+    Copy_Stats stats = path_copy_ex("copy_src", "copy_dst", COPY_TIMESTAMPS);
+    log_set_level(LOG_INFO);
+    INFO("    Copied %zu files and %zu directories", stats.files, stats.dirs);
+    DEMO(IS_FILE(PATH_LIT("copy_dst", "assets", "data.bin")));
+    DEMO(IS_NEWER(PATH_LIT("copy_src", "assets", "data.bin"), PATH_LIT("copy_dst", "assets", "data.bin")));
+
+    INFO("Mapping");
+    File_View view = {0};
+    DEMO(file_map(PATH_LIT("copy_src", "assets", "data.bin"), &view));
+    DEMO(view.mapped);
+    DEMO(view.size == 32 * 1024 * 1024 && view.data[view.size - 1] == 'a');
+    file_unmap(view);
+    DEMO(file_map(PATH_LIT("examples", "file.c"), &view));
+    DEMO(view.mapped);
+    DEMO(strstr(view.data, "file_map") != NULL);
+    file_unmap(view);
+    DEMO(file_map("./file_that_does_not_exist", &view) == ENOENT);
+    RM("copy_src");
+
+    INFO("Background removal");
+    path_rm_ex("copy_dst", RM_BACKGROUND);
+    DEMO(PATH_EXISTS("copy_dst"));
+
     return 0;
 }
@@ -0,0 +1,78 @@
+#define NOBUILD_IMPLEMENTATION
+#include "../nobuild.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif // _WIN32
+
+HASH_SET_DEFINE(Path_Set, path_set, Cstr, hash_cstr, HASH_EQ_CSTR)
+HASH_MAP_DEFINE(Count_Map, count_map, Cstr, size_t, hash_cstr, HASH_EQ_CSTR)
+
+double now(void)
+{
+#ifndef _WIN32
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#else
+    return (double) GetTickCount() / 1e3;
+#endif // _WIN32
+}
+
+// Looks up `lookups` of the paths, spread over the whole array
+void bench(size_t count, size_t lookups)
+{
+    Arena_Mark mark = temp_mark();
+    Cstr_Array paths = cstr_array_reserve((Cstr_Array) {0}, count);
+    for (size_t i = 0; i < count; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "src/module%zu/file%zu.c", i % 97, i);
+        paths = cstr_array_append(paths, temp_strdup(name));
+    }
+
+    Path_Set set = {0};
+    double start = now();
+    for (size_t i = 0; i < count; ++i) {
+        path_set_add(&set, paths.elems[i]);
+    }
+    double insert = now() - start;
+
+    size_t found = 0;
+    start = now();
+    for (size_t i = 0; i < lookups; ++i) {
+        found += cstr_array_contains(paths, temp_strdup(paths.elems[i * (count / lookups)]));
+    }
+    double array = now() - start;
+
+    start = now();
+    const size_t set_lookups = lookups * 100;
+    for (size_t i = 0; i < set_lookups; ++i) {
+        found += path_set_contains(&set, paths.elems[(i * 7919) % count]);
+    }
+    double hash = now() - start;
+
+    INFO("%zu paths: inserting %.2fms, cstr_array_contains() %.0fns, path_set_contains() %.0fns per lookup (%zu found)",
+         count, insert * 1e3, array / (double) lookups * 1e9, hash / (double) set_lookups * 1e9, found);
+
+    path_set_free(&set);
+    temp_reset(mark);
+}
+
+int main(void)
+{
+    Count_Map counts = {0};
+    Cstr words[] = { "cc", "-c", "cc", "-o", "cc", "-c" };
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+        size_t *count = count_map_get(&counts, words[i]);
+        count_map_put(&counts, words[i], count != NULL ? *count + 1 : 1);
+    }
+    count_map_remove(&counts, "-o");
+    HASH_FOREACH(Count_Map_Entry, entry, counts, {
+        INFO("%s: %zu", entry->key, entry->value);
+    });
+    count_map_free(&counts);
+
+    bench(10 * 1000, 1000);
+    bench(1000 * 1000, 100);
+    return 0;
+}
@@ -7,5 +7,10 @@ int main(void)
     WARN("    Warning Message");
     ERRO("    Error Message");
 
+    TRACE("    Trace Message that is not printed");
+    log_set_level(LOG_TRACE);
+    TRACE("    Trace Message");
+    log_set_level(LOG_INFO);
+
     return 0;
 }
@@ -1,14 +1,210 @@
 #define NOBUILD_IMPLEMENTATION
 #include "../nobuild.h"
 
+#include "../tools/rot13.h"
+#include "../tools/hex.h"
+
+#define STAGE_BUFFER_SIZE (64 * 1024)
+
+// Returns 0 once `out` stops taking data
+int write_all(Fd out, char *buffer, size_t n)
+{
+    for (size_t written = 0; written < n;) {
+        size_t m = fd_write(out, buffer + written, (unsigned long) (n - written));
+        if (m == 0) {
+            return 0;
+        }
+        written += m;
+    }
+    return 1;
+}
+
+// The same transforms as tools/rot13 and tools/hex, run inside nobuild
+int rot13_stage(Fd in, Fd out, void *data)
+{
+    (void) data;
+    char buffer[STAGE_BUFFER_SIZE];
+    for (size_t n = 0; (n = fd_read(in, buffer, sizeof(buffer))) > 0;) {
+        rot13_buffer(buffer, n);
+        if (!write_all(out, buffer, n)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int hex_stage(Fd in, Fd out, void *data)
+{
+    (void) data;
+    uint8_t bytes[STAGE_BUFFER_SIZE];
+    char lines[STAGE_BUFFER_SIZE / HEX_COLUMNS * HEX_LINE_SIZE];
+    size_t count = 0;
+    for (size_t n = 0; (n = fd_read(in, bytes + count, sizeof(bytes) - count)) > 0;) {
+        count += n;
+
+        size_t i = 0, len = 0;
+        for (; count - i >= HEX_COLUMNS; i += HEX_COLUMNS) {
+            len += hex_line(bytes + i, HEX_COLUMNS, lines + len);
+        }
+        if (!write_all(out, lines, len)) {
+            return 1;
+        }
+
+        count -= i;
+        memmove(bytes, bytes + i, count);
+    }
+
+    // Like tools/hex, finish with whatever is left, even if that is nothing
+    size_t len = hex_line(bytes, count, lines);
+    return !write_all(out, lines, len);
+}
+
+// Exits the example when the two files differ
+void expect_same_files(Cstr path1, Cstr path2)
+{
+    static char buffer1[STAGE_BUFFER_SIZE];
+    static char buffer2[STAGE_BUFFER_SIZE];
+    Fd fd1 = fd_open_for_read(path1);
+    Fd fd2 = fd_open_for_read(path2);
+    for (;;) {
+        size_t n1 = fd_read(fd1, buffer1, sizeof(buffer1));
+        size_t n2 = fd_read(fd2, buffer2, sizeof(buffer2));
+        if (n1 != n2 || memcmp(buffer1, buffer2, n1) != 0) {
+            PANIC("%s and %s differ", path1, path2);
+        }
+        if (n1 == 0) {
+            break;
+        }
+    }
+    fd_close(fd1);
+    fd_close(fd2);
+}
+
+#ifndef _WIN32
+#include <sys/time.h>
+
+#define BENCH_SIZE (256 * 1024 * 1024)
+
+double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+void make_input(Cstr path)
+{
+    static char chunk[64 * 1024];
+    for (size_t i = 0; i < sizeof(chunk); ++i) {
+        chunk[i] = 'a' + (char) (i % 26);
+    }
+
+    Atomic_File file = atomic_file_open(path);
+    for (size_t i = 0; i < BENCH_SIZE; i += sizeof(chunk)) {
+        fd_write(file.fd, chunk, (unsigned long) sizeof(chunk));
+    }
+    atomic_file_commit(&file);
+}
+
+int copy_stage(Fd in, Fd out, void *data)
+{
+    (void) data;
+    fd_pump(in, out);
+    return 0;
+}
+
+// The chains only pass the data along, so the output must be as large as the input.
+// The previous output is removed and whatever was written before is flushed first,
+// otherwise freeing and writing back those pages slows down whichever chain is next.
+void bench(Cstr name, Chain chain)
+{
+    if (path_exists("bench.out")) {
+        path_rm("bench.out");
+    }
+    atomic_file_sync();
+    double start = now();
+    chain_run_sync(chain);
+    double secs = now() - start;
+
+    Fd fd = fd_open_for_read("bench.out");
+    static char buffer[64 * 1024];
+    size_t total = 0;
+    for (size_t n = 0; (n = fd_read(fd, buffer, sizeof(buffer))) > 0;) {
+        total += n;
+    }
+    fd_close(fd);
+
+    if (total != BENCH_SIZE) {
+        PANIC("%s chain produced %zu bytes instead of %d", name, total, BENCH_SIZE);
+    }
+    INFO("    %s: %d MiB in %.3fs (%.1f MB/s)", name, BENCH_SIZE / (1024 * 1024), secs,
+         secs > 0 ? BENCH_SIZE / 1e6 / secs : 0.0);
+}
+#endif // _WIN32
+
 int main(void)
 {
-    CHAIN(CHAIN_IN(PATH("examples", "pipe.c")),
-          CHAIN_CMD(PATH("tools", "rot13")),
-          CHAIN_CMD(PATH("tools", "hex")),
+    CHAIN(CHAIN_IN(PATH_LIT("examples", "pipe.c")),
+          CHAIN_CMD(PATH_LIT("tools", "rot13")),
+          CHAIN_CMD(PATH_LIT("tools", "hex")),
           CHAIN_OUT("output.txt"));
-    CMD(PATH("tools", "cat"), "output.txt");
+    CMD(PATH_LIT("tools", "cat"), "output.txt");
+
+    // The same chain without starting any process
+    CHAIN(CHAIN_IN(PATH_LIT("examples", "pipe.c")),
+          CHAIN_FN(rot13_stage, NULL),
+          CHAIN_FN(hex_stage, NULL),
+          CHAIN_OUT("output.fn.txt"));
+    expect_same_files("output.txt", "output.fn.txt");
     RM("output.txt");
+    RM("output.fn.txt");
+
+    // Encode once, then dump the encoded stream both as is and in hex
+    CHAIN(CHAIN_IN(PATH_LIT("examples", "pipe.c")),
+          CHAIN_CMD(PATH_LIT("tools", "rot13")),
+          CHAIN_TEE(CHAIN_CMD(PATH_LIT("tools", "hex")), CHAIN_OUT("output.hex")),
+          CHAIN_OUT("output.txt"));
+    CMD(PATH_LIT("tools", "cat"), "output.txt");
+    RM("output.txt");
+    RM("output.hex");
+
+#ifndef _WIN32
+    // Keep the diagnostics of the commands out of the terminal, or in the stream
+    CHAIN(CHAIN_IN(PATH_LIT("examples", "pipe.c")),
+          CHAIN_CMD("sh", "-c", "echo 'rot13: encoding' >&2; exec tools/rot13"),
+          CHAIN_CMD("sh", "-c", "echo 'hex: dumping' >&2; exec tools/hex"),
+          CHAIN_OUT("output.txt"),
+          CHAIN_ERR("output.err"));
+    CMD(PATH_LIT("tools", "cat"), "output.err");
+    CHAIN(CHAIN_CMD("sh", "-c", "echo 'to stdout'; echo 'to stderr' >&2"),
+          CHAIN_MERGE_ERR,
+          CHAIN_CMD(PATH_LIT("tools", "rot13")),
+          CHAIN_OUT("output.txt"));
+    CMD(PATH_LIT("tools", "cat"), "output.txt");
+    RM("output.txt");
+    RM("output.err");
+
+    atomic_file_set_sync(1);
+    make_input("bench.in");
+    bench("Default pipes", chain_build_from_tokens(CHAIN_IN("bench.in"),
+                                                   CHAIN_CMD("cat"),
+                                                   CHAIN_CMD("cat"),
+                                                   CHAIN_OUT("bench.out"),
+                                                   (Chain_Token) {0}));
+    bench("1 MiB pipes", chain_build_from_tokens(CHAIN_IN("bench.in"),
+                                                 CHAIN_PIPE_SIZE(1024 * 1024),
+                                                 CHAIN_CMD("cat"),
+                                                 CHAIN_CMD("cat"),
+                                                 CHAIN_OUT("bench.out"),
+                                                 (Chain_Token) {0}));
+    bench("In-process stages", chain_build_from_tokens(CHAIN_IN("bench.in"),
+                                                       CHAIN_FN(copy_stage, NULL),
+                                                       CHAIN_FN(copy_stage, NULL),
+                                                       CHAIN_OUT("bench.out"),
+                                                       (Chain_Token) {0}));
+    RM("bench.in");
+    RM("bench.out");
+#endif // _WIN32
 
     return 0;
 }
@@ -0,0 +1,27 @@
+// Counts what nobuild does and prints a summary when the program exits. Run it with
+// `NOBUILD_STATS_JSON=stats.json` to get the summary as JSON instead.
+#define NOBUILD_STATS
+#define NOBUILD_IMPLEMENTATION
+#include "../nobuild.h"
+
+int main(void)
+{
+    MKDIRS("stats_demo", "src");
+    Fd fd = fd_open_for_write(PATH_LIT("stats_demo", "src", "main.c"));
+    fd_printf(fd, "int main(void) { return 0; }\n");
+    fd_close(fd);
+
+    path_copy(PATH_LIT("stats_demo", "src"), PATH_LIT("stats_demo", "copy"));
+    CHAIN(CHAIN_IN(PATH_LIT("stats_demo", "src", "main.c")),
+          CHAIN_CMD("tr", "a-z", "A-Z"),
+          CHAIN_PIPE_SIZE(64 * 1024),
+          CHAIN_OUT(PATH_LIT("stats_demo", "MAIN.C")));
+    CMD("cc", "-c", PATH_LIT("stats_demo", "copy", "main.c"), "-o", PATH_LIT("stats_demo", "main.o"));
+
+    Stats stats = stats_get();
+    INFO("%llu forks, %llu bytes copied and %llu bytes piped so far",
+         stats.calls[STATS_FORK].count, stats.copied_bytes, stats.piped_bytes);
+
+    RM("stats_demo");
+    return 0;
+}
@@ -7,14 +7,53 @@
 #define DEMO_D(expr)                         \
     INFO("    " #expr " == %d", expr)
 
+#define DEMO_SV(expr)                        \
+    do {                                     \
+        String_View sv = expr;               \
+        INFO("    " #expr " == \"" SV_FMT "\"", SV_ARG(sv)); \
+    } while (0)
+
+Cstr build_object_path(Cstr source, int variant)
+{
+    String_Builder sb = {0};
+    sb_append_path(&sb, "build/");
+    sb_append_path(&sb, "obj");
+    sb_append_path(&sb, NOEXT(source));
+    sb_append_fmt(&sb, ".%d.o", variant);
+    return sb_to_cstr(&sb);
+}
+
 int main(void)
 {
     DEMO_S(CONCAT("foo", "bar", "baz"));
     DEMO_S(PATH("foo", "bar", "baz"));
     DEMO_S(JOIN("++", "foo", "bar", "baz"));
+    DEMO_S(PATH_LIT("foo", "bar", "baz"));
+    DEMO_S(CONCAT_LIT("foo", "bar", "baz"));
     DEMO_S(NOEXT("main.c"));
+    DEMO_S(build_object_path("main.c", 2));
     DEMO_D(ENDS_WITH("main.c", ".c"));
     DEMO_D(ENDS_WITH("main.java", ".c"));
     DEMO_D(ENDS_WITH("", ".c"));
+
+    String_View flags = SV("  -Wall -O2 ");
+    DEMO_SV(sv_trim(flags));
+    DEMO_SV(sv_chop_by_delim(&flags, '-'));
+    DEMO_SV(flags);
+    DEMO_D(sv_ends_with(sv_from_cstr("src/main.c"), SV(".c")));
+    DEMO_SV(path_no_ext_sv(SV("src/main.c")));
+    DEMO_SV(path_dirname_sv(SV("src/main.c")));
+    DEMO_SV(path_basename_sv(SV("src/lib/")));
+
+    Split_Iter it = split_iter_make(SV("cc,-c,,main.c"), SV(","));
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        DEMO_SV(piece);
+    }
+    DEMO_D((int) sv_split(SV("a -- b -- c"), SV(" -- ")).count);
+    DEMO_D((int) SPLIT("foo bar", "/").count);
+
+    DEMO_D(intern(PATH("src", "main.c")) == intern(CONCAT("src", PATH_SEP, "main.c")));
+    DEMO_D(intern_find(SV("src/main.h")) != NULL);
     return 0;
 }
@@ -1,9 +1,9 @@
-#include <ctype.h>
-
 #define NOBUILD_IMPLEMENTATION
 #include "./nobuild.h"
 
-#define CFLAGS "-Wall", "-Wextra", "-std=c99", "-pedantic"
+#include <ctype.h>
+
+#define CFLAGS "-Wall", "-Wextra", "-std=c99", "-pedantic", "-pthread"
 
 void build_tool(const char *tool)
 {
@@ -76,13 +76,13 @@ int main(int argc, char **argv)
         PANIC("Could not retrieve current working directory.");
     }
 
-    Cstr dir = PATH("tools", "pcpp");
+    Cstr dir = PATH_LIT("tools", "pcpp");
     if (chdir(dir) < 0) {
         PANIC("Could not change current directory to '%s': %s", dir, nobuild__strerror(errno));
     }
 
     CMD("cc", CFLAGS, "-o", "nobuild", "nobuild.c");
-    CMD(PATH(".", "nobuild"));
+    CMD(PATH_LIT(".", "nobuild"));
 
     if (chdir(cwd) < 0) {
         PANIC("Could not change current directory to '%s': %s", cwd, nobuild__strerror(errno));
@@ -95,15 +95,17 @@ int main(int argc, char **argv)
 
     Cstr_Array header_guards = CSTR_ARRAY_MAKE(
         "NOBUILD_LOG_H_", "NOBUILD_CSTR_H_", "NOBUILD_PATH_H_",
-        "NOBUILD_CMD_H_", "NOBUILD_IO_H_", "MINIRENT_H_"
+        "NOBUILD_CMD_H_", "NOBUILD_IO_H_", "NOBUILD_EMBED_H_", "NOBUILD_BULK_H_", "NOBUILD_ARENA_H_", "NOBUILD_HASH_H_", "NOBUILD_STATS_H_", "MINIRENT_H_"
     );
     Cstr_Array impl_flags = CSTR_ARRAY_MAKE(
         "NOBUILD_LOG_IMPLEMENTATION", "NOBUILD_CSTR_IMPLEMENTATION", "NOBUILD_PATH_IMPLEMENTATION",
-        "NOBUILD_CMD_IMPLEMENTATION", "NOBUILD_IO_IMPLEMENTATION", "MINIRENT_IMPLEMENTATION"
+        "NOBUILD_CMD_IMPLEMENTATION", "NOBUILD_IO_IMPLEMENTATION", "NOBUILD_EMBED_IMPLEMENTATION",
+        "NOBUILD_BULK_IMPLEMENTATION", "NOBUILD_ARENA_IMPLEMENTATION", "NOBUILD_HASH_IMPLEMENTATION",
+        "NOBUILD_STATS_IMPLEMENTATION", "MINIRENT_IMPLEMENTATION"
     );
     Cstr_Array impl_guards = CSTR_ARRAY_MAKE(
         "NOBUILD_LOG_I_", "NOBUILD_CSTR_I_", "NOBUILD_PATH_I_",
-        "NOBUILD_CMD_I_", "NOBUILD_IO_I_", "MINIRENT_I_"
+        "NOBUILD_CMD_I_", "NOBUILD_IO_I_", "NOBUILD_EMBED_I_", "NOBUILD_BULK_I_", "NOBUILD_ARENA_I_", "NOBUILD_HASH_I_", "NOBUILD_STATS_I_", "MINIRENT_I_"
     );
 
     FOREACH_FILE_IN_DIR(header, "src", {
@@ -121,7 +123,7 @@ int main(int argc, char **argv)
         impl_flags = cstr_array_remove(impl_flags, CONCAT(lib_name, "_IMPLEMENTATION"));
 
         Cstr macros = JOIN(",", cstr_array_join(",", header_guards), cstr_array_join(",", impl_guards), cstr_array_join(",", impl_flags));
-        CMD(PATH("tools", "pcpp", "build", "pcpp"), "--implicitly-undef", "--only", macros, "--include-all", "-o", PATH("standalone", header), PATH("src", header));
+        CMD(PATH_LIT("tools", "pcpp", "build", "pcpp"), "--implicitly-undef", "--only", macros, "--include-all", "-o", PATH("standalone", header), PATH("src", header));
 
         header_guards = cstr_array_append(header_guards, CONCAT(lib_name, "_H_"));
         impl_guards = cstr_array_append(impl_guards, CONCAT(lib_name, "_I_"));
@@ -129,6 +131,6 @@ int main(int argc, char **argv)
     });
 
     Cstr macros = JOIN(",", cstr_array_join(",", header_guards), cstr_array_join(",", impl_guards), cstr_array_join(",", impl_flags));
-    CMD(PATH("tools", "pcpp", "build", "pcpp"), "--implicitly-undef",  "--only", macros, "--include-all", "-o", "nobuild.h", PATH("src", "nobuild.h"));
+    CMD(PATH_LIT("tools", "pcpp", "build", "pcpp"), "--implicitly-undef",  "--only", macros, "--include-all", "-o", "nobuild.h", PATH_LIT("src", "nobuild.h"));
     return 0;
 }
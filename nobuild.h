@@ -1,6 +1,16 @@
 #ifndef NOBUILD_H_
 #define NOBUILD_H_
 
+// The implementation uses POSIX 2008 functions like `futimens()` and `clock_gettime()`.
+// Ask for them when the compiler runs in strict ISO C mode and the user did not pick a
+// feature level. This only works when nobuild is included before any system header;
+// otherwise the modules fall back to older calls.
+#ifdef NOBUILD_IMPLEMENTATION
+#	if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE)
+#		define _POSIX_C_SOURCE 200809L
+#	endif
+#endif
+
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -22,8 +32,22 @@
 #	endif
 #endif
 
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
 NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
 
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
 void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 #define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
 
@@ -46,8 +70,285 @@ void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 ////////////////////////////////////////////////////////////////////////////////
 
 
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stddef.h>
+#include <string.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Region based allocation. An arena hands out memory from a list of large regions
+// and takes all of it back at once, so a lot of small allocations that die together
+// cost a pointer bump each and a single rewind in the end.
+
+typedef struct Arena_Region Arena_Region;
+
+typedef struct {
+    Arena_Region *begin;
+    // The region allocations are served from. The ones after it are empty.
+    Arena_Region *end;
+} Arena;
+
+// A position in an arena to rewind to
+typedef struct {
+    Arena_Region *region;
+    size_t count;
+} Arena_Mark;
+
+// Never returns NULL, panics when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// Resizes `old`, which was allocated with `old_size` bytes. It is resized in place
+// when it is the last allocation of the arena, and copied otherwise.
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *cstr);
+
+Arena_Mark arena_mark(Arena *arena);
+// Releases everything allocated since `mark` was taken. The regions are kept around
+// for the allocations that follow.
+void arena_rewind(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+// Gives the regions back to the system
+void arena_free(Arena *arena);
+// Number of bytes currently allocated from `arena`
+size_t arena_used(const Arena *arena);
+
+// Every string, array and chain that nobuild returns is allocated from the temporary
+// arena and is never freed on its own. Code that creates garbage on every iteration
+// of a loop can release it in O(1) by resetting to a mark taken at the start:
+//
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         Arena_Mark mark = temp_mark();
+//         if (ENDS_WITH(file, ".c")) {
+//             CMD("cc", "-c", PATH("src", file), "-o", CONCAT(NOEXT(file), ".o"));
+//         }
+//         temp_reset(mark);
+//     });
+//
+// Everything returned since the mark is gone after the reset, including the storage
+// of arrays that were grown in between. The arena is shared by all threads and none
+// of them may be using it while it is reset.
+void *temp_alloc(size_t size);
+void *temp_realloc(void *old, size_t old_size, size_t new_size);
+char *temp_strdup(const char *cstr);
+Arena_Mark temp_mark(void);
+void temp_reset(Arena_Mark mark);
+size_t temp_used(void);
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size);
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size);
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr);
+// Counts the allocation for the module that makes it
+#	define temp_alloc(size) nobuild__stats_temp_alloc(NOBUILD__STATS_MODULE, (size))
+#	define temp_realloc(old, old_size, new_size) \
+    nobuild__stats_temp_realloc(NOBUILD__STATS_MODULE, (old), (old_size), (new_size))
+#	define temp_strdup(cstr) nobuild__stats_temp_strdup(NOBUILD__STATS_MODULE, (cstr))
+#endif // NOBUILD_STATS
+
+// Dynamic arrays, for any struct with an `elems` pointer and `count` and `capacity`
+// fields. Their storage comes from the temporary arena and doubles when it is full,
+// so appending costs O(1) amortized, and a single allocation when nothing else was
+// allocated since the last append.
+//
+//     typedef struct {
+//         Cmd *elems;
+//         size_t count;
+//         size_t capacity;
+//     } Cmd_Array;
+//
+//     Cmd_Array cmds = {0};
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", file) }));
+//     });
+//     FOREACH_ARRAY(Cmd, cmd, cmds, cmd_run_sync(*cmd));
+//
+// Arrays with a `capacity` below their `count` wrap storage that nobuild did not
+// allocate, like `argv`, which is copied on the first append. The macros evaluate
+// `da` more than once.
+
+// Makes room for `n` elements in total
+#define da_reserve(da, n)                                                                  \
+    ((da)->elems = nobuild__da_reserve((da)->elems, sizeof(*(da)->elems), (da)->count,     \
+                                       &(da)->capacity, (n)))
+
+#define da_append(da, elem)                                                                \
+    ((da)->count >= (da)->capacity                                                         \
+         ? (void) ((da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems),       \
+                                                  (da)->count, &(da)->capacity,            \
+                                                  (da)->count + 1))                        \
+         : (void) 0,                                                                       \
+     (void) ((da)->elems[(da)->count++] = (elem)))
+
+// Appends the `n` elements that `new_elems` points to
+#define da_append_many(da, new_elems, n)                                                   \
+    do {                                                                                   \
+        const size_t nobuild__da_n = (n);                                                  \
+        /* Only compiles when the elements have the same type */                           \
+        (void) sizeof(*(da)->elems = *(new_elems));                                        \
+        if (nobuild__da_n > 0) {                                                           \
+            (da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems), (da)->count, \
+                                           &(da)->capacity, (da)->count + nobuild__da_n);  \
+            memcpy((da)->elems + (da)->count, (new_elems),                                 \
+                   sizeof(*(da)->elems) * nobuild__da_n);                                  \
+            (da)->count += nobuild__da_n;                                                  \
+        }                                                                                  \
+    } while (0)
+
+// Removes the last element and returns it. The array must not be empty.
+#define da_pop(da) ((da)->elems[--(da)->count])
+
+// Leaves the array empty. The storage only goes back to the arena when it is the last
+// allocation, the rest waits for the next `temp_reset()`.
+#define da_free(da)                                                                        \
+    do {                                                                                   \
+        nobuild__da_free((da)->elems, sizeof(*(da)->elems), (da)->count, (da)->capacity);  \
+        (da)->elems = NULL;                                                                \
+        (da)->count = 0;                                                                   \
+        (da)->capacity = 0;                                                                \
+    } while (0)
+
+// Visits the elements of an array in order
+#define FOREACH_ARRAY(type, elem, array, body)                                             \
+    for (size_t elem_##index = 0; elem_##index < (array).count; ++elem_##index) {         \
+        type *elem = &(array).elems[elem_##index];                                         \
+        body;                                                                              \
+    }
+
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
 #include <stddef.h>
 
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
 #ifndef NOBUILD__DEPRECATED
 #	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
 #		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
@@ -64,30 +365,426 @@ int cstr_ends_with(Cstr cstr, Cstr postfix);
 int cstr_starts_with(Cstr cstr, Cstr prefix);
 #define STARTS_WITH(cstr, prefix) cstr_starts_with(cstr, prefix)
 
+// A string that carries its length, so it never has to be measured again. The data
+// is not null terminated, unless it comes straight from a `Cstr`.
+typedef struct {
+    const char *data;
+    size_t count;
+} String_View;
+
+// Only for string literals, whose length is known at compile time
+#define SV(cstr_lit) ((String_View) { (cstr_lit), sizeof(cstr_lit) - 1 })
+// printf("name: "SV_FMT"\n", SV_ARG(name));
+#define SV_FMT "%.*s"
+#define SV_ARG(sv) (int) (sv).count, (sv).data
+
+String_View sv_from_cstr(Cstr cstr);
+String_View sv_from_parts(const char *data, size_t count);
+// Copies the view into the temporary arena with a null terminator
+Cstr sv_to_cstr(String_View sv);
+
+int sv_eq(String_View a, String_View b);
+// Compares without measuring `cstr` first
+int sv_eq_cstr(String_View sv, Cstr cstr);
+int sv_starts_with(String_View sv, String_View prefix);
+int sv_ends_with(String_View sv, String_View suffix);
+// Index of the first occurrence of `needle`, or `sv.count` when there is none
+size_t sv_find(String_View sv, String_View needle);
+// Index of the last occurrence of `c`, or `sv.count` when there is none
+size_t sv_rfind_char(String_View sv, char c);
+String_View sv_trim(String_View sv);
+
+// Cut `n` bytes off the front or the back of `sv` and return them
+String_View sv_chop_left(String_View *sv, size_t n);
+String_View sv_chop_right(String_View *sv, size_t n);
+// Returns everything before the first `delim` and leaves `sv` with everything after
+// it, or returns all of `sv` and leaves it empty when there is no `delim`
+String_View sv_chop_by_delim(String_View *sv, char delim);
+
 typedef struct {
     Cstr *elems;
     size_t count;
+    // Number of elements `elems` has room for. Arrays that wrap storage nobuild did
+    // not allocate, like `argv`, leave it at 0 and are copied on the first append.
     size_t capacity;
 } Cstr_Array;
 
 Cstr_Array cstr_array_make(Cstr first, ...);
 #define CSTR_ARRAY_MAKE(first, ...) cstr_array_make(first, ##__VA_ARGS__, NULL)
-
+// An array of the arguments whose storage lives until the end of the enclosing block,
+// without counting them at runtime or allocating. It has no capacity, so appending
+// to it copies it into the temporary arena first.
+#define CSTR_ARRAY_LOCAL(...)                                        \
+    ((Cstr_Array) {                                                  \
+        .elems = (Cstr[]) { __VA_ARGS__ },                           \
+        .count = sizeof((Cstr[]) { __VA_ARGS__ }) / sizeof(Cstr)     \
+    })
+
+// Appending to a full array doubles its capacity
 Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr);
 
+// Makes room for at least `capacity` elements in total
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity);
+// Drops the capacity beyond `count`. The memory only goes back to the arena when the
+// array is its last allocation.
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs);
+
 Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr);
 
 Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b);
 
 int cstr_array_contains(Cstr_Array cstrs, Cstr cstr);
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv);
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv);
 
+// Splits `cstr` at every `delim` in a single pass. The pieces are cut out of one copy
+// of `cstr`, and an empty `delim` leaves it whole.
 Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim);
 #define SPLIT(cstr, delim) cstr_array_from_cstr(cstr, delim)
 
+typedef struct {
+    String_View *elems;
+    size_t count;
+    size_t capacity;
+} String_View_Array;
+
+// Like `SPLIT()`, but the pieces are views into `sv` and only the array is allocated
+String_View_Array sv_split(String_View sv, String_View delim);
+
+// Hands out the pieces of a split one at a time, without allocating anything:
+//
+//     Split_Iter it = split_iter_make(sv_from_cstr(output), SV("\n"));
+//     String_View line;
+//     while (split_iter_next(&it, &line)) { ... }
+typedef struct {
+    String_View rest;
+    String_View delim;
+    int done;
+} Split_Iter;
+
+Split_Iter split_iter_make(String_View sv, String_View delim);
+// Stores the next piece in `piece`, or returns 0 when there are no more
+int split_iter_next(Split_Iter *it, String_View *piece);
+
 Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
-#define JOIN(sep, ...) cstr_array_join(sep, cstr_array_make(__VA_ARGS__, NULL))
+
+// Returns the single copy that is kept of every distinct string, so that interned
+// strings are equal exactly when their pointers are. The copies are kept in a hash
+// set for the whole process, in an arena of their own that `temp_reset()` leaves alone.
+Cstr intern(Cstr cstr);
+Cstr intern_sv(String_View sv);
+// The interned copy of `sv`, or NULL when it was never interned
+Cstr intern_find(String_View sv);
+
+// Interns every element of `cstrs` in place
+Cstr_Array cstr_array_intern(Cstr_Array cstrs);
+// Compare pointers instead of strings, for arrays and strings that are all interned
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned);
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned);
+
+// Joins the strings up to the NULL that terminates them, without building an array
+Cstr cstr_join(Cstr sep, Cstr first, ...);
+#define JOIN(sep, ...) cstr_join(sep, __VA_ARGS__, NULL)
 #define CONCAT(...) JOIN("", __VA_ARGS__)
 
+// Like `JOIN` and `CONCAT`, but for string literals only, which the compiler pastes
+// together into a single literal. Anything else fails to compile. Takes up to 16 of them.
+#define JOIN_LIT(sep, ...) "" NOBUILD__CAT(NOBUILD__JOIN_LIT_, NOBUILD__NARGS(__VA_ARGS__))(sep, __VA_ARGS__)
+#define CONCAT_LIT(...) JOIN_LIT("", __VA_ARGS__)
+
+#define NOBUILD__CAT(a, b) NOBUILD__CAT_(a, b)
+#define NOBUILD__CAT_(a, b) a##b
+#define NOBUILD__NARGS(...) NOBUILD__NARGS_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NOBUILD__NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+#define NOBUILD__JOIN_LIT_1(sep, lit) lit ""
+#define NOBUILD__JOIN_LIT_2(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_1(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_3(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_2(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_4(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_3(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_5(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_4(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_6(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_5(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_7(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_6(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_8(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_7(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_9(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_8(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_10(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_9(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_11(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_10(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_12(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_11(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_13(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_12(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_14(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_13(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_15(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_14(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_16(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_15(sep, __VA_ARGS__)
+
+// A growable string. The buffer comes from `arena`, or from the temporary arena when
+// it is NULL, and doubles when it runs out. The last allocation of an arena grows in
+// place, so a string built in one go usually costs a single allocation.
+typedef struct {
+    char *elems;
+    size_t count;
+    size_t capacity;
+    Arena *arena;
+} String_Builder;
+
+// Makes room for `size` more bytes and a null terminator
+void sb_reserve(String_Builder *sb, size_t size);
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size);
+void sb_append_cstr(String_Builder *sb, Cstr cstr);
+void sb_append_sv(String_Builder *sb, String_View sv);
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+// Null terminates the string, gives back the capacity it does not use and returns
+// it. The builder is left empty for the next string.
+Cstr sb_to_cstr(String_Builder *sb);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Typed hash maps and sets, generated by macros for the key and value types at hand.
+// They use open addressing with linear probing, keep the hash of every entry next to
+// it and stay at most 70% full. Removing an entry shifts the ones after it back, so
+// there are no tombstones to slow lookups down.
+//
+//     HASH_SET_DEFINE(Path_Set, path_set, Cstr, hash_cstr, HASH_EQ_CSTR)
+//     HASH_MAP_DEFINE(Mtime_Map, mtime_map, Cstr, long long, hash_cstr, HASH_EQ_CSTR)
+//
+//     Path_Set compiled = {0};
+//     if (path_set_add(&compiled, source)) {
+//         CMD("cc", "-c", source);
+//     }
+//
+//     Mtime_Map mtimes = {0};
+//     mtime_map_put(&mtimes, "main.c", 42);
+//     long long *mtime = mtime_map_get(&mtimes, "main.c");
+//
+// A table allocates its storage on the heap and is freed with `<fn>_free()`. Setting
+// its `arena` before the first insertion allocates it from that arena instead, say
+// `&arena` for a private one. Keys and values are stored as they are, so strings used
+// as keys have to outlive the table.
+
+size_t hash_bytes(const void *data, size_t size);
+size_t hash_cstr(Cstr cstr);
+size_t hash_sv(String_View sv);
+size_t hash_integer(unsigned long long integer);
+size_t hash_pointer(const void *pointer);
+
+#define HASH_EQ_CSTR(a, b) (strcmp((a), (b)) == 0)
+#define HASH_EQ_SV(a, b) sv_eq((a), (b))
+#define HASH_EQ_VALUE(a, b) ((a) == (b))
+
+// What maps and sets have in common, for an `Entry` type whose first field is `key`
+#define NOBUILD__HASH_TABLE_DEFINE(Table, fn, Entry, Key, hash_fn, eq_fn)                   \
+    typedef struct {                                                                        \
+        Entry *entries;                                                                     \
+        /* The hash of the entry in every slot, 0 for an empty slot */                      \
+        size_t *hashes;                                                                     \
+        size_t count;                                                                       \
+        size_t capacity;                                                                    \
+        Arena *arena;                                                                       \
+    } Table;                                                                                \
+                                                                                            \
+    static inline size_t fn##__hash(Key key)                                                \
+    {                                                                                       \
+        size_t hash = (size_t) hash_fn(key);                                                \
+        return hash != 0 ? hash : 1;                                                        \
+    }                                                                                       \
+                                                                                            \
+    /* The slot that holds `key`, or the empty slot where it belongs */                     \
+    static inline size_t fn##__probe(const Table *table, Key key, size_t hash)              \
+    {                                                                                       \
+        const size_t mask = table->capacity - 1;                                            \
+        size_t i = hash & mask;                                                             \
+        while (table->hashes[i] != 0                                                        \
+               && !(table->hashes[i] == hash && eq_fn(table->entries[i].key, key))) {       \
+            i = (i + 1) & mask;                                                             \
+        }                                                                                   \
+        return i;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##__resize(Table *table, size_t capacity)                          \
+    {                                                                                       \
+        Table old = *table;                                                                 \
+        table->capacity = capacity;                                                         \
+        if (table->arena != NULL) {                                                         \
+            table->entries = arena_alloc(table->arena, sizeof(*table->entries) * capacity); \
+            table->hashes = arena_alloc(table->arena, sizeof(*table->hashes) * capacity);   \
+            memset(table->hashes, 0, sizeof(*table->hashes) * capacity);                    \
+        } else {                                                                            \
+            table->entries = NOBUILD__MALLOC(sizeof(*table->entries) * capacity);           \
+            table->hashes = NOBUILD__CALLOC(capacity, sizeof(*table->hashes));              \
+            if (table->entries == NULL || table->hashes == NULL) {                          \
+                PANIC("Could not allocate memory: %s", strerror(errno));                    \
+            }                                                                               \
+        }                                                                                   \
+                                                                                            \
+        for (size_t i = 0; i < old.capacity; ++i) {                                         \
+            if (old.hashes[i] == 0) {                                                       \
+                continue;                                                                   \
+            }                                                                               \
+            size_t j = old.hashes[i] & (capacity - 1);                                      \
+            while (table->hashes[j] != 0) {                                                 \
+                j = (j + 1) & (capacity - 1);                                               \
+            }                                                                               \
+            table->hashes[j] = old.hashes[i];                                               \
+            table->entries[j] = old.entries[i];                                             \
+        }                                                                                   \
+                                                                                            \
+        if (old.arena == NULL) {                                                            \
+            free(old.entries);                                                              \
+            free(old.hashes);                                                               \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* Makes room for `count` entries in total */                                           \
+    static inline void fn##_reserve(Table *table, size_t count)                             \
+    {                                                                                       \
+        size_t capacity = table->capacity > 0 ? table->capacity : 16;                       \
+        while (count * 10 > capacity * 7) {                                                 \
+            capacity *= 2;                                                                  \
+        }                                                                                   \
+        if (capacity > table->capacity) {                                                   \
+            fn##__resize(table, capacity);                                                  \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* The slot of `key`, which is added without a value when it is missing */              \
+    static inline size_t fn##__insert(Table *table, Key key, int *added)                    \
+    {                                                                                       \
+        fn##_reserve(table, table->count + 1);                                              \
+        const size_t hash = fn##__hash(key);                                                \
+        const size_t i = fn##__probe(table, key, hash);                                     \
+        *added = table->hashes[i] == 0;                                                     \
+        if (*added) {                                                                       \
+            table->hashes[i] = hash;                                                        \
+            table->entries[i].key = key;                                                    \
+            table->count += 1;                                                              \
+        }                                                                                   \
+        return i;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    static inline Entry *fn##__find(const Table *table, Key key)                            \
+    {                                                                                       \
+        if (table->count == 0) {                                                            \
+            return NULL;                                                                    \
+        }                                                                                   \
+        const size_t i = fn##__probe(table, key, fn##__hash(key));                          \
+        return table->hashes[i] != 0 ? &table->entries[i] : NULL;                           \
+    }                                                                                       \
+                                                                                            \
+    static inline int fn##_contains(const Table *table, Key key)                            \
+    {                                                                                       \
+        return fn##__find(table, key) != NULL;                                              \
+    }                                                                                       \
+                                                                                            \
+    /* Returns whether `key` was there to remove */                                         \
+    static inline int fn##_remove(Table *table, Key key)                                    \
+    {                                                                                       \
+        if (table->count == 0) {                                                            \
+            return 0;                                                                       \
+        }                                                                                   \
+                                                                                            \
+        const size_t mask = table->capacity - 1;                                            \
+        size_t i = fn##__probe(table, key, fn##__hash(key));                                \
+        if (table->hashes[i] == 0) {                                                        \
+            return 0;                                                                       \
+        }                                                                                   \
+                                                                                            \
+        /* Move back every following entry of the run that may live in the hole */          \
+        for (size_t j = i;;) {                                                              \
+            table->hashes[i] = 0;                                                           \
+            size_t home;                                                                    \
+            do {                                                                            \
+                j = (j + 1) & mask;                                                         \
+                if (table->hashes[j] == 0) {                                                \
+                    table->count -= 1;                                                      \
+                    return 1;                                                               \
+                }                                                                           \
+                home = table->hashes[j] & mask;                                             \
+            } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));           \
+                                                                                            \
+            table->hashes[i] = table->hashes[j];                                            \
+            table->entries[i] = table->entries[j];                                          \
+            i = j;                                                                          \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##_clear(Table *table)                                             \
+    {                                                                                       \
+        if (table->capacity > 0) {                                                          \
+            memset(table->hashes, 0, sizeof(*table->hashes) * table->capacity);             \
+        }                                                                                   \
+        table->count = 0;                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##_free(Table *table)                                              \
+    {                                                                                       \
+        if (table->arena == NULL) {                                                         \
+            free(table->entries);                                                           \
+            free(table->hashes);                                                            \
+        }                                                                                   \
+        Table empty = { .arena = table->arena };                                            \
+        *table = empty;                                                                     \
+    }
+
+#define HASH_MAP_DEFINE(Map, fn, Key, Value, hash_fn, eq_fn)                                \
+    typedef struct {                                                                        \
+        Key key;                                                                            \
+        Value value;                                                                        \
+    } Map##_Entry;                                                                          \
+                                                                                            \
+    NOBUILD__HASH_TABLE_DEFINE(Map, fn, Map##_Entry, Key, hash_fn, eq_fn)                   \
+                                                                                            \
+    /* The value of `key`, or NULL when there is none */                                    \
+    static inline Value *fn##_get(const Map *map, Key key)                                  \
+    {                                                                                       \
+        Map##_Entry *entry = fn##__find(map, key);                                          \
+        return entry != NULL ? &entry->value : NULL;                                        \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##_put(Map *map, Key key, Value value)                             \
+    {                                                                                       \
+        int added;                                                                          \
+        const size_t i = fn##__insert(map, key, &added);                                    \
+        map->entries[i].value = value;                                                      \
+    }
+
+#define HASH_SET_DEFINE(Set, fn, Key, hash_fn, eq_fn)                                       \
+    typedef struct {                                                                        \
+        Key key;                                                                            \
+    } Set##_Entry;                                                                          \
+                                                                                            \
+    NOBUILD__HASH_TABLE_DEFINE(Set, fn, Set##_Entry, Key, hash_fn, eq_fn)                   \
+                                                                                            \
+    /* Returns whether `key` was new to the set */                                          \
+    static inline int fn##_add(Set *set, Key key)                                           \
+    {                                                                                       \
+        int added;                                                                          \
+        fn##__insert(set, key, &added);                                                     \
+        return added;                                                                       \
+    }
+
+// Visits the entries of a map or set in no particular order
+#define HASH_FOREACH(type, entry, table, body)                                              \
+    for (size_t entry##_index = 0; entry##_index < (table).capacity; ++entry##_index) {     \
+        if ((table).hashes[entry##_index] == 0) {                                           \
+            continue;                                                                       \
+        }                                                                                   \
+        type *entry = &(table).entries[entry##_index];                                      \
+        body;                                                                               \
+    }
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -117,7 +814,11 @@ typedef struct {
     Fd write;
 } Pipe;
 
+// Both ends are closed on exec, so only the children they are handed to keep them open
 Pipe pipe_make(void);
+// Asks for a pipe capacity of at least `size` bytes and returns the capacity the
+// pipe ended up with, or 0 where it cannot be changed
+size_t pipe_set_size(Pipe pip, size_t size);
 
 Fd fd_open_for_read(const char *path);
 Fd fd_open_for_write(const char *path);
@@ -125,9 +826,77 @@ size_t fd_read(Fd fd, void *buf, unsigned long count);
 size_t fd_write(Fd fd, void *buf, unsigned long count);
 int fd_printf(Fd fd, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
 void fd_close(Fd fd);
+// Moves everything from `in` to `out` until the end of `in`, or until `out` is a
+// pipe without readers. Uses splice(2) when either side is a pipe on Linux.
+unsigned long long fd_pump(Fd in, Fd out);
+// Copies everything from `in` to both `out1` and `out2`, with tee(2) when `in` is
+// a pipe on Linux. An output without readers is dropped and the other one is kept.
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2);
+
+// The whole contents of a file, see `file_map()`
+typedef struct {
+    const char *data;
+    size_t size;
+    // Whether `data` is a memory mapping rather than a copy in a buffer
+    int mapped;
+} File_View;
+
+// Makes the whole file at `path` readable through `view`. Files of 64 KiB or more
+// are memory mapped for sequential access, smaller ones are read in a single read
+// into a null terminated buffer. Returns 0, or the errno of what failed.
+int file_map(const char *path, File_View *view);
+void file_unmap(File_View view);
+
+// An output that is written to `<path>.tmp.<pid>` and only renamed over `path` once
+// it is complete, so an interrupted build never leaves a truncated `path` with a
+// fresh modification time behind
+typedef struct {
+    Fd fd;
+    const char *path;
+    char *tmp_path;
+} Atomic_File;
+
+Atomic_File atomic_file_open(const char *path);
+// Closes the file and renames it over its path
+void atomic_file_commit(Atomic_File *file);
+// Closes and removes the file, leaving its path as it was
+void atomic_file_abort(Atomic_File *file);
+// Commits are not flushed to disk, which only matters if the whole system goes down.
+// With sync enabled every commit is remembered until `atomic_file_sync()` flushes
+// them and their directories at once, which also happens when the program exits.
+// Temporary files that were neither committed nor aborted are removed at exit, so a
+// PANIC in the middle of a step leaves none behind.
+void atomic_file_set_sync(int enabled);
+void atomic_file_sync(void);
 
 void pid_wait(Pid pid);
 
+// Define `NOBUILD_NO_THREADS` to build without a thread library. Threads then run
+// to completion inside `thread_create()` and mutexes do nothing.
+#if defined(NOBUILD_NO_THREADS)
+typedef int Thread;
+typedef int Mutex;
+#elif !defined(_WIN32)
+#    include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#else
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+#endif
+
+typedef void (*Thread_Fn)(void *data);
+
+Thread thread_create(Thread_Fn fn, void *data);
+void thread_join(Thread thread);
+// Number of online processors, at least 1
+size_t thread_count(void);
+
+void mutex_init(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -153,35 +922,60 @@ typedef struct {
 
 Cstr cmd_show(Cmd cmd);
 Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout);
+// Like cmd_run_async() but also redirects stderr when `fderr` is given
+Pid cmd_run_async_ex(Cmd cmd, Fd *fdin, Fd *fdout, Fd *fderr);
 void cmd_run_sync(Cmd cmd);
 
+// The arguments are counted at compile time and stay on the stack, and the line is
+// only formatted when INFO messages are printed
+//
 // TODO(#1): no way to disable echo in nobuild scripts
 // TODO(#2): no way to ignore fails
 #define CMD(...)                                        \
     do {                                                \
         Cmd cmd = {                                     \
-            .line = cstr_array_make(__VA_ARGS__, NULL)  \
+            .line = CSTR_ARRAY_LOCAL(__VA_ARGS__)       \
         };                                              \
-        INFO("CMD: %s", cmd_show(cmd));                 \
+        if (log_enabled(LOG_INFO)) {                    \
+            INFO("CMD: %s", cmd_show(cmd));             \
+        }                                               \
         cmd_run_sync(cmd);                              \
     } while (0)
 
+// Grows with `da_append()` and the other `da_*()` macros
 typedef struct {
     Cmd *elems;
     size_t count;
+    size_t capacity;
 } Cmd_Array;
 
 typedef enum {
     CHAIN_TOKEN_END = 0,
     CHAIN_TOKEN_IN,
     CHAIN_TOKEN_OUT,
-    CHAIN_TOKEN_CMD
+    CHAIN_TOKEN_CMD,
+    CHAIN_TOKEN_PIPE_SIZE,
+    CHAIN_TOKEN_TEE,
+    CHAIN_TOKEN_FN,
+    CHAIN_TOKEN_ERR,
+    CHAIN_TOKEN_MERGE_ERR
 } Chain_Token_Type;
 
+struct Chain;
+
+// A chain stage that runs on a thread inside nobuild instead of in a child process.
+// It reads its input from `in` until the end and writes its output to `out`, both
+// of which are closed once it returns. Anything but 0 fails the chain.
+typedef int (*Chain_Fn)(Fd in, Fd out, void *data);
+
 // A single token for the CHAIN(...) DSL syntax
 typedef struct {
     Chain_Token_Type type;
     Cstr_Array args;
+    size_t size;
+    struct Chain *chain;
+    Chain_Fn fn;
+    void *data;
 } Chain_Token;
 
 #define CHAIN_IN(path)                      \
@@ -202,15 +996,101 @@ typedef struct {
         .args = cstr_array_make(__VA_ARGS__, NULL) \
     }
 
-// TODO(#20): pipes do not allow redirecting stderr
+// Sends the stderr of every command of the chain and of its branches to `path`,
+// unless a branch has a CHAIN_ERR of its own
+#define CHAIN_ERR(path)                     \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_ERR,            \
+        .args = cstr_array_make(path, NULL) \
+    }
+
+// Sends the stderr of the CHAIN_CMD right before it down the chain along with its
+// stdout, like `2>&1` in a shell
+#define CHAIN_MERGE_ERR                     \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_MERGE_ERR       \
+    }
+
+// Runs `fn(in, out, data)` as a stage of the chain, without a fork and exec. A stage
+// that passes its data on with `fd_pump()` never copies it through user space and
+// beats a command. One that reads and writes through a buffer streams about as fast
+// as a command doing the same, and only saves starting the process, which matters
+// for short inputs and many small chains.
+#define CHAIN_FN(fn_, data_)                 \
+    (Chain_Token) {                          \
+        .type = CHAIN_TOKEN_FN,              \
+        .args = cstr_array_make(#fn_, NULL), \
+        .fn = (fn_),                         \
+        .data = (data_)                      \
+    }
+
+// Raises the capacity of the pipes between the commands to `size` bytes. Regular
+// input and output files are still handed to the commands, which read and write them
+// directly. Anything else, like a fifo or a device, is pumped through a pipe of that
+// size by nobuild itself, with splice(2) on Linux.
+#define CHAIN_PIPE_SIZE(n)                  \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_PIPE_SIZE,      \
+        .size = (n)                         \
+    }
+
+// Sends a copy of the stream at this point of the chain into a branch chain made of
+// the given CHAIN_CMD, CHAIN_OUT, CHAIN_PIPE_SIZE and CHAIN_TEE tokens, while the
+// stream itself continues down the chain. A branch without an output writes to
+// stdout. The stream is duplicated with tee(2) on Linux.
+#define CHAIN_TEE(...)                                                                 \
+    (Chain_Token) {                                                                    \
+        .type = CHAIN_TOKEN_TEE,                                                       \
+        .chain = chain_branch(chain_build_from_tokens(__VA_ARGS__, (Chain_Token) {0})) \
+    }
+
+typedef struct {
+    // Number of commands of the chain in front of the tee
+    size_t position;
+    struct Chain *chain;
+} Chain_Tee;
+
+typedef struct {
+    Chain_Tee *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Tee_Array;
+
+typedef struct {
+    // Index of the stage among the commands of the chain
+    size_t position;
+    Chain_Fn fn;
+    void *data;
+} Chain_Fn_Stage;
+
+typedef struct {
+    Chain_Fn_Stage *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Fn_Stage_Array;
+
 typedef struct {
+    size_t *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Position_Array;
+
+typedef struct Chain {
     Cstr input_filepath;
     Cmd_Array cmds;
     Cstr output_filepath;
+    Cstr error_filepath;
+    size_t pipe_size;
+    Chain_Tee_Array tees;
+    Chain_Fn_Stage_Array fns;
+    // Indices of the commands whose stderr goes down the chain
+    Chain_Position_Array merged_err;
 } Chain;
 
 Chain chain_build_from_tokens(Chain_Token first, ...);
+Chain *chain_branch(Chain chain);
 void chain_run_sync(Chain chain);
+// Prints the chain when INFO messages are printed
 void chain_echo(Chain chain);
 
 // TODO(#15): PIPE does not report where exactly a syntactic error has happened
@@ -225,6 +1105,56 @@ void chain_echo(Chain chain);
 ////////////////////////////////////////////////////////////////////////////////
 
 
+#include <stddef.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Batched filesystem operations for work that touches many independent files.
+// Define `NOBUILD_IO_URING` on Linux to queue them on an io_uring, so that a whole
+// batch costs a single `io_uring_enter()` instead of a syscall per file and the
+// kernel works on all of them at once. That pays off when every file is a round
+// trip, like on network filesystems. With a local filesystem the kernel hands path
+// lookups to worker threads, which makes it slower than plain syscalls. Those are
+// used one by one by default, and when the kernel or a seccomp filter refuses to
+// set up a ring.
+
+typedef struct {
+    Cstr path;
+    // 0 on success, the errno of the failed operation otherwise
+    int error;
+    int is_dir;
+    unsigned long long size;
+    // Seconds since the epoch, or the FILETIME on Windows, like `path_is_newer()`
+    long long mtime;
+} Bulk_Stat;
+
+// Stats the `path` of every element, following symbolic links
+void bulk_stat(Bulk_Stat *stats, size_t count);
+
+typedef struct {
+    Cstr path;
+    int error;
+    // The whole file with a null terminator after it, to be freed by the caller.
+    // As much as the file had when it was stat'ed is read.
+    char *data;
+    size_t size;
+} Bulk_Read;
+
+// Reads every `path` into memory
+void bulk_read(Bulk_Read *reads, size_t count);
+
+// Whether the bulk operations go through io_uring in this process
+int bulk_uses_io_uring(void);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// `futimens()` and the nanosecond timestamps of `struct stat` are POSIX 2008, which
+// -std=c99 hides unless a feature level is requested before the first system header
+
 #ifndef NOBUILD__DEPRECATED
 #	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
 #		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
@@ -244,6 +1174,12 @@ void chain_echo(Chain chain);
 
 
 #define PATH(...) JOIN(PATH_SEP, __VA_ARGS__)
+// A path made of string literals at compile time, see `JOIN_LIT`
+#define PATH_LIT(...) JOIN_LIT(PATH_SEP, __VA_ARGS__)
+
+// Appends `component` to the path being built, with a separator in between unless
+// the path is empty or already ends with one
+void sb_append_path(String_Builder *sb, Cstr component);
 
 Cstr path_no_ext(Cstr path);
 #define NOEXT(path) path_no_ext(path)
@@ -254,6 +1190,11 @@ Cstr path_dirname(Cstr path);
 Cstr path_basename(Cstr path);
 #define BASENAME(path) path_basename(path)
 
+// Like the functions above, but the result points into `path` and nothing is allocated
+String_View path_no_ext_sv(String_View path);
+String_View path_dirname_sv(String_View path);
+String_View path_basename_sv(String_View path);
+
 int path_is_dir(Cstr path);
 #define IS_DIR(path) path_is_dir(path)
 
@@ -282,14 +1223,44 @@ void path_rename(Cstr old_path, Cstr new_path);
         path_rename(old_path, new_path);              \
     } while (0)
 
+typedef enum {
+    COPY_DEFAULT = 0,
+    // Also preserve the access and modification times
+    COPY_TIMESTAMPS = 1 << 0,
+} Copy_Flags;
+
+typedef struct {
+    size_t files;
+    size_t dirs;
+    size_t symlinks;
+    // Sockets, fifos and devices are not copied
+    size_t skipped;
+    unsigned long long bytes;
+    double seconds;
+} Copy_Stats;
+
+// Copies files and directories recursively, preserving permission bits. Symbolic
+// links inside a directory are recreated instead of followed, and the files of a
+// directory are copied by a pool of `thread_count()` workers.
 void path_copy(Cstr old_path, Cstr new_path);
+Copy_Stats path_copy_ex(Cstr old_path, Cstr new_path, int flags);
 #define COPY(old_path, new_path)                    \
     do {                                            \
         INFO("COPY: %s -> %s", old_path, new_path); \
         path_copy(old_path, new_path);              \
     } while(0)
 
+typedef enum {
+    RM_DEFAULT = 0,
+    // Rename the path to a hidden trash name next to it and delete that from a
+    // detached process, so the call returns right away
+    RM_BACKGROUND = 1 << 0,
+} Rm_Flags;
+
+// Removes files and directories recursively. Symbolic links are removed, never
+// followed, and the subdirectories are deleted by a pool of `thread_count()` workers.
 void path_rm(Cstr path);
+void path_rm_ex(Cstr path, int flags);
 #define RM(path)                                \
     do {                                        \
         INFO("RM: %s", path);                   \
@@ -322,11 +1293,63 @@ void path_rm(Cstr path);
 ////////////////////////////////////////////////////////////////////////////////
 
 
-#define FOREACH_ARRAY(type, elem, array, body)                                  \
-    for (size_t elem_##index = 0; elem_##index < array.count; ++elem_##index) { \
-        type *elem = &array.elems[elem_##index];                                \
-        body;                                                                   \
-    }
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Layout of the source generated by `file_to_c_array_format()`. Every format
+// defines `array_name` and an `unsigned long array_name_len` holding the number
+// of elements, including the null terminator if one was requested.
+typedef enum {
+    // `array_type array_name[] = { 0x.., ... };`
+    C_ARRAY_BYTES = 0,
+    // Chunked and escaped string literals. Much cheaper for the compiler to
+    // parse than C_ARRAY_BYTES, but MSVC limits string literals to 64 KiB.
+    C_ARRAY_STRING,
+    // A top-level assembler stub that pulls the file in with `.incbin`.
+    // Requires a GNU compatible compiler and assembler.
+    C_ARRAY_INCBIN,
+    // C23 `#embed`, falling back to C_ARRAY_BYTES when the compiler does not
+    // support it.
+    C_ARRAY_EMBED,
+} C_Array_Format;
+
+void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type,  Cstr array_name, int null_term);
+#define FILE_TO_C_ARRAY(path, out_path, array_name) file_to_c_array(path, out_path, "unsigned char", array_name, 1)
+
+void file_to_c_array_format(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term, C_Array_Format format);
+#define FILE_TO_C_ARRAY_FORMAT(path, out_path, array_name, format) \
+    file_to_c_array_format(path, out_path, "unsigned char", array_name, 1, format)
+
+// Writes a relocatable ELF64 object defining `symbol` and `unsigned long symbol_len`
+// in `.rodata`, skipping the C compiler entirely. Only supported on ELF hosts.
+void file_to_object(Cstr path, Cstr out_path, Cstr symbol, int null_term);
+#define FILE_TO_OBJECT(path, out_path, symbol) file_to_object(path, out_path, symbol, 1)
+
+typedef enum {
+    PACK_DEFAULT = 0,
+    // Generate a `long pack_name_find(const char *name)` perfect hash lookup that
+    // returns the index of the entry or -1. Only available for C sources.
+    PACK_LOOKUP = 1 << 0,
+} Pack_Flags;
+
+// Packs every file under `dir_path` into a single source, or an ELF object if
+// `out_path` ends with ".o". The pack is regenerated unless `out_path` is strictly
+// newer than every file and directory under `dir_path` and was generated with the
+// same `flags` and `pack_name`. Objects do not support PACK_LOOKUP, which
+// `DIR_TO_PACK()` only asks for when generating a C source. It defines:
+//
+//   const unsigned char pack_name[];          // Members aligned to 16 bytes and null terminated
+//   const char pack_name_names[];             // Null terminated member names, '/' separated
+//   const unsigned long pack_name_entries[][4] // { name offset, name length, offset, size } sorted by name
+//   const unsigned long pack_name_count;
+void dir_to_pack(Cstr dir_path, Cstr out_path, Cstr pack_name, int flags);
+#define DIR_TO_PACK(dir_path, out_path, pack_name) \
+    dir_to_pack(dir_path, out_path, pack_name, cstr_ends_with(out_path, ".o") ? PACK_DEFAULT : PACK_LOOKUP)
+
+
+////////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef REBUILD_URSELF
 #	if _WIN32
@@ -338,7 +1361,8 @@ void path_rm(Cstr path);
 #			define REBUILD_URSELF(binary_path, source_path) CMD("cl.exe", source_path)
 #		endif
 #	else
-#		define REBUILD_URSELF(binary_path, source_path) CMD("cc", "-o", binary_path, source_path)
+		// Threads need libpthread before glibc 2.34
+#		define REBUILD_URSELF(binary_path, source_path) CMD("cc", "-pthread", "-o", binary_path, source_path)
 #	endif
 #endif
 
@@ -379,7 +1403,9 @@ void path_rm(Cstr path);
                     .count = argc,                                     \
                 },                                                     \
             };                                                         \
-            INFO("CMD: %s", cmd_show(cmd));                            \
+            if (log_enabled(LOG_INFO)) {                               \
+                INFO("CMD: %s", cmd_show(cmd));                        \
+            }                                                          \
             cmd_run_sync(cmd);                                         \
             exit(0);                                                   \
         }                                                              \
@@ -387,9 +1413,6 @@ void path_rm(Cstr path);
 
 char *shift_args(int *argc, char ***argv);
 
-void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type,  Cstr array_name, int null_term);
-#define FILE_TO_C_ARRAY(path, out_path, array_name) file_to_c_array(path, out_path, "unsigned char", array_name, 1)
-
 #endif  // NOBUILD_H_
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -402,6 +1425,18 @@ void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type,  Cstr array_name
 
 #include <stdlib.h>
 
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
 void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
 {
     fprintf(stream, "[%s] ", tag);
@@ -415,8 +1450,24 @@ void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
     nobuild__vlog(stream, tag, fmt, args);
 }
 
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
 void info(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "INFO", fmt, args);
@@ -425,6 +1476,10 @@ void info(const char *fmt, ...)
 
 void warn(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "WARN", fmt, args);
@@ -433,6 +1488,10 @@ void warn(const char *fmt, ...)
 
 void erro(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "ERRO", fmt, args);
@@ -470,291 +1529,282 @@ void todo_safe(const char *fmt, ...)
 ////////////////////////////////////////////////////////////////////////////////
 
 
+#ifdef NOBUILD_STATS
+
 #include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 #include <errno.h>
 
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
-// Multiple modules could define this function, so add a guard around it to prevent redefinition
-#ifndef NOBUILD__STRERROR
-#define NOBUILD__STRERROR
-Cstr nobuild__strerror(int errnum)
-{
-#ifndef _WIN32
-    return strerror(errnum);
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
 #else
-    static char buffer[1024];
-    strerror_s(buffer, 1024, errnum);
-    return buffer;
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
 #endif
-}
-#endif // NOBUILD__STRERROR
 
-int cstr_ends_with(Cstr cstr, Cstr postfix)
-{
-    const size_t cstr_len = strlen(cstr);
-    const size_t postfix_len = strlen(postfix);
-    return postfix_len <= cstr_len
-           && strcmp(cstr + cstr_len - postfix_len, postfix) == 0;
-}
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
 
-int cstr_starts_with(Cstr cstr, Cstr prefix)
-{
-    const size_t cstr_len = strlen(cstr);
-    const size_t prefix_len = strlen(prefix);
-    return prefix_len <= cstr_len && strncmp(cstr, prefix, prefix_len) == 0;
-}
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
 
-Cstr_Array cstr_array_make(Cstr first, ...)
-{
-    Cstr_Array result = {0};
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
 
-    if (first == NULL) {
-        return result;
-    }
-    result.count += 1;
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
 
-    va_list args;
-    va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.count += 1;
-    }
-    va_end(args);
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
+}
 
-    result.elems = malloc(sizeof *result.elems * result.count);
-    if (result.elems == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
+static void nobuild__stats_report(void)
+{
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
     }
+#endif // _WIN32
 
-    result.count = 0;
-    result.elems[result.count++] = first;
-
-    va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.elems[result.count++] = next;
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
     }
-    va_end(args);
-
-    return result;
 }
 
-Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
 {
-    if (cstrs.capacity < 1) {
-        cstrs.elems = realloc(cstrs.elems, sizeof *cstrs.elems * (cstrs.count + 10));
-        cstrs.capacity += 10;
-        if (cstrs.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
     }
 
-    cstrs.elems[cstrs.count++] = cstr;
-    cstrs.capacity--;
-    return cstrs;
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
 }
 
-
-Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
 {
-    if (cstrs.count == 0) {
-        return cstrs;
-    }
-
-    if (cstr == NULL) {
-        cstrs.elems[--cstrs.count];
-        cstrs.capacity++;
-        return cstrs;
-    }
-
-    // Find the index of the element to be removed
-    const size_t cstr_len = strlen(cstr);
-    for (size_t i = 0; i < cstrs.count; i++) {
-        const size_t elem_len = strlen(cstrs.elems[i]);
-        if (elem_len != cstr_len || strcmp(cstrs.elems[i], cstr) != 0) {
-            continue;
-        }
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
 
-        // Shift elements left if found the cstr
-        for (size_t j = i; j < cstrs.count - 1; j++) {
-            cstrs.elems[j] = cstrs.elems[j + 1];
-        }
-        cstrs.count--;
-        cstrs.capacity++;
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
 
-        // TODO: Might want to realloc array if capacity is too high
-        return cstrs;
-    }
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
 
-    // The string was not found
-    return cstrs;
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
 }
 
-Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
+void nobuild__stats_temp(Stats_Module module, size_t size)
 {
-    if (cstrs_a.capacity < cstrs_b.count) {
-        cstrs_a.elems = realloc(cstrs_a.elems, sizeof *cstrs_a.elems * (cstrs_a.count + cstrs_b.count));
-        cstrs_a.capacity += cstrs_b.count;
-        if (cstrs_a.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-    }
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
 
-    memcpy(cstrs_a.elems + cstrs_a.count, cstrs_b.elems, sizeof *cstrs_a.elems * cstrs_b.count);
-    cstrs_a.count += cstrs_b.count;
-    cstrs_a.capacity -= cstrs_b.count;
-    return cstrs_a;
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
 }
 
-int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
-    for (size_t i = 0; i < cstrs.count; ++i) {
-        if (strcmp(cstr, cstrs.elems[i]) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
 }
 
-Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+void nobuild__stats_copied(unsigned long long bytes)
 {
-    size_t len = strlen(cstr);
-    size_t d_len = strlen(delim);
-    size_t substr_count = 1;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
-        }
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
-        }
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
+}
 
-        if (delim_found) {
-            substr_count++;
-            i += d_len - 1;
-        }
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
     }
-
-    // if dlen == 0 or was never found
-    if (substr_count == 1) {
-        // TODO: differentiate between delim == null and delim == "" and delim not found
-        //       Split the string into an array of strings, where each string is a single character
-        return cstr_array_make(cstr);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
     }
-
-    Cstr_Array ret = { .count = substr_count };
-    ret.elems = malloc(sizeof(Cstr) * ret.count);
-    if (ret.elems == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
     }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
+}
 
-    size_t substr_start = 0;
-    size_t substr_index = 0;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
-        }
-
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
-        }
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
+{
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
 
-        if (!delim_found) {
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
             continue;
         }
-
-        size_t substr_len = i - substr_start;
-        char *substr = calloc(substr_len + 1, sizeof(unsigned char));
-        if (substr == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-
-        ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-        i += d_len - 1;
-        substr_start = i + 1;
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
     }
 
-    // Add the last substring
-    size_t substr_len = len - substr_start;
-    char *substr = malloc(substr_len * sizeof(unsigned char));
-    if (substr == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
     }
 
-    ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-    return ret;
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
 }
 
-Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
 {
-    if (cstrs.count == 0) {
-        return "";
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
     }
+    fprintf(file, "  },\n");
+}
 
-    const size_t sep_len = strlen(sep);
-    size_t len = 0;
-    for (size_t i = 0; i < cstrs.count; ++i) {
-        len += strlen(cstrs.elems[i]);
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
     }
 
-    const size_t result_len = (cstrs.count - 1) * sep_len + len + 1;
-    char *result = malloc(sizeof(char) * result_len);
-    if (result == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
     }
-
-    len = 0;
-    for (size_t i = 0; i < cstrs.count; ++i) {
-        if (i > 0) {
-            memcpy(result + len, sep, sep_len);
-            len += sep_len;
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
         }
-
-        size_t elem_len = strlen(cstrs.elems[i]);
-        memcpy(result + len, cstrs.elems[i], elem_len);
-        len += elem_len;
+        return 0;
     }
-    result[len] = '\0';
-
-    return result;
+    return 1;
 }
 
+#endif // NOBUILD_STATS
 
 
-////////////////////////////////////////////////////////////////////////////////
-
 
-#ifndef _WIN32
-#	include <sys/wait.h>
-#	include <sys/stat.h>
-#	include <unistd.h>
-#	include <fcntl.h>
+////////////////////////////////////////////////////////////////////////////////
 
-// Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
-char *strsignal(int sig);
-#else
-#	include <assert.h>
-#endif
 
-#include <stdio.h>
-#include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -762,257 +1812,307 @@ char *strsignal(int sig);
 ////////////////////////////////////////////////////////////////////////////////
 
 
-// Multiple modules could define this function, so add a guard around it to prevent redefinition
-#if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
-#define NOBUILD__GETLASTERROR
-LPSTR nobuild__GetLastErrorAsString(void)
-{
-    // https://stackoverflow.com/q/1387064/21582981
-    DWORD errorMessageId = GetLastError();
-    assert(errorMessageId != 0);
 
-    LPSTR messageBuffer = NULL;
+////////////////////////////////////////////////////////////////////////////////
 
-    FormatMessage(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, // DWORD   dwFlags,
-        NULL, // LPCVOID lpSource,
-        errorMessageId, // DWORD   dwMessageId,
-        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), // DWORD   dwLanguageId,
-        (LPSTR) &messageBuffer, // LPTSTR  lpBuffer,
-        0, // DWORD   nSize,
-        NULL // va_list *Arguments
-    );
 
-    return messageBuffer;
-}
-#endif // NOBUILD__GETLASTERROR
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_ARENA
 
-Pipe pipe_make(void)
+#if defined(NOBUILD_NO_THREADS)
+#elif !defined(_WIN32)
+#	include <pthread.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+// Words of a region that is not made larger by a single big allocation
+#ifndef NOBUILD_ARENA_REGION_WORDS
+#	define NOBUILD_ARENA_REGION_WORDS (8 * 1024)
+#endif
+
+// Allocations are made in whole words, which keeps all of them suitably aligned
+typedef union {
+    void *pointer;
+    long long integer;
+    double real;
+} Nobuild__Arena_Word;
+
+struct Arena_Region {
+    Arena_Region *next;
+    size_t count;
+    size_t capacity;
+    Nobuild__Arena_Word data[];
+};
+
+static size_t nobuild__arena_words(size_t size)
 {
-    Pipe pip = {0};
+    return (size + sizeof(Nobuild__Arena_Word) - 1) / sizeof(Nobuild__Arena_Word);
+}
 
-#ifndef _WIN32
-    Fd pipefd[2];
-    if (pipe(pipefd) < 0) {
-        PANIC("Could not create pipe: %s", strerror(errno));
+static Arena_Region *nobuild__arena_region_new(size_t words)
+{
+    size_t capacity = words > NOBUILD_ARENA_REGION_WORDS ? words : NOBUILD_ARENA_REGION_WORDS;
+    Arena_Region *region = NOBUILD__MALLOC(sizeof(*region) + sizeof(Nobuild__Arena_Word) * capacity);
+    if (region == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
     }
 
-    pip.read = pipefd[0];
-    pip.write = pipefd[1];
-#else
-    // https://docs.microsoft.com/en-us/windows/win32/ProcThread/creating-a-child-process-with-redirected-input-and-output
+    region->next = NULL;
+    region->count = 0;
+    region->capacity = capacity;
+    return region;
+}
 
-    SECURITY_ATTRIBUTES saAttr = {0};
-    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
-    saAttr.bInheritHandle = TRUE;
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t words = nobuild__arena_words(size);
+    if (arena->end == NULL) {
+        arena->begin = arena->end = nobuild__arena_region_new(words);
+    }
 
-    if (!CreatePipe(&pip.read, &pip.write, &saAttr, 0)) {
-        PANIC("Could not create pipe: %s", nobuild__GetLastErrorAsString());
+    // Regions emptied by a rewind are reused before new ones are made
+    while (arena->end->count + words > arena->end->capacity && arena->end->next != NULL) {
+        arena->end = arena->end->next;
     }
-#endif // _WIN32
 
-    return pip;
+    if (arena->end->count + words > arena->end->capacity) {
+        arena->end->next = nobuild__arena_region_new(words);
+        arena->end = arena->end->next;
+    }
+
+    void *result = &arena->end->data[arena->end->count];
+    arena->end->count += words;
+    return result;
 }
 
-Fd fd_open_for_read(const char *path)
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size)
 {
-#ifndef _WIN32
-    Fd result = open(path, O_RDONLY);
-    if (result < 0) {
-        PANIC("Could not open file %s: %s", path, strerror(errno));
+    if (old == NULL) {
+        return arena_alloc(arena, new_size);
     }
-    return result;
-#else
-    // https://docs.microsoft.com/en-us/windows/win32/fileio/opening-a-file-for-reading-or-writing
-    SECURITY_ATTRIBUTES saAttr = {0};
-    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
-    saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
-                    path,
-                    GENERIC_READ,
-                    0,
-                    &saAttr,
-                    OPEN_EXISTING,
-                    FILE_ATTRIBUTE_READONLY,
-                    NULL);
+    size_t old_words = nobuild__arena_words(old_size);
+    size_t new_words = nobuild__arena_words(new_size);
+    Arena_Region *end = arena->end;
+    if (end != NULL && (Nobuild__Arena_Word *) old + old_words == &end->data[end->count]
+        && end->count - old_words + new_words <= end->capacity) {
+        end->count = end->count - old_words + new_words;
+        return old;
+    }
 
-    if (result == INVALID_HANDLE_VALUE) {
-        PANIC("Could not open file %s", path);
+    if (new_size <= old_size) {
+        return old;
     }
 
+    void *result = arena_alloc(arena, new_size);
+    memcpy(result, old, old_size);
     return result;
-#endif // _WIN32
 }
 
-Fd fd_open_for_write(const char *path)
+char *arena_strdup(Arena *arena, const char *cstr)
 {
-#ifndef _WIN32
-    Fd result = open(path,
-                     O_WRONLY | O_CREAT | O_TRUNC,
-                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (result < 0) {
-        PANIC("Could not open file %s: %s", path, strerror(errno));
+    size_t size = strlen(cstr) + 1;
+    return memcpy(arena_alloc(arena, size), cstr, size);
+}
+
+Arena_Mark arena_mark(Arena *arena)
+{
+    Arena_Mark mark = { .region = arena->end };
+    if (arena->end != NULL) {
+        mark.count = arena->end->count;
     }
-    return result;
-#else
-    SECURITY_ATTRIBUTES saAttr = {0};
-    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
-    saAttr.bInheritHandle = TRUE;
-
-    Fd result = CreateFile(
-                    path,                  // name of the write
-                    GENERIC_WRITE,         // open for writing
-                    0,                     // do not share
-                    &saAttr,               // default security
-                    CREATE_ALWAYS,         // Same as `O_CREAT | O_TRUNC`
-                    FILE_ATTRIBUTE_NORMAL, // normal file
-                    NULL                   // no attr. template
-                );
+    return mark;
+}
 
-    if (result == INVALID_HANDLE_VALUE) {
-        PANIC("Could not open file %s: %s", path, nobuild__GetLastErrorAsString());
+void arena_rewind(Arena *arena, Arena_Mark mark)
+{
+    if (mark.region == NULL) {
+        arena_reset(arena);
+        return;
     }
 
-    return result;
-#endif // _WIN32
+    mark.region->count = mark.count;
+    for (Arena_Region *region = mark.region->next; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = mark.region;
 }
 
-size_t fd_read(Fd fd, void *buf, unsigned long count)
+void arena_reset(Arena *arena)
 {
-#ifndef _WIN32
-    ssize_t bytes = read(fd, buf, count);
-    if (bytes == -1) {
-        ERRO("Read error: %s", strerror(errno));
-        return 0;
-    }
-#else
-    DWORD bytes;
-    if (!ReadFile(fd, buf, count, &bytes, NULL)) {
-        ERRO("Read error: %s", nobuild__GetLastErrorAsString());
-        return 0;
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        region->count = 0;
     }
-#endif
-
-    return (size_t) bytes;
+    arena->end = arena->begin;
 }
 
-size_t fd_write(Fd fd, void *buf, unsigned long count)
+void arena_free(Arena *arena)
 {
-#ifndef _WIN32
-    ssize_t bytes = read(fd, buf, (size_t) count);
-    if (bytes == -1) {
-        ERRO("Write error: %s", strerror(errno));
-        return 0;
-    }
-#else
-    DWORD bytes;
-    if (!WriteFile(fd, buf, count, &bytes, NULL)) {
-        ERRO("Write error: %s", nobuild__GetLastErrorAsString());
-        return 0;
+    Arena_Region *region = arena->begin;
+    while (region != NULL) {
+        Arena_Region *next = region->next;
+        free(region);
+        region = next;
     }
-#endif
-
-    return (size_t) bytes;
+    arena->begin = arena->end = NULL;
 }
 
-int fd_printf(Fd fd, const char *fmt, ...) {
-    va_list args;
-
-    va_start(args, fmt);
-    int len = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-    if (len < 0) {
-        return len;
+size_t arena_used(const Arena *arena)
+{
+    size_t words = 0;
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        words += region->count;
     }
+    return words * sizeof(Nobuild__Arena_Word);
+}
 
-    // MSVC does not support variable length arrays
-#ifndef _WIN32
-     char buffer[len + 1];
+// Locks for global state, which are initialized statically so that they are ready
+// before any thread exists. Multiple modules could define them, so add a guard
+// around them to prevent redefinition.
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
 #else
-     char *buffer = malloc(sizeof *buffer * (len + 1));
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
 #endif
+#endif // NOBUILD__LOCK_INIT
 
-    va_start(args, fmt);
-    int result = vsnprintf(buffer, (size_t)(len + 1), fmt, args);
-    va_end(args);
-    if (result < 0) {
-        return result;
-    }
+static Arena nobuild__temp = {0};
+static Nobuild__Lock nobuild__temp_lock = NOBUILD__LOCK_INIT;
 
-    fd_write(fd, buffer, (unsigned long) result);
+// The names are in parentheses, which keeps the macros of `NOBUILD_STATS` out of them
+void *(temp_alloc)(size_t size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_alloc(&nobuild__temp, size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
 
-#ifdef _WIN32
-    free(buffer);
-#endif
+void *(temp_realloc)(void *old, size_t old_size, size_t new_size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_realloc(&nobuild__temp, old, old_size, new_size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
 
+char *(temp_strdup)(const char *cstr)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    char *result = arena_strdup(&nobuild__temp, cstr);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
     return result;
 }
 
-void fd_close(Fd fd)
+Arena_Mark temp_mark(void)
 {
-#ifndef _WIN32
-    close(fd);
-#else
-    CloseHandle(fd);
-#endif // _WIN32
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    Arena_Mark mark = arena_mark(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return mark;
 }
 
-void pid_wait(Pid pid)
+void temp_reset(Arena_Mark mark)
 {
-#ifndef _WIN32
-    for (;;) {
-        int wstatus = 0;
-        if (waitpid(pid, &wstatus, 0) < 0) {
-            PANIC("Could not wait on command (pid %d): %s", pid, strerror(errno));
-        }
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    arena_rewind(&nobuild__temp, mark);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+}
 
-        if (WIFEXITED(wstatus)) {
-            int exit_status = WEXITSTATUS(wstatus);
-            if (exit_status != 0) {
-                PANIC("Command exited with exit code %d", exit_status);
-            }
+size_t temp_used(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    size_t used = arena_used(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return used;
+}
 
-            break;
-        }
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_temp(module, size);
+    return (temp_alloc)(size);
+}
 
-        if (WIFSIGNALED(wstatus)) {
-            PANIC("Command process was terminated by %s", strsignal(WTERMSIG(wstatus)));
-        }
+// Releases and shrinks are not allocations
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size)
+{
+    if (new_size > old_size) {
+        nobuild__stats_temp(module, new_size);
     }
-#else
-    DWORD result = WaitForSingleObject(
-                       pid,     // HANDLE hHandle,
-                       INFINITE // DWORD  dwMilliseconds
-                   );
+    return (temp_realloc)(old, old_size, new_size);
+}
 
-    if (result == WAIT_FAILED) {
-        PANIC("Could not wait on child process: %s", nobuild__GetLastErrorAsString());
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr)
+{
+    nobuild__stats_temp(module, strlen(cstr) + 1);
+    return (temp_strdup)(cstr);
+}
+#endif // NOBUILD_STATS
+
+// Resizes storage with room for `*capacity` elements of which `count` are used to
+// room for exactly `n` when that is more
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
     }
 
-    DWORD exit_status;
-    if (GetExitCodeProcess(pid, &exit_status) == 0) {
-        PANIC("Could not get process exit code: %lu", GetLastError());
+    // Storage that was not allocated by nobuild has `count` elements to copy
+    const size_t old_capacity = *capacity > count ? *capacity : count;
+    elems = temp_realloc(elems, elem_size * old_capacity, elem_size * n);
+    *capacity = n;
+    return elems;
+}
+
+// Like `nobuild__da_reserve()`, but doubles the capacity until `n` elements fit
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
     }
 
-    if (exit_status != 0) {
-        PANIC("Command exited with exit code %lu", exit_status);
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    while (new_capacity < n) {
+        new_capacity *= 2;
     }
+    return nobuild__da_reserve(elems, elem_size, count, capacity, new_capacity);
+}
 
-    CloseHandle(pid);
-#endif // _WIN32
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity)
+{
+    if (elems != NULL && capacity > 0 && capacity >= count) {
+        temp_realloc(elems, elem_size * capacity, 0);
+    }
 }
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
-#include <assert.h>
-#include <string.h>
 #include <stdio.h>
-#include <stdarg.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
 #include <errno.h>
 
 
@@ -1027,13 +2127,16 @@ void pid_wait(Pid pid)
 ////////////////////////////////////////////////////////////////////////////////
 
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CSTR
+
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #ifndef NOBUILD__STRERROR
 #define NOBUILD__STRERROR
 Cstr nobuild__strerror(int errnum)
 {
 #ifndef _WIN32
-    return nobuild__strerror(errnum);
+    return strerror(errnum);
 #else
     static char buffer[1024];
     strerror_s(buffer, 1024, errnum);
@@ -1042,457 +2145,682 @@ Cstr nobuild__strerror(int errnum)
 }
 #endif // NOBUILD__STRERROR
 
-// Multiple modules could define this function, so add a guard around it to prevent redefinition
-#if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
-#define NOBUILD__GETLASTERROR
-LPSTR nobuild__GetLastErrorAsString(void)
+int cstr_ends_with(Cstr cstr, Cstr postfix)
 {
-    // https://stackoverflow.com/q/1387064/21582981
-    DWORD errorMessageId = GetLastError();
-    assert(errorMessageId != 0);
-
-    LPSTR messageBuffer = NULL;
-
-    FormatMessage(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, // DWORD   dwFlags,
-        NULL, // LPCVOID lpSource,
-        errorMessageId, // DWORD   dwMessageId,
-        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), // DWORD   dwLanguageId,
-        (LPSTR) &messageBuffer, // LPTSTR  lpBuffer,
-        0, // DWORD   nSize,
-        NULL // va_list *Arguments
-    );
-
-    return messageBuffer;
+    return sv_ends_with(sv_from_cstr(cstr), sv_from_cstr(postfix));
 }
-#endif // NOBUILD__GETLASTERROR
 
-Cstr cmd_show(Cmd cmd)
+int cstr_starts_with(Cstr cstr, Cstr prefix)
 {
-    // TODO(#31): cmd_show does not render the command line properly
-    // - No string literals when arguments contains space
-    // - No escaping of special characters
-    // - Etc.
-    return cstr_array_join(" ", cmd.line);
+    // Stops at the first difference instead of measuring `cstr`
+    for (; *prefix != '\0'; ++prefix, ++cstr) {
+        if (*cstr != *prefix) {
+            return 0;
+        }
+    }
+    return 1;
 }
 
-Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
+String_View sv_from_cstr(Cstr cstr)
 {
-#ifndef _WIN32
-    pid_t cpid = fork();
-    if (cpid < 0) {
-        PANIC("Could not fork child process: %s: %s",
-              cmd_show(cmd), nobuild__strerror(errno));
-    }
+    return sv_from_parts(cstr, strlen(cstr));
+}
 
-    if (cpid == 0) {
-        Cstr_Array args = {
-            .count = cmd.line.count
-        };
-        args.elems = malloc(sizeof(Cstr) * args.count+1);
-        memcpy(args.elems, cmd.line.elems, args.count * sizeof(Cstr));
-        args.elems[args.count++] = NULL;
+String_View sv_from_parts(const char *data, size_t count)
+{
+    String_View sv = { .data = data, .count = count };
+    return sv;
+}
 
-        if (fdin) {
-            if (dup2(*fdin, STDIN_FILENO) < 0) {
-                PANIC("Could not setup stdin for child process: %s", nobuild__strerror(errno));
-            }
-        }
+Cstr sv_to_cstr(String_View sv)
+{
+    char *result = temp_alloc(sv.count + 1);
+    memcpy(result, sv.data, sv.count);
+    result[sv.count] = '\0';
+    return result;
+}
 
-        if (fdout) {
-            if (dup2(*fdout, STDOUT_FILENO) < 0) {
-                PANIC("Could not setup stdout for child process: %s", nobuild__strerror(errno));
-            }
-        }
+int sv_eq(String_View a, String_View b)
+{
+    return a.count == b.count && memcmp(a.data, b.data, a.count) == 0;
+}
 
-        if (execvp(args.elems[0], (char * const*) args.elems) < 0) {
-            PANIC("Could not exec child process: %s: %s",
-                  cmd_show(cmd), nobuild__strerror(errno));
+int sv_eq_cstr(String_View sv, Cstr cstr)
+{
+    for (size_t i = 0; i < sv.count; ++i) {
+        if (cstr[i] == '\0' || cstr[i] != sv.data[i]) {
+            return 0;
         }
     }
+    return cstr[sv.count] == '\0';
+}
 
-    return cpid;
-#else
-    // https://docs.microsoft.com/en-us/windows/win32/procthread/creating-a-child-process-with-redirected-input-and-output
+int sv_starts_with(String_View sv, String_View prefix)
+{
+    return prefix.count <= sv.count && memcmp(sv.data, prefix.data, prefix.count) == 0;
+}
 
-    STARTUPINFO siStartInfo;
-    ZeroMemory(&siStartInfo, sizeof(siStartInfo));
-    siStartInfo.cb = sizeof(STARTUPINFO);
-    // NOTE: theoretically setting NULL to std handles should not be a problem
-    // https://docs.microsoft.com/en-us/windows/console/getstdhandle?redirectedfrom=MSDN#attachdetach-behavior
-    siStartInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
-    // TODO(#32): check for errors in GetStdHandle
-    siStartInfo.hStdOutput = fdout ? *fdout : GetStdHandle(STD_OUTPUT_HANDLE);
-    siStartInfo.hStdInput = fdin ? *fdin : GetStdHandle(STD_INPUT_HANDLE);
-    siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
+int sv_ends_with(String_View sv, String_View suffix)
+{
+    return suffix.count <= sv.count
+           && memcmp(sv.data + sv.count - suffix.count, suffix.data, suffix.count) == 0;
+}
 
-    PROCESS_INFORMATION piProcInfo;
-    ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
+size_t sv_find(String_View sv, String_View needle)
+{
+    if (needle.count == 0) {
+        return 0;
+    }
 
-    BOOL bSuccess =
-        CreateProcess(
-            NULL,
-            // TODO(#33): cmd_run_async on Windows does not render command line properly
-            // It may require wrapping some arguments with double-quotes if they contains spaces, etc.
-            (LPSTR) cstr_array_join(" ", cmd.line),
-            NULL,
-            NULL,
-            TRUE,
-            0,
-            NULL,
-            NULL,
-            &siStartInfo,
-            &piProcInfo
-        );
+    // Jump between candidates for the first byte and compare the rest there
+    size_t i = 0;
+    while (needle.count <= sv.count - i) {
+        const char *first = memchr(sv.data + i, needle.data[0], sv.count - i - needle.count + 1);
+        if (first == NULL) {
+            break;
+        }
 
-    if (!bSuccess) {
-        PANIC("Could not create child process %s: %s\n",
-              cmd_show(cmd), nobuild__GetLastErrorAsString());
+        i = (size_t) (first - sv.data);
+        if (memcmp(first + 1, needle.data + 1, needle.count - 1) == 0) {
+            return i;
+        }
+        i += 1;
     }
+    return sv.count;
+}
 
-    CloseHandle(piProcInfo.hThread);
-
-    return piProcInfo.hProcess;
-#endif // _WIN32
+size_t sv_rfind_char(String_View sv, char c)
+{
+    for (size_t i = sv.count; i-- > 0;) {
+        if (sv.data[i] == c) {
+            return i;
+        }
+    }
+    return sv.count;
 }
 
-void cmd_run_sync(Cmd cmd)
+String_View sv_trim(String_View sv)
 {
-    pid_wait(cmd_run_async(cmd, NULL, NULL));
+    while (sv.count > 0 && isspace((unsigned char) sv.data[0])) {
+        sv.data += 1;
+        sv.count -= 1;
+    }
+    while (sv.count > 0 && isspace((unsigned char) sv.data[sv.count - 1])) {
+        sv.count -= 1;
+    }
+    return sv;
 }
 
-static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token token)
+String_View sv_chop_left(String_View *sv, size_t n)
 {
-    switch (token.type) {
-    case CHAIN_TOKEN_CMD: {
-        chain->cmds.count += 1;
+    if (n > sv->count) {
+        n = sv->count;
     }
-    break;
 
-    case CHAIN_TOKEN_IN: {
-        if (chain->input_filepath) {
-            PANIC("Input file path was already set");
-        }
-
-        chain->input_filepath = token.args.elems[0];
-    }
-    break;
-
-    case CHAIN_TOKEN_OUT: {
-        if (chain->output_filepath) {
-            PANIC("Output file path was already set");
-        }
+    String_View result = sv_from_parts(sv->data, n);
+    sv->data += n;
+    sv->count -= n;
+    return result;
+}
 
-        chain->output_filepath = token.args.elems[0];
+String_View sv_chop_right(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
     }
-    break;
 
-    case CHAIN_TOKEN_END:
-    default: {
-        assert(0 && "unreachable");
-        exit(1);
-    }
-    }
+    sv->count -= n;
+    return sv_from_parts(sv->data + sv->count, n);
 }
 
-static void chain_push_cmd(Chain *chain, Chain_Token token)
+String_View sv_chop_by_delim(String_View *sv, char delim)
 {
-    if (token.type == CHAIN_TOKEN_CMD) {
-        chain->cmds.elems[chain->cmds.count++] = (Cmd) {
-            .line = token.args
-        };
+    const char *found = sv->count > 0 ? memchr(sv->data, delim, sv->count) : NULL;
+    if (found == NULL) {
+        return sv_chop_left(sv, sv->count);
     }
+
+    String_View result = sv_chop_left(sv, (size_t) (found - sv->data));
+    sv_chop_left(sv, 1);
+    return result;
 }
 
-Chain chain_build_from_tokens(Chain_Token first, ...)
+Cstr_Array cstr_array_make(Cstr first, ...)
 {
-    Chain result = {0};
+    Cstr_Array result = {0};
+
+    if (first == NULL) {
+        return result;
+    }
 
-    chain_set_input_output_files_or_count_cmds(&result, first);
+    // Counting the arguments first sizes the array exactly with a single allocation
+    size_t count = 1;
     va_list args;
     va_start(args, first);
-    Chain_Token next = va_arg(args, Chain_Token);
-    while (next.type != CHAIN_TOKEN_END) {
-        chain_set_input_output_files_or_count_cmds(&result, next);
-        next = va_arg(args, Chain_Token);
+    while (va_arg(args, Cstr) != NULL) {
+        count += 1;
     }
     va_end(args);
 
-    result.cmds.elems = malloc(sizeof(result.cmds.elems[0]) * result.cmds.count);
-    if (result.cmds.elems == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-    }
-    result.cmds.count = 0;
-
-    chain_push_cmd(&result, first);
-
+    da_reserve(&result, count);
+    result.elems[result.count++] = first;
     va_start(args, first);
-    next = va_arg(args, Chain_Token);
-    while (next.type != CHAIN_TOKEN_END) {
-        chain_push_cmd(&result, next);
-        next = va_arg(args, Chain_Token);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        result.elems[result.count++] = next;
     }
     va_end(args);
 
     return result;
 }
 
-void chain_run_sync(Chain chain)
+Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
 {
-    if (chain.cmds.count == 0) {
-        return;
-    }
-
-    Pid *cpids = malloc(sizeof(Pid) * chain.cmds.count);
+    da_append(&cstrs, cstr);
+    return cstrs;
+}
 
-    Pipe pip = {0};
-    Fd fdin = 0;
-    Fd *fdprev = NULL;
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity)
+{
+    da_reserve(&cstrs, capacity);
+    return cstrs;
+}
 
-    if (chain.input_filepath) {
-        fdin = fd_open_for_read(chain.input_filepath);
-        fdprev = &fdin;
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs)
+{
+    if (cstrs.capacity <= cstrs.count) {
+        return cstrs;
     }
 
-    for (size_t i = 0; i < chain.cmds.count - 1; ++i) {
-        pip = pipe_make();
+    cstrs.elems = temp_realloc(cstrs.elems, sizeof *cstrs.elems * cstrs.capacity,
+                               sizeof *cstrs.elems * cstrs.count);
+    cstrs.capacity = cstrs.count;
+    return cstrs;
+}
 
-        cpids[i] = cmd_run_async(
-                       chain.cmds.elems[i],
-                       fdprev,
-                       &pip.write);
+Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
+{
+    if (cstrs.count == 0) {
+        return cstrs;
+    }
 
-        if (fdprev) fd_close(*fdprev);
-        fd_close(pip.write);
-        fdprev = &fdin;
-        fdin = pip.read;
+    if (cstr == NULL) {
+        cstrs.count--;
+        return cstrs;
     }
 
-    {
-        Fd fdout = 0;
-        Fd *fdnext = NULL;
+    return cstr_array_remove_sv(cstrs, sv_from_cstr(cstr));
+}
 
-        if (chain.output_filepath) {
-            fdout = fd_open_for_write(chain.output_filepath);
-            fdnext = &fdout;
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv)
+{
+    // Find the index of the element to be removed
+    for (size_t i = 0; i < cstrs.count; i++) {
+        if (!sv_eq_cstr(sv, cstrs.elems[i])) {
+            continue;
         }
 
-        const size_t last = chain.cmds.count - 1;
-        cpids[last] =
-            cmd_run_async(
-                chain.cmds.elems[last],
-                fdprev,
-                fdnext);
-
-        if (fdprev) fd_close(*fdprev);
-        if (fdnext) fd_close(*fdnext);
+        // Shift elements left if found the cstr
+        for (size_t j = i; j < cstrs.count - 1; j++) {
+            cstrs.elems[j] = cstrs.elems[j + 1];
+        }
+        cstrs.count--;
+        return cstrs;
     }
 
-    for (size_t i = 0; i < chain.cmds.count; ++i) {
-        pid_wait(cpids[i]);
-    }
+    // The string was not found
+    return cstrs;
 }
 
-void chain_echo(Chain chain)
+Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
 {
-    printf("[INFO] CHAIN:");
-    if (chain.input_filepath) {
-        printf(" %s", chain.input_filepath);
+    if (cstrs_b.count == 0) {
+        return cstrs_a;
     }
 
-    for (size_t cmd_index = 0; cmd_index < chain.cmds.count; ++cmd_index) {
-        Cmd *cmd = &chain.cmds.elems[cmd_index];
-        printf(" |> %s", cmd_show(*cmd));
-    }
+    da_append_many(&cstrs_a, cstrs_b.elems, cstrs_b.count);
+    return cstrs_a;
+}
 
-    if (chain.output_filepath) {
-        printf(" |> %s", chain.output_filepath);
+int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (strcmp(cstr, cstrs.elems[i]) == 0) {
+            return 1;
+        }
     }
-
-    printf("\n");
+    return 0;
 }
 
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (sv_eq_cstr(sv, cstrs.elems[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
+Split_Iter split_iter_make(String_View sv, String_View delim)
+{
+    Split_Iter it = { .rest = sv, .delim = delim };
+    return it;
+}
 
-////////////////////////////////////////////////////////////////////////////////
-
-
-#include <assert.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
+int split_iter_next(Split_Iter *it, String_View *piece)
+{
+    if (it->done) {
+        return 0;
+    }
 
+    // `sv_find()` jumps between candidates with memchr(), which is vectorized by the libc
+    const size_t i = it->delim.count > 0 ? sv_find(it->rest, it->delim) : it->rest.count;
+    const int found = i < it->rest.count;
+    *piece = sv_chop_left(&it->rest, i);
+    if (found) {
+        sv_chop_left(&it->rest, it->delim.count);
+    } else {
+        it->done = 1;
+    }
+    return 1;
+}
 
-////////////////////////////////////////////////////////////////////////////////
+String_View_Array sv_split(String_View sv, String_View delim)
+{
+    String_View_Array result = {0};
+    Split_Iter it = split_iter_make(sv, delim);
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        da_append(&result, piece);
+    }
+    return result;
+}
 
+Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+{
+    const String_View sv = sv_from_cstr(cstr);
+    Split_Iter it = split_iter_make(sv, sv_from_cstr(delim));
 
+    // The pieces are null terminated in place in a copy of `cstr`
+    char *copy = NULL;
+    Cstr_Array result = {0};
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        if (it.done && result.count == 0) {
+            // `delim` was never found
+            return cstr_array_make(cstr, NULL);
+        }
 
-////////////////////////////////////////////////////////////////////////////////
+        if (copy == NULL) {
+            copy = temp_alloc(sv.count + 1);
+            memcpy(copy, cstr, sv.count + 1);
+        }
 
+        char *substr = copy + (piece.data - cstr);
+        substr[piece.count] = '\0';
+        result = cstr_array_append(result, substr);
+    }
 
+    return result;
+}
 
-////////////////////////////////////////////////////////////////////////////////
+Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
+{
+    if (cstrs.count == 0) {
+        return "";
+    }
 
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (i > 0) {
+            sb_append_bytes(&sb, sep, sep_len);
+        }
+        sb_append_cstr(&sb, cstrs.elems[i]);
+    }
 
-#ifndef _WIN32
-#	include <sys/types.h>
-#	include <sys/stat.h>
-#	include <unistd.h>
-#	include <dirent.h>
-#else
-#	define WIN32_MEAN_AND_LEAN
-#	include <windows.h>
-#	include <direct.h>
-// Copyright 2021 Alexey Kutepov <reximkut@gmail.com>
-//
-// Permission is hereby granted, free of charge, to any person obtaining
-// a copy of this software and associated documentation files (the
-// "Software"), to deal in the Software without restriction, including
-// without limitation the rights to use, copy, modify, merge, publish,
-// distribute, sublicense, and/or sell copies of the Software, and to
-// permit persons to whom the Software is furnished to do so, subject to
-// the following conditions:
-//
-// The above copyright notice and this permission notice shall be
-// included in all copies or substantial portions of the Software.
-//
-// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
-// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
-// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
-// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-//
-// ============================================================
-//
-// minirent — 0.0.1 — A subset of dirent interface for Windows.
-//
-// https://github.com/tsoding/minirent
-//
-// ============================================================
-//
-// ChangeLog (https://semver.org/ is implied)
-//
-//    0.0.1 First Official Release
+    return sb_to_cstr(&sb);
+}
 
+typedef struct {
+    Cstr cstr;
+    size_t count;
+    unsigned long long hash;
+} Nobuild__Intern_Slot;
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+// Open addressing with linear probing, kept at most half full
+static struct {
+    Arena arena;
+    Nobuild__Intern_Slot *slots;
+    size_t count;
+    size_t capacity;
+} nobuild__intern = {0};
+static Nobuild__Lock nobuild__intern_lock = NOBUILD__LOCK_INIT;
 
-struct dirent
+// FNV-1a
+static unsigned long long nobuild__intern_hash(String_View sv)
 {
-    char d_name[MAX_PATH+1];
-};
-
-typedef struct DIR DIR;
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sv.count; ++i) {
+        hash = (hash ^ (unsigned char) sv.data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
 
-DIR *opendir(const char *dirpath);
-struct dirent *readdir(DIR *dirp);
-int closedir(DIR *dirp);
+// The slot that holds `sv`, or the empty slot where it belongs
+static Nobuild__Intern_Slot *nobuild__intern_probe(String_View sv, unsigned long long hash)
+{
+    const size_t mask = nobuild__intern.capacity - 1;
+    for (size_t i = (size_t) hash & mask;; i = (i + 1) & mask) {
+        Nobuild__Intern_Slot *slot = &nobuild__intern.slots[i];
+        if (slot->cstr == NULL || (slot->hash == hash && slot->count == sv.count
+                                   && memcmp(slot->cstr, sv.data, sv.count) == 0)) {
+            return slot;
+        }
+    }
+}
 
+static void nobuild__intern_grow(void)
+{
+    Nobuild__Intern_Slot *old_slots = nobuild__intern.slots;
+    const size_t old_capacity = nobuild__intern.capacity;
 
-////////////////////////////////////////////////////////////////////////////////
+    nobuild__intern.capacity = old_capacity > 0 ? old_capacity * 2 : 1024;
+    nobuild__intern.slots = NOBUILD__CALLOC(nobuild__intern.capacity, sizeof(*nobuild__intern.slots));
+    if (nobuild__intern.slots == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
 
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].cstr != NULL) {
+            String_View sv = sv_from_parts(old_slots[i].cstr, old_slots[i].count);
+            *nobuild__intern_probe(sv, old_slots[i].hash) = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
 
-struct DIR
+Cstr intern(Cstr cstr)
 {
-    HANDLE hFind;
-    WIN32_FIND_DATA data;
-    struct dirent *dirent;
-};
+    return intern_sv(sv_from_cstr(cstr));
+}
 
-DIR *opendir(const char *dirpath)
+Cstr intern_sv(String_View sv)
 {
-    assert(dirpath);
-
-    char buffer[MAX_PATH];
-    snprintf(buffer, MAX_PATH, "%s\\*", dirpath);
-
-    DIR *dir = (DIR*)calloc(1, sizeof(DIR));
+    const unsigned long long hash = nobuild__intern_hash(sv);
 
-    dir->hFind = FindFirstFile(buffer, &dir->data);
-    if (dir->hFind == INVALID_HANDLE_VALUE) {
-        // TODO: opendir should set errno accordingly on FindFirstFile fail
-        // https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror
-        errno = ENOSYS;
-        goto fail;
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    if ((nobuild__intern.count + 1) * 2 > nobuild__intern.capacity) {
+        nobuild__intern_grow();
     }
 
-    return dir;
+    Nobuild__Intern_Slot *slot = nobuild__intern_probe(sv, hash);
+    if (slot->cstr == NULL) {
+        char *copy = arena_alloc(&nobuild__intern.arena, sv.count + 1);
+        memcpy(copy, sv.data, sv.count);
+        copy[sv.count] = '\0';
 
-fail:
-    if (dir) {
-        free(dir);
+        slot->cstr = copy;
+        slot->count = sv.count;
+        slot->hash = hash;
+        nobuild__intern.count += 1;
     }
+    Cstr result = slot->cstr;
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
 
-    return NULL;
+    return result;
 }
 
-struct dirent *readdir(DIR *dirp)
+Cstr intern_find(String_View sv)
 {
-    assert(dirp);
+    const unsigned long long hash = nobuild__intern_hash(sv);
 
-    if (dirp->dirent == NULL) {
-        dirp->dirent = (struct dirent*)calloc(1, sizeof(struct dirent));
-    } else {
-        if(!FindNextFile(dirp->hFind, &dirp->data)) {
-            if (GetLastError() != ERROR_NO_MORE_FILES) {
-                // TODO: readdir should set errno accordingly on FindNextFile fail
-                // https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror
-                errno = ENOSYS;
-            }
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    Cstr result = NULL;
+    if (nobuild__intern.capacity > 0) {
+        result = nobuild__intern_probe(sv, hash)->cstr;
+    }
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
 
-            return NULL;
+    return result;
+}
+
+Cstr_Array cstr_array_intern(Cstr_Array cstrs)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        cstrs.elems[i] = intern(cstrs.elems[i]);
+    }
+    return cstrs;
+}
+
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            return 1;
         }
     }
+    return 0;
+}
 
-    memset(dirp->dirent->d_name, 0, sizeof(dirp->dirent->d_name));
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            memmove(cstrs.elems + i, cstrs.elems + i + 1, sizeof(*cstrs.elems) * (cstrs.count - i - 1));
+            cstrs.count--;
+            break;
+        }
+    }
+    return cstrs;
+}
 
-    strncpy(
-        dirp->dirent->d_name,
-        dirp->data.cFileName,
-        sizeof(dirp->dirent->d_name) - 1);
+Cstr cstr_join(Cstr sep, Cstr first, ...)
+{
+    if (first == NULL) {
+        return "";
+    }
 
-    return dirp->dirent;
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
+    sb_append_cstr(&sb, first);
+
+    va_list args;
+    va_start(args, first);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        sb_append_bytes(&sb, sep, sep_len);
+        sb_append_cstr(&sb, next);
+    }
+    va_end(args);
+
+    return sb_to_cstr(&sb);
 }
 
-int closedir(DIR *dirp)
+static char *nobuild__sb_realloc(String_Builder *sb, size_t capacity)
 {
-    assert(dirp);
+    if (sb->arena != NULL) {
+        return arena_realloc(sb->arena, sb->elems, sb->capacity, capacity);
+    }
+    return temp_realloc(sb->elems, sb->capacity, capacity);
+}
 
-    if(!FindClose(dirp->hFind)) {
-        // TODO: closedir should set errno accordingly on FindClose fail
-        // https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror
-        errno = ENOSYS;
-        return -1;
+void sb_reserve(String_Builder *sb, size_t size)
+{
+    const size_t needed = sb->count + size + 1;
+    if (needed <= sb->capacity) {
+        return;
     }
 
-    if (dirp->dirent) {
-        free(dirp->dirent);
+    size_t capacity = sb->capacity > 0 ? sb->capacity : 64;
+    while (capacity < needed) {
+        capacity *= 2;
     }
-    free(dirp);
 
-    return 0;
+    sb->elems = nobuild__sb_realloc(sb, capacity);
+    sb->capacity = capacity;
 }
 
-#endif // _WIN32
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size)
+{
+    sb_reserve(sb, size);
+    memcpy(sb->elems + sb->count, bytes, size);
+    sb->count += size;
+}
 
-// Multiple modules could define this function, so add a guard around it to prevent redefinition
-#ifndef NOBUILD__STRERROR
-#define NOBUILD__STRERROR
-Cstr nobuild__strerror(int errnum)
+void sb_append_cstr(String_Builder *sb, Cstr cstr)
+{
+    sb_append_bytes(sb, cstr, strlen(cstr));
+}
+
+void sb_append_sv(String_Builder *sb, String_View sv)
+{
+    sb_append_bytes(sb, sv.data, sv.count);
+}
+
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...)
+{
+    sb_reserve(sb, 0);
+
+    // Try formatting into the capacity that is left first, and again once the size is known
+    const size_t available = sb->capacity - sb->count;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(sb->elems + sb->count, available, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        PANIC("Could not format string %s: %s", fmt, nobuild__strerror(errno));
+    }
+
+    if ((size_t) n >= available) {
+        sb_reserve(sb, (size_t) n);
+        va_start(args, fmt);
+        vsnprintf(sb->elems + sb->count, (size_t) n + 1, fmt, args);
+        va_end(args);
+    }
+    sb->count += (size_t) n;
+}
+
+Cstr sb_to_cstr(String_Builder *sb)
+{
+    sb_reserve(sb, 0);
+    sb->elems[sb->count] = '\0';
+    char *result = nobuild__sb_realloc(sb, sb->count + 1);
+
+    String_Builder empty = { .arena = sb->arena };
+    *sb = empty;
+    return result;
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// FNV-1a
+size_t hash_bytes(const void *data, size_t size)
 {
+    const unsigned char *bytes = data;
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+size_t hash_cstr(Cstr cstr)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (; *cstr != '\0'; ++cstr) {
+        hash = (hash ^ (unsigned char) *cstr) * 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+size_t hash_sv(String_View sv)
+{
+    return hash_bytes(sv.data, sv.count);
+}
+
+// The finalizer of splitmix64, so that the low bits that pick the slot depend on all of them
+size_t hash_integer(unsigned long long integer)
+{
+    integer = (integer ^ (integer >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    integer = (integer ^ (integer >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t) (integer ^ (integer >> 31));
+}
+
+size_t hash_pointer(const void *pointer)
+{
+    return hash_integer((unsigned long long) (size_t) pointer);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
 #ifndef _WIN32
-    return strerror(errnum);
+#	include <sys/wait.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+
+// Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
+char *strsignal(int sig);
+// Hidden along with the rest of the BSD extensions
+int madvise(void *addr, size_t length, int advice);
+#	ifndef MADV_SEQUENTIAL
+#		define MADV_SEQUENTIAL 2
+#	endif
+
+#	ifdef __linux__
+#		include <sys/syscall.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+#		define NOBUILD__F_SETPIPE_SZ 1031
+#		define NOBUILD__F_GETPIPE_SZ 1032
+#		define NOBUILD__SPLICE_F_MOVE 1
+#		define NOBUILD__SPLICE_F_MORE 4
+#	endif // __linux__
 #else
-    static char buffer[1024];
-    strerror_s(buffer, 1024, errnum);
-    return buffer;
+#	include <assert.h>
 #endif
-}
-#endif // NOBUILD__STRERROR
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_IO
 
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
@@ -1519,396 +2847,5050 @@ LPSTR nobuild__GetLastErrorAsString(void)
 }
 #endif // NOBUILD__GETLASTERROR
 
-int nobuild__mkdir(const char *pathname, unsigned int mode)
-{
-#ifndef _WIN32
-    return mkdir(pathname, mode);
-#else
-    _Pragma("unused(mode)");
-    return _mkdir(pathname);
-#endif
-}
-
-int nobuild__rmdir(const char *pathname)
+Pipe pipe_make(void)
 {
-#ifndef _WIN32
-    return rmdir(pathname);
-#else
-    return _rmdir(pathname);
-#endif
-}
+    Pipe pip = {0};
 
-int nobuild__unlink(const char *pathname)
-{
 #ifndef _WIN32
-    return unlink(pathname);
-#else
-    return _unlink(pathname);
-#endif
-}
+    Fd pipefd[2];
+    if (pipe(pipefd) < 0) {
+        PANIC("Could not create pipe: %s", strerror(errno));
+    }
 
-Cstr path_no_ext(Cstr path)
-{
-    size_t n = strlen(path);
-    while (n > 0 && path[n - 1] != '.') {
-        n -= 1;
+    pip.read = pipefd[0];
+    pip.write = pipefd[1];
+    if (fcntl(pip.read, F_SETFD, FD_CLOEXEC) < 0 || fcntl(pip.write, F_SETFD, FD_CLOEXEC) < 0) {
+        PANIC("Could not set close-on-exec on pipe: %s", strerror(errno));
     }
+#else
+    // https://docs.microsoft.com/en-us/windows/win32/ProcThread/creating-a-child-process-with-redirected-input-and-output
 
-    if (n > 0) {
-        char *result = malloc(n);
-        memcpy(result, path, n);
-        result[n - 1] = '\0';
+    SECURITY_ATTRIBUTES saAttr = {0};
+    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+    saAttr.bInheritHandle = TRUE;
 
-        return result;
-    } else {
-        return path;
+    if (!CreatePipe(&pip.read, &pip.write, &saAttr, 0)) {
+        PANIC("Could not create pipe: %s", nobuild__GetLastErrorAsString());
     }
+#endif // _WIN32
+
+    return pip;
 }
 
-Cstr path_dirname(Cstr path)
+Fd fd_open_for_read(const char *path)
 {
-    char path_sep = *PATH_SEP;
-    size_t prefix_len = 0;
-
-    // Get length of directory prefix
-    for (size_t i = 1; i < strlen(path); ++i) {
-        if (path[i] != path_sep && path[i-1] == path_sep) {
-            prefix_len = i;
-        }
-    }
-
-    if (prefix_len == 0) {
-        return *path == path_sep ? PATH_SEP : ".";
+#ifndef _WIN32
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (result < 0) {
+        PANIC("Could not open file %s: %s", path, strerror(errno));
     }
+    return result;
+#else
+    // https://docs.microsoft.com/en-us/windows/win32/fileio/opening-a-file-for-reading-or-writing
+    SECURITY_ATTRIBUTES saAttr = {0};
+    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+    saAttr.bInheritHandle = TRUE;
 
-    // Strip trailing slashes
-    while (prefix_len > 1 && path[prefix_len-1] == path_sep) {
-        --prefix_len;
-    }
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
+                    path,
+                    GENERIC_READ,
+                    0,
+                    &saAttr,
+                    OPEN_EXISTING,
+                    FILE_ATTRIBUTE_READONLY,
+                    NULL));
 
-    // copy prefix
-    size_t len = prefix_len;
-    char* dirname = malloc(len+1);
-    if (dirname == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    if (result == INVALID_HANDLE_VALUE) {
+        PANIC("Could not open file %s", path);
     }
 
-    return dirname[len] = '\0', memcpy(dirname, path, len);
+    return result;
+#endif // _WIN32
 }
 
-Cstr path_basename(Cstr path)
+Fd fd_open_for_write(const char *path)
 {
-    char path_sep = *PATH_SEP;
-    Cstr last_sep = strrchr(path, path_sep);
-    if (last_sep == NULL) {
-        return path;
+#ifndef _WIN32
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path,
+                                                     O_WRONLY | O_CREAT | O_TRUNC,
+                                                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (result < 0) {
+        PANIC("Could not open file %s: %s", path, strerror(errno));
     }
+    return result;
+#else
+    SECURITY_ATTRIBUTES saAttr = {0};
+    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+    saAttr.bInheritHandle = TRUE;
+
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
+                    path,                  // name of the write
+                    GENERIC_WRITE,         // open for writing
+                    0,                     // do not share
+                    &saAttr,               // default security
+                    CREATE_ALWAYS,         // Same as `O_CREAT | O_TRUNC`
+                    FILE_ATTRIBUTE_NORMAL, // normal file
+                    NULL                   // no attr. template
+                ));
+
+    if (result == INVALID_HANDLE_VALUE) {
+        PANIC("Could not open file %s: %s", path, nobuild__GetLastErrorAsString());
+    }
+
+    return result;
+#endif // _WIN32
+}
+
+size_t fd_read(Fd fd, void *buf, unsigned long count)
+{
+#ifndef _WIN32
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_READ, read(fd, buf, count));
+    if (bytes == -1) {
+        ERRO("Read error: %s", strerror(errno));
+        return 0;
+    }
+#else
+    DWORD bytes;
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buf, count, &bytes, NULL))) {
+        ERRO("Read error: %s", nobuild__GetLastErrorAsString());
+        return 0;
+    }
+#endif
+
+    return (size_t) bytes;
+}
+
+size_t fd_write(Fd fd, void *buf, unsigned long count)
+{
+#ifndef _WIN32
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buf, (size_t) count));
+    if (bytes == -1) {
+        ERRO("Write error: %s", strerror(errno));
+        return 0;
+    }
+#else
+    DWORD bytes;
+    if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buf, count, &bytes, NULL))) {
+        ERRO("Write error: %s", nobuild__GetLastErrorAsString());
+        return 0;
+    }
+#endif
+
+    return (size_t) bytes;
+}
+
+int fd_printf(Fd fd, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return len;
+    }
+
+    // MSVC does not support variable length arrays
+#ifndef _WIN32
+     char buffer[len + 1];
+#else
+     char *buffer = NOBUILD__MALLOC(sizeof *buffer * (len + 1));
+#endif
+
+    va_start(args, fmt);
+    int result = vsnprintf(buffer, (size_t)(len + 1), fmt, args);
+    va_end(args);
+    if (result < 0) {
+        return result;
+    }
+
+    fd_write(fd, buffer, (unsigned long) result);
+
+#ifdef _WIN32
+    free(buffer);
+#endif
+
+    return result;
+}
+
+void fd_close(Fd fd)
+{
+#ifndef _WIN32
+    close(fd);
+#else
+    CloseHandle(fd);
+#endif // _WIN32
+}
+
+size_t pipe_set_size(Pipe pip, size_t size)
+{
+#ifdef __linux__
+    if (fcntl(pip.write, NOBUILD__F_SETPIPE_SZ, (int) size) < 0) {
+        // Above /proc/sys/fs/pipe-max-size without CAP_SYS_RESOURCE
+        WARN("Could not set pipe size to %zu bytes: %s", size, strerror(errno));
+        errno = 0;
+    }
+
+    int result = fcntl(pip.write, NOBUILD__F_GETPIPE_SZ);
+    return result > 0 ? (size_t) result : 0;
+#else
+    (void) pip;
+    (void) size;
+    return 0;
+#endif // __linux__
+}
+
+#define NOBUILD__PUMP_SIZE (1024 * 1024)
+
+// Returns 0 when `fd` is a pipe that nobody reads anymore
+static int nobuild__fd_write_all(Fd fd, const char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (size_t written = 0; written < count;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buffer + written, count - written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return 0;
+            }
+            PANIC("Could not write to file descriptor: %s", strerror(errno));
+        }
+        written += (size_t) n;
+    }
+#else
+    for (size_t written = 0; written < count;) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buffer + written, (DWORD) (count - written), &n, NULL))) {
+            if (GetLastError() == ERROR_NO_DATA || GetLastError() == ERROR_BROKEN_PIPE) {
+                return 0;
+            }
+            PANIC("Could not write to file: %s", nobuild__GetLastErrorAsString());
+        }
+        written += n;
+    }
+#endif // _WIN32
+
+    return 1;
+}
+
+// Returns 0 at the end of `fd`
+static size_t nobuild__fd_read_some(Fd fd, char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (;;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer, count));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PANIC("Could not read from file descriptor: %s", strerror(errno));
+        }
+        return (size_t) n;
+    }
+#else
+    DWORD n = 0;
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buffer, (DWORD) count, &n, NULL))) {
+        if (GetLastError() == ERROR_BROKEN_PIPE) {
+            return 0;
+        }
+        PANIC("Could not read from file: %s", nobuild__GetLastErrorAsString());
+    }
+    return n;
+#endif // _WIN32
+}
+
+#ifdef __linux__
+// Moves exactly `count` bytes from the pipe `in` to `out`. Returns 0 when `out`
+// has no readers, after dropping what is left of the `count` bytes from `in`.
+static int nobuild__fd_splice_exactly(Fd in, Fd out, size_t count)
+{
+    while (count > 0) {
+        long n = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, count, NOBUILD__SPLICE_F_MOVE));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EPIPE) {
+                PANIC("Could not splice between file descriptors: %s", strerror(errno));
+            }
+
+            errno = 0;
+            char buffer[4096];
+            while (count > 0) {
+                size_t dropped = nobuild__fd_read_some(in, buffer, count < sizeof(buffer) ? count : sizeof(buffer));
+                if (dropped == 0) {
+                    break;
+                }
+                count -= dropped;
+            }
+            return 0;
+        }
+        count -= (size_t) n;
+    }
+
+    return 1;
+}
+#endif // __linux__
+
+unsigned long long fd_pump(Fd in, Fd out)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, (size_t) NOBUILD__PUMP_SIZE,
+                                                              NOBUILD__SPLICE_F_MOVE | NOBUILD__SPLICE_F_MORE));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total;
+            }
+
+            // Neither side is a pipe, or the file does not support splicing
+            break;
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    for (;;) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0 || !nobuild__fd_write_all(out, buffer, bytes)) {
+            break;
+        }
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        // Duplicate what is buffered in `in` into `out1` without consuming it, then
+        // move the same bytes into `out2`
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_tee, in, out1, (size_t) NOBUILD__PUMP_SIZE, 0u));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total + fd_pump(in, out2);
+            }
+
+            // `in` or `out1` is not a pipe
+            break;
+        }
+
+        if (!nobuild__fd_splice_exactly(in, out2, (size_t) bytes)) {
+            return total + (unsigned long long) bytes + fd_pump(in, out1);
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    int alive1 = 1;
+    int alive2 = 1;
+    while (alive1 || alive2) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0) {
+            break;
+        }
+
+        alive1 = alive1 && nobuild__fd_write_all(out1, buffer, bytes);
+        alive2 = alive2 && nobuild__fd_write_all(out2, buffer, bytes);
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+// Mapping costs a few page faults and a TLB shootdown on unmap, which is more
+// than copying a small file
+#define NOBUILD__MAP_THRESHOLD (64 * 1024)
+
+#ifdef _WIN32
+static int nobuild__errno_from_win32(DWORD error)
+{
+    switch (error) {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+        return ENOENT;
+    case ERROR_ACCESS_DENIED:
+        return EACCES;
+    case ERROR_NOT_ENOUGH_MEMORY:
+        return ENOMEM;
+    default:
+        return EIO;
+    }
+}
+#endif // _WIN32
+
+int file_map(const char *path, File_View *view)
+{
+    view->data = NULL;
+    view->size = 0;
+    view->mapped = 0;
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        int error = errno;
+        errno = 0;
+        return error;
+    }
+
+    struct stat statbuf;
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0) {
+        int error = errno;
+        errno = 0;
+        close(fd);
+        return error;
+    }
+
+    if (S_ISDIR(statbuf.st_mode)) {
+        close(fd);
+        return EISDIR;
+    }
+
+    const size_t size = (size_t) statbuf.st_size;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            close(fd);
+            view->data = data;
+            view->size = size;
+            view->mapped = 1;
+            return 0;
+        }
+
+        // Some filesystems cannot map files, read those instead
+        errno = 0;
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        close(fd);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer + count, size - count));
+        if (n < 0 && errno == EINTR) {
+            errno = 0;
+            continue;
+        }
+
+        if (n < 0) {
+            int error = errno;
+            errno = 0;
+            free(buffer);
+            close(fd);
+            return error;
+        }
+
+        // The file shrank since fstat()
+        if (n == 0) {
+            break;
+        }
+        count += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                                                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        return nobuild__errno_from_win32(GetLastError());
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        int error = nobuild__errno_from_win32(GetLastError());
+        CloseHandle(file);
+        return error;
+    }
+
+    const size_t size = (size_t) file_size.QuadPart;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            // The view keeps the file alive on its own
+            void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (data != NULL) {
+                CloseHandle(file);
+                view->data = data;
+                view->size = size;
+                view->mapped = 1;
+                return 0;
+            }
+        }
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        CloseHandle(file);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, buffer + count, (DWORD) (size - count), &n, NULL))) {
+            int error = nobuild__errno_from_win32(GetLastError());
+            free(buffer);
+            CloseHandle(file);
+            return error;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        count += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    buffer[count] = '\0';
+    view->data = buffer;
+    view->size = count;
+    return 0;
+}
+
+void file_unmap(File_View view)
+{
+    if (!view.mapped) {
+        free((char *) view.data);
+        return;
+    }
+
+#ifndef _WIN32
+    munmap((void *) view.data, view.size);
+#else
+    UnmapViewOfFile(view.data);
+#endif // _WIN32
+}
+
+// Multiple modules could define these locks, so add a guard around them to prevent redefinition
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static struct {
+    Nobuild__Lock lock;
+    // Whether the exit handler was registered, by the process with `pid`
+    int registered;
+    unsigned long pid;
+    int sync;
+    // Committed since the last `atomic_file_sync()`
+    char **paths;
+    size_t count;
+    size_t capacity;
+    // Temporary files that were neither renamed nor removed yet
+    const char **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} nobuild__atomic = { .lock = NOBUILD__LOCK_INIT };
+
+static unsigned long nobuild__getpid(void)
+{
+#ifndef _WIN32
+    return (unsigned long) getpid();
+#else
+    return (unsigned long) GetCurrentProcessId();
+#endif // _WIN32
+}
+
+// Removes the temporary files that a failed build left behind, PANIC included, and
+// flushes the commits when sync is enabled
+static void nobuild__atomic_exit(void)
+{
+    // Forked children exit through here too, but the files belong to the parent
+    if (nobuild__getpid() != nobuild__atomic.pid) {
+        return;
+    }
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = 0; i < nobuild__atomic.pending_count; ++i) {
+        remove(nobuild__atomic.pending[i]);
+    }
+    nobuild__atomic.pending_count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+
+    atomic_file_sync();
+}
+
+// Must be called with the lock held
+static void nobuild__atomic_register(void)
+{
+    if (!nobuild__atomic.registered) {
+        nobuild__atomic.registered = 1;
+        nobuild__atomic.pid = nobuild__getpid();
+        atexit(nobuild__atomic_exit);
+    }
+}
+
+// Has `tmp_path` removed at exit unless it is forgotten before. The path is not copied.
+static void nobuild__atomic_pending_add(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    nobuild__atomic_register();
+    if (nobuild__atomic.pending_count >= nobuild__atomic.pending_capacity) {
+        nobuild__atomic.pending_capacity = nobuild__atomic.pending_capacity ? nobuild__atomic.pending_capacity * 2 : 16;
+        nobuild__atomic.pending = NOBUILD__REALLOC(nobuild__atomic.pending,
+                                                   sizeof(*nobuild__atomic.pending) * nobuild__atomic.pending_capacity);
+        if (nobuild__atomic.pending == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.pending[nobuild__atomic.pending_count++] = tmp_path;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static void nobuild__atomic_pending_remove(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = nobuild__atomic.pending_count; i-- > 0;) {
+        if (nobuild__atomic.pending[i] == tmp_path) {
+            nobuild__atomic.pending[i] = nobuild__atomic.pending[--nobuild__atomic.pending_count];
+            break;
+        }
+    }
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static int nobuild__atomic_sync_enabled(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    int enabled = nobuild__atomic.sync;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+    return enabled;
+}
+
+static char *nobuild__atomic_tmp_path(const char *path)
+{
+    unsigned long pid = nobuild__getpid();
+    size_t size = strlen(path) + 32;
+    char *tmp_path = NOBUILD__MALLOC(size);
+    if (tmp_path == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    snprintf(tmp_path, size, "%s.tmp.%lu", path, pid);
+    return tmp_path;
+}
+
+// Remembers `path` for `atomic_file_sync()` when sync is enabled
+static void nobuild__atomic_sync_push(const char *path)
+{
+    if (!nobuild__atomic_sync_enabled()) {
+        return;
+    }
+
+    size_t size = strlen(path) + 1;
+    char *copy = NOBUILD__MALLOC(size);
+    if (copy == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    memcpy(copy, path, size);
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (nobuild__atomic.count >= nobuild__atomic.capacity) {
+        nobuild__atomic.capacity = nobuild__atomic.capacity ? nobuild__atomic.capacity * 2 : 64;
+        nobuild__atomic.paths = NOBUILD__REALLOC(nobuild__atomic.paths,
+                                                 sizeof(*nobuild__atomic.paths) * nobuild__atomic.capacity);
+        if (nobuild__atomic.paths == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.paths[nobuild__atomic.count++] = copy;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+// Moves the temporary file of `file` over its path, once whoever wrote it has closed it
+static void nobuild__atomic_file_rename(Atomic_File *file)
+{
+#ifndef _WIN32
+    if (rename(file->tmp_path, file->path) < 0) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, strerror(errno));
+    }
+#else
+    if (!MoveFileExA(file->tmp_path, file->path, MOVEFILE_REPLACE_EXISTING)) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    nobuild__atomic_pending_remove(file->tmp_path);
+    nobuild__atomic_sync_push(file->path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+Atomic_File atomic_file_open(const char *path)
+{
+    Atomic_File file = {0};
+    file.path = path;
+    file.tmp_path = nobuild__atomic_tmp_path(path);
+    nobuild__atomic_pending_add(file.tmp_path);
+    file.fd = fd_open_for_write(file.tmp_path);
+    return file;
+}
+
+void atomic_file_commit(Atomic_File *file)
+{
+    fd_close(file->fd);
+    nobuild__atomic_file_rename(file);
+}
+
+void atomic_file_abort(Atomic_File *file)
+{
+    fd_close(file->fd);
+    remove(file->tmp_path);
+    nobuild__atomic_pending_remove(file->tmp_path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+void atomic_file_set_sync(int enabled)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (enabled) {
+        nobuild__atomic_register();
+    }
+    nobuild__atomic.sync = enabled;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+#ifndef _WIN32
+static void nobuild__fsync_path(const char *path)
+{
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        WARN("Could not open %s to flush it: %s", path, strerror(errno));
+        errno = 0;
+        return;
+    }
+
+    if (fsync(fd) < 0) {
+        WARN("Could not flush %s: %s", path, strerror(errno));
+        errno = 0;
+    }
+    close(fd);
+}
+#endif // _WIN32
+
+void atomic_file_sync(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (!nobuild__atomic.sync) {
+        NOBUILD__UNLOCK(&nobuild__atomic.lock);
+        return;
+    }
+
+#ifndef _WIN32
+    const char *last_dir = NULL;
+    size_t last_dir_len = 0;
+#endif // _WIN32
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        char *path = nobuild__atomic.paths[i];
+#ifndef _WIN32
+        nobuild__fsync_path(path);
+
+        // The renames live in the directories, flush each of them once in a row
+        char *sep = strrchr(path, '/');
+        size_t dir_len = sep ? (size_t) (sep - path) : 0;
+        if (last_dir == NULL || dir_len != last_dir_len || memcmp(last_dir, path, dir_len) != 0) {
+            if (dir_len == 0) {
+                nobuild__fsync_path(sep ? "/" : ".");
+            } else {
+                *sep = '\0';
+                nobuild__fsync_path(path);
+                *sep = '/';
+            }
+            last_dir = path;
+            last_dir_len = dir_len;
+        }
+#else
+        HANDLE handle = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+        if (handle == INVALID_HANDLE_VALUE || !FlushFileBuffers(handle)) {
+            WARN("Could not flush %s: %s", path, nobuild__GetLastErrorAsString());
+        }
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#endif // _WIN32
+    }
+
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        free(nobuild__atomic.paths[i]);
+    }
+    nobuild__atomic.count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+void pid_wait(Pid pid)
+{
+#ifndef _WIN32
+    for (;;) {
+        int wstatus = 0;
+        if (NOBUILD__STATS_CALL(STATS_WAITPID, waitpid(pid, &wstatus, 0)) < 0) {
+            PANIC("Could not wait on command (pid %d): %s", pid, strerror(errno));
+        }
+
+        if (WIFEXITED(wstatus)) {
+            int exit_status = WEXITSTATUS(wstatus);
+            if (exit_status != 0) {
+                PANIC("Command exited with exit code %d", exit_status);
+            }
+
+            break;
+        }
+
+        if (WIFSIGNALED(wstatus)) {
+            PANIC("Command process was terminated by %s", strsignal(WTERMSIG(wstatus)));
+        }
+    }
+#else
+    DWORD result = (DWORD) NOBUILD__STATS_CALL(STATS_WAITPID, WaitForSingleObject(
+                       pid,     // HANDLE hHandle,
+                       INFINITE // DWORD  dwMilliseconds
+                   ));
+
+    if (result == WAIT_FAILED) {
+        PANIC("Could not wait on child process: %s", nobuild__GetLastErrorAsString());
+    }
+
+    DWORD exit_status;
+    if (GetExitCodeProcess(pid, &exit_status) == 0) {
+        PANIC("Could not get process exit code: %lu", GetLastError());
+    }
+
+    if (exit_status != 0) {
+        PANIC("Command exited with exit code %lu", exit_status);
+    }
+
+    CloseHandle(pid);
+#endif // _WIN32
+}
+
+typedef struct {
+    Thread_Fn fn;
+    void *data;
+} Nobuild__Thread_Start;
+
+#if !defined(NOBUILD_NO_THREADS) && !defined(_WIN32)
+static void *nobuild__thread_start(void *arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return NULL;
+}
+#elif !defined(NOBUILD_NO_THREADS)
+static DWORD WINAPI nobuild__thread_start(LPVOID arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return 0;
+}
+#endif
+
+Thread thread_create(Thread_Fn fn, void *data)
+{
+#ifdef NOBUILD_NO_THREADS
+    fn(data);
+    return 0;
+#else
+    Nobuild__Thread_Start *start = NOBUILD__MALLOC(sizeof(*start));
+    if (start == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    start->fn = fn;
+    start->data = data;
+
+#	ifndef _WIN32
+    Thread thread;
+    int error = pthread_create(&thread, NULL, nobuild__thread_start, start);
+    if (error != 0) {
+        PANIC("Could not create thread: %s", strerror(error));
+    }
+#	else
+    Thread thread = CreateThread(NULL, 0, nobuild__thread_start, start, 0, NULL);
+    if (thread == NULL) {
+        PANIC("Could not create thread: %s", nobuild__GetLastErrorAsString());
+    }
+#	endif // _WIN32
+
+    return thread;
+#endif // NOBUILD_NO_THREADS
+}
+
+void thread_join(Thread thread)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) thread;
+#elif !defined(_WIN32)
+    int error = pthread_join(thread, NULL);
+    if (error != 0) {
+        PANIC("Could not join thread: %s", strerror(error));
+    }
+#else
+    if (WaitForSingleObject(thread, INFINITE) == WAIT_FAILED) {
+        PANIC("Could not join thread: %s", nobuild__GetLastErrorAsString());
+    }
+    CloseHandle(thread);
+#endif
+}
+
+size_t thread_count(void)
+{
+#ifndef _WIN32
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+#endif // _WIN32
+}
+
+void mutex_init(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    *mutex = 0;
+#elif !defined(_WIN32)
+    int error = pthread_mutex_init(mutex, NULL);
+    if (error != 0) {
+        PANIC("Could not create mutex: %s", strerror(error));
+    }
+#else
+    InitializeCriticalSection(mutex);
+#endif
+}
+
+void mutex_lock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_lock(mutex);
+#else
+    EnterCriticalSection(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_unlock(mutex);
+#else
+    LeaveCriticalSection(mutex);
+#endif
+}
+
+void mutex_destroy(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_destroy(mutex);
+#else
+    DeleteCriticalSection(mutex);
+#endif
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CMD
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
+#define NOBUILD__GETLASTERROR
+LPSTR nobuild__GetLastErrorAsString(void)
+{
+    // https://stackoverflow.com/q/1387064/21582981
+    DWORD errorMessageId = GetLastError();
+    assert(errorMessageId != 0);
+
+    LPSTR messageBuffer = NULL;
+
+    FormatMessage(
+        FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, // DWORD   dwFlags,
+        NULL, // LPCVOID lpSource,
+        errorMessageId, // DWORD   dwMessageId,
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), // DWORD   dwLanguageId,
+        (LPSTR) &messageBuffer, // LPTSTR  lpBuffer,
+        0, // DWORD   nSize,
+        NULL // va_list *Arguments
+    );
+
+    return messageBuffer;
+}
+#endif // NOBUILD__GETLASTERROR
+
+Cstr cmd_show(Cmd cmd)
+{
+    // TODO(#31): cmd_show does not render the command line properly
+    // - No string literals when arguments contains space
+    // - No escaping of special characters
+    // - Etc.
+    return cstr_array_join(" ", cmd.line);
+}
+
+Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
+{
+    return cmd_run_async_ex(cmd, fdin, fdout, NULL);
+}
+
+Pid cmd_run_async_ex(Cmd cmd, Fd *fdin, Fd *fdout, Fd *fderr)
+{
+#ifndef _WIN32
+#ifdef NOBUILD_STATS
+    // Both ends are closed on exec, which is what reading from it waits for
+    Pipe exec_pipe = pipe_make();
+#endif // NOBUILD_STATS
+
+    pid_t cpid = NOBUILD__STATS_CALL(STATS_FORK, fork());
+    if (cpid < 0) {
+        PANIC("Could not fork child process: %s: %s",
+              cmd_show(cmd), nobuild__strerror(errno));
+    }
+
+    if (cpid == 0) {
+        // The child is about to exec, so the terminated copy of the line can live on its stack
+        Cstr argv[cmd.line.count + 1];
+        memcpy(argv, cmd.line.elems, sizeof(Cstr) * cmd.line.count);
+        argv[cmd.line.count] = NULL;
+
+        if (fdin) {
+            if (dup2(*fdin, STDIN_FILENO) < 0) {
+                PANIC("Could not setup stdin for child process: %s", nobuild__strerror(errno));
+            }
+        }
+
+        if (fdout) {
+            if (dup2(*fdout, STDOUT_FILENO) < 0) {
+                PANIC("Could not setup stdout for child process: %s", nobuild__strerror(errno));
+            }
+        }
+
+        if (fderr) {
+            if (dup2(*fderr, STDERR_FILENO) < 0) {
+                PANIC("Could not setup stderr for child process: %s", nobuild__strerror(errno));
+            }
+        }
+
+        // The parent ignores SIGPIPE while pumping a chain, and ignored signals survive exec
+        signal(SIGPIPE, SIG_DFL);
+
+        if (execvp(argv[0], (char * const*) argv) < 0) {
+            PANIC("Could not exec child process: %s: %s",
+                  cmd_show(cmd), nobuild__strerror(errno));
+        }
+    }
+
+#ifdef NOBUILD_STATS
+    fd_close(exec_pipe.write);
+    char byte;
+    (void) NOBUILD__STATS_CALL(STATS_EXEC, read(exec_pipe.read, &byte, 1));
+    fd_close(exec_pipe.read);
+#endif // NOBUILD_STATS
+
+    return cpid;
+#else
+    // https://docs.microsoft.com/en-us/windows/win32/procthread/creating-a-child-process-with-redirected-input-and-output
+
+    STARTUPINFO siStartInfo;
+    ZeroMemory(&siStartInfo, sizeof(siStartInfo));
+    siStartInfo.cb = sizeof(STARTUPINFO);
+    // NOTE: theoretically setting NULL to std handles should not be a problem
+    // https://docs.microsoft.com/en-us/windows/console/getstdhandle?redirectedfrom=MSDN#attachdetach-behavior
+    siStartInfo.hStdError = fderr ? *fderr : GetStdHandle(STD_ERROR_HANDLE);
+    // TODO(#32): check for errors in GetStdHandle
+    siStartInfo.hStdOutput = fdout ? *fdout : GetStdHandle(STD_OUTPUT_HANDLE);
+    siStartInfo.hStdInput = fdin ? *fdin : GetStdHandle(STD_INPUT_HANDLE);
+    siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
+
+    PROCESS_INFORMATION piProcInfo;
+    ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
+
+    BOOL bSuccess =
+        NOBUILD__STATS_CALL(STATS_FORK, CreateProcess(
+            NULL,
+            // TODO(#33): cmd_run_async on Windows does not render command line properly
+            // It may require wrapping some arguments with double-quotes if they contains spaces, etc.
+            (LPSTR) cstr_array_join(" ", cmd.line),
+            NULL,
+            NULL,
+            TRUE,
+            0,
+            NULL,
+            NULL,
+            &siStartInfo,
+            &piProcInfo
+        ));
+
+    if (!bSuccess) {
+        PANIC("Could not create child process %s: %s\n",
+              cmd_show(cmd), nobuild__GetLastErrorAsString());
+    }
+
+    CloseHandle(piProcInfo.hThread);
+
+    return piProcInfo.hProcess;
+#endif // _WIN32
+}
+
+void cmd_run_sync(Cmd cmd)
+{
+    pid_wait(cmd_run_async(cmd, NULL, NULL));
+}
+
+static void chain_push_token(Chain *chain, Chain_Token token)
+{
+    switch (token.type) {
+    case CHAIN_TOKEN_CMD: {
+        da_append(&chain->cmds, ((Cmd) {
+            .line = token.args
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_FN: {
+        da_append(&chain->fns, ((Chain_Fn_Stage) {
+            .position = chain->cmds.count,
+            .fn = token.fn,
+            .data = token.data
+        }));
+        da_append(&chain->cmds, ((Cmd) {
+            .line = token.args
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_IN: {
+        if (chain->input_filepath) {
+            PANIC("Input file path was already set");
+        }
+
+        chain->input_filepath = token.args.elems[0];
+    }
+    break;
+
+    case CHAIN_TOKEN_OUT: {
+        if (chain->output_filepath) {
+            PANIC("Output file path was already set");
+        }
+
+        chain->output_filepath = token.args.elems[0];
+    }
+    break;
+
+    case CHAIN_TOKEN_ERR: {
+        if (chain->error_filepath) {
+            PANIC("Error file path was already set to %s", chain->error_filepath);
+        }
+
+        chain->error_filepath = token.args.elems[0];
+    }
+    break;
+
+    case CHAIN_TOKEN_MERGE_ERR: {
+        if (chain->cmds.count == 0) {
+            PANIC("CHAIN_MERGE_ERR has to follow a CHAIN_CMD, but comes before stage %zu", chain->cmds.count);
+        }
+
+        const size_t position = chain->cmds.count - 1;
+        if (chain->fns.count > 0 && chain->fns.elems[chain->fns.count - 1].position == position) {
+            PANIC("CHAIN_MERGE_ERR has to follow a CHAIN_CMD, not CHAIN_FN(%s)", chain->cmds.elems[position].line.elems[0]);
+        }
+        da_append(&chain->merged_err, position);
+    }
+    break;
+
+    case CHAIN_TOKEN_TEE: {
+        if (token.chain->input_filepath) {
+            PANIC("A CHAIN_TEE branch reads the stream of its chain and cannot have an input file %s",
+                  token.chain->input_filepath);
+        }
+
+        da_append(&chain->tees, ((Chain_Tee) {
+            .position = chain->cmds.count,
+            .chain = token.chain
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_PIPE_SIZE: {
+        if (chain->pipe_size) {
+            PANIC("Pipe size was already set to %zu", chain->pipe_size);
+        }
+
+        chain->pipe_size = token.size;
+    }
+    break;
+
+    case CHAIN_TOKEN_END:
+    default: {
+        assert(0 && "unreachable");
+        exit(1);
+    }
+    }
+}
+
+Chain chain_build_from_tokens(Chain_Token first, ...)
+{
+    Chain result = {0};
+
+    chain_push_token(&result, first);
+    va_list args;
+    va_start(args, first);
+    for (Chain_Token next = va_arg(args, Chain_Token);
+            next.type != CHAIN_TOKEN_END;
+            next = va_arg(args, Chain_Token)) {
+        chain_push_token(&result, next);
+    }
+    va_end(args);
+
+    return result;
+}
+
+Chain *chain_branch(Chain chain)
+{
+    Chain *result = temp_alloc(sizeof(*result));
+    *result = chain;
+    return result;
+}
+
+// Pumps between the chain files and the pipes run on threads, which would block
+// forever when they run inline
+#if !defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__CHAIN_CAN_PUMP 1
+#else
+#	define NOBUILD__CHAIN_CAN_PUMP 0
+#endif
+
+typedef struct {
+    Fd in;
+    Fd out;
+    // Only set for tees
+    Fd branch;
+    int tee;
+} Nobuild__Chain_Pump;
+
+typedef struct {
+    Chain_Fn fn;
+    void *data;
+    Cstr name;
+    Fd in;
+    Fd out;
+    Thread thread;
+    int result;
+} Nobuild__Chain_Stage;
+
+// Everything a running chain and its branches have to be waited for
+typedef struct {
+    struct {
+        Pid *elems;
+        size_t count;
+        size_t capacity;
+    } pids;
+    struct {
+        Thread *elems;
+        size_t count;
+        size_t capacity;
+    } pumps;
+    struct {
+        Nobuild__Chain_Stage **elems;
+        size_t count;
+        size_t capacity;
+    } stages;
+    // Replace their paths once everything above is done
+    struct {
+        Atomic_File *elems;
+        size_t count;
+        size_t capacity;
+    } outputs;
+} Nobuild__Chain_Jobs;
+
+static void nobuild__chain_pump(void *data)
+{
+    Nobuild__Chain_Pump *pump = data;
+    unsigned long long bytes;
+    if (pump->tee) {
+        bytes = fd_tee(pump->in, pump->branch, pump->out);
+        fd_close(pump->branch);
+    } else {
+        bytes = fd_pump(pump->in, pump->out);
+    }
+    NOBUILD__STATS_PIPED(bytes);
+    fd_close(pump->in);
+    fd_close(pump->out);
+    free(pump);
+}
+
+static void nobuild__chain_pump_start(Nobuild__Chain_Jobs *jobs, Nobuild__Chain_Pump pump)
+{
+    Nobuild__Chain_Pump *data = NOBUILD__MALLOC(sizeof(*data));
+    if (data == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    *data = pump;
+    da_append(&jobs->pumps, thread_create(nobuild__chain_pump, data));
+}
+
+static void nobuild__chain_pid_push(Nobuild__Chain_Jobs *jobs, Pid pid)
+{
+    da_append(&jobs->pids, pid);
+}
+
+static void nobuild__chain_stage(void *data)
+{
+    Nobuild__Chain_Stage *stage = data;
+    stage->result = stage->fn(stage->in, stage->out, stage->data);
+    fd_close(stage->in);
+    fd_close(stage->out);
+}
+
+static const Chain_Fn_Stage *nobuild__chain_fn_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.fns.count; ++i) {
+        if (chain.fns.elems[i].position == position) {
+            return &chain.fns.elems[i];
+        }
+    }
+    return NULL;
+}
+
+// Stages and pumps close what they are given, so they get their own copy of the
+// standard streams of nobuild
+static Fd nobuild__chain_dup_std(int output)
+{
+#ifndef _WIN32
+    Fd fd = dup(output ? STDOUT_FILENO : STDIN_FILENO);
+    if (fd < 0) {
+        PANIC("Could not duplicate %s: %s", output ? "stdout" : "stdin", nobuild__strerror(errno));
+    }
+#else
+    Fd fd = GetStdHandle(output ? STD_OUTPUT_HANDLE : STD_INPUT_HANDLE);
+    if (!DuplicateHandle(GetCurrentProcess(), fd, GetCurrentProcess(), &fd, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+        PANIC("Could not duplicate %s: %s", output ? "stdout" : "stdin", nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    return fd;
+}
+
+static int nobuild__chain_merges_err_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.merged_err.count; ++i) {
+        if (chain.merged_err.elems[i] == position) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Starts the command or function at `index` of `chain` between `fdin` and `fdout`,
+// where NULL stands for the standard streams. Both are owned by the stage afterwards.
+// Commands write their stderr to `fderr` when it is given.
+static void nobuild__chain_stage_start(Chain chain, size_t index, Fd *fdin, Fd *fdout, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    const Chain_Fn_Stage *fn = nobuild__chain_fn_at(chain, index);
+    if (fn == NULL) {
+        if (nobuild__chain_merges_err_at(chain, index)) {
+            Fd fdstd = fdout ? *fdout : nobuild__chain_dup_std(1);
+            nobuild__chain_pid_push(jobs, cmd_run_async_ex(chain.cmds.elems[index], fdin, &fdstd, &fdstd));
+            if (!fdout) fd_close(fdstd);
+        } else {
+            nobuild__chain_pid_push(jobs, cmd_run_async_ex(chain.cmds.elems[index], fdin, fdout, fderr));
+        }
+        if (fdin) fd_close(*fdin);
+        if (fdout) fd_close(*fdout);
+        return;
+    }
+
+    if (!NOBUILD__CHAIN_CAN_PUMP) {
+        PANIC("CHAIN_FN(%s) needs threads, which are disabled by NOBUILD_NO_THREADS", chain.cmds.elems[index].line.elems[0]);
+    }
+
+    Nobuild__Chain_Stage *stage = NOBUILD__MALLOC(sizeof(*stage));
+    if (stage == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    *stage = (Nobuild__Chain_Stage) {
+        .fn = fn->fn,
+        .data = fn->data,
+        .name = chain.cmds.elems[index].line.elems[0],
+        .in = fdin ? *fdin : nobuild__chain_dup_std(0),
+        .out = fdout ? *fdout : nobuild__chain_dup_std(1)
+    };
+    da_append(&jobs->stages, stage);
+    stage->thread = thread_create(nobuild__chain_stage, stage);
+}
+
+// Opens the output file of a chain, which is handed to a stage or a pump that closes it
+static Fd nobuild__chain_output_open(Nobuild__Chain_Jobs *jobs, Cstr path)
+{
+    da_append(&jobs->outputs, atomic_file_open(path));
+    return jobs->outputs.elems[jobs->outputs.count - 1].fd;
+}
+
+static Pipe nobuild__chain_pipe(Chain chain)
+{
+    Pipe pip = pipe_make();
+    if (chain.pipe_size) {
+        pipe_set_size(pip, chain.pipe_size);
+    }
+    return pip;
+}
+
+// Whether the input or output `fd` of `chain` is pumped through a pipe of the chain's
+// size. Regular files are not, since a pump only adds a thread and a copy to them.
+static int nobuild__chain_pumps(Chain chain, Fd fd)
+{
+    if (chain.pipe_size == 0 || !NOBUILD__CHAIN_CAN_PUMP) {
+        return 0;
+    }
+
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    return NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0 || !S_ISREG(statbuf.st_mode);
+#else
+    return GetFileType(fd) != FILE_TYPE_DISK;
+#endif // _WIN32
+}
+
+static int nobuild__chain_has_tee_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.tees.count; ++i) {
+        if (chain.tees.elems[i].position == position) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void nobuild__chain_start(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs);
+
+// Splits the stream `*fdprev` into every branch that sits at `position` and
+// points `fdprev` at the copy that continues down the chain
+static Fd *nobuild__chain_start_tees(Chain chain, size_t position, Fd *fdprev, Fd *fdin, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    for (size_t i = 0; i < chain.tees.count; ++i) {
+        Chain_Tee tee = chain.tees.elems[i];
+        if (tee.position != position) {
+            continue;
+        }
+
+        if (fdprev == NULL) {
+            PANIC("CHAIN_TEE in front of command %zu has no stream to copy, add a CHAIN_IN or a CHAIN_CMD before it", position);
+        }
+
+        if (!NOBUILD__CHAIN_CAN_PUMP) {
+            PANIC("CHAIN_TEE in front of command %zu needs threads, which are disabled by NOBUILD_NO_THREADS", position);
+        }
+
+        if (tee.chain->pipe_size == 0) {
+            tee.chain->pipe_size = chain.pipe_size;
+        }
+
+        Pipe branch = nobuild__chain_pipe(chain);
+        Pipe next = nobuild__chain_pipe(chain);
+        nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+            .in = *fdprev,
+            .out = next.write,
+            .branch = branch.write,
+            .tee = 1
+        });
+
+        nobuild__chain_start(*tee.chain, &branch.read, fderr, jobs);
+        *fdin = next.read;
+        fdprev = fdin;
+    }
+
+    return fdprev;
+}
+
+static void nobuild__chain_start_stages(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    Pipe pip = {0};
+    Fd fdin = 0;
+    Fd *fdprev = NULL;
+
+    if (input) {
+        fdin = *input;
+        fdprev = &fdin;
+    } else if (chain.input_filepath) {
+        fdin = fd_open_for_read(chain.input_filepath);
+        // A function stage reads the file itself just as fast as a pump would
+        if (!nobuild__chain_fn_at(chain, 0) && nobuild__chain_pumps(chain, fdin)) {
+            pip = nobuild__chain_pipe(chain);
+            nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+                .in = fdin,
+                .out = pip.write
+            });
+            fdin = pip.read;
+        }
+        fdprev = &fdin;
+    }
+
+    // The last command only writes to the output directly when no tee follows it
+    const int tail = nobuild__chain_has_tee_at(chain, chain.cmds.count);
+    for (size_t i = 0; i < chain.cmds.count; ++i) {
+        fdprev = nobuild__chain_start_tees(chain, i, fdprev, &fdin, fderr, jobs);
+
+        if (i + 1 < chain.cmds.count || tail) {
+            pip = nobuild__chain_pipe(chain);
+            nobuild__chain_stage_start(chain, i, fdprev, &pip.write, fderr, jobs);
+            fdin = pip.read;
+            fdprev = &fdin;
+            continue;
+        }
+
+        Fd fdout = 0;
+        Fd *fdnext = NULL;
+
+        if (chain.output_filepath) {
+            fdout = nobuild__chain_output_open(jobs, chain.output_filepath);
+            if (!nobuild__chain_fn_at(chain, i) && nobuild__chain_pumps(chain, fdout)) {
+                pip = nobuild__chain_pipe(chain);
+                nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+                    .in = pip.read,
+                    .out = fdout
+                });
+                fdout = pip.write;
+            }
+            fdnext = &fdout;
+        }
+
+        nobuild__chain_stage_start(chain, i, fdprev, fdnext, fderr, jobs);
+        return;
+    }
+
+    // The stream is left after the trailing tees, or the chain had no commands at all
+    fdprev = nobuild__chain_start_tees(chain, chain.cmds.count, fdprev, &fdin, fderr, jobs);
+    if (fdprev == NULL) {
+        return;
+    }
+
+    if (!NOBUILD__CHAIN_CAN_PUMP) {
+        PANIC("Chain of %zu commands needs threads to pump its output, which are disabled by NOBUILD_NO_THREADS", chain.cmds.count);
+    }
+
+    Fd fdout = chain.output_filepath ? nobuild__chain_output_open(jobs, chain.output_filepath) : nobuild__chain_dup_std(1);
+
+    nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+        .in = *fdprev,
+        .out = fdout
+    });
+}
+
+// Starts the commands of `chain` reading from `input` when it is given, which is
+// then owned by the chain. Commands write their stderr to the error file of the
+// chain, or to `fderr` when it has none.
+static void nobuild__chain_start(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    // The commands keep their own copies, so the file is closed as soon as they run
+    Fd fdfile = 0;
+    if (chain.error_filepath) {
+        fdfile = fd_open_for_write(chain.error_filepath);
+        fderr = &fdfile;
+    }
+
+    nobuild__chain_start_stages(chain, input, fderr, jobs);
+
+    if (chain.error_filepath) {
+        fd_close(fdfile);
+    }
+}
+
+void chain_run_sync(Chain chain)
+{
+    if (chain.cmds.count == 0 && chain.tees.count == 0) {
+        return;
+    }
+
+    Nobuild__Chain_Jobs jobs = {0};
+    const int pump = (chain.pipe_size > 0 || chain.tees.count > 0 || chain.fns.count > 0) && NOBUILD__CHAIN_CAN_PUMP;
+#ifndef _WIN32
+    // A command that stops reading early must not take nobuild down with it, since
+    // pumps and function stages write to it from inside nobuild
+    void (*sigpipe)(int) = pump ? signal(SIGPIPE, SIG_IGN) : SIG_DFL;
+#endif // _WIN32
+
+    nobuild__chain_start(chain, NULL, NULL, &jobs);
+
+    FOREACH_ARRAY(Pid, pid, jobs.pids, pid_wait(*pid));
+    FOREACH_ARRAY(Thread, thread, jobs.pumps, thread_join(*thread));
+    FOREACH_ARRAY(Nobuild__Chain_Stage *, stage, jobs.stages, thread_join((*stage)->thread));
+
+#ifndef _WIN32
+    if (pump) {
+        signal(SIGPIPE, sigpipe);
+    }
+#endif // _WIN32
+
+    for (size_t i = 0; i < jobs.stages.count; ++i) {
+        Nobuild__Chain_Stage *stage = jobs.stages.elems[i];
+        if (stage->result != 0) {
+            PANIC("CHAIN_FN(%s) failed with %d", stage->name, stage->result);
+        }
+        free(stage);
+    }
+
+    // A failed chain has panicked by now and left the previous outputs in place
+    FOREACH_ARRAY(Atomic_File, output, jobs.outputs, nobuild__atomic_file_rename(output));
+
+    da_free(&jobs.outputs);
+    da_free(&jobs.stages);
+    da_free(&jobs.pumps);
+    da_free(&jobs.pids);
+}
+
+// `sep` goes in front of the first command, branches start without one
+static void nobuild__chain_echo(Chain chain, Cstr sep)
+{
+    if (chain.input_filepath) {
+        printf(" %s", chain.input_filepath);
+        sep = " |> ";
+    }
+
+    for (size_t cmd_index = 0; cmd_index <= chain.cmds.count; ++cmd_index) {
+        for (size_t i = 0; i < chain.tees.count; ++i) {
+            if (chain.tees.elems[i].position == cmd_index) {
+                printf("%stee(", sep);
+                nobuild__chain_echo(*chain.tees.elems[i].chain, "");
+                printf(")");
+                sep = " |> ";
+            }
+        }
+
+        if (cmd_index < chain.cmds.count) {
+            Cmd *cmd = &chain.cmds.elems[cmd_index];
+            if (nobuild__chain_fn_at(chain, cmd_index)) {
+                printf("%s%s()", sep, cmd->line.elems[0]);
+            } else {
+                printf("%s%s", sep, cmd_show(*cmd));
+            }
+            if (nobuild__chain_merges_err_at(chain, cmd_index)) {
+                printf(" 2>&1");
+            }
+            sep = " |> ";
+        }
+    }
+
+    if (chain.output_filepath) {
+        printf("%s%s", sep, chain.output_filepath);
+    }
+
+    if (chain.error_filepath) {
+        printf(" 2> %s", chain.error_filepath);
+    }
+}
+
+void chain_echo(Chain chain)
+{
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
+    printf("[INFO] CHAIN:");
+    nobuild__chain_echo(chain, " |> ");
+    printf("\n");
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_BULK
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif // _WIN32
+
+// The ring is driven with GCC atomics and the raw syscalls, so there is no liburing to link
+#if defined(__linux__) && defined(NOBUILD_IO_URING) && (defined(__GNUC__) || defined(__clang__))
+#	define NOBUILD__BULK_URING 1
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <linux/io_uring.h>
+#	include <linux/stat.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+// New syscalls have the same number on every architecture
+#	ifndef __NR_io_uring_setup
+#		define __NR_io_uring_setup 425
+#	endif
+#	ifndef __NR_io_uring_enter
+#		define __NR_io_uring_enter 426
+#	endif
+#	define NOBUILD__AT_FDCWD -100
+#	ifdef O_CLOEXEC
+#		define NOBUILD__O_CLOEXEC O_CLOEXEC
+#	else
+#		define NOBUILD__O_CLOEXEC 02000000
+#	endif
+// Large enough to keep the kernel busy without holding too many files open at once
+#	define NOBUILD__BULK_RING_ENTRIES 256
+#else
+#	define NOBUILD__BULK_URING 0
+#endif
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+static void nobuild__bulk_stat_sync(Bulk_Stat *stat_)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(stat_->path, &statbuf)) < 0) {
+        stat_->error = errno;
+        errno = 0;
+        return;
+    }
+
+    stat_->error = 0;
+    stat_->is_dir = S_ISDIR(statbuf.st_mode);
+    stat_->size = (unsigned long long) statbuf.st_size;
+    stat_->mtime = (long long) statbuf.st_mtime;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesExA(stat_->path, GetFileExInfoStandard, &data))) {
+        stat_->error = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        return;
+    }
+
+    stat_->error = 0;
+    stat_->is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    stat_->size = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    stat_->mtime = ((long long) data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#endif // _WIN32
+}
+
+static void nobuild__bulk_read_sync(Bulk_Read *read_)
+{
+    Bulk_Stat stat_ = { .path = read_->path };
+    nobuild__bulk_stat_sync(&stat_);
+    read_->data = NULL;
+    read_->size = 0;
+    read_->error = stat_.error;
+    if (read_->error) {
+        return;
+    }
+
+    if (stat_.is_dir) {
+        read_->error = EISDIR;
+        return;
+    }
+
+    read_->data = NOBUILD__MALLOC((size_t) stat_.size + 1);
+    if (read_->data == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(read_->path, O_RDONLY));
+    if (fd < 0) {
+        read_->error = errno;
+        errno = 0;
+        free(read_->data);
+        read_->data = NULL;
+        return;
+    }
+
+    while (read_->size < stat_.size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, read_->data + read_->size, (size_t) stat_.size - read_->size));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0) {
+            read_->error = errno;
+            errno = 0;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        read_->size += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(read_->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        read_->error = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        free(read_->data);
+        read_->data = NULL;
+        return;
+    }
+
+    while (read_->size < stat_.size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, read_->data + read_->size, (DWORD) (stat_.size - read_->size), &n, NULL))) {
+            read_->error = EIO;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        read_->size += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    if (read_->error) {
+        free(read_->data);
+        read_->data = NULL;
+        read_->size = 0;
+        return;
+    }
+    read_->data[read_->size] = '\0';
+}
+
+#if NOBUILD__BULK_URING
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Nobuild__Uring;
+
+// Returns 0 when io_uring cannot be used
+static int nobuild__uring_init(Nobuild__Uring *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, NOBUILD__BULK_RING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        errno = 0;
+        return 0;
+    }
+
+    // Statx, openat, read and close are all there by the time fast poll is
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        close(ring->fd);
+        return 0;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    const int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        errno = 0;
+        return 0;
+    }
+
+    ring->cq_ring = ring->sq_ring;
+    if (!single_mmap) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            errno = 0;
+            return 0;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (!single_mmap) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        errno = 0;
+        return 0;
+    }
+
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return 1;
+}
+
+static void nobuild__uring_destroy(Nobuild__Uring *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Fills `sqe` for element `index`, or returns 0 to skip it
+typedef int (*Nobuild__Uring_Prep)(struct io_uring_sqe *sqe, size_t index, void *data);
+// Receives the result of the operation of element `index`, a negated errno on failure
+typedef void (*Nobuild__Uring_Done)(size_t index, int res, void *data);
+
+// Runs one operation for each of `count` elements, a ring full at a time
+static void nobuild__uring_run(Nobuild__Uring *ring, size_t count, Nobuild__Uring_Prep prep, Nobuild__Uring_Done done, void *data)
+{
+    const unsigned mask = *ring->sq_mask;
+    size_t next = 0;
+    while (next < count) {
+        const unsigned tail = *ring->sq_tail;
+        unsigned queued = 0;
+        for (; next < count && queued < ring->entries; ++next) {
+            const unsigned slot = (tail + queued) & mask;
+            struct io_uring_sqe *sqe = &ring->sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            if (!prep(sqe, next, data)) {
+                continue;
+            }
+
+            sqe->user_data = next;
+            ring->sq_array[slot] = slot;
+            queued += 1;
+        }
+
+        if (queued == 0) {
+            break;
+        }
+        __atomic_store_n(ring->sq_tail, tail + queued, __ATOMIC_RELEASE);
+
+        unsigned to_submit = queued;
+        unsigned completed = 0;
+        while (completed < queued) {
+            long n = syscall(__NR_io_uring_enter, ring->fd, to_submit, queued - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    errno = 0;
+                    continue;
+                }
+                PANIC("Could not submit to io_uring: %s", nobuild__strerror(errno));
+            }
+            to_submit -= (unsigned) n;
+
+            unsigned head = *ring->cq_head;
+            const unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; ++head) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                done((size_t) cqe->user_data, cqe->res, data);
+                completed += 1;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+typedef struct {
+    Bulk_Stat *stats;
+    struct statx *buffers;
+} Nobuild__Bulk_Stat_Batch;
+
+static int nobuild__bulk_stat_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Stat_Batch *batch = data;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = NOBUILD__AT_FDCWD;
+    sqe->addr = (unsigned long long) (size_t) batch->stats[index].path;
+    sqe->len = STATX_TYPE | STATX_MTIME | STATX_SIZE;
+    sqe->off = (unsigned long long) (size_t) &batch->buffers[index];
+    return 1;
+}
+
+static void nobuild__bulk_stat_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Stat_Batch *batch = data;
+    Bulk_Stat *stat_ = &batch->stats[index];
+    if (res < 0) {
+        stat_->error = -res;
+        return;
+    }
+
+    const struct statx *buffer = &batch->buffers[index];
+    stat_->error = 0;
+    stat_->is_dir = (buffer->stx_mode & 0170000) == 0040000;
+    stat_->size = buffer->stx_size;
+    stat_->mtime = buffer->stx_mtime.tv_sec;
+}
+
+// Reading a file takes a statx, an open, as many reads as it needs and a close,
+// and each of these steps is one submission for the whole batch
+typedef struct {
+    Bulk_Read *reads;
+    Bulk_Stat *stats;
+    int *fds;
+} Nobuild__Bulk_Read_Batch;
+
+static int nobuild__bulk_open_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (batch->reads[index].error) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = NOBUILD__AT_FDCWD;
+    sqe->addr = (unsigned long long) (size_t) batch->reads[index].path;
+    // Commands started by other threads must not inherit the files
+    sqe->open_flags = O_RDONLY | NOBUILD__O_CLOEXEC;
+    return 1;
+}
+
+static void nobuild__bulk_open_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (res < 0) {
+        batch->reads[index].error = -res;
+        return;
+    }
+    batch->fds[index] = res;
+}
+
+static int nobuild__bulk_read_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    Bulk_Read *read_ = &batch->reads[index];
+    if (read_->error || batch->fds[index] < 0 || read_->size >= batch->stats[index].size) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = batch->fds[index];
+    sqe->addr = (unsigned long long) (size_t) (read_->data + read_->size);
+    const unsigned long long left = batch->stats[index].size - read_->size;
+    sqe->len = left < (1u << 30) ? (unsigned) left : (1u << 30);
+    sqe->off = read_->size;
+    return 1;
+}
+
+static void nobuild__bulk_read_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    Bulk_Read *read_ = &batch->reads[index];
+    if (res < 0) {
+        read_->error = -res;
+        return;
+    }
+
+    if (res == 0) {
+        // The file shrank since it was stat'ed
+        batch->stats[index].size = read_->size;
+        return;
+    }
+    read_->size += (size_t) res;
+}
+
+static int nobuild__bulk_close_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (batch->fds[index] < 0) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = batch->fds[index];
+    return 1;
+}
+
+static void nobuild__bulk_close_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    (void) res;
+    batch->fds[index] = -1;
+}
+
+static void nobuild__bulk_stat_ring(Nobuild__Uring *ring, Bulk_Stat *stats, size_t count)
+{
+    Nobuild__Bulk_Stat_Batch batch = {
+        .stats = stats,
+        .buffers = NOBUILD__MALLOC(count * sizeof(struct statx)),
+    };
+    if (batch.buffers == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_stat_prep, nobuild__bulk_stat_done, &batch);
+    free(batch.buffers);
+}
+
+static void nobuild__bulk_read_batch(Nobuild__Uring *ring, Bulk_Read *reads, size_t count)
+{
+    Nobuild__Bulk_Read_Batch batch = {
+        .reads = reads,
+        .stats = NOBUILD__CALLOC(count, sizeof(Bulk_Stat)),
+        .fds = NOBUILD__MALLOC(count * sizeof(int)),
+    };
+    if (batch.stats == NULL || batch.fds == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        batch.stats[i].path = reads[i].path;
+        batch.fds[i] = -1;
+    }
+    nobuild__bulk_stat_ring(ring, batch.stats, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        reads[i].data = NULL;
+        reads[i].size = 0;
+        reads[i].error = batch.stats[i].error;
+        if (reads[i].error == 0 && batch.stats[i].is_dir) {
+            reads[i].error = EISDIR;
+        }
+
+        if (reads[i].error == 0) {
+            reads[i].data = NOBUILD__MALLOC((size_t) batch.stats[i].size + 1);
+            if (reads[i].data == NULL) {
+                PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+            }
+        }
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_open_prep, nobuild__bulk_open_done, &batch);
+
+    // Regular files are read in one go, anything short is picked up by another round
+    for (;;) {
+        size_t pending = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!reads[i].error && batch.fds[i] >= 0 && reads[i].size < batch.stats[i].size) {
+                pending += 1;
+            }
+        }
+
+        if (pending == 0) {
+            break;
+        }
+        nobuild__uring_run(ring, count, nobuild__bulk_read_prep, nobuild__bulk_read_done, &batch);
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_close_prep, nobuild__bulk_close_done, &batch);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (reads[i].error) {
+            free(reads[i].data);
+            reads[i].data = NULL;
+            reads[i].size = 0;
+            continue;
+        }
+        reads[i].data[reads[i].size] = '\0';
+    }
+
+    free(batch.stats);
+    free(batch.fds);
+}
+#endif // NOBUILD__BULK_URING
+
+int bulk_uses_io_uring(void)
+{
+#if NOBUILD__BULK_URING
+    // Probed once, a race between threads only probes twice
+    static int available = -1;
+    if (available < 0) {
+        Nobuild__Uring ring;
+        available = nobuild__uring_init(&ring);
+        if (available) {
+            nobuild__uring_destroy(&ring);
+        }
+    }
+    return available;
+#else
+    return 0;
+#endif // NOBUILD__BULK_URING
+}
+
+void bulk_stat(Bulk_Stat *stats, size_t count)
+{
+#if NOBUILD__BULK_URING
+    Nobuild__Uring ring;
+    if (count > 1 && bulk_uses_io_uring() && nobuild__uring_init(&ring)) {
+        nobuild__bulk_stat_ring(&ring, stats, count);
+        nobuild__uring_destroy(&ring);
+        return;
+    }
+#endif // NOBUILD__BULK_URING
+
+    for (size_t i = 0; i < count; ++i) {
+        nobuild__bulk_stat_sync(&stats[i]);
+    }
+}
+
+void bulk_read(Bulk_Read *reads, size_t count)
+{
+#if NOBUILD__BULK_URING
+    Nobuild__Uring ring;
+    if (count > 1 && bulk_uses_io_uring() && nobuild__uring_init(&ring)) {
+        // Every file of a batch is open at the same time, so keep the batches small
+        for (size_t i = 0; i < count; i += ring.entries) {
+            const size_t n = count - i < ring.entries ? count - i : ring.entries;
+            nobuild__bulk_read_batch(&ring, reads + i, n);
+        }
+        nobuild__uring_destroy(&ring);
+        return;
+    }
+#endif // NOBUILD__BULK_URING
+
+    for (size_t i = 0; i < count; ++i) {
+        nobuild__bulk_read_sync(&reads[i]);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_PATH
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	include <dirent.h>
+#	include <fcntl.h>
+#	include <sys/time.h>
+
+// Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
+int openat(int dirfd, const char *pathname, int flags, ...);
+DIR *fdopendir(int fd);
+int mkdirat(int dirfd, const char *pathname, mode_t mode);
+int fstatat(int dirfd, const char *pathname, struct stat *statbuf, int flags);
+int lstat(const char *pathname, struct stat *statbuf);
+ssize_t readlinkat(int dirfd, const char *pathname, char *buf, size_t bufsiz);
+int symlinkat(const char *target, int newdirfd, const char *linkpath);
+int unlinkat(int dirfd, const char *pathname, int flags);
+int renameat(int olddirfd, const char *oldpath, int newdirfd, const char *newpath);
+int fchmod(int fd, mode_t mode);
+
+// Timestamps are copied with nanoseconds where POSIX 2008 is available, and in whole
+// seconds through `futimes()` when a system header was included before the feature
+// level could be requested
+#	if defined(__APPLE__)
+int futimens(int fd, const struct timespec times[2]);
+#		define NOBUILD__FUTIMENS
+#		define NOBUILD__ST_ATIM(st) ((st)->st_atimespec)
+#		define NOBUILD__ST_MTIM(st) ((st)->st_mtimespec)
+#	elif defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L
+#		define NOBUILD__FUTIMENS
+#		define NOBUILD__ST_ATIM(st) ((st)->st_atim)
+#		define NOBUILD__ST_MTIM(st) ((st)->st_mtim)
+#	else
+int futimes(int fd, const struct timeval tv[2]);
+#	endif
+
+#	ifdef __linux__
+#		ifndef AT_SYMLINK_NOFOLLOW
+#			define AT_SYMLINK_NOFOLLOW 0x100
+#		endif
+#		ifndef AT_REMOVEDIR
+#			define AT_REMOVEDIR 0x200
+#		endif
+#	endif // __linux__
+
+// `d_type` is there, but its values are hidden along with the rest of POSIX 2008.
+// These are the same on Linux, macOS and the BSDs.
+#	ifndef DT_UNKNOWN
+#		define DT_UNKNOWN 0
+#		define DT_DIR 4
+#		define DT_REG 8
+#		define DT_LNK 10
+#	endif
+#	if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#		define NOBUILD__D_TYPE(dp) ((dp)->d_type)
+#	else
+#		define NOBUILD__D_TYPE(dp) DT_UNKNOWN
+#	endif
+#	ifdef __linux__
+#		include <sys/ioctl.h>
+#		include <sys/sendfile.h>
+#		include <sys/syscall.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+#		ifndef NOBUILD__FICLONE
+#			define NOBUILD__FICLONE _IOW(0x94, 9, int)
+#		endif
+#	endif // __linux__
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#	include <direct.h>
+// Copyright 2021 Alexey Kutepov <reximkut@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ============================================================
+//
+// minirent — 0.0.1 — A subset of dirent interface for Windows.
+//
+// https://github.com/tsoding/minirent
+//
+// ============================================================
+//
+// ChangeLog (https://semver.org/ is implied)
+//
+//    0.0.1 First Official Release
+
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+struct dirent
+{
+    char d_name[MAX_PATH+1];
+};
+
+typedef struct DIR DIR;
+
+DIR *opendir(const char *dirpath);
+struct dirent *readdir(DIR *dirp);
+int closedir(DIR *dirp);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+struct DIR
+{
+    HANDLE hFind;
+    WIN32_FIND_DATA data;
+    struct dirent *dirent;
+};
+
+DIR *opendir(const char *dirpath)
+{
+    assert(dirpath);
+
+    char buffer[MAX_PATH];
+    snprintf(buffer, MAX_PATH, "%s\\*", dirpath);
+
+    DIR *dir = (DIR*)calloc(1, sizeof(DIR));
+
+    dir->hFind = FindFirstFile(buffer, &dir->data);
+    if (dir->hFind == INVALID_HANDLE_VALUE) {
+        // TODO: opendir should set errno accordingly on FindFirstFile fail
+        // https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror
+        errno = ENOSYS;
+        goto fail;
+    }
+
+    return dir;
+
+fail:
+    if (dir) {
+        free(dir);
+    }
+
+    return NULL;
+}
+
+struct dirent *readdir(DIR *dirp)
+{
+    assert(dirp);
+
+    if (dirp->dirent == NULL) {
+        dirp->dirent = (struct dirent*)calloc(1, sizeof(struct dirent));
+    } else {
+        if(!FindNextFile(dirp->hFind, &dirp->data)) {
+            if (GetLastError() != ERROR_NO_MORE_FILES) {
+                // TODO: readdir should set errno accordingly on FindNextFile fail
+                // https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror
+                errno = ENOSYS;
+            }
+
+            return NULL;
+        }
+    }
+
+    memset(dirp->dirent->d_name, 0, sizeof(dirp->dirent->d_name));
+
+    strncpy(
+        dirp->dirent->d_name,
+        dirp->data.cFileName,
+        sizeof(dirp->dirent->d_name) - 1);
+
+    return dirp->dirent;
+}
+
+int closedir(DIR *dirp)
+{
+    assert(dirp);
+
+    if(!FindClose(dirp->hFind)) {
+        // TODO: closedir should set errno accordingly on FindClose fail
+        // https://docs.microsoft.com/en-us/windows/win32/api/errhandlingapi/nf-errhandlingapi-getlasterror
+        errno = ENOSYS;
+        return -1;
+    }
+
+    if (dirp->dirent) {
+        free(dirp->dirent);
+    }
+    free(dirp);
+
+    return 0;
+}
+
+#endif // _WIN32
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
+#define NOBUILD__GETLASTERROR
+LPSTR nobuild__GetLastErrorAsString(void)
+{
+    // https://stackoverflow.com/q/1387064/21582981
+    DWORD errorMessageId = GetLastError();
+    assert(errorMessageId != 0);
+
+    LPSTR messageBuffer = NULL;
+
+    FormatMessage(
+        FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, // DWORD   dwFlags,
+        NULL, // LPCVOID lpSource,
+        errorMessageId, // DWORD   dwMessageId,
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), // DWORD   dwLanguageId,
+        (LPSTR) &messageBuffer, // LPTSTR  lpBuffer,
+        0, // DWORD   nSize,
+        NULL // va_list *Arguments
+    );
+
+    return messageBuffer;
+}
+#endif // NOBUILD__GETLASTERROR
+
+int nobuild__mkdir(const char *pathname, unsigned int mode)
+{
+#ifndef _WIN32
+    return mkdir(pathname, mode);
+#else
+    _Pragma("unused(mode)");
+    return _mkdir(pathname);
+#endif
+}
+
+int nobuild__rmdir(const char *pathname)
+{
+#ifndef _WIN32
+    return rmdir(pathname);
+#else
+    return _rmdir(pathname);
+#endif
+}
+
+int nobuild__unlink(const char *pathname)
+{
+#ifndef _WIN32
+    return unlink(pathname);
+#else
+    return _unlink(pathname);
+#endif
+}
+
+void sb_append_path(String_Builder *sb, Cstr component)
+{
+    if (sb->count > 0 && sb->elems[sb->count - 1] != *PATH_SEP) {
+        sb_append_bytes(sb, PATH_SEP, 1);
+    }
+    sb_append_cstr(sb, component);
+}
+
+String_View path_no_ext_sv(String_View path)
+{
+    const size_t dot = sv_rfind_char(path, '.');
+    if (dot < path.count) {
+        path.count = dot;
+    }
+    return path;
+}
+
+Cstr path_no_ext(Cstr path)
+{
+    String_View sv = sv_from_cstr(path);
+    String_View no_ext = path_no_ext_sv(sv);
+    return no_ext.count < sv.count ? sv_to_cstr(no_ext) : path;
+}
+
+String_View path_dirname_sv(String_View path)
+{
+    char path_sep = *PATH_SEP;
+    size_t prefix_len = 0;
+
+    // Get length of directory prefix
+    for (size_t i = 1; i < path.count; ++i) {
+        if (path.data[i] != path_sep && path.data[i-1] == path_sep) {
+            prefix_len = i;
+        }
+    }
+
+    if (prefix_len == 0) {
+        return path.count > 0 && *path.data == path_sep ? SV(PATH_SEP) : SV(".");
+    }
+
+    // Strip trailing slashes
+    while (prefix_len > 1 && path.data[prefix_len-1] == path_sep) {
+        --prefix_len;
+    }
+
+    path.count = prefix_len;
+    return path;
+}
+
+Cstr path_dirname(Cstr path)
+{
+    String_View dirname = path_dirname_sv(sv_from_cstr(path));
+    return dirname.data == path ? sv_to_cstr(dirname) : dirname.data;
+}
+
+String_View path_basename_sv(String_View path)
+{
+    char path_sep = *PATH_SEP;
+
+    // Skip trailing separators
+    size_t end = path.count;
+    while (end > 0 && path.data[end - 1] == path_sep) {
+        --end;
+    }
+
+    if (end == 0) {
+        return path.count > 0 ? SV(PATH_SEP) : path;
+    }
+
+    // Find the start of the basename
+    size_t start = end;
+    while (start > 0 && path.data[start - 1] != path_sep) {
+        --start;
+    }
+
+    return sv_from_parts(path.data + start, end - start);
+}
+
+Cstr path_basename(Cstr path)
+{
+    String_View sv = sv_from_cstr(path);
+    String_View basename = path_basename_sv(sv);
+    if (basename.data == path && basename.count == sv.count) {
+        return path;
+    }
+    return basename.data[basename.count] == '\0' ? basename.data : sv_to_cstr(basename);
+}
+
+int path_is_dir(Cstr path)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
+        if (errno == ENOENT) {
+            errno = 0;
+            return 0;
+        }
+
+        PANIC("could not retrieve information about file %s: %s",
+              path, nobuild__strerror(errno));
+    }
+
+    return S_ISDIR(statbuf.st_mode);
+#else
+    DWORD dwAttrib = (DWORD) NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributes(path));
+
+    return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
+            (dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
+#endif // _WIN32
+}
+
+int path_is_file(Cstr path)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
+        if (errno == ENOENT) {
+            errno = 0;
+            return 0;
+        }
+
+        PANIC("Could not retrieve information about file %s: %s",
+              path, nobuild__strerror(errno));
+    }
+
+    return S_ISREG(statbuf.st_mode);
+#else
+    DWORD dwAttrib = (DWORD) NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributes(path));
+    return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
+            !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
+#endif // _WIN32
+}
+
+int path_exists(Cstr path)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
+        if (errno == ENOENT) {
+            errno = 0;
+            return 0;
+        }
+
+        PANIC("could not retrieve information about file %s: %s",
+              path, nobuild__strerror(errno));
+    }
+
+    return 1;
+#else
+    DWORD dwAttrib = (DWORD) NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributes(path));
+    return (dwAttrib != INVALID_FILE_ATTRIBUTES);
+#endif
+}
+
+int is_path1_modified_after_path2(Cstr path1, Cstr path2)
+{
+    WARN("This function is deprecated. Use `path_is_newer()` instead.");
+    return path_is_newer(path1, path2);
+}
+
+#ifndef _WIN32
+typedef struct {
+    Bulk_Stat *elems;
+    size_t count;
+    size_t capacity;
+} Nobuild__Mtime_Entries;
+
+// Walks the directories readdir() already knows about right away and leaves
+// everything else to be stat'ed in one batch
+static void nobuild__mtime_collect(Nobuild__Mtime_Entries *entries, Cstr dir_path)
+{
+    FOREACH_FILE_IN_DIR(file, dir_path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        if (NOBUILD__D_TYPE(dp) == DT_DIR) {
+            nobuild__mtime_collect(entries, PATH(dir_path, file));
+        } else {
+            da_append(entries, ((Bulk_Stat) { .path = PATH(dir_path, file) }));
+        }
+    });
+}
+#endif // _WIN32
+
+long long nobuild__get_modification_time(Cstr path) {
+#ifndef _WIN32
+    Nobuild__Mtime_Entries entries = {0};
+    da_append(&entries, ((Bulk_Stat) { .path = path }));
+
+    long long mod_time = -1;
+    size_t begin = 0;
+    // Directories behind symbolic links only turn up once they are stat'ed
+    while (begin < entries.count) {
+        const size_t end = entries.count;
+        bulk_stat(entries.elems + begin, end - begin);
+
+        for (size_t i = begin; i < end; ++i) {
+            Bulk_Stat entry = entries.elems[i];
+            if (entry.error) {
+                PANIC("Could not stat %s: %s\n", entry.path, nobuild__strerror(entry.error));
+            }
+
+            if (entry.is_dir) {
+                nobuild__mtime_collect(&entries, entry.path);
+            } else {
+                mod_time = entry.mtime > mod_time ? entry.mtime : mod_time;
+            }
+        }
+        begin = end;
+    }
+
+    da_free(&entries);
+    return mod_time;
+#else
+    if (IS_DIR(path)) {
+        long long mod_time = -1;
+        FOREACH_FILE_IN_DIR(file, path, {
+            if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+                continue;
+            }
+
+            long long path_mod_time = nobuild__get_modification_time(PATH(path, file));
+            mod_time = path_mod_time > mod_time ? path_mod_time : mod_time;
+        });
+        return mod_time;
+    } else {
+        FILETIME path_time;
+        Fd path_fd = fd_open_for_read(path);
+        if (!GetFileTime(path_fd, NULL, NULL, &path_time)) {
+            PANIC("could not get time of %s: %s", path, nobuild__GetLastErrorAsString());
+        }
+        fd_close(path_fd);
+        return ((long long) path_time.dwHighDateTime) << 32 | path_time.dwLowDateTime;
+    }
+#endif
+}
+
+int path_is_newer(Cstr path1, Cstr path2)
+{
+    // Warn the user that the path is missing
+    if (!PATH_EXISTS(path1)) {
+        WARN("File %s does not exist", path2);
+        return 0;
+    }
+
+    if (!PATH_EXISTS(path2)) {
+        return 1;
+    }
+
+    return nobuild__get_modification_time(path1) > nobuild__get_modification_time(path2);
+}
+
+void path_mkdirs(Cstr_Array path)
+{
+    if (path.count == 0) {
+        return;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < path.count; ++i) {
+        len += strlen(path.elems[i]);
+    }
+
+    size_t seps_count = path.count - 1;
+    const size_t sep_len = strlen(PATH_SEP);
+
+    char *result = temp_alloc(len + seps_count * sep_len + 1);
+
+    len = 0;
+    for (size_t i = 0; i < path.count; ++i) {
+        size_t n = strlen(path.elems[i]);
+        memcpy(result + len, path.elems[i], n);
+        len += n;
+
+        if (seps_count > 0) {
+            memcpy(result + len, PATH_SEP, sep_len);
+            len += sep_len;
+            seps_count -= 1;
+        }
+
+        result[len] = '\0';
+
+        if (nobuild__mkdir(result, 0755) < 0) {
+            if (errno == EEXIST) {
+                errno = 0;
+                WARN("directory %s already exists", result);
+            } else {
+                PANIC("could not create directory %s: %s", result, nobuild__strerror(errno));
+            }
+        }
+    }
+}
+
+void path_rename(Cstr old_path, Cstr new_path)
+{
+#ifndef _WIN32
+    if (rename(old_path, new_path) < 0) {
+        PANIC("could not rename %s to %s: %s", old_path, new_path,
+              nobuild__strerror(errno));
+    }
+#else
+    if (!MoveFileEx(old_path, new_path, MOVEFILE_REPLACE_EXISTING)) {
+        PANIC("could not rename %s to %s: %s", old_path, new_path,
+              nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+}
+
+#define NOBUILD__COPY_BUFFER_SIZE (1024 * 1024)
+#define NOBUILD__COPY_CHUNK_SIZE (1024 * 1024 * 1024)
+
+// Wall clock seconds, only used for reporting
+static double nobuild__now(void)
+{
+#ifndef _WIN32
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#else
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+// Copies the rest of `in` into `out`. Every method advances the file offsets, so
+// when one is not supported the next one continues from where it stopped.
+static unsigned long long nobuild__copy_fd(Fd in, Fd out, Cstr old_path, Cstr new_path)
+{
+    unsigned long long copied = 0;
+
+#ifdef __linux__
+    // Share the extents on filesystems that support reflinks
+    if (ioctl(out, NOBUILD__FICLONE, in) == 0) {
+        struct stat statbuf = {0};
+        if (NOBUILD__STATS_CALL(STATS_STAT, fstat(in, &statbuf)) < 0) {
+            PANIC("Could not retrieve information about file %s: %s", old_path, nobuild__strerror(errno));
+        }
+        return (unsigned long long) statbuf.st_size;
+    }
+    errno = 0;
+
+#ifdef SYS_copy_file_range
+    for (;;) {
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_copy_file_range, in, NULL, out, NULL, (size_t) NOBUILD__COPY_CHUNK_SIZE, 0u));
+        if (bytes == 0) {
+            return copied;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        copied += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // SYS_copy_file_range
+
+    for (;;) {
+        ssize_t bytes = NOBUILD__STATS_CALL(STATS_WRITE, sendfile(out, in, NULL, NOBUILD__COPY_CHUNK_SIZE));
+        if (bytes == 0) {
+            return copied;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        copied += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    unsigned char *buffer = NOBUILD__MALLOC(NOBUILD__COPY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    for (;;) {
+        ssize_t bytes = NOBUILD__STATS_CALL(STATS_READ, read(in, buffer, NOBUILD__COPY_BUFFER_SIZE));
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PANIC("Could not copy %s to %s due to read error: %s", old_path, new_path, nobuild__strerror(errno));
+        }
+
+        if (bytes == 0) {
+            break;
+        }
+
+        // Writes to regular files can still be cut short, e.g. by a signal or a full disk
+        for (ssize_t written = 0; written < bytes;) {
+            ssize_t n = NOBUILD__STATS_CALL(STATS_WRITE, write(out, buffer + written, (size_t) (bytes - written)));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                PANIC("Could not copy %s to %s due to write error: %s", old_path, new_path, nobuild__strerror(errno));
+            }
+
+            if (n == 0) {
+                PANIC("Could not copy %s to %s: no bytes were written", old_path, new_path);
+            }
+            written += n;
+        }
+        copied += (unsigned long long) bytes;
+    }
+
+    free(buffer);
+    return copied;
+}
+
+static void nobuild__copy_metadata(Fd fd, Cstr path, const struct stat *statbuf, int flags)
+{
+    if (fchmod(fd, statbuf->st_mode & 07777) < 0) {
+        PANIC("Could not set the permissions of %s: %s", path, nobuild__strerror(errno));
+    }
+
+    if (flags & COPY_TIMESTAMPS) {
+#	ifdef NOBUILD__FUTIMENS
+        const struct timespec times[2] = { NOBUILD__ST_ATIM(statbuf), NOBUILD__ST_MTIM(statbuf) };
+        if (futimens(fd, times) < 0) {
+#	else
+        struct timeval times[2] = {{0}};
+        times[0].tv_sec = statbuf->st_atime;
+        times[1].tv_sec = statbuf->st_mtime;
+        if (futimes(fd, times) < 0) {
+#	endif
+            PANIC("Could not set the timestamps of %s: %s", path, nobuild__strerror(errno));
+        }
+    }
+}
+#endif // _WIN32
+
+static unsigned long long nobuild__copy_file(Cstr old_path, Cstr new_path, int flags)
+{
+    double start = log_enabled(LOG_TRACE) ? nobuild__now() : 0.0;
+
+#ifndef _WIN32
+    Fd in = fd_open_for_read(old_path);
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(in, &statbuf)) < 0) {
+        PANIC("Could not retrieve information about file %s: %s", old_path, nobuild__strerror(errno));
+    }
+
+    Atomic_File out = atomic_file_open(new_path);
+    unsigned long long copied = nobuild__copy_fd(in, out.fd, old_path, new_path);
+    nobuild__copy_metadata(out.fd, new_path, &statbuf, flags);
+    fd_close(in);
+    atomic_file_commit(&out);
+#else
+    // `CopyFile` already keeps the attributes and the modification time
+    (void) flags;
+    Atomic_File out = atomic_file_open(new_path);
+    fd_close(out.fd);
+    if (!CopyFile(old_path, out.tmp_path, FALSE)) {
+        PANIC("Could not copy %s to %s: %s", old_path, new_path, nobuild__GetLastErrorAsString());
+    }
+    nobuild__atomic_file_rename(&out);
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    unsigned long long copied = 0;
+    if (NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesEx(new_path, GetFileExInfoStandard, &data))) {
+        copied = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    }
+#endif // _WIN32
+
+    if (log_enabled(LOG_TRACE)) {
+        double secs = nobuild__now() - start;
+        TRACE("Copied %llu bytes from %s to %s in %.3fs (%.1f MiB/s)", copied, old_path, new_path,
+              secs, secs > 0 ? (double) copied / (1024.0 * 1024.0) / secs : 0.0);
+    }
+
+    NOBUILD__STATS_COPIED(copied);
+    return copied;
+}
+
+#ifndef _WIN32
+// Number of files a worker takes from the queue at once
+#define NOBUILD__COPY_BATCH 16
+
+typedef struct {
+    Cstr path;
+    struct stat statbuf;
+} Nobuild__Copy_Dir;
+
+typedef struct {
+    Fd src_root;
+    Fd dst_root;
+    Cstr old_path;
+    Cstr new_path;
+    int flags;
+    // Names the temporary files of the copies
+    unsigned long pid;
+
+    // Paths relative to both roots
+    Cstr_Array files;
+    Nobuild__Copy_Dir *dirs;
+    size_t dirs_count;
+    size_t dirs_capacity;
+
+    Mutex mutex;
+    size_t next;
+    unsigned long long bytes;
+} Nobuild__Copy_Tree;
+
+static void nobuild__copy_tree_dir(Nobuild__Copy_Tree *tree, Cstr path, Fd fd)
+{
+    if (tree->dirs_count >= tree->dirs_capacity) {
+        tree->dirs_capacity = tree->dirs_capacity ? tree->dirs_capacity * 2 : 64;
+        tree->dirs = NOBUILD__REALLOC(tree->dirs, sizeof(*tree->dirs) * tree->dirs_capacity);
+        if (tree->dirs == NULL) {
+            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        }
+    }
+
+    Nobuild__Copy_Dir *dir = &tree->dirs[tree->dirs_count++];
+    dir->path = path;
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &dir->statbuf)) < 0) {
+        PANIC("Could not retrieve information about directory %s: %s",
+              PATH(tree->old_path, path), nobuild__strerror(errno));
+    }
+}
+
+static void nobuild__copy_tree_link(Nobuild__Copy_Tree *tree, Fd src_dir, Fd dst_dir, Cstr name, Cstr path)
+{
+    size_t size = 256;
+    char *target = NULL;
+    for (;;) {
+        target = NOBUILD__REALLOC(target, size);
+        if (target == NULL) {
+            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        }
+
+        ssize_t len = readlinkat(src_dir, name, target, size);
+        if (len < 0) {
+            PANIC("Could not read symbolic link %s: %s", PATH(tree->old_path, path), nobuild__strerror(errno));
+        }
+
+        if ((size_t) len < size) {
+            target[len] = '\0';
+            break;
+        }
+        size *= 2;
+    }
+
+    if (symlinkat(target, dst_dir, name) < 0) {
+        if (errno != EEXIST || unlinkat(dst_dir, name, 0) < 0 || symlinkat(target, dst_dir, name) < 0) {
+            PANIC("Could not create symbolic link %s: %s", path, nobuild__strerror(errno));
+        }
+    }
+    errno = 0;
+    free(target);
+}
+
+// Creates the directories and links up front and queues the regular files. Takes
+// ownership of both directory fds.
+static void nobuild__copy_tree_walk(Nobuild__Copy_Tree *tree, Fd src_dir, Fd dst_dir, Cstr prefix, Copy_Stats *stats)
+{
+    DIR *dir = fdopendir(src_dir);
+    if (dir == NULL) {
+        PANIC("Could not open directory %s: %s", PATH(tree->old_path, prefix), nobuild__strerror(errno));
+    }
+
+    struct dirent *dp = NULL;
+    errno = 0;
+    while ((dp = readdir(dir))) {
+        Cstr name = dp->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        Cstr path = strcmp(prefix, ".") == 0 ? CONCAT(name) : JOIN("/", prefix, name);
+        int type = NOBUILD__D_TYPE(dp);
+        if (type == DT_UNKNOWN) {
+            struct stat statbuf = {0};
+            if (NOBUILD__STATS_CALL(STATS_STAT, fstatat(src_dir, name, &statbuf, AT_SYMLINK_NOFOLLOW)) < 0) {
+                PANIC("Could not retrieve information about file %s: %s",
+                      PATH(tree->old_path, path), nobuild__strerror(errno));
+            }
+
+            type = S_ISDIR(statbuf.st_mode) ? DT_DIR
+                 : S_ISREG(statbuf.st_mode) ? DT_REG
+                 : S_ISLNK(statbuf.st_mode) ? DT_LNK
+                 : -1;
+        }
+
+        if (type == DT_DIR) {
+            // Owner access is required to fill the directory, the real mode is set once it is full
+            if (mkdirat(dst_dir, name, 0700) < 0 && errno != EEXIST) {
+                PANIC("Could not create directory %s: %s", path, nobuild__strerror(errno));
+            }
+
+            Fd src_child = NOBUILD__STATS_CALL(STATS_OPEN, openat(src_dir, name, O_RDONLY));
+            Fd dst_child = src_child < 0 ? -1 : NOBUILD__STATS_CALL(STATS_OPEN, openat(dst_dir, name, O_RDONLY));
+            if (src_child < 0 || dst_child < 0) {
+                PANIC("Could not open directory %s: %s", path, nobuild__strerror(errno));
+            }
+
+            nobuild__copy_tree_dir(tree, path, src_child);
+            stats->dirs += 1;
+            nobuild__copy_tree_walk(tree, src_child, dst_child, path, stats);
+        } else if (type == DT_REG) {
+            tree->files = cstr_array_append(tree->files, path);
+            stats->files += 1;
+        } else if (type == DT_LNK) {
+            nobuild__copy_tree_link(tree, src_dir, dst_dir, name, path);
+            stats->symlinks += 1;
+        } else {
+            WARN("Skipping %s: not a regular file, directory or symbolic link", PATH(tree->old_path, path));
+            stats->skipped += 1;
+        }
+        errno = 0;
+    }
+
+    if (errno > 0) {
+        PANIC("Could not read directory %s: %s", PATH(tree->old_path, prefix), nobuild__strerror(errno));
+    }
+
+    closedir(dir);
+    close(dst_dir);
+}
+
+static void nobuild__copy_tree_worker(void *data)
+{
+    Nobuild__Copy_Tree *tree = data;
+    unsigned long long bytes = 0;
+
+    for (;;) {
+        mutex_lock(&tree->mutex);
+        size_t begin = tree->next;
+        size_t end = begin + NOBUILD__COPY_BATCH < tree->files.count ? begin + NOBUILD__COPY_BATCH : tree->files.count;
+        tree->next = end;
+        mutex_unlock(&tree->mutex);
+
+        if (begin >= end) {
+            break;
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            Cstr path = tree->files.elems[i];
+            Fd in = NOBUILD__STATS_CALL(STATS_OPEN, openat(tree->src_root, path, O_RDONLY));
+            if (in < 0) {
+                PANIC("Could not open file %s: %s", PATH(tree->old_path, path), nobuild__strerror(errno));
+            }
+
+            struct stat statbuf = {0};
+            if (NOBUILD__STATS_CALL(STATS_STAT, fstat(in, &statbuf)) < 0) {
+                PANIC("Could not retrieve information about file %s: %s",
+                      PATH(tree->old_path, path), nobuild__strerror(errno));
+            }
+
+            // Like `atomic_file_open()`, but relative to the destination directory
+            char tmp_path[4096];
+            if ((size_t) snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%lu", path, tree->pid) >= sizeof(tmp_path)) {
+                PANIC("Path is too long: %s", path);
+            }
+            // Removed at exit when the copy panics before the rename
+            Cstr pending = PATH(tree->new_path, tmp_path);
+            nobuild__atomic_pending_add(pending);
+
+            Fd out = NOBUILD__STATS_CALL(STATS_OPEN, openat(tree->dst_root, tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600));
+            if (out < 0) {
+                PANIC("Could not open file %s: %s", tmp_path, nobuild__strerror(errno));
+            }
+
+            bytes += nobuild__copy_fd(in, out, path, path);
+            nobuild__copy_metadata(out, path, &statbuf, tree->flags);
+            close(in);
+            close(out);
+
+            if (renameat(tree->dst_root, tmp_path, tree->dst_root, path) < 0) {
+                PANIC("Could not rename %s to %s: %s", tmp_path, path, nobuild__strerror(errno));
+            }
+            nobuild__atomic_pending_remove(pending);
+            if (nobuild__atomic_sync_enabled()) {
+                nobuild__atomic_sync_push(PATH(tree->new_path, path));
+            }
+        }
+    }
+
+    mutex_lock(&tree->mutex);
+    tree->bytes += bytes;
+    mutex_unlock(&tree->mutex);
+    NOBUILD__STATS_COPIED(bytes);
+}
+
+static void nobuild__copy_tree(Cstr old_path, Cstr new_path, int flags, Copy_Stats *stats)
+{
+    if (nobuild__mkdir(new_path, 0700) < 0 && errno != EEXIST) {
+        PANIC("Could not create directory %s: %s", new_path, nobuild__strerror(errno));
+    }
+    errno = 0;
+
+    Nobuild__Copy_Tree tree = {0};
+    tree.old_path = old_path;
+    tree.new_path = new_path;
+    tree.flags = flags;
+    tree.pid = (unsigned long) getpid();
+    tree.src_root = NOBUILD__STATS_CALL(STATS_OPEN, open(old_path, O_RDONLY));
+    tree.dst_root = NOBUILD__STATS_CALL(STATS_OPEN, open(new_path, O_RDONLY));
+    if (tree.src_root < 0 || tree.dst_root < 0) {
+        PANIC("Could not open directory %s: %s", tree.src_root < 0 ? old_path : new_path, nobuild__strerror(errno));
+    }
+
+    nobuild__copy_tree_dir(&tree, ".", tree.src_root);
+    stats->dirs += 1;
+    nobuild__copy_tree_walk(&tree, dup(tree.src_root), dup(tree.dst_root), ".", stats);
+
+    size_t batches = (tree.files.count + NOBUILD__COPY_BATCH - 1) / NOBUILD__COPY_BATCH;
+    size_t workers = thread_count() < batches ? thread_count() : batches;
+    Thread *threads = NOBUILD__MALLOC(sizeof(*threads) * (workers ? workers : 1));
+    if (threads == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    mutex_init(&tree.mutex);
+    for (size_t i = 0; i < workers; ++i) {
+        threads[i] = thread_create(nobuild__copy_tree_worker, &tree);
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        thread_join(threads[i]);
+    }
+    mutex_destroy(&tree.mutex);
+    stats->bytes += tree.bytes;
+
+    // Children before parents, so read-only directories are locked only once they are full
+    for (size_t i = tree.dirs_count; i-- > 0;) {
+        Nobuild__Copy_Dir *dir = &tree.dirs[i];
+        Fd fd = NOBUILD__STATS_CALL(STATS_OPEN, openat(tree.dst_root, dir->path, O_RDONLY));
+        if (fd < 0) {
+            PANIC("Could not open directory %s: %s", PATH(new_path, dir->path), nobuild__strerror(errno));
+        }
+        nobuild__copy_metadata(fd, dir->path, &dir->statbuf, flags);
+        close(fd);
+    }
+
+    close(tree.src_root);
+    close(tree.dst_root);
+    free(threads);
+    free(tree.dirs);
+}
+#else
+static void nobuild__copy_tree(Cstr old_path, Cstr new_path, int flags, Copy_Stats *stats)
+{
+    if (nobuild__mkdir(new_path, 0755) < 0 && errno != EEXIST) {
+        PANIC("Could not create directory %s: %s", new_path, nobuild__strerror(errno));
+    }
+    errno = 0;
+    stats->dirs += 1;
+
+    FOREACH_FILE_IN_DIR(file, old_path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        Cstr old_child = PATH(old_path, file);
+        Cstr new_child = PATH(new_path, file);
+        if (IS_DIR(old_child)) {
+            nobuild__copy_tree(old_child, new_child, flags, stats);
+        } else {
+            stats->bytes += nobuild__copy_file(old_child, new_child, flags);
+            stats->files += 1;
+        }
+    });
+}
+#endif // _WIN32
+
+void path_copy(Cstr old_path, Cstr new_path)
+{
+    path_copy_ex(old_path, new_path, COPY_DEFAULT);
+}
+
+Copy_Stats path_copy_ex(Cstr old_path, Cstr new_path, int flags)
+{
+    Copy_Stats stats = {0};
+    double start = nobuild__now();
+
+    if (!IS_DIR(old_path)) {
+        stats.bytes = nobuild__copy_file(old_path, new_path, flags);
+        stats.files = 1;
+        stats.seconds = nobuild__now() - start;
+        return stats;
+    }
+
+    nobuild__copy_tree(old_path, new_path, flags, &stats);
+    stats.seconds = nobuild__now() - start;
+    TRACE("Copied %zu files, %zu directories and %zu symbolic links (%llu bytes) from %s to %s in %.3fs (%.1f MiB/s)",
+          stats.files, stats.dirs, stats.symlinks, stats.bytes, old_path, new_path, stats.seconds,
+          stats.seconds > 0 ? (double) stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0.0);
+
+    return stats;
+}
+
+static void nobuild__rm_missing(Cstr path, int is_dir)
+{
+    if (errno != ENOENT) {
+        PANIC("Could not remove %s %s: %s", is_dir ? "directory" : "file", path, nobuild__strerror(errno));
+    }
+
+    errno = 0;
+    WARN("%s %s does not exist", is_dir ? "Directory" : "File", path);
+}
+
+// Numbers the trash names of `RM_BACKGROUND`, which only the pid would not keep apart
+static unsigned long nobuild__rm_trash_count = 0;
+static Nobuild__Lock nobuild__rm_trash_lock = NOBUILD__LOCK_INIT;
+
+#ifndef _WIN32
+// The frontier is grown until it has this many directories per worker
+#define NOBUILD__RM_SPLIT 4
+#define NOBUILD__RM_SPLIT_DEPTH 3
+
+typedef struct {
+    Cstr_Array dirs;
+    size_t next;
+    Mutex mutex;
+} Nobuild__Rm_Tree;
+
+static int nobuild__rm_type(Fd dir_fd, struct dirent *dp, Cstr path)
+{
+    int type = NOBUILD__D_TYPE(dp);
+    if (type != DT_UNKNOWN) {
+        return type;
+    }
+
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstatat(dir_fd, dp->d_name, &statbuf, AT_SYMLINK_NOFOLLOW)) < 0) {
+        PANIC("Could not retrieve information about file %s: %s", PATH(path, dp->d_name), nobuild__strerror(errno));
+    }
+    return S_ISDIR(statbuf.st_mode) ? DT_DIR : DT_REG;
+}
+
+// Empties the directory `fd` opened at `path` and closes it. Subdirectories are
+// either removed in place or, when `subdirs` is given, only collected into it.
+static void nobuild__rm_contents(Fd fd, Cstr path, Cstr_Array *subdirs)
+{
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        PANIC("Could not open directory %s: %s", path, nobuild__strerror(errno));
+    }
+
+    struct dirent *dp = NULL;
+    errno = 0;
+    while ((dp = readdir(dir))) {
+        Cstr name = dp->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        if (nobuild__rm_type(fd, dp, path) != DT_DIR) {
+            if (unlinkat(fd, name, 0) < 0 && errno != ENOENT) {
+                PANIC("Could not remove file %s: %s", PATH(path, name), nobuild__strerror(errno));
+            }
+        } else if (subdirs != NULL) {
+            *subdirs = cstr_array_append(*subdirs, PATH(path, name));
+        } else {
+            Cstr child_path = PATH(path, name);
+            Fd child = NOBUILD__STATS_CALL(STATS_OPEN, openat(fd, name, O_RDONLY));
+            if (child < 0) {
+                PANIC("Could not open directory %s: %s", child_path, nobuild__strerror(errno));
+            }
+
+            nobuild__rm_contents(child, child_path, NULL);
+            if (unlinkat(fd, name, AT_REMOVEDIR) < 0 && errno != ENOENT) {
+                PANIC("Could not remove directory %s: %s", child_path, nobuild__strerror(errno));
+            }
+        }
+        errno = 0;
+    }
+
+    if (errno > 0) {
+        PANIC("Could not read directory %s: %s", path, nobuild__strerror(errno));
+    }
+    closedir(dir);
+}
+
+static void nobuild__rm_worker(void *data)
+{
+    Nobuild__Rm_Tree *tree = data;
+    for (;;) {
+        mutex_lock(&tree->mutex);
+        size_t i = tree->next++;
+        mutex_unlock(&tree->mutex);
+
+        if (i >= tree->dirs.count) {
+            break;
+        }
+
+        Cstr path = tree->dirs.elems[i];
+        Fd fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+        if (fd < 0) {
+            PANIC("Could not open directory %s: %s", path, nobuild__strerror(errno));
+        }
+
+        nobuild__rm_contents(fd, path, NULL);
+        if (nobuild__rmdir(path) < 0 && errno != ENOENT) {
+            PANIC("Could not remove directory %s: %s", path, nobuild__strerror(errno));
+        }
+    }
+}
+
+static void nobuild__rm_tree(Cstr path)
+{
+    const size_t workers = thread_count();
+
+    // Split the top of the tree into enough directories to keep the workers busy,
+    // deleting the files found on the way. The split directories are removed last.
+    Cstr_Array split = {0};
+    Cstr_Array frontier = cstr_array_make(path, NULL);
+    for (size_t depth = 0; depth < NOBUILD__RM_SPLIT_DEPTH && frontier.count > 0
+         && frontier.count < workers * NOBUILD__RM_SPLIT; ++depth) {
+        Cstr_Array next = {0};
+        for (size_t i = 0; i < frontier.count; ++i) {
+            Fd fd = NOBUILD__STATS_CALL(STATS_OPEN, open(frontier.elems[i], O_RDONLY));
+            if (fd < 0) {
+                PANIC("Could not open directory %s: %s", frontier.elems[i], nobuild__strerror(errno));
+            }
+
+            nobuild__rm_contents(fd, frontier.elems[i], &next);
+            split = cstr_array_append(split, frontier.elems[i]);
+        }
+
+        frontier = next;
+    }
+
+    Nobuild__Rm_Tree tree = {0};
+    tree.dirs = frontier;
+    size_t count = workers < frontier.count ? workers : frontier.count;
+    Thread *threads = NOBUILD__MALLOC(sizeof(*threads) * (count ? count : 1));
+    if (threads == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    mutex_init(&tree.mutex);
+    for (size_t i = 0; i < count; ++i) {
+        threads[i] = thread_create(nobuild__rm_worker, &tree);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        thread_join(threads[i]);
+    }
+    mutex_destroy(&tree.mutex);
+
+    for (size_t i = split.count; i-- > 0;) {
+        if (nobuild__rmdir(split.elems[i]) < 0 && errno != ENOENT) {
+            PANIC("Could not remove directory %s: %s", split.elems[i], nobuild__strerror(errno));
+        }
+    }
+    errno = 0;
+
+    free(threads);
+}
+
+// Points the standard streams at /dev/null and closes every other descriptor, so
+// that the background deleter does not keep the pipes of its parent open and
+// `./nobuild | cat` returns without waiting for the delete
+static void nobuild__rm_detach_fds(void)
+{
+    Fd null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO) {
+            close(null_fd);
+        }
+    }
+
+#	ifdef __linux__
+    Fd fds_fd = open("/proc/self/fd", O_RDONLY);
+    DIR *fds = fds_fd >= 0 ? fdopendir(fds_fd) : NULL;
+    if (fds != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(fds)) != NULL) {
+            int fd = atoi(entry->d_name);
+            if (fd > STDERR_FILENO && fd != fds_fd) {
+                close(fd);
+            }
+        }
+        closedir(fds);
+        return;
+    }
+#	endif
+
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    for (long fd = STDERR_FILENO + 1; fd < max_fd; ++fd) {
+        close((int) fd);
+    }
+}
+
+static void nobuild__rm_background(Cstr path)
+{
+    // Stay on the same filesystem so the rename cannot fail with EXDEV. A name left
+    // behind by an earlier process with the same pid is skipped.
+    Cstr trash = NULL;
+    struct stat statbuf = {0};
+    for (;;) {
+        NOBUILD__LOCK(&nobuild__rm_trash_lock);
+        unsigned long count = nobuild__rm_trash_count++;
+        NOBUILD__UNLOCK(&nobuild__rm_trash_lock);
+
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".trash.%ld.%lu", (long) getpid(), count);
+        trash = PATH(DIRNAME(path), CONCAT(".", BASENAME(path), suffix));
+        if (NOBUILD__STATS_CALL(STATS_STAT, lstat(trash, &statbuf)) == 0) {
+            continue;
+        }
+        if (rename(path, trash) == 0) {
+            break;
+        }
+        if (errno == ENOTEMPTY || errno == EEXIST) {
+            continue;
+        }
+        if (errno == ENOENT) {
+            nobuild__rm_missing(path, 0);
+            return;
+        }
+        PANIC("Could not rename %s to %s: %s", path, trash, nobuild__strerror(errno));
+    }
+
+    // Fork twice so the process deleting the trash is adopted by init and never
+    // has to be waited for
+    Pid child = NOBUILD__STATS_CALL(STATS_FORK, fork());
+    if (child < 0) {
+        WARN("Could not fork a background process to delete %s: %s", trash, nobuild__strerror(errno));
+        errno = 0;
+        path_rm_ex(trash, RM_DEFAULT);
+        return;
+    }
+
+    if (child == 0) {
+        if (NOBUILD__STATS_CALL(STATS_FORK, fork()) == 0) {
+            setsid();
+            nobuild__rm_detach_fds();
+            log_set_level(LOG_ERRO);
+            path_rm_ex(trash, RM_DEFAULT);
+        }
+        _exit(0);
+    }
+
+    pid_wait(child);
+}
+#else
+static void nobuild__rm_tree(Cstr path)
+{
+    FOREACH_FILE_IN_DIR(file, path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        Cstr child = PATH(path, file);
+        if (IS_DIR(child)) {
+            nobuild__rm_tree(child);
+        } else if (nobuild__unlink(child) < 0) {
+            nobuild__rm_missing(child, 0);
+        }
+    });
+
+    if (nobuild__rmdir(path) < 0) {
+        nobuild__rm_missing(path, 1);
+    }
+}
+
+static void nobuild__rm_background(Cstr path)
+{
+    // Without MOVEFILE_REPLACE_EXISTING the move fails on a name that is taken, and
+    // the next one is tried
+    Cstr trash = NULL;
+    for (;;) {
+        NOBUILD__LOCK(&nobuild__rm_trash_lock);
+        unsigned long count = nobuild__rm_trash_count++;
+        NOBUILD__UNLOCK(&nobuild__rm_trash_lock);
+
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".trash.%lu.%lu", (unsigned long) GetCurrentProcessId(), count);
+        trash = PATH(DIRNAME(path), CONCAT(".", BASENAME(path), suffix));
+        if (MoveFileEx(path, trash, 0)) {
+            break;
+        }
+        if (GetLastError() != ERROR_ALREADY_EXISTS) {
+            PANIC("Could not rename %s to %s: %s", path, trash, nobuild__GetLastErrorAsString());
+        }
+    }
+
+    Cstr command = IS_DIR(trash) ? CONCAT("cmd /c rmdir /s /q \"", trash, "\"")
+                                 : CONCAT("cmd /c del /f /q \"", trash, "\"");
+
+    STARTUPINFO siStartInfo;
+    ZeroMemory(&siStartInfo, sizeof(siStartInfo));
+    siStartInfo.cb = sizeof(STARTUPINFO);
+    PROCESS_INFORMATION piProcInfo;
+    ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
+
+    if (!NOBUILD__STATS_CALL(STATS_FORK, CreateProcess(NULL, (LPSTR) command, NULL, NULL, FALSE, DETACHED_PROCESS | CREATE_NO_WINDOW,
+                                                       NULL, NULL, &siStartInfo, &piProcInfo))) {
+        WARN("Could not start a background process to delete %s: %s", trash, nobuild__GetLastErrorAsString());
+        path_rm_ex(trash, RM_DEFAULT);
+        return;
+    }
+
+    CloseHandle(piProcInfo.hThread);
+    CloseHandle(piProcInfo.hProcess);
+}
+#endif // _WIN32
+
+void path_rm(Cstr path)
+{
+    path_rm_ex(path, RM_DEFAULT);
+}
+
+void path_rm_ex(Cstr path, int flags)
+{
+    if (flags & RM_BACKGROUND) {
+        nobuild__rm_background(path);
+        return;
+    }
+
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, lstat(path, &statbuf)) < 0) {
+        nobuild__rm_missing(path, 0);
+        return;
+    }
+    int is_dir = S_ISDIR(statbuf.st_mode);
+#else
+    int is_dir = IS_DIR(path);
+#endif // _WIN32
+
+    if (is_dir) {
+        nobuild__rm_tree(path);
+    } else if (nobuild__unlink(path) < 0) {
+        nobuild__rm_missing(path, 0);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	include <dirent.h>
+#else
+#	include <direct.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_EMBED
+
+// Size of the blocks read from the embedded file
+#define NOBUILD__EMBED_READ_SIZE (1024 * 1024)
+
+// Size of the buffer the generated source is formatted into before being written out
+#define NOBUILD__EMBED_WRITE_SIZE (512 * 1024)
+
+// Bytes per row of the generated array and the size of a single formatted row
+#define NOBUILD__EMBED_ROW 16
+#define NOBUILD__EMBED_CELL 6
+#define NOBUILD__EMBED_ROW_SIZE (1 + NOBUILD__EMBED_ROW * NOBUILD__EMBED_CELL + 1)
+
+// Bytes per string literal of C_ARRAY_STRING and the worst case size of a line
+#define NOBUILD__EMBED_LITERAL 64
+#define NOBUILD__EMBED_LITERAL_SIZE (2 + NOBUILD__EMBED_LITERAL * 4 + 2)
+
+typedef struct {
+    Fd fd;
+    Cstr path;
+    char *elems;
+    size_t count;
+} Nobuild__Embed_Writer;
 
-    // Last character is not a separator
-    if (*(last_sep + 1) != '\0') {
-        size_t len = strlen(last_sep + 1);
-        char* basename = malloc(len + 1);
-        if (basename == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-
-        return basename[len] = '\0', memcpy(basename, last_sep + 1, len);
+// Every byte is formatted as "0x%02x, ", so precompute all 256 cells once and
+// copy them instead of going through printf for each byte.
+static char nobuild__embed_cells[256][NOBUILD__EMBED_CELL];
+
+// Escape sequences for C_ARRAY_STRING. Octal escapes are always 3 digits wide so
+// that they can not swallow a following digit, and '?' is escaped to avoid
+// accidentally forming trigraphs.
+static char nobuild__embed_escapes[256][4];
+static unsigned char nobuild__embed_escapes_len[256];
+
+static void nobuild__embed_cells_init(void)
+{
+    static int initialized = 0;
+    if (initialized) {
+        return;
+    }
+
+    const char *digits = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+        memcpy(nobuild__embed_cells[i], "0x00, ", NOBUILD__EMBED_CELL);
+        nobuild__embed_cells[i][2] = digits[i >> 4];
+        nobuild__embed_cells[i][3] = digits[i & 0xf];
+
+        char *escape = nobuild__embed_escapes[i];
+        if (i == '"' || i == '\\' || i == '?') {
+            escape[0] = '\\';
+            escape[1] = (char) i;
+            nobuild__embed_escapes_len[i] = 2;
+        } else if (i >= 0x20 && i < 0x7f) {
+            escape[0] = (char) i;
+            nobuild__embed_escapes_len[i] = 1;
+        } else {
+            escape[0] = '\\';
+            escape[1] = (char) ('0' + ((i >> 6) & 7));
+            escape[2] = (char) ('0' + ((i >> 3) & 7));
+            escape[3] = (char) ('0' + (i & 7));
+            nobuild__embed_escapes_len[i] = 4;
+        }
+    }
+    initialized = 1;
+}
+
+static void nobuild__embed_flush(Nobuild__Embed_Writer *writer)
+{
+    size_t written = 0;
+    while (written < writer->count) {
+        size_t n = fd_write(writer->fd, writer->elems + written, (unsigned long) (writer->count - written));
+        if (n == 0) {
+            PANIC("Could not write to %s", writer->path);
+        }
+        written += n;
+    }
+    writer->count = 0;
+}
+
+static void nobuild__embed_write(Nobuild__Embed_Writer *writer, Cstr data, size_t size)
+{
+    if (writer->count + size > NOBUILD__EMBED_WRITE_SIZE) {
+        nobuild__embed_flush(writer);
+    }
+
+    if (size > NOBUILD__EMBED_WRITE_SIZE) {
+        size_t written = 0;
+        while (written < size) {
+            size_t n = fd_write(writer->fd, (void *) (data + written), (unsigned long) (size - written));
+            if (n == 0) {
+                PANIC("Could not write to %s", writer->path);
+            }
+            written += n;
+        }
+        return;
+    }
+
+    memcpy(writer->elems + writer->count, data, size);
+    writer->count += size;
+}
+
+// Formats `size` bytes as rows of hex cells. `column` carries the position in
+// the current row across calls so that short reads do not break up the rows.
+static void nobuild__embed_write_bytes(Nobuild__Embed_Writer *writer, const unsigned char *bytes, size_t size, size_t *column)
+{
+    size_t i = 0;
+    while (i < size) {
+        if (writer->count + NOBUILD__EMBED_ROW_SIZE > NOBUILD__EMBED_WRITE_SIZE) {
+            nobuild__embed_flush(writer);
+        }
+
+        char *out = writer->elems + writer->count;
+
+        // Fast path: a whole row is available
+        if (*column == 0 && size - i >= NOBUILD__EMBED_ROW) {
+            *out++ = '\t';
+            for (size_t j = 0; j < NOBUILD__EMBED_ROW; ++j) {
+                memcpy(out, nobuild__embed_cells[bytes[i + j]], NOBUILD__EMBED_CELL);
+                out += NOBUILD__EMBED_CELL;
+            }
+            *out++ = '\n';
+            writer->count += NOBUILD__EMBED_ROW_SIZE;
+            i += NOBUILD__EMBED_ROW;
+            continue;
+        }
+
+        if (*column == 0) {
+            *out++ = '\t';
+        }
+        while (i < size && *column < NOBUILD__EMBED_ROW) {
+            memcpy(out, nobuild__embed_cells[bytes[i++]], NOBUILD__EMBED_CELL);
+            out += NOBUILD__EMBED_CELL;
+            *column += 1;
+        }
+        if (*column == NOBUILD__EMBED_ROW) {
+            *out++ = '\n';
+            *column = 0;
+        }
+        writer->count = (size_t) (out - writer->elems);
+    }
+}
+
+static void nobuild__embed_write_cstr(Nobuild__Embed_Writer *writer, Cstr cstr)
+{
+    nobuild__embed_write(writer, cstr, strlen(cstr));
+}
+
+static void nobuild__embed_printf(Nobuild__Embed_Writer *writer, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+
+// Only meant for short lines, anything longer than the buffer is truncated
+static void nobuild__embed_printf(Nobuild__Embed_Writer *writer, const char *fmt, ...)
+{
+    char line[512];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        PANIC("Could not format output for %s", writer->path);
+    }
+
+    nobuild__embed_write(writer, line, (size_t) len < sizeof(line) ? (size_t) len : sizeof(line) - 1);
+}
+
+// Formats `size` bytes as chunked string literals, one per line
+static void nobuild__embed_write_literals(Nobuild__Embed_Writer *writer, const unsigned char *bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i += NOBUILD__EMBED_LITERAL) {
+        if (writer->count + NOBUILD__EMBED_LITERAL_SIZE > NOBUILD__EMBED_WRITE_SIZE) {
+            nobuild__embed_flush(writer);
+        }
+
+        char *out = writer->elems + writer->count;
+        *out++ = '\t';
+        *out++ = '"';
+        for (size_t j = i; j < size && j < i + NOBUILD__EMBED_LITERAL; ++j) {
+            memcpy(out, nobuild__embed_escapes[bytes[j]], 4);
+            out += nobuild__embed_escapes_len[bytes[j]];
+        }
+        *out++ = '"';
+        *out++ = '\n';
+        writer->count = (size_t) (out - writer->elems);
+    }
+}
+
+static unsigned long nobuild__embed_fd_size(Fd fd, Cstr path)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0) {
+        PANIC("Could not retrieve information about file %s: %s", path, nobuild__strerror(errno));
+    }
+    return (unsigned long) statbuf.st_size;
+#else
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fd, &size)) {
+        PANIC("Could not retrieve size of file %s: %s", path, nobuild__GetLastErrorAsString());
+    }
+    return (unsigned long) size.QuadPart;
+#endif // _WIN32
+}
+
+// Returns `path` as an absolute path, so that it can be referenced from a
+// generated source that lives in another directory.
+static Cstr nobuild__embed_abs_path(Cstr path)
+{
+#ifndef _WIN32
+    if (path[0] != '/') {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            PANIC("Could not retrieve current working directory: %s", nobuild__strerror(errno));
+        }
+        return PATH(cwd, path);
+    }
+#else
+    if (path[0] != '\\' && !(path[0] != '\0' && path[1] == ':')) {
+        char cwd[MAX_PATH];
+        if (_getcwd(cwd, sizeof(cwd)) == NULL) {
+            PANIC("Could not retrieve current working directory: %s", nobuild__strerror(errno));
+        }
+        return PATH(cwd, path);
+    }
+#endif // _WIN32
+
+    return path;
+}
+
+// Escapes quotes and backslashes so `cstr` can be placed inside a string literal
+static Cstr nobuild__embed_escape(Cstr cstr)
+{
+    size_t len = strlen(cstr);
+    char *escaped = temp_alloc(len * 2 + 1);
+
+    size_t count = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (cstr[i] == '"' || cstr[i] == '\\') {
+            escaped[count++] = '\\';
+        }
+        escaped[count++] = cstr[i];
+    }
+    escaped[count] = '\0';
+
+    return escaped;
+}
+
+// Streams `file` into the writer as the body of a C_ARRAY_BYTES array
+static unsigned long nobuild__embed_array_body(Nobuild__Embed_Writer *writer, Fd file, unsigned char *input, int null_term)
+{
+    unsigned long total_bytes_read = 0;
+    size_t column = 0;
+    for (;;) {
+        size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+        if (bytes_read == 0) {
+            break;
+        }
+
+        nobuild__embed_write_bytes(writer, input, bytes_read, &column);
+        total_bytes_read += (unsigned long) bytes_read;
+    }
+
+    if (column > 0) {
+        nobuild__embed_write(writer, "\n", 1);
+    }
+
+    if (null_term) {
+        nobuild__embed_write_cstr(writer, "\t0x00 /* Terminate with null */\n");
+        total_bytes_read++;
+    }
+
+    return total_bytes_read;
+}
+
+void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term)
+{
+    file_to_c_array_format(path, out_path, array_type, array_name, null_term, C_ARRAY_BYTES);
+}
+
+void file_to_c_array_format(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term, C_Array_Format format)
+{
+    nobuild__embed_cells_init();
+
+    unsigned char *input = NOBUILD__MALLOC(NOBUILD__EMBED_READ_SIZE);
+    char *output = NOBUILD__MALLOC(NOBUILD__EMBED_WRITE_SIZE);
+    if (input == NULL || output == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    Fd file = fd_open_for_read(path);
+    Atomic_File out = atomic_file_open(out_path);
+    Nobuild__Embed_Writer writer = {
+        .fd = out.fd,
+        .path = out_path,
+        .elems = output,
+    };
+
+    switch (format) {
+    case C_ARRAY_BYTES: {
+        nobuild__embed_write_cstr(&writer, JOIN(" ", array_type, CONCAT(array_name, "[] = {\n")));
+        unsigned long len = nobuild__embed_array_body(&writer, file, input, null_term);
+        nobuild__embed_write_cstr(&writer, "};\n");
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "unsigned long %s_len = %lu;\n", array_name, len);
+    }
+    break;
+
+    case C_ARRAY_STRING: {
+        // Without a null terminator the array is sized to drop the implicit one of the literal,
+        // except for an empty file where it keeps it since C has no zero length arrays
+        unsigned long size = nobuild__embed_fd_size(file, path);
+        unsigned long len = size + (null_term ? 1 : 0);
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "%s %s[%lu] =\n", array_type, array_name, len > 0 ? len : 1);
+
+        unsigned long total_bytes_read = 0;
+        for (;;) {
+            size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+            if (bytes_read == 0) {
+                break;
+            }
+
+            nobuild__embed_write_literals(&writer, input, bytes_read);
+            total_bytes_read += (unsigned long) bytes_read;
+        }
+
+        if (total_bytes_read != size) {
+            PANIC("File %s changed size while being embedded", path);
+        }
+
+        nobuild__embed_write_cstr(&writer, total_bytes_read == 0 ? "\t\"\";\n" : ";\n");
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "unsigned long %s_len = %lu;\n", array_name, len);
+    }
+    break;
+
+    case C_ARRAY_INCBIN: {
+        unsigned long size = nobuild__embed_fd_size(file, path);
+        // The path is quoted once for the assembler and once more for the C compiler
+        Cstr quoted_path = nobuild__embed_escape(nobuild__embed_escape(nobuild__embed_abs_path(path)));
+        Cstr terminator = null_term ? "    \"  .byte 0\\n\"\n" : "";
+
+        fd_printf(writer.fd,
+                  "#if defined(_MSC_VER) && !defined(__clang__)\n"
+                  "#    error \"%s: the incbin format requires a GNU compatible compiler\"\n"
+                  "#endif\n"
+                  "\n"
+                  "#ifdef __APPLE__\n"
+                  "__asm__(\n"
+                  "    \"  .pushsection __TEXT,__const\\n\"\n"
+                  "    \"  .globl _%s\\n\"\n"
+                  "    \"  .balign 16\\n\"\n"
+                  "    \"_%s:\\n\"\n"
+                  "    \"  .incbin \\\"%s\\\"\\n\"\n"
+                  "%s"
+                  "    \"  .popsection\\n\"\n"
+                  ");\n"
+                  "#else\n"
+                  "__asm__(\n"
+                  "    \"  .pushsection .rodata\\n\"\n"
+                  "    \"  .globl %s\\n\"\n"
+                  "    \"  .type %s, %%object\\n\"\n"
+                  "    \"  .size %s, %lu\\n\"\n"
+                  "    \"  .balign 16\\n\"\n"
+                  "    \"%s:\\n\"\n"
+                  "    \"  .incbin \\\"%s\\\"\\n\"\n"
+                  "%s"
+                  "    \"  .popsection\\n\"\n"
+                  ");\n"
+                  "#endif\n"
+                  "\n"
+                  "extern const %s %s[];\n"
+                  "unsigned long %s_len = %lu;\n",
+                  array_name,
+                  array_name, array_name, quoted_path, terminator,
+                  array_name, array_name, array_name, size + (null_term ? 1 : 0), array_name, quoted_path, terminator,
+                  array_type, array_name,
+                  array_name, size + (null_term ? 1 : 0));
     }
+    break;
+
+    case C_ARRAY_EMBED: {
+        // The header name of `#embed` has no escape sequences, so the path goes in as is
+        Cstr embed_path = nobuild__embed_abs_path(path);
+        if (strpbrk(embed_path, "\"\n") != NULL) {
+            PANIC("Could not embed %s: paths with quotes or newlines cannot be used with #embed", path);
+        }
+
+        fd_printf(writer.fd,
+                  "#if defined(__has_embed)\n"
+                  "%s %s[] = {\n"
+                  "#embed \"%s\"%s\n"
+                  "%s"
+                  "};\n"
+                  "#else\n",
+                  array_type, array_name,
+                  embed_path, null_term ? " suffix(,)" : "",
+                  null_term ? "\t0x00 /* Terminate with null */\n" : "");
+
+        nobuild__embed_write_cstr(&writer, JOIN(" ", array_type, CONCAT(array_name, "[] = {\n")));
+        nobuild__embed_array_body(&writer, file, input, null_term);
+        nobuild__embed_write_cstr(&writer, "};\n#endif\n");
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "unsigned long %s_len = sizeof(%s) / sizeof(%s[0]);\n", array_name, array_name, array_name);
+    }
+    break;
+
+    default: {
+        PANIC("Unknown C array format %d", (int) format);
+    }
+    }
+
+    fd_close(file);
+    atomic_file_commit(&out);
+    free(input);
+    free(output);
+}
+
+// ELF64 constants used by `file_to_object()`
+#define NOBUILD__ELF_HEADER_SIZE 64
+#define NOBUILD__ELF_SECTION_SIZE 64
+#define NOBUILD__ELF_SYMBOL_SIZE 24
+#define NOBUILD__ELF_SECTION_COUNT 6
+
+#if defined(__ELF__) && defined(__x86_64__)
+#	define NOBUILD__ELF_MACHINE 62 // EM_X86_64
+#	define NOBUILD__ELF_FLAGS 0
+#elif defined(__ELF__) && defined(__aarch64__) && !defined(__AARCH64EB__)
+#	define NOBUILD__ELF_MACHINE 183 // EM_AARCH64
+#	define NOBUILD__ELF_FLAGS 0
+#elif defined(__ELF__) && defined(__riscv) && __riscv_xlen == 64
+#	define NOBUILD__ELF_MACHINE 243 // EM_RISCV
+#	if defined(__riscv_float_abi_double)
+#		define NOBUILD__ELF_FLOAT_ABI 0x4
+#	elif defined(__riscv_float_abi_single)
+#		define NOBUILD__ELF_FLOAT_ABI 0x2
+#	else
+#		define NOBUILD__ELF_FLOAT_ABI 0x0
+#	endif
+#	if defined(__riscv_compressed)
+#		define NOBUILD__ELF_FLAGS (NOBUILD__ELF_FLOAT_ABI | 0x1)
+#	else
+#		define NOBUILD__ELF_FLAGS NOBUILD__ELF_FLOAT_ABI
+#	endif
+#else
+#	define NOBUILD__ELF_MACHINE 0
+#	define NOBUILD__ELF_FLAGS 0
+#endif
+
+// Little endian encoders for the ELF structures
+static char *nobuild__elf_u8(char *out, unsigned char value)
+{
+    *out++ = (char) value;
+    return out;
+}
+
+static char *nobuild__elf_u16(char *out, unsigned int value)
+{
+    for (int i = 0; i < 2; ++i) {
+        *out++ = (char) ((value >> (8 * i)) & 0xff);
+    }
+    return out;
+}
+
+static char *nobuild__elf_u32(char *out, unsigned long value)
+{
+    for (int i = 0; i < 4; ++i) {
+        *out++ = (char) ((value >> (8 * i)) & 0xff);
+    }
+    return out;
+}
+
+static char *nobuild__elf_u64(char *out, unsigned long long value)
+{
+    for (int i = 0; i < 8; ++i) {
+        *out++ = (char) ((value >> (8 * i)) & 0xff);
+    }
+    return out;
+}
+
+static char *nobuild__elf_section(char *out, unsigned long name, unsigned long type, unsigned long long flags,
+                                  unsigned long long offset, unsigned long long size, unsigned long link,
+                                  unsigned long info, unsigned long long align, unsigned long long entsize)
+{
+    out = nobuild__elf_u32(out, name);
+    out = nobuild__elf_u32(out, type);
+    out = nobuild__elf_u64(out, flags);
+    out = nobuild__elf_u64(out, 0); // sh_addr
+    out = nobuild__elf_u64(out, offset);
+    out = nobuild__elf_u64(out, size);
+    out = nobuild__elf_u32(out, link);
+    out = nobuild__elf_u32(out, info);
+    out = nobuild__elf_u64(out, align);
+    out = nobuild__elf_u64(out, entsize);
+    return out;
+}
+
+static char *nobuild__elf_symbol(char *out, unsigned long name, unsigned long long value, unsigned long long size)
+{
+    out = nobuild__elf_u32(out, name);
+    out = nobuild__elf_u8(out, 0x11); // STB_GLOBAL, STT_OBJECT
+    out = nobuild__elf_u8(out, 0);    // STV_DEFAULT
+    out = nobuild__elf_u16(out, 1);   // .rodata
+    out = nobuild__elf_u64(out, value);
+    out = nobuild__elf_u64(out, size);
+    return out;
+}
+
+#define NOBUILD__ALIGN(n, alignment) (((n) + (alignment) - 1) / (alignment) * (alignment))
+
+// A global object defined in the `.rodata` section of a generated object
+typedef struct {
+    Cstr name;
+    unsigned long long offset;
+    unsigned long long size;
+} Nobuild__Elf_Symbol;
+
+static const char nobuild__elf_shstrtab[] = "\0.rodata\0.note.GNU-stack\0.symtab\0.strtab\0.shstrtab";
+
+typedef struct {
+    unsigned long long rodata_size;
+    unsigned long long symtab_offset;
+    unsigned long long symtab_size;
+    unsigned long long strtab_offset;
+    unsigned long long strtab_size;
+    unsigned long long shstrtab_offset;
+    unsigned long long sections_offset;
+} Nobuild__Elf_Layout;
+
+static Nobuild__Elf_Layout nobuild__elf_layout(unsigned long long rodata_size, const Nobuild__Elf_Symbol *symbols, size_t symbols_count)
+{
+    Nobuild__Elf_Layout layout = { .rodata_size = rodata_size };
+
+    layout.strtab_size = 1;
+    for (size_t i = 0; i < symbols_count; ++i) {
+        layout.strtab_size += strlen(symbols[i].name) + 1;
+    }
+
+    layout.symtab_offset = NOBUILD__ALIGN(NOBUILD__ELF_HEADER_SIZE + rodata_size, 8);
+    layout.symtab_size = (symbols_count + 1) * NOBUILD__ELF_SYMBOL_SIZE;
+    layout.strtab_offset = layout.symtab_offset + layout.symtab_size;
+    layout.shstrtab_offset = layout.strtab_offset + layout.strtab_size;
+    layout.sections_offset = NOBUILD__ALIGN(layout.shstrtab_offset + sizeof(nobuild__elf_shstrtab), 8);
+    return layout;
+}
+
+// Writes the ELF header. The caller must then write exactly `layout.rodata_size`
+// bytes of `.rodata` contents before calling `nobuild__elf_end()`.
+static void nobuild__elf_begin(Nobuild__Embed_Writer *writer, Nobuild__Elf_Layout layout)
+{
+    if (NOBUILD__ELF_MACHINE == 0) {
+        PANIC("Could not write object file %s: ELF objects are not supported on this target", writer->path);
+    }
+
+    char header[NOBUILD__ELF_HEADER_SIZE] = {0};
+    char *out = header;
+    memcpy(out, "\x7f" "ELF", 4);
+    out += 4;
+    out = nobuild__elf_u8(out, 2); // ELFCLASS64
+    out = nobuild__elf_u8(out, 1); // ELFDATA2LSB
+    out = nobuild__elf_u8(out, 1); // EV_CURRENT
+    out += 9;                      // ELFOSABI_NONE and padding
+    out = nobuild__elf_u16(out, 1); // ET_REL
+    out = nobuild__elf_u16(out, NOBUILD__ELF_MACHINE);
+    out = nobuild__elf_u32(out, 1); // EV_CURRENT
+    out = nobuild__elf_u64(out, 0); // e_entry
+    out = nobuild__elf_u64(out, 0); // e_phoff
+    out = nobuild__elf_u64(out, layout.sections_offset);
+    out = nobuild__elf_u32(out, NOBUILD__ELF_FLAGS);
+    out = nobuild__elf_u16(out, NOBUILD__ELF_HEADER_SIZE);
+    out = nobuild__elf_u16(out, 0); // e_phentsize
+    out = nobuild__elf_u16(out, 0); // e_phnum
+    out = nobuild__elf_u16(out, NOBUILD__ELF_SECTION_SIZE);
+    out = nobuild__elf_u16(out, NOBUILD__ELF_SECTION_COUNT);
+    out = nobuild__elf_u16(out, NOBUILD__ELF_SECTION_COUNT - 1); // .shstrtab
+    nobuild__embed_write(writer, header, sizeof(header));
+}
+
+// Writes the symbol table, the string tables and the section headers
+static void nobuild__elf_end(Nobuild__Embed_Writer *writer, Nobuild__Elf_Layout layout, const Nobuild__Elf_Symbol *symbols, size_t symbols_count)
+{
+    char scratch[NOBUILD__ELF_SECTION_SIZE * NOBUILD__ELF_SECTION_COUNT] = {0};
+    nobuild__embed_write(writer, scratch, (size_t) (layout.symtab_offset - NOBUILD__ELF_HEADER_SIZE - layout.rodata_size));
+
+    // .symtab
+    nobuild__embed_write(writer, scratch, NOBUILD__ELF_SYMBOL_SIZE);
+    unsigned long name = 1;
+    for (size_t i = 0; i < symbols_count; ++i) {
+        char *out = nobuild__elf_symbol(scratch, name, symbols[i].offset, symbols[i].size);
+        nobuild__embed_write(writer, scratch, (size_t) (out - scratch));
+        name += (unsigned long) strlen(symbols[i].name) + 1;
+    }
+
+    // .strtab and .shstrtab
+    nobuild__embed_write(writer, "", 1);
+    for (size_t i = 0; i < symbols_count; ++i) {
+        nobuild__embed_write(writer, symbols[i].name, strlen(symbols[i].name) + 1);
+    }
+    nobuild__embed_write(writer, nobuild__elf_shstrtab, sizeof(nobuild__elf_shstrtab));
+    memset(scratch, 0, sizeof(scratch));
+    nobuild__embed_write(writer, scratch, (size_t) (layout.sections_offset - layout.shstrtab_offset - sizeof(nobuild__elf_shstrtab)));
+
+    // Section headers. The names are offsets into `nobuild__elf_shstrtab`
+    char *out = scratch + NOBUILD__ELF_SECTION_SIZE;
+    out = nobuild__elf_section(out, 1, 1, 0x2, NOBUILD__ELF_HEADER_SIZE, layout.rodata_size, 0, 0, 16, 0);     // .rodata: SHT_PROGBITS, SHF_ALLOC
+    out = nobuild__elf_section(out, 9, 1, 0, layout.symtab_offset, 0, 0, 0, 1, 0);                            // .note.GNU-stack
+    out = nobuild__elf_section(out, 25, 2, 0, layout.symtab_offset, layout.symtab_size, 4, 1, 8,
+                               NOBUILD__ELF_SYMBOL_SIZE);                                                      // .symtab: SHT_SYMTAB
+    out = nobuild__elf_section(out, 33, 3, 0, layout.strtab_offset, layout.strtab_size, 0, 0, 1, 0);          // .strtab: SHT_STRTAB
+    out = nobuild__elf_section(out, 41, 3, 0, layout.shstrtab_offset, sizeof(nobuild__elf_shstrtab), 0, 0, 1, 0); // .shstrtab: SHT_STRTAB
+    nobuild__embed_write(writer, scratch, (size_t) (out - scratch));
+}
+
+// Streams `file` into the writer, returning the number of bytes read
+static unsigned long long nobuild__embed_copy(Nobuild__Embed_Writer *writer, Fd file, unsigned char *input)
+{
+    unsigned long long total_bytes_read = 0;
+    for (;;) {
+        size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+        if (bytes_read == 0) {
+            break;
+        }
+
+        nobuild__embed_write(writer, (Cstr) input, bytes_read);
+        total_bytes_read += bytes_read;
+    }
+    return total_bytes_read;
+}
+
+static void nobuild__embed_zeros(Nobuild__Embed_Writer *writer, size_t count)
+{
+    static const char zeros[64] = {0};
+    while (count > 0) {
+        size_t n = count < sizeof(zeros) ? count : sizeof(zeros);
+        nobuild__embed_write(writer, zeros, n);
+        count -= n;
+    }
+}
+
+void file_to_object(Cstr path, Cstr out_path, Cstr symbol, int null_term)
+{
+    unsigned char *input = NOBUILD__MALLOC(NOBUILD__EMBED_READ_SIZE);
+    char *output = NOBUILD__MALLOC(NOBUILD__EMBED_WRITE_SIZE);
+    if (input == NULL || output == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    Fd file = fd_open_for_read(path);
+    unsigned long long size = nobuild__embed_fd_size(file, path);
+    unsigned long long len = size + (null_term ? 1 : 0);
+
+    // .rodata holds the blob followed by the 8 byte aligned `symbol_len`
+    const unsigned long long len_offset = NOBUILD__ALIGN(len, 8);
+    Nobuild__Elf_Symbol symbols[] = {
+        { .name = symbol, .offset = 0, .size = len },
+        { .name = CONCAT(symbol, "_len"), .offset = len_offset, .size = 8 },
+    };
+    Nobuild__Elf_Layout layout = nobuild__elf_layout(len_offset + 8, symbols, 2);
+
+    Atomic_File out = atomic_file_open(out_path);
+    Nobuild__Embed_Writer writer = {
+        .fd = out.fd,
+        .path = out_path,
+        .elems = output,
+    };
+
+    nobuild__elf_begin(&writer, layout);
+    if (nobuild__embed_copy(&writer, file, input) != size) {
+        PANIC("File %s changed size while being embedded", path);
+    }
+
+    char len_bytes[8];
+    nobuild__embed_zeros(&writer, (size_t) (len_offset - size));
+    nobuild__elf_u64(len_bytes, len);
+    nobuild__embed_write(&writer, len_bytes, sizeof(len_bytes));
+
+    nobuild__elf_end(&writer, layout, symbols, 2);
+    nobuild__embed_flush(&writer);
+
+    fd_close(file);
+    atomic_file_commit(&out);
+    free(input);
+    free(output);
+}
+
+#define NOBUILD__PACK_ALIGN 16
+#define NOBUILD__PACK_STAMP "// nobuild pack: flags=%d name=%s\n"
+
+typedef struct {
+    Cstr name;
+    Cstr path;
+    unsigned long long size;
+    unsigned long long offset;
+    unsigned long long name_offset;
+} Nobuild__Pack_Entry;
+
+typedef struct {
+    Nobuild__Pack_Entry *elems;
+    size_t count;
+    size_t capacity;
+} Nobuild__Pack_Entries;
+
+static int nobuild__pack_stat(Cstr path, int *is_dir, long long *mtime, unsigned long long *size)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
+        return -1;
+    }
+
+    *is_dir = S_ISDIR(statbuf.st_mode);
+    // In nanoseconds where `struct stat` has them, so an edit in the same second as
+    // the pack is still seen
+#	if defined(__APPLE__)
+    *mtime = (long long) statbuf.st_mtimespec.tv_sec * 1000000000LL + (long long) statbuf.st_mtimespec.tv_nsec;
+#	elif defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L
+    *mtime = (long long) statbuf.st_mtim.tv_sec * 1000000000LL + (long long) statbuf.st_mtim.tv_nsec;
+#	else
+    *mtime = (long long) statbuf.st_mtime * 1000000000LL;
+#	endif
+    *size = (unsigned long long) statbuf.st_size;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesExA(path, GetFileExInfoStandard, &data))) {
+        return -1;
+    }
+
+    *is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    *mtime = ((long long) data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+    *size = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+#endif // _WIN32
+
+    return 0;
+}
 
-    // Skip consecutive seprators
-    while (last_sep > path && *(last_sep - 1) == path_sep) {
-        --last_sep;
+// Collects the files under `dir_path` and the most recent modification time of
+// them and of the directories themselves, so that removing a file is noticed.
+static void nobuild__pack_collect(Nobuild__Pack_Entries *entries, Cstr dir_path, Cstr prefix, long long *mtime)
+{
+    FOREACH_FILE_IN_DIR(file, dir_path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        Cstr path = PATH(dir_path, file);
+        Cstr name = prefix ? JOIN("/", prefix, file) : CONCAT(file);
+
+        int is_dir = 0;
+        long long path_mtime = 0;
+        unsigned long long size = 0;
+        if (nobuild__pack_stat(path, &is_dir, &path_mtime, &size) < 0) {
+            PANIC("Could not retrieve information about file %s", path);
+        }
+
+        *mtime = path_mtime > *mtime ? path_mtime : *mtime;
+        if (is_dir) {
+            nobuild__pack_collect(entries, path, name, mtime);
+            continue;
+        }
+
+        da_append(entries, ((Nobuild__Pack_Entry) { .name = name, .path = path, .size = size }));
+    });
+}
+
+static int nobuild__pack_entry_compare(const void *a, const void *b)
+{
+    return strcmp(((const Nobuild__Pack_Entry *) a)->name, ((const Nobuild__Pack_Entry *) b)->name);
+}
+
+// 32 bit FNV-1a. Must match the hash emitted into the generated lookup function.
+static unsigned long nobuild__pack_hash(Cstr name, unsigned long seed)
+{
+    unsigned long hash = (2166136261ul ^ seed) & 0xfffffffful;
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash = (hash * 16777619ul) & 0xfffffffful;
     }
+    return hash;
+}
 
-    if (last_sep == path) {
-        return PATH_SEP;
-    }
+typedef struct {
+    size_t bucket;
+    size_t count;
+} Nobuild__Pack_Bucket;
 
-    // Find the start of the basename
-    Cstr start = last_sep;
-    while (start > path && *(start - 1) != path_sep) {
-        --start;
+static int nobuild__pack_bucket_compare(const void *a, const void *b)
+{
+    const Nobuild__Pack_Bucket *x = a;
+    const Nobuild__Pack_Bucket *y = b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
     }
-    assert(last_sep >= start && "last_sep must never be less than start");
+    return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
 
-    size_t len = (size_t)(last_sep - start);
-    char *basename = malloc(len + 1);
-    if (basename == NULL) {
+// Builds a minimal perfect hash with the hash and displace method. Every key
+// lands in bucket `hash(key, 0) % n`. Buckets with several keys get a seed that
+// sends all of their keys to free slots with `hash(key, seed) % n`, while single
+// key buckets store the free slot directly as `-slot - 1`.
+static void nobuild__pack_perfect_hash(const Nobuild__Pack_Entries *entries, long *seeds, unsigned long *slots)
+{
+    const size_t n = entries->count;
+    Nobuild__Pack_Bucket *buckets = NOBUILD__CALLOC(n, sizeof(*buckets));
+    size_t *starts = NOBUILD__CALLOC(n + 1, sizeof(*starts));
+    size_t *items = NOBUILD__MALLOC(sizeof(*items) * n);
+    size_t *candidates = NOBUILD__MALLOC(sizeof(*candidates) * n);
+    char *taken = NOBUILD__CALLOC(n, 1);
+    if (buckets == NULL || starts == NULL || items == NULL || candidates == NULL || taken == NULL) {
         PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
     }
 
-    return basename[len] = '\0', memcpy(basename, start, len);
-}
-
-int path_is_dir(Cstr path)
-{
-#ifndef _WIN32
-    struct stat statbuf = {0};
-    if (stat(path, &statbuf) < 0) {
-        if (errno == ENOENT) {
-            errno = 0;
-            return 0;
+    for (size_t i = 0; i < n; ++i) {
+        buckets[i].bucket = i;
+        starts[nobuild__pack_hash(entries->elems[i].name, 0) % n + 1] += 1;
+    }
+    for (size_t b = 0; b < n; ++b) {
+        buckets[b].count = starts[b + 1];
+        starts[b + 1] += starts[b];
+    }
+    {
+        size_t *fill = NOBUILD__CALLOC(n, sizeof(*fill));
+        if (fill == NULL) {
+            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
         }
-
-        PANIC("could not retrieve information about file %s: %s",
-              path, nobuild__strerror(errno));
+        for (size_t i = 0; i < n; ++i) {
+            size_t b = nobuild__pack_hash(entries->elems[i].name, 0) % n;
+            items[starts[b] + fill[b]++] = i;
+        }
+        free(fill);
     }
 
-    return S_ISDIR(statbuf.st_mode);
-#else
-    DWORD dwAttrib = GetFileAttributes(path);
+    qsort(buckets, n, sizeof(*buckets), nobuild__pack_bucket_compare);
 
-    return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
-            (dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
-#endif // _WIN32
-}
+    size_t next_free = 0;
+    for (size_t k = 0; k < n && buckets[k].count > 0; ++k) {
+        const size_t b = buckets[k].bucket;
+        const size_t *bucket_items = items + starts[b];
 
-int path_is_file(Cstr path)
-{
-#ifndef _WIN32
-    struct stat statbuf = {0};
-    if (stat(path, &statbuf) < 0) {
-        if (errno == ENOENT) {
-            errno = 0;
-            return 0;
+        if (buckets[k].count == 1) {
+            while (taken[next_free]) {
+                next_free++;
+            }
+            taken[next_free] = 1;
+            slots[next_free] = (unsigned long) bucket_items[0];
+            seeds[b] = -(long) next_free - 1;
+            continue;
         }
 
-        PANIC("Could not retrieve information about file %s: %s",
-              path, nobuild__strerror(errno));
-    }
+        for (unsigned long seed = 1;; ++seed) {
+            if (seed > 0x7fffffful) {
+                PANIC("Could not build a perfect hash for %zu names", n);
+            }
 
-    return S_ISREG(statbuf.st_mode);
-#else
-    DWORD dwAttrib = GetFileAttributes(path);
-    return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
-            !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
-#endif // _WIN32
-}
+            size_t placed = 0;
+            for (; placed < buckets[k].count; ++placed) {
+                size_t slot = nobuild__pack_hash(entries->elems[bucket_items[placed]].name, seed) % n;
+                if (taken[slot]) {
+                    break;
+                }
+                taken[slot] = 1;
+                candidates[placed] = slot;
+            }
 
-int path_exists(Cstr path)
-{
-#ifndef _WIN32
-    struct stat statbuf = {0};
-    if (stat(path, &statbuf) < 0) {
-        if (errno == ENOENT) {
-            errno = 0;
-            return 0;
-        }
+            if (placed == buckets[k].count) {
+                for (size_t i = 0; i < placed; ++i) {
+                    slots[candidates[i]] = (unsigned long) bucket_items[i];
+                }
+                seeds[b] = (long) seed;
+                break;
+            }
 
-        PANIC("could not retrieve information about file %s: %s",
-              path, nobuild__strerror(errno));
+            for (size_t i = 0; i < placed; ++i) {
+                taken[candidates[i]] = 0;
+            }
+        }
     }
 
-    return 1;
-#else
-    DWORD dwAttrib = GetFileAttributes(path);
-    return (dwAttrib != INVALID_FILE_ATTRIBUTES);
-#endif
+    free(buckets);
+    free(starts);
+    free(items);
+    free(candidates);
+    free(taken);
 }
 
-int is_path1_modified_after_path2(Cstr path1, Cstr path2)
+static void nobuild__pack_write_c(Nobuild__Embed_Writer *writer, const Nobuild__Pack_Entries *entries,
+                                  Cstr dir_path, Cstr pack_name, unsigned long long blob_size,
+                                  unsigned char *input, int flags)
 {
-    WARN("This function is deprecated. Use `path_is_newer()` instead.");
-    return path_is_newer(path1, path2);
-}
+    static const unsigned char zeros[NOBUILD__PACK_ALIGN] = {0};
 
-long long nobuild__get_modification_time(Cstr path) {
-    if (IS_DIR(path)) {
-        long long mod_time = -1;
-        FOREACH_FILE_IN_DIR(file, path, {
-            if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
-                continue;
+    nobuild__embed_printf(writer, NOBUILD__PACK_STAMP, flags, pack_name);
+    nobuild__embed_printf(writer, "// Generated by nobuild from %s. Do not edit.\n", dir_path);
+    if (flags & PACK_LOOKUP) {
+        nobuild__embed_write_cstr(writer, "#include <string.h>\n");
+    }
+    nobuild__embed_printf(writer,
+                          "\n"
+                          "#if defined(_MSC_VER)\n"
+                          "__declspec(align(%d))\n"
+                          "#endif\n"
+                          "const unsigned char %s[]\n"
+                          "#if defined(__GNUC__) || defined(__clang__)\n"
+                          "__attribute__((aligned(%d)))\n"
+                          "#endif\n"
+                          "= {\n",
+                          NOBUILD__PACK_ALIGN, pack_name, NOBUILD__PACK_ALIGN);
+
+    size_t column = 0;
+    unsigned long long offset = 0;
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        nobuild__embed_write_bytes(writer, zeros, (size_t) (entry->offset - offset), &column);
+
+        Fd file = fd_open_for_read(entry->path);
+        unsigned long long total_bytes_read = 0;
+        for (;;) {
+            size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+            if (bytes_read == 0) {
+                break;
             }
 
-            long long path_mod_time = nobuild__get_modification_time(PATH(path, file));
-            mod_time = path_mod_time > mod_time ? path_mod_time : mod_time;
-        });
-        return mod_time;
-    } else {
-#ifndef _WIN32
-        struct stat statbuf = {0};
-
-        if (stat(path, &statbuf) < 0) {
-            PANIC("Could not stat %s: %s\n", path, nobuild__strerror(errno));
+            nobuild__embed_write_bytes(writer, input, bytes_read, &column);
+            total_bytes_read += bytes_read;
         }
-        return (long long) statbuf.st_mtime;
-#else
-        FILETIME path_time;
-        Fd path_fd = fd_open_for_read(path);
-        if (!GetFileTime(path_fd, NULL, NULL, &path_time)) {
-            PANIC("could not get time of %s: %s", path, nobuild__GetLastErrorAsString());
+        fd_close(file);
+
+        if (total_bytes_read != entry->size) {
+            PANIC("File %s changed size while being packed", entry->path);
         }
-        fd_close(path_fd);
-        return ((long long) path_time.dwHighDateTime) << 32 | path_time.dwLowDateTime;
-#endif
+        offset = entry->offset + entry->size;
     }
-}
-
-int path_is_newer(Cstr path1, Cstr path2)
-{
-    // Warn the user that the path is missing
-    if (!PATH_EXISTS(path1)) {
-        WARN("File %s does not exist", path2);
-        return 0;
+    nobuild__embed_write_bytes(writer, zeros, (size_t) (blob_size - offset), &column);
+    if (blob_size == 0) {
+        nobuild__embed_write_cstr(writer, "\t0x00,\n");
+    } else if (column > 0) {
+        nobuild__embed_write(writer, "\n", 1);
     }
+    nobuild__embed_write_cstr(writer, "};\n\n");
 
-    if (!PATH_EXISTS(path2)) {
-        return 1;
+    nobuild__embed_printf(writer, "const char %s_names[] =\n", pack_name);
+    for (size_t i = 0; i < entries->count; ++i) {
+        Cstr name = entries->elems[i].name;
+        nobuild__embed_write_literals(writer, (const unsigned char *) name, strlen(name) + (i + 1 < entries->count));
     }
+    nobuild__embed_write_cstr(writer, entries->count == 0 ? "\t\"\";\n\n" : ";\n\n");
 
-    return nobuild__get_modification_time(path1) > nobuild__get_modification_time(path2);
-}
+    nobuild__embed_printf(writer, "const unsigned long %s_entries[][4] = {\n", pack_name);
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        nobuild__embed_printf(writer, "\t{ %llu, %lu, %llu, %llu },\n",
+                              entry->name_offset, (unsigned long) strlen(entry->name), entry->offset, entry->size);
+    }
+    if (entries->count == 0) {
+        nobuild__embed_write_cstr(writer, "\t{ 0, 0, 0, 0 },\n");
+    }
+    nobuild__embed_write_cstr(writer, "};\n");
+    nobuild__embed_printf(writer, "const unsigned long %s_count = %lu;\n", pack_name, (unsigned long) entries->count);
 
-void path_mkdirs(Cstr_Array path)
-{
-    if (path.count == 0) {
+    if (!(flags & PACK_LOOKUP)) {
         return;
     }
 
-    size_t len = 0;
-    for (size_t i = 0; i < path.count; ++i) {
-        len += strlen(path.elems[i]);
+    const size_t n = entries->count;
+    long *seeds = NOBUILD__CALLOC(n ? n : 1, sizeof(*seeds));
+    unsigned long *slots = NOBUILD__CALLOC(n ? n : 1, sizeof(*slots));
+    if (seeds == NULL || slots == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    if (n > 0) {
+        nobuild__pack_perfect_hash(entries, seeds, slots);
     }
 
-    size_t seps_count = path.count - 1;
-    const size_t sep_len = strlen(PATH_SEP);
-
-    char *result = malloc(len + seps_count * sep_len + 1);
-
-    len = 0;
-    for (size_t i = 0; i < path.count; ++i) {
-        size_t n = strlen(path.elems[i]);
-        memcpy(result + len, path.elems[i], n);
-        len += n;
+    nobuild__embed_printf(writer, "\nstatic const long %s__seeds[] = {\n", pack_name);
+    for (size_t i = 0; i < (n ? n : 1); ++i) {
+        nobuild__embed_printf(writer, "\t%ld,\n", seeds[i]);
+    }
+    nobuild__embed_printf(writer, "};\n\nstatic const unsigned long %s__slots[] = {\n", pack_name);
+    for (size_t i = 0; i < (n ? n : 1); ++i) {
+        nobuild__embed_printf(writer, "\t%lu,\n", slots[i]);
+    }
+    nobuild__embed_write_cstr(writer, "};\n\n");
+
+    nobuild__embed_printf(writer,
+                          "static unsigned long %s__hash(const char *name, unsigned long seed)\n"
+                          "{\n"
+                          "    unsigned long hash = (2166136261ul ^ seed) & 0xfffffffful;\n"
+                          "    while (*name) {\n"
+                          "        hash ^= (unsigned char) *name++;\n"
+                          "        hash = (hash * 16777619ul) & 0xfffffffful;\n"
+                          "    }\n"
+                          "    return hash;\n"
+                          "}\n"
+                          "\n",
+                          pack_name);
+    nobuild__embed_printf(writer,
+                          "long %s_find(const char *name)\n"
+                          "{\n"
+                          "    const unsigned long n = %lu;\n"
+                          "    if (n == 0) return -1;\n"
+                          "    long seed = %s__seeds[%s__hash(name, 0) %% n];\n",
+                          pack_name, (unsigned long) n, pack_name, pack_name);
+    nobuild__embed_printf(writer,
+                          "    unsigned long slot = seed < 0 ? (unsigned long) (-seed - 1) : %s__hash(name, (unsigned long) seed) %% n;\n"
+                          "    unsigned long index = %s__slots[slot];\n"
+                          "    return strcmp(%s_names + %s_entries[index][0], name) == 0 ? (long) index : -1;\n"
+                          "}\n",
+                          pack_name, pack_name, pack_name, pack_name);
+
+    free(seeds);
+    free(slots);
+}
 
-        if (seps_count > 0) {
-            memcpy(result + len, PATH_SEP, sep_len);
-            len += sep_len;
-            seps_count -= 1;
+static void nobuild__pack_write_object(Nobuild__Embed_Writer *writer, const Nobuild__Pack_Entries *entries,
+                                       Cstr pack_name, unsigned long long blob_size, unsigned long long names_size,
+                                       unsigned char *input)
+{
+    // .rodata holds the blob, the names, then the 8 byte aligned entries and count
+    const unsigned long long names_offset = blob_size;
+    const unsigned long long entries_offset = NOBUILD__ALIGN(names_offset + names_size, 8);
+    const unsigned long long entries_size = (entries->count ? entries->count : 1) * 4 * 8;
+    const unsigned long long count_offset = entries_offset + entries_size;
+
+    Nobuild__Elf_Symbol symbols[] = {
+        { .name = pack_name, .offset = 0, .size = blob_size },
+        { .name = CONCAT(pack_name, "_names"), .offset = names_offset, .size = names_size },
+        { .name = CONCAT(pack_name, "_entries"), .offset = entries_offset, .size = entries_size },
+        { .name = CONCAT(pack_name, "_count"), .offset = count_offset, .size = 8 },
+    };
+    Nobuild__Elf_Layout layout = nobuild__elf_layout(count_offset + 8, symbols, 4);
+
+    nobuild__elf_begin(writer, layout);
+
+    unsigned long long offset = 0;
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        nobuild__embed_zeros(writer, (size_t) (entry->offset - offset));
+
+        Fd file = fd_open_for_read(entry->path);
+        if (nobuild__embed_copy(writer, file, input) != entry->size) {
+            PANIC("File %s changed size while being packed", entry->path);
         }
+        fd_close(file);
+        offset = entry->offset + entry->size;
+    }
+    nobuild__embed_zeros(writer, (size_t) (blob_size - offset));
 
-        result[len] = '\0';
+    for (size_t i = 0; i < entries->count; ++i) {
+        nobuild__embed_write(writer, entries->elems[i].name, strlen(entries->elems[i].name) + 1);
+    }
+    nobuild__embed_zeros(writer, (size_t) (entries_offset - names_offset - names_size));
+
+    char bytes[4 * 8] = {0};
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        char *out = bytes;
+        out = nobuild__elf_u64(out, entry->name_offset);
+        out = nobuild__elf_u64(out, strlen(entry->name));
+        out = nobuild__elf_u64(out, entry->offset);
+        out = nobuild__elf_u64(out, entry->size);
+        nobuild__embed_write(writer, bytes, sizeof(bytes));
+    }
+    if (entries->count == 0) {
+        nobuild__embed_zeros(writer, sizeof(bytes));
+    }
+    nobuild__elf_u64(bytes, entries->count);
+    nobuild__embed_write(writer, bytes, 8);
 
-        if (nobuild__mkdir(result, 0755) < 0) {
-            if (errno == EEXIST) {
-                errno = 0;
-                WARN("directory %s already exists", result);
-            } else {
-                PANIC("could not create directory %s: %s", result, nobuild__strerror(errno));
-            }
-        }
+    nobuild__elf_end(writer, layout, symbols, 4);
+}
+
+static unsigned long long nobuild__pack_u64(const char *in)
+{
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | (unsigned char) in[i];
     }
+    return value;
 }
 
-void path_rename(Cstr old_path, Cstr new_path)
+// Reads `count` bytes at `offset` of `fd`, returns whether they were all there
+static int nobuild__pack_read_at(Fd fd, unsigned long long offset, char *buf, size_t count)
 {
 #ifndef _WIN32
-    if (rename(old_path, new_path) < 0) {
-        PANIC("could not rename %s to %s: %s", old_path, new_path,
-              nobuild__strerror(errno));
+    if (lseek(fd, (off_t) offset, SEEK_SET) < 0) {
+        return 0;
     }
 #else
-    if (!MoveFileEx(old_path, new_path, MOVEFILE_REPLACE_EXISTING)) {
-        PANIC("could not rename %s to %s: %s", old_path, new_path,
-              nobuild__GetLastErrorAsString());
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG) offset;
+    if (!SetFilePointerEx(fd, position, NULL, FILE_BEGIN)) {
+        return 0;
     }
 #endif // _WIN32
+    return fd_read(fd, buf, (unsigned long) count) == count;
 }
 
-void path_copy(Cstr old_path, Cstr new_path) {
-    if (IS_DIR(old_path)) {
-        path_mkdirs(cstr_array_make(new_path, NULL));
-        FOREACH_FILE_IN_DIR(file, old_path, {
-            if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
-                continue;
-            }
-
-            path_copy(PATH(old_path, file), PATH(new_path, file));
-        });
-    } else {
-        Fd f1 = fd_open_for_read(old_path);
-        Fd f2 = fd_open_for_write(new_path);
-
-        unsigned char buffer[4096];
-        while (1) {
-#ifndef _WIN32
-            ssize_t bytes = read(f1, buffer, sizeof buffer);
-            if (bytes == -1) {
-                ERRO("Could not copy %s to %s due to read error: %s", old_path, new_path, nobuild__strerror(errno));
-                break;
-            }
-
-            if (bytes == 0) {
-                break;
-            }
+// Whether `out_path` was generated with the same `flags` and `pack_name`. Sources
+// start with `NOBUILD__PACK_STAMP`, objects are checked through the name of their
+// first symbol since they can only be generated without flags
+static int nobuild__pack_stamp_matches(Cstr out_path, Cstr pack_name, int flags, int object)
+{
+    char expected[256];
+    int len = object ? snprintf(expected, sizeof(expected), "%s", pack_name)
+                     : snprintf(expected, sizeof(expected), NOBUILD__PACK_STAMP, flags, pack_name);
+    if (len < 0 || (size_t) len >= sizeof(expected)) {
+        return 0;
+    }
 
-            bytes = write(f2, buffer, (size_t)bytes);
-            if (bytes == -1) {
-                ERRO("Could not copy %s to %s due to write error: %s", old_path, new_path, nobuild__strerror(errno));
-                break;
-            }
+    Fd fd = fd_open_for_read(out_path);
+    unsigned long long offset = 0;
+    int matches = 1;
+    if (object) {
+        // The first symbol name follows the null byte at the start of `.strtab`,
+        // the fifth section. Its terminator is compared too.
+        char header[NOBUILD__ELF_HEADER_SIZE];
+        char section[NOBUILD__ELF_SECTION_SIZE];
+        matches = nobuild__pack_read_at(fd, 0, header, sizeof(header)) && memcmp(header, "\x7f" "ELF", 4) == 0 &&
+                  nobuild__pack_read_at(fd, nobuild__pack_u64(header + 0x28) + 4 * NOBUILD__ELF_SECTION_SIZE,
+                                        section, sizeof(section));
+        offset = matches ? nobuild__pack_u64(section + 0x18) + 1 : 0;
+        len += 1;
+    }
 
-            if (bytes == 0) {
-                break;
-            }
-#else
-            DWORD bytes;
-            if (!ReadFile(f1, buffer, sizeof buffer, &bytes, NULL)) {
-                ERRO("Could not copy %s to %s due to read error: %s", old_path, new_path, nobuild__GetLastErrorAsString());
-                break;
+    char actual[sizeof(expected)];
+    matches = matches && nobuild__pack_read_at(fd, offset, actual, (size_t) len) && memcmp(actual, expected, (size_t) len) == 0;
+    fd_close(fd);
+    return matches;
+}
 
-            }
+void dir_to_pack(Cstr dir_path, Cstr out_path, Cstr pack_name, int flags)
+{
+    const int object = cstr_ends_with(out_path, ".o");
+    if (object && (flags & PACK_LOOKUP)) {
+        PANIC("Could not pack %s into %s: PACK_LOOKUP is only available for C sources, "
+              "use dir_to_pack() with PACK_DEFAULT for objects", dir_path, out_path);
+    }
 
-            if (bytes == 0) {
-                break;
-            }
+    Nobuild__Pack_Entries entries = {0};
+    long long mtime = 0;
+    unsigned long long size = 0;
+    int is_dir = 0;
+    if (nobuild__pack_stat(dir_path, &is_dir, &mtime, &size) < 0 || !is_dir) {
+        PANIC("Could not pack %s: not a directory", dir_path);
+    }
+    nobuild__pack_collect(&entries, dir_path, NULL, &mtime);
+
+    // A file with the same timestamp as the pack may have been written right after it
+    // within the resolution of the clock, so only a strictly newer pack is reused
+    long long out_mtime = 0;
+    if (nobuild__pack_stat(out_path, &is_dir, &out_mtime, &size) == 0 && out_mtime > mtime &&
+        nobuild__pack_stamp_matches(out_path, pack_name, flags, object)) {
+        da_free(&entries);
+        return;
+    }
 
-            if (!WriteFile(f2, buffer, bytes, &bytes, NULL)) {
-                ERRO("Could not copy %s to %s due to write error: %s", old_path, new_path, nobuild__GetLastErrorAsString());
-                break;
-            }
+    qsort(entries.elems, entries.count, sizeof(*entries.elems), nobuild__pack_entry_compare);
 
-            if (bytes == 0) {
-                break;
-            }
-#endif
-        }
+    unsigned long long blob_size = 0;
+    unsigned long long names_size = 0;
+    for (size_t i = 0; i < entries.count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries.elems[i];
+        entry->offset = blob_size;
+        entry->name_offset = names_size;
+        blob_size = NOBUILD__ALIGN(blob_size + entry->size + 1, NOBUILD__PACK_ALIGN);
+        names_size += strlen(entry->name) + 1;
+    }
 
-        fd_close(f1);
-        fd_close(f2);
+    unsigned char *input = NOBUILD__MALLOC(NOBUILD__EMBED_READ_SIZE);
+    char *output = NOBUILD__MALLOC(NOBUILD__EMBED_WRITE_SIZE);
+    if (input == NULL || output == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
     }
-}
+    nobuild__embed_cells_init();
 
-void path_rm(Cstr path)
-{
-    if (IS_DIR(path)) {
-        FOREACH_FILE_IN_DIR(file, path, {
-            if (strcmp(file, ".") != 0 && strcmp(file, "..") != 0)
-            {
-                path_rm(PATH(path, file));
-            }
-        });
+    Atomic_File out = atomic_file_open(out_path);
+    Nobuild__Embed_Writer writer = {
+        .fd = out.fd,
+        .path = out_path,
+        .elems = output,
+    };
 
-        if (nobuild__rmdir(path) < 0) {
-            if (errno == ENOENT) {
-                errno = 0;
-                WARN("Directory %s does not exist", path);
-            } else {
-                PANIC("Could not remove directory %s: %s", path, nobuild__strerror(errno));
-            }
-        }
+    if (object) {
+        nobuild__pack_write_object(&writer, &entries, pack_name, blob_size, names_size, input);
     } else {
-        if (nobuild__unlink(path) < 0) {
-            if (errno == ENOENT) {
-                errno = 0;
-                WARN("File %s does not exist", path);
-            } else {
-                PANIC("Could not remove file %s: %s", path, nobuild__strerror(errno));
-            }
-        }
+        nobuild__pack_write_c(&writer, &entries, dir_path, pack_name, blob_size, input, flags);
     }
+    nobuild__embed_flush(&writer);
+
+    atomic_file_commit(&out);
+    da_free(&entries);
+    free(input);
+    free(output);
 }
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 
 char *shift_args(int *argc, char ***argv)
 {
@@ -1919,61 +7901,4 @@ char *shift_args(int *argc, char ***argv)
     return result;
 }
 
-void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term) {
-    Fd file = fd_open_for_read(path);
-    Fd output_file = fd_open_for_write(out_path);
-    fd_printf(output_file, "%s %s[] = {\n", array_type, array_name);
-
-    unsigned char buffer[4096];
-    unsigned long total_bytes_read = 0;
-    do {
-#ifndef _WIN32
-        ssize_t bytes = read(file, buffer, sizeof(buffer));
-        if (bytes == -1) {
-            ERRO("Could not read file %s: %s", path, strerror(errno));
-            fd_close(file);
-            fd_close(output_file);
-            break;
-        }
-
-        if (bytes == 0) {
-            break;
-        }
-#else
-        DWORD bytes;
-        if (!ReadFile(file, buffer, sizeof buffer, &bytes, NULL)) {
-            ERRO("Could not read file %s: %s", path, nobuild__GetLastErrorAsString());
-            break;
-        }
-#endif
-        int bytes_read = (int) bytes;
-
-        if (bytes_read == 0) {
-            break;
-        }
-
-        for (int i = 0; i < bytes_read; i+=16) {
-            fd_printf(output_file, "\t");
-            for (int j = i; j < i+16; j++) {
-                if (j >= bytes_read) {
-                    break;
-                }
-                fd_printf(output_file, "0x%02x, ", buffer[j]);
-            }
-            fd_printf(output_file, "\n");
-        }
-        total_bytes_read += (unsigned long) bytes_read;
-    } while (1);
-
-    if (null_term) {
-        fd_printf(output_file, "\t0x00 /* Terminate with null */\n");
-        total_bytes_read++;
-    }
-    fd_printf(output_file, "};\n");
-    fd_printf(output_file, "unsigned long %s_len = %lu;\n", array_name, total_bytes_read);
-
-    fd_close(file);
-    fd_close(output_file);
-}
-
 #endif // NOBUILD_IMPLEMENTATION
@@ -1,17 +1,26 @@
 #ifndef NOBUILD_H_
 #define NOBUILD_H_
 
+// The implementation uses POSIX 2008 functions like `futimens()` and `clock_gettime()`.
+// Ask for them when the compiler runs in strict ISO C mode and the user did not pick a
+// feature level. This only works when nobuild is included before any system header;
+// otherwise the modules fall back to older calls.
+#ifdef NOBUILD_IMPLEMENTATION
+#	if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE)
+#		define _POSIX_C_SOURCE 200809L
+#	endif
+#endif
+
 #include "nobuild_log.h"
+#include "nobuild_stats.h"
+#include "nobuild_arena.h"
 #include "nobuild_cstr.h"
+#include "nobuild_hash.h"
 #include "nobuild_io.h"
 #include "nobuild_cmd.h"
+#include "nobuild_bulk.h"
 #include "nobuild_path.h"
-
-#define FOREACH_ARRAY(type, elem, array, body)                                  \
-    for (size_t elem_##index = 0; elem_##index < array.count; ++elem_##index) { \
-        type *elem = &array.elems[elem_##index];                                \
-        body;                                                                   \
-    }
+#include "nobuild_embed.h"
 
 #ifndef REBUILD_URSELF
 #	if _WIN32
@@ -23,7 +32,8 @@
 #			define REBUILD_URSELF(binary_path, source_path) CMD("cl.exe", source_path)
 #		endif
 #	else
-#		define REBUILD_URSELF(binary_path, source_path) CMD("cc", "-o", binary_path, source_path)
+		// Threads need libpthread before glibc 2.34
+#		define REBUILD_URSELF(binary_path, source_path) CMD("cc", "-pthread", "-o", binary_path, source_path)
 #	endif
 #endif
 
@@ -64,7 +74,9 @@
                     .count = argc,                                     \
                 },                                                     \
             };                                                         \
-            INFO("CMD: %s", cmd_show(cmd));                            \
+            if (log_enabled(LOG_INFO)) {                               \
+                INFO("CMD: %s", cmd_show(cmd));                        \
+            }                                                          \
             cmd_run_sync(cmd);                                         \
             exit(0);                                                   \
         }                                                              \
@@ -72,9 +84,6 @@
 
 char *shift_args(int *argc, char ***argv);
 
-void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type,  Cstr array_name, int null_term);
-#define FILE_TO_C_ARRAY(path, out_path, array_name) file_to_c_array(path, out_path, "unsigned char", array_name, 1)
-
 #endif  // NOBUILD_H_
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -84,18 +93,33 @@ void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type,  Cstr array_name
 #define NOBUILD_LOG_IMPLEMENTATION
 #include "nobuild_log.h"
 
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#define NOBUILD_ARENA_IMPLEMENTATION
+#include "nobuild_arena.h"
+
 #define NOBUILD_CSTR_IMPLEMENTATION
 #include "nobuild_cstr.h"
 
+#define NOBUILD_HASH_IMPLEMENTATION
+#include "nobuild_hash.h"
+
 #define NOBUILD_IO_IMPLEMENTATION
 #include "nobuild_io.h"
 
 #define NOBUILD_CMD_IMPLEMENTATION
 #include "nobuild_cmd.h"
 
+#define NOBUILD_BULK_IMPLEMENTATION
+#include "nobuild_bulk.h"
+
 #define NOBUILD_PATH_IMPLEMENTATION
 #include "nobuild_path.h"
 
+#define NOBUILD_EMBED_IMPLEMENTATION
+#include "nobuild_embed.h"
+
 char *shift_args(int *argc, char ***argv)
 {
     assert(*argc > 0);
@@ -105,61 +129,4 @@ char *shift_args(int *argc, char ***argv)
     return result;
 }
 
-void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term) {
-    Fd file = fd_open_for_read(path);
-    Fd output_file = fd_open_for_write(out_path);
-    fd_printf(output_file, "%s %s[] = {\n", array_type, array_name);
-
-    unsigned char buffer[4096];
-    unsigned long total_bytes_read = 0;
-    do {
-#ifndef _WIN32
-        ssize_t bytes = read(file, buffer, sizeof(buffer));
-        if (bytes == -1) {
-            ERRO("Could not read file %s: %s", path, strerror(errno));
-            fd_close(file);
-            fd_close(output_file);
-            break;
-        }
-
-        if (bytes == 0) {
-            break;
-        }
-#else
-        DWORD bytes;
-        if (!ReadFile(file, buffer, sizeof buffer, &bytes, NULL)) {
-            ERRO("Could not read file %s: %s", path, nobuild__GetLastErrorAsString());
-            break;
-        }
-#endif
-        int bytes_read = (int) bytes;
-
-        if (bytes_read == 0) {
-            break;
-        }
-
-        for (int i = 0; i < bytes_read; i+=16) {
-            fd_printf(output_file, "\t");
-            for (int j = i; j < i+16; j++) {
-                if (j >= bytes_read) {
-                    break;
-                }
-                fd_printf(output_file, "0x%02x, ", buffer[j]);
-            }
-            fd_printf(output_file, "\n");
-        }
-        total_bytes_read += (unsigned long) bytes_read;
-    } while (1);
-
-    if (null_term) {
-        fd_printf(output_file, "\t0x00 /* Terminate with null */\n");
-        total_bytes_read++;
-    }
-    fd_printf(output_file, "};\n");
-    fd_printf(output_file, "unsigned long %s_len = %lu;\n", array_name, total_bytes_read);
-
-    fd_close(file);
-    fd_close(output_file);
-}
-
 #endif // NOBUILD_IMPLEMENTATION
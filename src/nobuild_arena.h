@@ -0,0 +1,456 @@
+#ifndef NOBUILD_ARENA_H_
+#define NOBUILD_ARENA_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include "nobuild_stats.h"
+
+// Region based allocation. An arena hands out memory from a list of large regions
+// and takes all of it back at once, so a lot of small allocations that die together
+// cost a pointer bump each and a single rewind in the end.
+
+typedef struct Arena_Region Arena_Region;
+
+typedef struct {
+    Arena_Region *begin;
+    // The region allocations are served from. The ones after it are empty.
+    Arena_Region *end;
+} Arena;
+
+// A position in an arena to rewind to
+typedef struct {
+    Arena_Region *region;
+    size_t count;
+} Arena_Mark;
+
+// Never returns NULL, panics when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// Resizes `old`, which was allocated with `old_size` bytes. It is resized in place
+// when it is the last allocation of the arena, and copied otherwise.
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *cstr);
+
+Arena_Mark arena_mark(Arena *arena);
+// Releases everything allocated since `mark` was taken. The regions are kept around
+// for the allocations that follow.
+void arena_rewind(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+// Gives the regions back to the system
+void arena_free(Arena *arena);
+// Number of bytes currently allocated from `arena`
+size_t arena_used(const Arena *arena);
+
+// Every string, array and chain that nobuild returns is allocated from the temporary
+// arena and is never freed on its own. Code that creates garbage on every iteration
+// of a loop can release it in O(1) by resetting to a mark taken at the start:
+//
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         Arena_Mark mark = temp_mark();
+//         if (ENDS_WITH(file, ".c")) {
+//             CMD("cc", "-c", PATH("src", file), "-o", CONCAT(NOEXT(file), ".o"));
+//         }
+//         temp_reset(mark);
+//     });
+//
+// Everything returned since the mark is gone after the reset, including the storage
+// of arrays that were grown in between. The arena is shared by all threads and none
+// of them may be using it while it is reset.
+void *temp_alloc(size_t size);
+void *temp_realloc(void *old, size_t old_size, size_t new_size);
+char *temp_strdup(const char *cstr);
+Arena_Mark temp_mark(void);
+void temp_reset(Arena_Mark mark);
+size_t temp_used(void);
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size);
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size);
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr);
+// Counts the allocation for the module that makes it
+#	define temp_alloc(size) nobuild__stats_temp_alloc(NOBUILD__STATS_MODULE, (size))
+#	define temp_realloc(old, old_size, new_size) \
+    nobuild__stats_temp_realloc(NOBUILD__STATS_MODULE, (old), (old_size), (new_size))
+#	define temp_strdup(cstr) nobuild__stats_temp_strdup(NOBUILD__STATS_MODULE, (cstr))
+#endif // NOBUILD_STATS
+
+// Dynamic arrays, for any struct with an `elems` pointer and `count` and `capacity`
+// fields. Their storage comes from the temporary arena and doubles when it is full,
+// so appending costs O(1) amortized, and a single allocation when nothing else was
+// allocated since the last append.
+//
+//     typedef struct {
+//         Cmd *elems;
+//         size_t count;
+//         size_t capacity;
+//     } Cmd_Array;
+//
+//     Cmd_Array cmds = {0};
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", file) }));
+//     });
+//     FOREACH_ARRAY(Cmd, cmd, cmds, cmd_run_sync(*cmd));
+//
+// Arrays with a `capacity` below their `count` wrap storage that nobuild did not
+// allocate, like `argv`, which is copied on the first append. The macros evaluate
+// `da` more than once.
+
+// Makes room for `n` elements in total
+#define da_reserve(da, n)                                                                  \
+    ((da)->elems = nobuild__da_reserve((da)->elems, sizeof(*(da)->elems), (da)->count,     \
+                                       &(da)->capacity, (n)))
+
+#define da_append(da, elem)                                                                \
+    ((da)->count >= (da)->capacity                                                         \
+         ? (void) ((da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems),       \
+                                                  (da)->count, &(da)->capacity,            \
+                                                  (da)->count + 1))                        \
+         : (void) 0,                                                                       \
+     (void) ((da)->elems[(da)->count++] = (elem)))
+
+// Appends the `n` elements that `new_elems` points to
+#define da_append_many(da, new_elems, n)                                                   \
+    do {                                                                                   \
+        const size_t nobuild__da_n = (n);                                                  \
+        /* Only compiles when the elements have the same type */                           \
+        (void) sizeof(*(da)->elems = *(new_elems));                                        \
+        if (nobuild__da_n > 0) {                                                           \
+            (da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems), (da)->count, \
+                                           &(da)->capacity, (da)->count + nobuild__da_n);  \
+            memcpy((da)->elems + (da)->count, (new_elems),                                 \
+                   sizeof(*(da)->elems) * nobuild__da_n);                                  \
+            (da)->count += nobuild__da_n;                                                  \
+        }                                                                                  \
+    } while (0)
+
+// Removes the last element and returns it. The array must not be empty.
+#define da_pop(da) ((da)->elems[--(da)->count])
+
+// Leaves the array empty. The storage only goes back to the arena when it is the last
+// allocation, the rest waits for the next `temp_reset()`.
+#define da_free(da)                                                                        \
+    do {                                                                                   \
+        nobuild__da_free((da)->elems, sizeof(*(da)->elems), (da)->count, (da)->capacity);  \
+        (da)->elems = NULL;                                                                \
+        (da)->count = 0;                                                                   \
+        (da)->capacity = 0;                                                                \
+    } while (0)
+
+// Visits the elements of an array in order
+#define FOREACH_ARRAY(type, elem, array, body)                                             \
+    for (size_t elem_##index = 0; elem_##index < (array).count; ++elem_##index) {         \
+        type *elem = &(array).elems[elem_##index];                                         \
+        body;                                                                              \
+    }
+
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity);
+
+#endif // NOBUILD_ARENA_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_ARENA_IMPLEMENTATION
+#ifndef NOBUILD_ARENA_I_
+#define NOBUILD_ARENA_I_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define NOBUILD_LOG_IMPLEMENTATION
+#include "nobuild_log.h"
+
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_ARENA
+
+#if defined(NOBUILD_NO_THREADS)
+#elif !defined(_WIN32)
+#	include <pthread.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+// Words of a region that is not made larger by a single big allocation
+#ifndef NOBUILD_ARENA_REGION_WORDS
+#	define NOBUILD_ARENA_REGION_WORDS (8 * 1024)
+#endif
+
+// Allocations are made in whole words, which keeps all of them suitably aligned
+typedef union {
+    void *pointer;
+    long long integer;
+    double real;
+} Nobuild__Arena_Word;
+
+struct Arena_Region {
+    Arena_Region *next;
+    size_t count;
+    size_t capacity;
+    Nobuild__Arena_Word data[];
+};
+
+static size_t nobuild__arena_words(size_t size)
+{
+    return (size + sizeof(Nobuild__Arena_Word) - 1) / sizeof(Nobuild__Arena_Word);
+}
+
+static Arena_Region *nobuild__arena_region_new(size_t words)
+{
+    size_t capacity = words > NOBUILD_ARENA_REGION_WORDS ? words : NOBUILD_ARENA_REGION_WORDS;
+    Arena_Region *region = NOBUILD__MALLOC(sizeof(*region) + sizeof(Nobuild__Arena_Word) * capacity);
+    if (region == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    region->next = NULL;
+    region->count = 0;
+    region->capacity = capacity;
+    return region;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t words = nobuild__arena_words(size);
+    if (arena->end == NULL) {
+        arena->begin = arena->end = nobuild__arena_region_new(words);
+    }
+
+    // Regions emptied by a rewind are reused before new ones are made
+    while (arena->end->count + words > arena->end->capacity && arena->end->next != NULL) {
+        arena->end = arena->end->next;
+    }
+
+    if (arena->end->count + words > arena->end->capacity) {
+        arena->end->next = nobuild__arena_region_new(words);
+        arena->end = arena->end->next;
+    }
+
+    void *result = &arena->end->data[arena->end->count];
+    arena->end->count += words;
+    return result;
+}
+
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size)
+{
+    if (old == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+
+    size_t old_words = nobuild__arena_words(old_size);
+    size_t new_words = nobuild__arena_words(new_size);
+    Arena_Region *end = arena->end;
+    if (end != NULL && (Nobuild__Arena_Word *) old + old_words == &end->data[end->count]
+        && end->count - old_words + new_words <= end->capacity) {
+        end->count = end->count - old_words + new_words;
+        return old;
+    }
+
+    if (new_size <= old_size) {
+        return old;
+    }
+
+    void *result = arena_alloc(arena, new_size);
+    memcpy(result, old, old_size);
+    return result;
+}
+
+char *arena_strdup(Arena *arena, const char *cstr)
+{
+    size_t size = strlen(cstr) + 1;
+    return memcpy(arena_alloc(arena, size), cstr, size);
+}
+
+Arena_Mark arena_mark(Arena *arena)
+{
+    Arena_Mark mark = { .region = arena->end };
+    if (arena->end != NULL) {
+        mark.count = arena->end->count;
+    }
+    return mark;
+}
+
+void arena_rewind(Arena *arena, Arena_Mark mark)
+{
+    if (mark.region == NULL) {
+        arena_reset(arena);
+        return;
+    }
+
+    mark.region->count = mark.count;
+    for (Arena_Region *region = mark.region->next; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = mark.region;
+}
+
+void arena_reset(Arena *arena)
+{
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = arena->begin;
+}
+
+void arena_free(Arena *arena)
+{
+    Arena_Region *region = arena->begin;
+    while (region != NULL) {
+        Arena_Region *next = region->next;
+        free(region);
+        region = next;
+    }
+    arena->begin = arena->end = NULL;
+}
+
+size_t arena_used(const Arena *arena)
+{
+    size_t words = 0;
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        words += region->count;
+    }
+    return words * sizeof(Nobuild__Arena_Word);
+}
+
+// Locks for global state, which are initialized statically so that they are ready
+// before any thread exists. Multiple modules could define them, so add a guard
+// around them to prevent redefinition.
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static Arena nobuild__temp = {0};
+static Nobuild__Lock nobuild__temp_lock = NOBUILD__LOCK_INIT;
+
+// The names are in parentheses, which keeps the macros of `NOBUILD_STATS` out of them
+void *(temp_alloc)(size_t size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_alloc(&nobuild__temp, size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+void *(temp_realloc)(void *old, size_t old_size, size_t new_size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_realloc(&nobuild__temp, old, old_size, new_size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+char *(temp_strdup)(const char *cstr)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    char *result = arena_strdup(&nobuild__temp, cstr);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+Arena_Mark temp_mark(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    Arena_Mark mark = arena_mark(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return mark;
+}
+
+void temp_reset(Arena_Mark mark)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    arena_rewind(&nobuild__temp, mark);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+}
+
+size_t temp_used(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    size_t used = arena_used(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return used;
+}
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_temp(module, size);
+    return (temp_alloc)(size);
+}
+
+// Releases and shrinks are not allocations
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size)
+{
+    if (new_size > old_size) {
+        nobuild__stats_temp(module, new_size);
+    }
+    return (temp_realloc)(old, old_size, new_size);
+}
+
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr)
+{
+    nobuild__stats_temp(module, strlen(cstr) + 1);
+    return (temp_strdup)(cstr);
+}
+#endif // NOBUILD_STATS
+
+// Resizes storage with room for `*capacity` elements of which `count` are used to
+// room for exactly `n` when that is more
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    // Storage that was not allocated by nobuild has `count` elements to copy
+    const size_t old_capacity = *capacity > count ? *capacity : count;
+    elems = temp_realloc(elems, elem_size * old_capacity, elem_size * n);
+    *capacity = n;
+    return elems;
+}
+
+// Like `nobuild__da_reserve()`, but doubles the capacity until `n` elements fit
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    while (new_capacity < n) {
+        new_capacity *= 2;
+    }
+    return nobuild__da_reserve(elems, elem_size, count, capacity, new_capacity);
+}
+
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity)
+{
+    if (elems != NULL && capacity > 0 && capacity >= count) {
+        temp_realloc(elems, elem_size * capacity, 0);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+#endif // NOBUILD_ARENA_I_
+#endif // NOBUILD_ARENA_IMPLEMENTATION
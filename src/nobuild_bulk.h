@@ -0,0 +1,644 @@
+#ifndef NOBUILD_BULK_H_
+#define NOBUILD_BULK_H_
+
+#include <stddef.h>
+
+#include "nobuild_cstr.h"
+
+// Batched filesystem operations for work that touches many independent files.
+// Define `NOBUILD_IO_URING` on Linux to queue them on an io_uring, so that a whole
+// batch costs a single `io_uring_enter()` instead of a syscall per file and the
+// kernel works on all of them at once. That pays off when every file is a round
+// trip, like on network filesystems. With a local filesystem the kernel hands path
+// lookups to worker threads, which makes it slower than plain syscalls. Those are
+// used one by one by default, and when the kernel or a seccomp filter refuses to
+// set up a ring.
+
+typedef struct {
+    Cstr path;
+    // 0 on success, the errno of the failed operation otherwise
+    int error;
+    int is_dir;
+    unsigned long long size;
+    // Seconds since the epoch, or the FILETIME on Windows, like `path_is_newer()`
+    long long mtime;
+} Bulk_Stat;
+
+// Stats the `path` of every element, following symbolic links
+void bulk_stat(Bulk_Stat *stats, size_t count);
+
+typedef struct {
+    Cstr path;
+    int error;
+    // The whole file with a null terminator after it, to be freed by the caller.
+    // As much as the file had when it was stat'ed is read.
+    char *data;
+    size_t size;
+} Bulk_Read;
+
+// Reads every `path` into memory
+void bulk_read(Bulk_Read *reads, size_t count);
+
+// Whether the bulk operations go through io_uring in this process
+int bulk_uses_io_uring(void);
+
+#endif // NOBUILD_BULK_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_BULK_IMPLEMENTATION
+#ifndef NOBUILD_BULK_I_
+#define NOBUILD_BULK_I_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define NOBUILD_LOG_IMPLEMENTATION
+#include "nobuild_log.h"
+
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_BULK
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif // _WIN32
+
+// The ring is driven with GCC atomics and the raw syscalls, so there is no liburing to link
+#if defined(__linux__) && defined(NOBUILD_IO_URING) && (defined(__GNUC__) || defined(__clang__))
+#	define NOBUILD__BULK_URING 1
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <linux/io_uring.h>
+#	include <linux/stat.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+// New syscalls have the same number on every architecture
+#	ifndef __NR_io_uring_setup
+#		define __NR_io_uring_setup 425
+#	endif
+#	ifndef __NR_io_uring_enter
+#		define __NR_io_uring_enter 426
+#	endif
+#	define NOBUILD__AT_FDCWD -100
+#	ifdef O_CLOEXEC
+#		define NOBUILD__O_CLOEXEC O_CLOEXEC
+#	else
+#		define NOBUILD__O_CLOEXEC 02000000
+#	endif
+// Large enough to keep the kernel busy without holding too many files open at once
+#	define NOBUILD__BULK_RING_ENTRIES 256
+#else
+#	define NOBUILD__BULK_URING 0
+#endif
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+static void nobuild__bulk_stat_sync(Bulk_Stat *stat_)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(stat_->path, &statbuf)) < 0) {
+        stat_->error = errno;
+        errno = 0;
+        return;
+    }
+
+    stat_->error = 0;
+    stat_->is_dir = S_ISDIR(statbuf.st_mode);
+    stat_->size = (unsigned long long) statbuf.st_size;
+    stat_->mtime = (long long) statbuf.st_mtime;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesExA(stat_->path, GetFileExInfoStandard, &data))) {
+        stat_->error = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        return;
+    }
+
+    stat_->error = 0;
+    stat_->is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    stat_->size = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    stat_->mtime = ((long long) data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#endif // _WIN32
+}
+
+static void nobuild__bulk_read_sync(Bulk_Read *read_)
+{
+    Bulk_Stat stat_ = { .path = read_->path };
+    nobuild__bulk_stat_sync(&stat_);
+    read_->data = NULL;
+    read_->size = 0;
+    read_->error = stat_.error;
+    if (read_->error) {
+        return;
+    }
+
+    if (stat_.is_dir) {
+        read_->error = EISDIR;
+        return;
+    }
+
+    read_->data = NOBUILD__MALLOC((size_t) stat_.size + 1);
+    if (read_->data == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(read_->path, O_RDONLY));
+    if (fd < 0) {
+        read_->error = errno;
+        errno = 0;
+        free(read_->data);
+        read_->data = NULL;
+        return;
+    }
+
+    while (read_->size < stat_.size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, read_->data + read_->size, (size_t) stat_.size - read_->size));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0) {
+            read_->error = errno;
+            errno = 0;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        read_->size += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(read_->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        read_->error = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        free(read_->data);
+        read_->data = NULL;
+        return;
+    }
+
+    while (read_->size < stat_.size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, read_->data + read_->size, (DWORD) (stat_.size - read_->size), &n, NULL))) {
+            read_->error = EIO;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        read_->size += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    if (read_->error) {
+        free(read_->data);
+        read_->data = NULL;
+        read_->size = 0;
+        return;
+    }
+    read_->data[read_->size] = '\0';
+}
+
+#if NOBUILD__BULK_URING
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Nobuild__Uring;
+
+// Returns 0 when io_uring cannot be used
+static int nobuild__uring_init(Nobuild__Uring *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, NOBUILD__BULK_RING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        errno = 0;
+        return 0;
+    }
+
+    // Statx, openat, read and close are all there by the time fast poll is
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        close(ring->fd);
+        return 0;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    const int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        errno = 0;
+        return 0;
+    }
+
+    ring->cq_ring = ring->sq_ring;
+    if (!single_mmap) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            errno = 0;
+            return 0;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (!single_mmap) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        errno = 0;
+        return 0;
+    }
+
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return 1;
+}
+
+static void nobuild__uring_destroy(Nobuild__Uring *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Fills `sqe` for element `index`, or returns 0 to skip it
+typedef int (*Nobuild__Uring_Prep)(struct io_uring_sqe *sqe, size_t index, void *data);
+// Receives the result of the operation of element `index`, a negated errno on failure
+typedef void (*Nobuild__Uring_Done)(size_t index, int res, void *data);
+
+// Runs one operation for each of `count` elements, a ring full at a time
+static void nobuild__uring_run(Nobuild__Uring *ring, size_t count, Nobuild__Uring_Prep prep, Nobuild__Uring_Done done, void *data)
+{
+    const unsigned mask = *ring->sq_mask;
+    size_t next = 0;
+    while (next < count) {
+        const unsigned tail = *ring->sq_tail;
+        unsigned queued = 0;
+        for (; next < count && queued < ring->entries; ++next) {
+            const unsigned slot = (tail + queued) & mask;
+            struct io_uring_sqe *sqe = &ring->sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            if (!prep(sqe, next, data)) {
+                continue;
+            }
+
+            sqe->user_data = next;
+            ring->sq_array[slot] = slot;
+            queued += 1;
+        }
+
+        if (queued == 0) {
+            break;
+        }
+        __atomic_store_n(ring->sq_tail, tail + queued, __ATOMIC_RELEASE);
+
+        unsigned to_submit = queued;
+        unsigned completed = 0;
+        while (completed < queued) {
+            long n = syscall(__NR_io_uring_enter, ring->fd, to_submit, queued - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    errno = 0;
+                    continue;
+                }
+                PANIC("Could not submit to io_uring: %s", nobuild__strerror(errno));
+            }
+            to_submit -= (unsigned) n;
+
+            unsigned head = *ring->cq_head;
+            const unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; ++head) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                done((size_t) cqe->user_data, cqe->res, data);
+                completed += 1;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+typedef struct {
+    Bulk_Stat *stats;
+    struct statx *buffers;
+} Nobuild__Bulk_Stat_Batch;
+
+static int nobuild__bulk_stat_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Stat_Batch *batch = data;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = NOBUILD__AT_FDCWD;
+    sqe->addr = (unsigned long long) (size_t) batch->stats[index].path;
+    sqe->len = STATX_TYPE | STATX_MTIME | STATX_SIZE;
+    sqe->off = (unsigned long long) (size_t) &batch->buffers[index];
+    return 1;
+}
+
+static void nobuild__bulk_stat_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Stat_Batch *batch = data;
+    Bulk_Stat *stat_ = &batch->stats[index];
+    if (res < 0) {
+        stat_->error = -res;
+        return;
+    }
+
+    const struct statx *buffer = &batch->buffers[index];
+    stat_->error = 0;
+    stat_->is_dir = (buffer->stx_mode & 0170000) == 0040000;
+    stat_->size = buffer->stx_size;
+    stat_->mtime = buffer->stx_mtime.tv_sec;
+}
+
+// Reading a file takes a statx, an open, as many reads as it needs and a close,
+// and each of these steps is one submission for the whole batch
+typedef struct {
+    Bulk_Read *reads;
+    Bulk_Stat *stats;
+    int *fds;
+} Nobuild__Bulk_Read_Batch;
+
+static int nobuild__bulk_open_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (batch->reads[index].error) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = NOBUILD__AT_FDCWD;
+    sqe->addr = (unsigned long long) (size_t) batch->reads[index].path;
+    // Commands started by other threads must not inherit the files
+    sqe->open_flags = O_RDONLY | NOBUILD__O_CLOEXEC;
+    return 1;
+}
+
+static void nobuild__bulk_open_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (res < 0) {
+        batch->reads[index].error = -res;
+        return;
+    }
+    batch->fds[index] = res;
+}
+
+static int nobuild__bulk_read_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    Bulk_Read *read_ = &batch->reads[index];
+    if (read_->error || batch->fds[index] < 0 || read_->size >= batch->stats[index].size) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = batch->fds[index];
+    sqe->addr = (unsigned long long) (size_t) (read_->data + read_->size);
+    const unsigned long long left = batch->stats[index].size - read_->size;
+    sqe->len = left < (1u << 30) ? (unsigned) left : (1u << 30);
+    sqe->off = read_->size;
+    return 1;
+}
+
+static void nobuild__bulk_read_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    Bulk_Read *read_ = &batch->reads[index];
+    if (res < 0) {
+        read_->error = -res;
+        return;
+    }
+
+    if (res == 0) {
+        // The file shrank since it was stat'ed
+        batch->stats[index].size = read_->size;
+        return;
+    }
+    read_->size += (size_t) res;
+}
+
+static int nobuild__bulk_close_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (batch->fds[index] < 0) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = batch->fds[index];
+    return 1;
+}
+
+static void nobuild__bulk_close_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    (void) res;
+    batch->fds[index] = -1;
+}
+
+static void nobuild__bulk_stat_ring(Nobuild__Uring *ring, Bulk_Stat *stats, size_t count)
+{
+    Nobuild__Bulk_Stat_Batch batch = {
+        .stats = stats,
+        .buffers = NOBUILD__MALLOC(count * sizeof(struct statx)),
+    };
+    if (batch.buffers == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_stat_prep, nobuild__bulk_stat_done, &batch);
+    free(batch.buffers);
+}
+
+static void nobuild__bulk_read_batch(Nobuild__Uring *ring, Bulk_Read *reads, size_t count)
+{
+    Nobuild__Bulk_Read_Batch batch = {
+        .reads = reads,
+        .stats = NOBUILD__CALLOC(count, sizeof(Bulk_Stat)),
+        .fds = NOBUILD__MALLOC(count * sizeof(int)),
+    };
+    if (batch.stats == NULL || batch.fds == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        batch.stats[i].path = reads[i].path;
+        batch.fds[i] = -1;
+    }
+    nobuild__bulk_stat_ring(ring, batch.stats, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        reads[i].data = NULL;
+        reads[i].size = 0;
+        reads[i].error = batch.stats[i].error;
+        if (reads[i].error == 0 && batch.stats[i].is_dir) {
+            reads[i].error = EISDIR;
+        }
+
+        if (reads[i].error == 0) {
+            reads[i].data = NOBUILD__MALLOC((size_t) batch.stats[i].size + 1);
+            if (reads[i].data == NULL) {
+                PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+            }
+        }
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_open_prep, nobuild__bulk_open_done, &batch);
+
+    // Regular files are read in one go, anything short is picked up by another round
+    for (;;) {
+        size_t pending = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!reads[i].error && batch.fds[i] >= 0 && reads[i].size < batch.stats[i].size) {
+                pending += 1;
+            }
+        }
+
+        if (pending == 0) {
+            break;
+        }
+        nobuild__uring_run(ring, count, nobuild__bulk_read_prep, nobuild__bulk_read_done, &batch);
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_close_prep, nobuild__bulk_close_done, &batch);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (reads[i].error) {
+            free(reads[i].data);
+            reads[i].data = NULL;
+            reads[i].size = 0;
+            continue;
+        }
+        reads[i].data[reads[i].size] = '\0';
+    }
+
+    free(batch.stats);
+    free(batch.fds);
+}
+#endif // NOBUILD__BULK_URING
+
+int bulk_uses_io_uring(void)
+{
+#if NOBUILD__BULK_URING
+    // Probed once, a race between threads only probes twice
+    static int available = -1;
+    if (available < 0) {
+        Nobuild__Uring ring;
+        available = nobuild__uring_init(&ring);
+        if (available) {
+            nobuild__uring_destroy(&ring);
+        }
+    }
+    return available;
+#else
+    return 0;
+#endif // NOBUILD__BULK_URING
+}
+
+void bulk_stat(Bulk_Stat *stats, size_t count)
+{
+#if NOBUILD__BULK_URING
+    Nobuild__Uring ring;
+    if (count > 1 && bulk_uses_io_uring() && nobuild__uring_init(&ring)) {
+        nobuild__bulk_stat_ring(&ring, stats, count);
+        nobuild__uring_destroy(&ring);
+        return;
+    }
+#endif // NOBUILD__BULK_URING
+
+    for (size_t i = 0; i < count; ++i) {
+        nobuild__bulk_stat_sync(&stats[i]);
+    }
+}
+
+void bulk_read(Bulk_Read *reads, size_t count)
+{
+#if NOBUILD__BULK_URING
+    Nobuild__Uring ring;
+    if (count > 1 && bulk_uses_io_uring() && nobuild__uring_init(&ring)) {
+        // Every file of a batch is open at the same time, so keep the batches small
+        for (size_t i = 0; i < count; i += ring.entries) {
+            const size_t n = count - i < ring.entries ? count - i : ring.entries;
+            nobuild__bulk_read_batch(&ring, reads + i, n);
+        }
+        nobuild__uring_destroy(&ring);
+        return;
+    }
+#endif // NOBUILD__BULK_URING
+
+    for (size_t i = 0; i < count; ++i) {
+        nobuild__bulk_read_sync(&reads[i]);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+#endif // NOBUILD_BULK_I_
+#endif // NOBUILD_BULK_IMPLEMENTATION
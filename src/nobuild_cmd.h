@@ -20,35 +20,60 @@ typedef struct {
 
 Cstr cmd_show(Cmd cmd);
 Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout);
+// Like cmd_run_async() but also redirects stderr when `fderr` is given
+Pid cmd_run_async_ex(Cmd cmd, Fd *fdin, Fd *fdout, Fd *fderr);
 void cmd_run_sync(Cmd cmd);
 
+// The arguments are counted at compile time and stay on the stack, and the line is
+// only formatted when INFO messages are printed
+//
 // TODO(#1): no way to disable echo in nobuild scripts
 // TODO(#2): no way to ignore fails
 #define CMD(...)                                        \
     do {                                                \
         Cmd cmd = {                                     \
-            .line = cstr_array_make(__VA_ARGS__, NULL)  \
+            .line = CSTR_ARRAY_LOCAL(__VA_ARGS__)       \
         };                                              \
-        INFO("CMD: %s", cmd_show(cmd));                 \
+        if (log_enabled(LOG_INFO)) {                    \
+            INFO("CMD: %s", cmd_show(cmd));             \
+        }                                               \
         cmd_run_sync(cmd);                              \
     } while (0)
 
+// Grows with `da_append()` and the other `da_*()` macros
 typedef struct {
     Cmd *elems;
     size_t count;
+    size_t capacity;
 } Cmd_Array;
 
 typedef enum {
     CHAIN_TOKEN_END = 0,
     CHAIN_TOKEN_IN,
     CHAIN_TOKEN_OUT,
-    CHAIN_TOKEN_CMD
+    CHAIN_TOKEN_CMD,
+    CHAIN_TOKEN_PIPE_SIZE,
+    CHAIN_TOKEN_TEE,
+    CHAIN_TOKEN_FN,
+    CHAIN_TOKEN_ERR,
+    CHAIN_TOKEN_MERGE_ERR
 } Chain_Token_Type;
 
+struct Chain;
+
+// A chain stage that runs on a thread inside nobuild instead of in a child process.
+// It reads its input from `in` until the end and writes its output to `out`, both
+// of which are closed once it returns. Anything but 0 fails the chain.
+typedef int (*Chain_Fn)(Fd in, Fd out, void *data);
+
 // A single token for the CHAIN(...) DSL syntax
 typedef struct {
     Chain_Token_Type type;
     Cstr_Array args;
+    size_t size;
+    struct Chain *chain;
+    Chain_Fn fn;
+    void *data;
 } Chain_Token;
 
 #define CHAIN_IN(path)                      \
@@ -69,15 +94,101 @@ typedef struct {
         .args = cstr_array_make(__VA_ARGS__, NULL) \
     }
 
-// TODO(#20): pipes do not allow redirecting stderr
+// Sends the stderr of every command of the chain and of its branches to `path`,
+// unless a branch has a CHAIN_ERR of its own
+#define CHAIN_ERR(path)                     \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_ERR,            \
+        .args = cstr_array_make(path, NULL) \
+    }
+
+// Sends the stderr of the CHAIN_CMD right before it down the chain along with its
+// stdout, like `2>&1` in a shell
+#define CHAIN_MERGE_ERR                     \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_MERGE_ERR       \
+    }
+
+// Runs `fn(in, out, data)` as a stage of the chain, without a fork and exec. A stage
+// that passes its data on with `fd_pump()` never copies it through user space and
+// beats a command. One that reads and writes through a buffer streams about as fast
+// as a command doing the same, and only saves starting the process, which matters
+// for short inputs and many small chains.
+#define CHAIN_FN(fn_, data_)                 \
+    (Chain_Token) {                          \
+        .type = CHAIN_TOKEN_FN,              \
+        .args = cstr_array_make(#fn_, NULL), \
+        .fn = (fn_),                         \
+        .data = (data_)                      \
+    }
+
+// Raises the capacity of the pipes between the commands to `size` bytes. Regular
+// input and output files are still handed to the commands, which read and write them
+// directly. Anything else, like a fifo or a device, is pumped through a pipe of that
+// size by nobuild itself, with splice(2) on Linux.
+#define CHAIN_PIPE_SIZE(n)                  \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_PIPE_SIZE,      \
+        .size = (n)                         \
+    }
+
+// Sends a copy of the stream at this point of the chain into a branch chain made of
+// the given CHAIN_CMD, CHAIN_OUT, CHAIN_PIPE_SIZE and CHAIN_TEE tokens, while the
+// stream itself continues down the chain. A branch without an output writes to
+// stdout. The stream is duplicated with tee(2) on Linux.
+#define CHAIN_TEE(...)                                                                 \
+    (Chain_Token) {                                                                    \
+        .type = CHAIN_TOKEN_TEE,                                                       \
+        .chain = chain_branch(chain_build_from_tokens(__VA_ARGS__, (Chain_Token) {0})) \
+    }
+
+typedef struct {
+    // Number of commands of the chain in front of the tee
+    size_t position;
+    struct Chain *chain;
+} Chain_Tee;
+
+typedef struct {
+    Chain_Tee *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Tee_Array;
+
 typedef struct {
+    // Index of the stage among the commands of the chain
+    size_t position;
+    Chain_Fn fn;
+    void *data;
+} Chain_Fn_Stage;
+
+typedef struct {
+    Chain_Fn_Stage *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Fn_Stage_Array;
+
+typedef struct {
+    size_t *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Position_Array;
+
+typedef struct Chain {
     Cstr input_filepath;
     Cmd_Array cmds;
     Cstr output_filepath;
+    Cstr error_filepath;
+    size_t pipe_size;
+    Chain_Tee_Array tees;
+    Chain_Fn_Stage_Array fns;
+    // Indices of the commands whose stderr goes down the chain
+    Chain_Position_Array merged_err;
 } Chain;
 
 Chain chain_build_from_tokens(Chain_Token first, ...);
+Chain *chain_branch(Chain chain);
 void chain_run_sync(Chain chain);
+// Prints the chain when INFO messages are printed
 void chain_echo(Chain chain);
 
 // TODO(#15): PIPE does not report where exactly a syntactic error has happened
@@ -102,6 +213,7 @@ void chain_echo(Chain chain);
 #include <stdarg.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
 
 #define NOBUILD_CSTR_IMPLEMENTATION
 #include "nobuild_cstr.h"
@@ -112,13 +224,19 @@ void chain_echo(Chain chain);
 #define NOBUILD_IO_IMPLEMENTATION
 #include "nobuild_io.h"
 
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CMD
+
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #ifndef NOBUILD__STRERROR
 #define NOBUILD__STRERROR
 Cstr nobuild__strerror(int errnum)
 {
 #ifndef _WIN32
-    return nobuild__strerror(errnum);
+    return strerror(errnum);
 #else
     static char buffer[1024];
     strerror_s(buffer, 1024, errnum);
@@ -162,21 +280,29 @@ Cstr cmd_show(Cmd cmd)
 }
 
 Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
+{
+    return cmd_run_async_ex(cmd, fdin, fdout, NULL);
+}
+
+Pid cmd_run_async_ex(Cmd cmd, Fd *fdin, Fd *fdout, Fd *fderr)
 {
 #ifndef _WIN32
-    pid_t cpid = fork();
+#ifdef NOBUILD_STATS
+    // Both ends are closed on exec, which is what reading from it waits for
+    Pipe exec_pipe = pipe_make();
+#endif // NOBUILD_STATS
+
+    pid_t cpid = NOBUILD__STATS_CALL(STATS_FORK, fork());
     if (cpid < 0) {
         PANIC("Could not fork child process: %s: %s",
               cmd_show(cmd), nobuild__strerror(errno));
     }
 
     if (cpid == 0) {
-        Cstr_Array args = {
-            .count = cmd.line.count
-        };
-        args.elems = malloc(sizeof(Cstr) * args.count+1);
-        memcpy(args.elems, cmd.line.elems, args.count * sizeof(Cstr));
-        args.elems[args.count++] = NULL;
+        // The child is about to exec, so the terminated copy of the line can live on its stack
+        Cstr argv[cmd.line.count + 1];
+        memcpy(argv, cmd.line.elems, sizeof(Cstr) * cmd.line.count);
+        argv[cmd.line.count] = NULL;
 
         if (fdin) {
             if (dup2(*fdin, STDIN_FILENO) < 0) {
@@ -190,12 +316,28 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
             }
         }
 
-        if (execvp(args.elems[0], (char * const*) args.elems) < 0) {
+        if (fderr) {
+            if (dup2(*fderr, STDERR_FILENO) < 0) {
+                PANIC("Could not setup stderr for child process: %s", nobuild__strerror(errno));
+            }
+        }
+
+        // The parent ignores SIGPIPE while pumping a chain, and ignored signals survive exec
+        signal(SIGPIPE, SIG_DFL);
+
+        if (execvp(argv[0], (char * const*) argv) < 0) {
             PANIC("Could not exec child process: %s: %s",
                   cmd_show(cmd), nobuild__strerror(errno));
         }
     }
 
+#ifdef NOBUILD_STATS
+    fd_close(exec_pipe.write);
+    char byte;
+    (void) NOBUILD__STATS_CALL(STATS_EXEC, read(exec_pipe.read, &byte, 1));
+    fd_close(exec_pipe.read);
+#endif // NOBUILD_STATS
+
     return cpid;
 #else
     // https://docs.microsoft.com/en-us/windows/win32/procthread/creating-a-child-process-with-redirected-input-and-output
@@ -205,7 +347,7 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
     siStartInfo.cb = sizeof(STARTUPINFO);
     // NOTE: theoretically setting NULL to std handles should not be a problem
     // https://docs.microsoft.com/en-us/windows/console/getstdhandle?redirectedfrom=MSDN#attachdetach-behavior
-    siStartInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    siStartInfo.hStdError = fderr ? *fderr : GetStdHandle(STD_ERROR_HANDLE);
     // TODO(#32): check for errors in GetStdHandle
     siStartInfo.hStdOutput = fdout ? *fdout : GetStdHandle(STD_OUTPUT_HANDLE);
     siStartInfo.hStdInput = fdin ? *fdin : GetStdHandle(STD_INPUT_HANDLE);
@@ -215,7 +357,7 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
     ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
 
     BOOL bSuccess =
-        CreateProcess(
+        NOBUILD__STATS_CALL(STATS_FORK, CreateProcess(
             NULL,
             // TODO(#33): cmd_run_async on Windows does not render command line properly
             // It may require wrapping some arguments with double-quotes if they contains spaces, etc.
@@ -228,7 +370,7 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
             NULL,
             &siStartInfo,
             &piProcInfo
-        );
+        ));
 
     if (!bSuccess) {
         PANIC("Could not create child process %s: %s\n",
@@ -246,11 +388,25 @@ void cmd_run_sync(Cmd cmd)
     pid_wait(cmd_run_async(cmd, NULL, NULL));
 }
 
-static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token token)
+static void chain_push_token(Chain *chain, Chain_Token token)
 {
     switch (token.type) {
     case CHAIN_TOKEN_CMD: {
-        chain->cmds.count += 1;
+        da_append(&chain->cmds, ((Cmd) {
+            .line = token.args
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_FN: {
+        da_append(&chain->fns, ((Chain_Fn_Stage) {
+            .position = chain->cmds.count,
+            .fn = token.fn,
+            .data = token.data
+        }));
+        da_append(&chain->cmds, ((Cmd) {
+            .line = token.args
+        }));
     }
     break;
 
@@ -272,6 +428,50 @@ static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token
     }
     break;
 
+    case CHAIN_TOKEN_ERR: {
+        if (chain->error_filepath) {
+            PANIC("Error file path was already set to %s", chain->error_filepath);
+        }
+
+        chain->error_filepath = token.args.elems[0];
+    }
+    break;
+
+    case CHAIN_TOKEN_MERGE_ERR: {
+        if (chain->cmds.count == 0) {
+            PANIC("CHAIN_MERGE_ERR has to follow a CHAIN_CMD, but comes before stage %zu", chain->cmds.count);
+        }
+
+        const size_t position = chain->cmds.count - 1;
+        if (chain->fns.count > 0 && chain->fns.elems[chain->fns.count - 1].position == position) {
+            PANIC("CHAIN_MERGE_ERR has to follow a CHAIN_CMD, not CHAIN_FN(%s)", chain->cmds.elems[position].line.elems[0]);
+        }
+        da_append(&chain->merged_err, position);
+    }
+    break;
+
+    case CHAIN_TOKEN_TEE: {
+        if (token.chain->input_filepath) {
+            PANIC("A CHAIN_TEE branch reads the stream of its chain and cannot have an input file %s",
+                  token.chain->input_filepath);
+        }
+
+        da_append(&chain->tees, ((Chain_Tee) {
+            .position = chain->cmds.count,
+            .chain = token.chain
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_PIPE_SIZE: {
+        if (chain->pipe_size) {
+            PANIC("Pipe size was already set to %zu", chain->pipe_size);
+        }
+
+        chain->pipe_size = token.size;
+    }
+    break;
+
     case CHAIN_TOKEN_END:
     default: {
         assert(0 && "unreachable");
@@ -280,122 +480,470 @@ static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token
     }
 }
 
-static void chain_push_cmd(Chain *chain, Chain_Token token)
-{
-    if (token.type == CHAIN_TOKEN_CMD) {
-        chain->cmds.elems[chain->cmds.count++] = (Cmd) {
-            .line = token.args
-        };
-    }
-}
-
 Chain chain_build_from_tokens(Chain_Token first, ...)
 {
     Chain result = {0};
 
-    chain_set_input_output_files_or_count_cmds(&result, first);
+    chain_push_token(&result, first);
     va_list args;
     va_start(args, first);
-    Chain_Token next = va_arg(args, Chain_Token);
-    while (next.type != CHAIN_TOKEN_END) {
-        chain_set_input_output_files_or_count_cmds(&result, next);
-        next = va_arg(args, Chain_Token);
+    for (Chain_Token next = va_arg(args, Chain_Token);
+            next.type != CHAIN_TOKEN_END;
+            next = va_arg(args, Chain_Token)) {
+        chain_push_token(&result, next);
     }
     va_end(args);
 
-    result.cmds.elems = malloc(sizeof(result.cmds.elems[0]) * result.cmds.count);
-    if (result.cmds.elems == NULL) {
+    return result;
+}
+
+Chain *chain_branch(Chain chain)
+{
+    Chain *result = temp_alloc(sizeof(*result));
+    *result = chain;
+    return result;
+}
+
+// Pumps between the chain files and the pipes run on threads, which would block
+// forever when they run inline
+#if !defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__CHAIN_CAN_PUMP 1
+#else
+#	define NOBUILD__CHAIN_CAN_PUMP 0
+#endif
+
+typedef struct {
+    Fd in;
+    Fd out;
+    // Only set for tees
+    Fd branch;
+    int tee;
+} Nobuild__Chain_Pump;
+
+typedef struct {
+    Chain_Fn fn;
+    void *data;
+    Cstr name;
+    Fd in;
+    Fd out;
+    Thread thread;
+    int result;
+} Nobuild__Chain_Stage;
+
+// Everything a running chain and its branches have to be waited for
+typedef struct {
+    struct {
+        Pid *elems;
+        size_t count;
+        size_t capacity;
+    } pids;
+    struct {
+        Thread *elems;
+        size_t count;
+        size_t capacity;
+    } pumps;
+    struct {
+        Nobuild__Chain_Stage **elems;
+        size_t count;
+        size_t capacity;
+    } stages;
+    // Replace their paths once everything above is done
+    struct {
+        Atomic_File *elems;
+        size_t count;
+        size_t capacity;
+    } outputs;
+} Nobuild__Chain_Jobs;
+
+static void nobuild__chain_pump(void *data)
+{
+    Nobuild__Chain_Pump *pump = data;
+    unsigned long long bytes;
+    if (pump->tee) {
+        bytes = fd_tee(pump->in, pump->branch, pump->out);
+        fd_close(pump->branch);
+    } else {
+        bytes = fd_pump(pump->in, pump->out);
+    }
+    NOBUILD__STATS_PIPED(bytes);
+    fd_close(pump->in);
+    fd_close(pump->out);
+    free(pump);
+}
+
+static void nobuild__chain_pump_start(Nobuild__Chain_Jobs *jobs, Nobuild__Chain_Pump pump)
+{
+    Nobuild__Chain_Pump *data = NOBUILD__MALLOC(sizeof(*data));
+    if (data == NULL) {
         PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
     }
-    result.cmds.count = 0;
+    *data = pump;
+    da_append(&jobs->pumps, thread_create(nobuild__chain_pump, data));
+}
 
-    chain_push_cmd(&result, first);
+static void nobuild__chain_pid_push(Nobuild__Chain_Jobs *jobs, Pid pid)
+{
+    da_append(&jobs->pids, pid);
+}
 
-    va_start(args, first);
-    next = va_arg(args, Chain_Token);
-    while (next.type != CHAIN_TOKEN_END) {
-        chain_push_cmd(&result, next);
-        next = va_arg(args, Chain_Token);
+static void nobuild__chain_stage(void *data)
+{
+    Nobuild__Chain_Stage *stage = data;
+    stage->result = stage->fn(stage->in, stage->out, stage->data);
+    fd_close(stage->in);
+    fd_close(stage->out);
+}
+
+static const Chain_Fn_Stage *nobuild__chain_fn_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.fns.count; ++i) {
+        if (chain.fns.elems[i].position == position) {
+            return &chain.fns.elems[i];
+        }
     }
-    va_end(args);
+    return NULL;
+}
 
-    return result;
+// Stages and pumps close what they are given, so they get their own copy of the
+// standard streams of nobuild
+static Fd nobuild__chain_dup_std(int output)
+{
+#ifndef _WIN32
+    Fd fd = dup(output ? STDOUT_FILENO : STDIN_FILENO);
+    if (fd < 0) {
+        PANIC("Could not duplicate %s: %s", output ? "stdout" : "stdin", nobuild__strerror(errno));
+    }
+#else
+    Fd fd = GetStdHandle(output ? STD_OUTPUT_HANDLE : STD_INPUT_HANDLE);
+    if (!DuplicateHandle(GetCurrentProcess(), fd, GetCurrentProcess(), &fd, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+        PANIC("Could not duplicate %s: %s", output ? "stdout" : "stdin", nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    return fd;
 }
 
-void chain_run_sync(Chain chain)
+static int nobuild__chain_merges_err_at(Chain chain, size_t position)
 {
-    if (chain.cmds.count == 0) {
+    for (size_t i = 0; i < chain.merged_err.count; ++i) {
+        if (chain.merged_err.elems[i] == position) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Starts the command or function at `index` of `chain` between `fdin` and `fdout`,
+// where NULL stands for the standard streams. Both are owned by the stage afterwards.
+// Commands write their stderr to `fderr` when it is given.
+static void nobuild__chain_stage_start(Chain chain, size_t index, Fd *fdin, Fd *fdout, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    const Chain_Fn_Stage *fn = nobuild__chain_fn_at(chain, index);
+    if (fn == NULL) {
+        if (nobuild__chain_merges_err_at(chain, index)) {
+            Fd fdstd = fdout ? *fdout : nobuild__chain_dup_std(1);
+            nobuild__chain_pid_push(jobs, cmd_run_async_ex(chain.cmds.elems[index], fdin, &fdstd, &fdstd));
+            if (!fdout) fd_close(fdstd);
+        } else {
+            nobuild__chain_pid_push(jobs, cmd_run_async_ex(chain.cmds.elems[index], fdin, fdout, fderr));
+        }
+        if (fdin) fd_close(*fdin);
+        if (fdout) fd_close(*fdout);
         return;
     }
 
-    Pid *cpids = malloc(sizeof(Pid) * chain.cmds.count);
+    if (!NOBUILD__CHAIN_CAN_PUMP) {
+        PANIC("CHAIN_FN(%s) needs threads, which are disabled by NOBUILD_NO_THREADS", chain.cmds.elems[index].line.elems[0]);
+    }
+
+    Nobuild__Chain_Stage *stage = NOBUILD__MALLOC(sizeof(*stage));
+    if (stage == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    *stage = (Nobuild__Chain_Stage) {
+        .fn = fn->fn,
+        .data = fn->data,
+        .name = chain.cmds.elems[index].line.elems[0],
+        .in = fdin ? *fdin : nobuild__chain_dup_std(0),
+        .out = fdout ? *fdout : nobuild__chain_dup_std(1)
+    };
+    da_append(&jobs->stages, stage);
+    stage->thread = thread_create(nobuild__chain_stage, stage);
+}
+
+// Opens the output file of a chain, which is handed to a stage or a pump that closes it
+static Fd nobuild__chain_output_open(Nobuild__Chain_Jobs *jobs, Cstr path)
+{
+    da_append(&jobs->outputs, atomic_file_open(path));
+    return jobs->outputs.elems[jobs->outputs.count - 1].fd;
+}
+
+static Pipe nobuild__chain_pipe(Chain chain)
+{
+    Pipe pip = pipe_make();
+    if (chain.pipe_size) {
+        pipe_set_size(pip, chain.pipe_size);
+    }
+    return pip;
+}
+
+// Whether the input or output `fd` of `chain` is pumped through a pipe of the chain's
+// size. Regular files are not, since a pump only adds a thread and a copy to them.
+static int nobuild__chain_pumps(Chain chain, Fd fd)
+{
+    if (chain.pipe_size == 0 || !NOBUILD__CHAIN_CAN_PUMP) {
+        return 0;
+    }
+
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    return NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0 || !S_ISREG(statbuf.st_mode);
+#else
+    return GetFileType(fd) != FILE_TYPE_DISK;
+#endif // _WIN32
+}
+
+static int nobuild__chain_has_tee_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.tees.count; ++i) {
+        if (chain.tees.elems[i].position == position) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void nobuild__chain_start(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs);
+
+// Splits the stream `*fdprev` into every branch that sits at `position` and
+// points `fdprev` at the copy that continues down the chain
+static Fd *nobuild__chain_start_tees(Chain chain, size_t position, Fd *fdprev, Fd *fdin, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    for (size_t i = 0; i < chain.tees.count; ++i) {
+        Chain_Tee tee = chain.tees.elems[i];
+        if (tee.position != position) {
+            continue;
+        }
+
+        if (fdprev == NULL) {
+            PANIC("CHAIN_TEE in front of command %zu has no stream to copy, add a CHAIN_IN or a CHAIN_CMD before it", position);
+        }
 
+        if (!NOBUILD__CHAIN_CAN_PUMP) {
+            PANIC("CHAIN_TEE in front of command %zu needs threads, which are disabled by NOBUILD_NO_THREADS", position);
+        }
+
+        if (tee.chain->pipe_size == 0) {
+            tee.chain->pipe_size = chain.pipe_size;
+        }
+
+        Pipe branch = nobuild__chain_pipe(chain);
+        Pipe next = nobuild__chain_pipe(chain);
+        nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+            .in = *fdprev,
+            .out = next.write,
+            .branch = branch.write,
+            .tee = 1
+        });
+
+        nobuild__chain_start(*tee.chain, &branch.read, fderr, jobs);
+        *fdin = next.read;
+        fdprev = fdin;
+    }
+
+    return fdprev;
+}
+
+static void nobuild__chain_start_stages(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
     Pipe pip = {0};
     Fd fdin = 0;
     Fd *fdprev = NULL;
 
-    if (chain.input_filepath) {
+    if (input) {
+        fdin = *input;
+        fdprev = &fdin;
+    } else if (chain.input_filepath) {
         fdin = fd_open_for_read(chain.input_filepath);
+        // A function stage reads the file itself just as fast as a pump would
+        if (!nobuild__chain_fn_at(chain, 0) && nobuild__chain_pumps(chain, fdin)) {
+            pip = nobuild__chain_pipe(chain);
+            nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+                .in = fdin,
+                .out = pip.write
+            });
+            fdin = pip.read;
+        }
         fdprev = &fdin;
     }
 
-    for (size_t i = 0; i < chain.cmds.count - 1; ++i) {
-        pip = pipe_make();
-
-        cpids[i] = cmd_run_async(
-                       chain.cmds.elems[i],
-                       fdprev,
-                       &pip.write);
-
-        if (fdprev) fd_close(*fdprev);
-        fd_close(pip.write);
-        fdprev = &fdin;
-        fdin = pip.read;
-    }
+    // The last command only writes to the output directly when no tee follows it
+    const int tail = nobuild__chain_has_tee_at(chain, chain.cmds.count);
+    for (size_t i = 0; i < chain.cmds.count; ++i) {
+        fdprev = nobuild__chain_start_tees(chain, i, fdprev, &fdin, fderr, jobs);
+
+        if (i + 1 < chain.cmds.count || tail) {
+            pip = nobuild__chain_pipe(chain);
+            nobuild__chain_stage_start(chain, i, fdprev, &pip.write, fderr, jobs);
+            fdin = pip.read;
+            fdprev = &fdin;
+            continue;
+        }
 
-    {
         Fd fdout = 0;
         Fd *fdnext = NULL;
 
         if (chain.output_filepath) {
-            fdout = fd_open_for_write(chain.output_filepath);
+            fdout = nobuild__chain_output_open(jobs, chain.output_filepath);
+            if (!nobuild__chain_fn_at(chain, i) && nobuild__chain_pumps(chain, fdout)) {
+                pip = nobuild__chain_pipe(chain);
+                nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+                    .in = pip.read,
+                    .out = fdout
+                });
+                fdout = pip.write;
+            }
             fdnext = &fdout;
         }
 
-        const size_t last = chain.cmds.count - 1;
-        cpids[last] =
-            cmd_run_async(
-                chain.cmds.elems[last],
-                fdprev,
-                fdnext);
+        nobuild__chain_stage_start(chain, i, fdprev, fdnext, fderr, jobs);
+        return;
+    }
 
-        if (fdprev) fd_close(*fdprev);
-        if (fdnext) fd_close(*fdnext);
+    // The stream is left after the trailing tees, or the chain had no commands at all
+    fdprev = nobuild__chain_start_tees(chain, chain.cmds.count, fdprev, &fdin, fderr, jobs);
+    if (fdprev == NULL) {
+        return;
     }
 
-    for (size_t i = 0; i < chain.cmds.count; ++i) {
-        pid_wait(cpids[i]);
+    if (!NOBUILD__CHAIN_CAN_PUMP) {
+        PANIC("Chain of %zu commands needs threads to pump its output, which are disabled by NOBUILD_NO_THREADS", chain.cmds.count);
     }
+
+    Fd fdout = chain.output_filepath ? nobuild__chain_output_open(jobs, chain.output_filepath) : nobuild__chain_dup_std(1);
+
+    nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+        .in = *fdprev,
+        .out = fdout
+    });
 }
 
-void chain_echo(Chain chain)
+// Starts the commands of `chain` reading from `input` when it is given, which is
+// then owned by the chain. Commands write their stderr to the error file of the
+// chain, or to `fderr` when it has none.
+static void nobuild__chain_start(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    // The commands keep their own copies, so the file is closed as soon as they run
+    Fd fdfile = 0;
+    if (chain.error_filepath) {
+        fdfile = fd_open_for_write(chain.error_filepath);
+        fderr = &fdfile;
+    }
+
+    nobuild__chain_start_stages(chain, input, fderr, jobs);
+
+    if (chain.error_filepath) {
+        fd_close(fdfile);
+    }
+}
+
+void chain_run_sync(Chain chain)
+{
+    if (chain.cmds.count == 0 && chain.tees.count == 0) {
+        return;
+    }
+
+    Nobuild__Chain_Jobs jobs = {0};
+    const int pump = (chain.pipe_size > 0 || chain.tees.count > 0 || chain.fns.count > 0) && NOBUILD__CHAIN_CAN_PUMP;
+#ifndef _WIN32
+    // A command that stops reading early must not take nobuild down with it, since
+    // pumps and function stages write to it from inside nobuild
+    void (*sigpipe)(int) = pump ? signal(SIGPIPE, SIG_IGN) : SIG_DFL;
+#endif // _WIN32
+
+    nobuild__chain_start(chain, NULL, NULL, &jobs);
+
+    FOREACH_ARRAY(Pid, pid, jobs.pids, pid_wait(*pid));
+    FOREACH_ARRAY(Thread, thread, jobs.pumps, thread_join(*thread));
+    FOREACH_ARRAY(Nobuild__Chain_Stage *, stage, jobs.stages, thread_join((*stage)->thread));
+
+#ifndef _WIN32
+    if (pump) {
+        signal(SIGPIPE, sigpipe);
+    }
+#endif // _WIN32
+
+    for (size_t i = 0; i < jobs.stages.count; ++i) {
+        Nobuild__Chain_Stage *stage = jobs.stages.elems[i];
+        if (stage->result != 0) {
+            PANIC("CHAIN_FN(%s) failed with %d", stage->name, stage->result);
+        }
+        free(stage);
+    }
+
+    // A failed chain has panicked by now and left the previous outputs in place
+    FOREACH_ARRAY(Atomic_File, output, jobs.outputs, nobuild__atomic_file_rename(output));
+
+    da_free(&jobs.outputs);
+    da_free(&jobs.stages);
+    da_free(&jobs.pumps);
+    da_free(&jobs.pids);
+}
+
+// `sep` goes in front of the first command, branches start without one
+static void nobuild__chain_echo(Chain chain, Cstr sep)
 {
-    printf("[INFO] CHAIN:");
     if (chain.input_filepath) {
         printf(" %s", chain.input_filepath);
+        sep = " |> ";
     }
 
-    for (size_t cmd_index = 0; cmd_index < chain.cmds.count; ++cmd_index) {
-        Cmd *cmd = &chain.cmds.elems[cmd_index];
-        printf(" |> %s", cmd_show(*cmd));
+    for (size_t cmd_index = 0; cmd_index <= chain.cmds.count; ++cmd_index) {
+        for (size_t i = 0; i < chain.tees.count; ++i) {
+            if (chain.tees.elems[i].position == cmd_index) {
+                printf("%stee(", sep);
+                nobuild__chain_echo(*chain.tees.elems[i].chain, "");
+                printf(")");
+                sep = " |> ";
+            }
+        }
+
+        if (cmd_index < chain.cmds.count) {
+            Cmd *cmd = &chain.cmds.elems[cmd_index];
+            if (nobuild__chain_fn_at(chain, cmd_index)) {
+                printf("%s%s()", sep, cmd->line.elems[0]);
+            } else {
+                printf("%s%s", sep, cmd_show(*cmd));
+            }
+            if (nobuild__chain_merges_err_at(chain, cmd_index)) {
+                printf(" 2>&1");
+            }
+            sep = " |> ";
+        }
     }
 
     if (chain.output_filepath) {
-        printf(" |> %s", chain.output_filepath);
+        printf("%s%s", sep, chain.output_filepath);
     }
 
+    if (chain.error_filepath) {
+        printf(" 2> %s", chain.error_filepath);
+    }
+}
+
+void chain_echo(Chain chain)
+{
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
+    printf("[INFO] CHAIN:");
+    nobuild__chain_echo(chain, " |> ");
     printf("\n");
 }
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_CMD_I_
 #endif // NOBUILD_CMD_IMPLEMENTATION
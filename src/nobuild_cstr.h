@@ -3,6 +3,17 @@
 
 #include <stddef.h>
 
+#include "nobuild_arena.h"
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
 #ifndef NOBUILD__DEPRECATED
 #	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
 #		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
@@ -19,30 +30,174 @@ int cstr_ends_with(Cstr cstr, Cstr postfix);
 int cstr_starts_with(Cstr cstr, Cstr prefix);
 #define STARTS_WITH(cstr, prefix) cstr_starts_with(cstr, prefix)
 
+// A string that carries its length, so it never has to be measured again. The data
+// is not null terminated, unless it comes straight from a `Cstr`.
+typedef struct {
+    const char *data;
+    size_t count;
+} String_View;
+
+// Only for string literals, whose length is known at compile time
+#define SV(cstr_lit) ((String_View) { (cstr_lit), sizeof(cstr_lit) - 1 })
+// printf("name: "SV_FMT"\n", SV_ARG(name));
+#define SV_FMT "%.*s"
+#define SV_ARG(sv) (int) (sv).count, (sv).data
+
+String_View sv_from_cstr(Cstr cstr);
+String_View sv_from_parts(const char *data, size_t count);
+// Copies the view into the temporary arena with a null terminator
+Cstr sv_to_cstr(String_View sv);
+
+int sv_eq(String_View a, String_View b);
+// Compares without measuring `cstr` first
+int sv_eq_cstr(String_View sv, Cstr cstr);
+int sv_starts_with(String_View sv, String_View prefix);
+int sv_ends_with(String_View sv, String_View suffix);
+// Index of the first occurrence of `needle`, or `sv.count` when there is none
+size_t sv_find(String_View sv, String_View needle);
+// Index of the last occurrence of `c`, or `sv.count` when there is none
+size_t sv_rfind_char(String_View sv, char c);
+String_View sv_trim(String_View sv);
+
+// Cut `n` bytes off the front or the back of `sv` and return them
+String_View sv_chop_left(String_View *sv, size_t n);
+String_View sv_chop_right(String_View *sv, size_t n);
+// Returns everything before the first `delim` and leaves `sv` with everything after
+// it, or returns all of `sv` and leaves it empty when there is no `delim`
+String_View sv_chop_by_delim(String_View *sv, char delim);
+
 typedef struct {
     Cstr *elems;
     size_t count;
+    // Number of elements `elems` has room for. Arrays that wrap storage nobuild did
+    // not allocate, like `argv`, leave it at 0 and are copied on the first append.
     size_t capacity;
 } Cstr_Array;
 
 Cstr_Array cstr_array_make(Cstr first, ...);
 #define CSTR_ARRAY_MAKE(first, ...) cstr_array_make(first, ##__VA_ARGS__, NULL)
-
+// An array of the arguments whose storage lives until the end of the enclosing block,
+// without counting them at runtime or allocating. It has no capacity, so appending
+// to it copies it into the temporary arena first.
+#define CSTR_ARRAY_LOCAL(...)                                        \
+    ((Cstr_Array) {                                                  \
+        .elems = (Cstr[]) { __VA_ARGS__ },                           \
+        .count = sizeof((Cstr[]) { __VA_ARGS__ }) / sizeof(Cstr)     \
+    })
+
+// Appending to a full array doubles its capacity
 Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr);
 
+// Makes room for at least `capacity` elements in total
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity);
+// Drops the capacity beyond `count`. The memory only goes back to the arena when the
+// array is its last allocation.
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs);
+
 Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr);
 
 Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b);
 
 int cstr_array_contains(Cstr_Array cstrs, Cstr cstr);
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv);
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv);
 
+// Splits `cstr` at every `delim` in a single pass. The pieces are cut out of one copy
+// of `cstr`, and an empty `delim` leaves it whole.
 Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim);
 #define SPLIT(cstr, delim) cstr_array_from_cstr(cstr, delim)
 
+typedef struct {
+    String_View *elems;
+    size_t count;
+    size_t capacity;
+} String_View_Array;
+
+// Like `SPLIT()`, but the pieces are views into `sv` and only the array is allocated
+String_View_Array sv_split(String_View sv, String_View delim);
+
+// Hands out the pieces of a split one at a time, without allocating anything:
+//
+//     Split_Iter it = split_iter_make(sv_from_cstr(output), SV("\n"));
+//     String_View line;
+//     while (split_iter_next(&it, &line)) { ... }
+typedef struct {
+    String_View rest;
+    String_View delim;
+    int done;
+} Split_Iter;
+
+Split_Iter split_iter_make(String_View sv, String_View delim);
+// Stores the next piece in `piece`, or returns 0 when there are no more
+int split_iter_next(Split_Iter *it, String_View *piece);
+
 Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
-#define JOIN(sep, ...) cstr_array_join(sep, cstr_array_make(__VA_ARGS__, NULL))
+
+// Returns the single copy that is kept of every distinct string, so that interned
+// strings are equal exactly when their pointers are. The copies are kept in a hash
+// set for the whole process, in an arena of their own that `temp_reset()` leaves alone.
+Cstr intern(Cstr cstr);
+Cstr intern_sv(String_View sv);
+// The interned copy of `sv`, or NULL when it was never interned
+Cstr intern_find(String_View sv);
+
+// Interns every element of `cstrs` in place
+Cstr_Array cstr_array_intern(Cstr_Array cstrs);
+// Compare pointers instead of strings, for arrays and strings that are all interned
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned);
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned);
+
+// Joins the strings up to the NULL that terminates them, without building an array
+Cstr cstr_join(Cstr sep, Cstr first, ...);
+#define JOIN(sep, ...) cstr_join(sep, __VA_ARGS__, NULL)
 #define CONCAT(...) JOIN("", __VA_ARGS__)
 
+// Like `JOIN` and `CONCAT`, but for string literals only, which the compiler pastes
+// together into a single literal. Anything else fails to compile. Takes up to 16 of them.
+#define JOIN_LIT(sep, ...) "" NOBUILD__CAT(NOBUILD__JOIN_LIT_, NOBUILD__NARGS(__VA_ARGS__))(sep, __VA_ARGS__)
+#define CONCAT_LIT(...) JOIN_LIT("", __VA_ARGS__)
+
+#define NOBUILD__CAT(a, b) NOBUILD__CAT_(a, b)
+#define NOBUILD__CAT_(a, b) a##b
+#define NOBUILD__NARGS(...) NOBUILD__NARGS_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NOBUILD__NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+#define NOBUILD__JOIN_LIT_1(sep, lit) lit ""
+#define NOBUILD__JOIN_LIT_2(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_1(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_3(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_2(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_4(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_3(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_5(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_4(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_6(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_5(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_7(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_6(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_8(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_7(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_9(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_8(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_10(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_9(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_11(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_10(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_12(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_11(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_13(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_12(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_14(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_13(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_15(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_14(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_16(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_15(sep, __VA_ARGS__)
+
+// A growable string. The buffer comes from `arena`, or from the temporary arena when
+// it is NULL, and doubles when it runs out. The last allocation of an arena grows in
+// place, so a string built in one go usually costs a single allocation.
+typedef struct {
+    char *elems;
+    size_t count;
+    size_t capacity;
+    Arena *arena;
+} String_Builder;
+
+// Makes room for `size` more bytes and a null terminator
+void sb_reserve(String_Builder *sb, size_t size);
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size);
+void sb_append_cstr(String_Builder *sb, Cstr cstr);
+void sb_append_sv(String_Builder *sb, String_View sv);
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+// Null terminates the string, gives back the capacity it does not use and returns
+// it. The builder is left empty for the next string.
+Cstr sb_to_cstr(String_Builder *sb);
+
 #endif  // NOBUILD_CSTR_H_
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -51,14 +206,25 @@ Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
 #ifndef NOBUILD_CSTR_I_
 #define NOBUILD_CSTR_I_
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 
 #define NOBUILD_LOG_IMPLEMENTATION
 #include "nobuild_log.h"
 
+#define NOBUILD_ARENA_IMPLEMENTATION
+#include "nobuild_arena.h"
+
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CSTR
+
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #ifndef NOBUILD__STRERROR
 #define NOBUILD__STRERROR
@@ -76,17 +242,142 @@ Cstr nobuild__strerror(int errnum)
 
 int cstr_ends_with(Cstr cstr, Cstr postfix)
 {
-    const size_t cstr_len = strlen(cstr);
-    const size_t postfix_len = strlen(postfix);
-    return postfix_len <= cstr_len
-           && strcmp(cstr + cstr_len - postfix_len, postfix) == 0;
+    return sv_ends_with(sv_from_cstr(cstr), sv_from_cstr(postfix));
 }
 
 int cstr_starts_with(Cstr cstr, Cstr prefix)
 {
-    const size_t cstr_len = strlen(cstr);
-    const size_t prefix_len = strlen(prefix);
-    return prefix_len <= cstr_len && strncmp(cstr, prefix, prefix_len) == 0;
+    // Stops at the first difference instead of measuring `cstr`
+    for (; *prefix != '\0'; ++prefix, ++cstr) {
+        if (*cstr != *prefix) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+String_View sv_from_cstr(Cstr cstr)
+{
+    return sv_from_parts(cstr, strlen(cstr));
+}
+
+String_View sv_from_parts(const char *data, size_t count)
+{
+    String_View sv = { .data = data, .count = count };
+    return sv;
+}
+
+Cstr sv_to_cstr(String_View sv)
+{
+    char *result = temp_alloc(sv.count + 1);
+    memcpy(result, sv.data, sv.count);
+    result[sv.count] = '\0';
+    return result;
+}
+
+int sv_eq(String_View a, String_View b)
+{
+    return a.count == b.count && memcmp(a.data, b.data, a.count) == 0;
+}
+
+int sv_eq_cstr(String_View sv, Cstr cstr)
+{
+    for (size_t i = 0; i < sv.count; ++i) {
+        if (cstr[i] == '\0' || cstr[i] != sv.data[i]) {
+            return 0;
+        }
+    }
+    return cstr[sv.count] == '\0';
+}
+
+int sv_starts_with(String_View sv, String_View prefix)
+{
+    return prefix.count <= sv.count && memcmp(sv.data, prefix.data, prefix.count) == 0;
+}
+
+int sv_ends_with(String_View sv, String_View suffix)
+{
+    return suffix.count <= sv.count
+           && memcmp(sv.data + sv.count - suffix.count, suffix.data, suffix.count) == 0;
+}
+
+size_t sv_find(String_View sv, String_View needle)
+{
+    if (needle.count == 0) {
+        return 0;
+    }
+
+    // Jump between candidates for the first byte and compare the rest there
+    size_t i = 0;
+    while (needle.count <= sv.count - i) {
+        const char *first = memchr(sv.data + i, needle.data[0], sv.count - i - needle.count + 1);
+        if (first == NULL) {
+            break;
+        }
+
+        i = (size_t) (first - sv.data);
+        if (memcmp(first + 1, needle.data + 1, needle.count - 1) == 0) {
+            return i;
+        }
+        i += 1;
+    }
+    return sv.count;
+}
+
+size_t sv_rfind_char(String_View sv, char c)
+{
+    for (size_t i = sv.count; i-- > 0;) {
+        if (sv.data[i] == c) {
+            return i;
+        }
+    }
+    return sv.count;
+}
+
+String_View sv_trim(String_View sv)
+{
+    while (sv.count > 0 && isspace((unsigned char) sv.data[0])) {
+        sv.data += 1;
+        sv.count -= 1;
+    }
+    while (sv.count > 0 && isspace((unsigned char) sv.data[sv.count - 1])) {
+        sv.count -= 1;
+    }
+    return sv;
+}
+
+String_View sv_chop_left(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
+    }
+
+    String_View result = sv_from_parts(sv->data, n);
+    sv->data += n;
+    sv->count -= n;
+    return result;
+}
+
+String_View sv_chop_right(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
+    }
+
+    sv->count -= n;
+    return sv_from_parts(sv->data + sv->count, n);
+}
+
+String_View sv_chop_by_delim(String_View *sv, char delim)
+{
+    const char *found = sv->count > 0 ? memchr(sv->data, delim, sv->count) : NULL;
+    if (found == NULL) {
+        return sv_chop_left(sv, sv->count);
+    }
+
+    String_View result = sv_chop_left(sv, (size_t) (found - sv->data));
+    sv_chop_left(sv, 1);
+    return result;
 }
 
 Cstr_Array cstr_array_make(Cstr first, ...)
@@ -96,25 +387,18 @@ Cstr_Array cstr_array_make(Cstr first, ...)
     if (first == NULL) {
         return result;
     }
-    result.count += 1;
 
+    // Counting the arguments first sizes the array exactly with a single allocation
+    size_t count = 1;
     va_list args;
     va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.count += 1;
+    while (va_arg(args, Cstr) != NULL) {
+        count += 1;
     }
     va_end(args);
 
-    result.elems = malloc(sizeof *result.elems * result.count);
-    if (result.elems == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
-    }
-
-    result.count = 0;
+    da_reserve(&result, count);
     result.elems[result.count++] = first;
-
     va_start(args, first);
     for (Cstr next = va_arg(args, Cstr);
             next != NULL;
@@ -128,19 +412,27 @@ Cstr_Array cstr_array_make(Cstr first, ...)
 
 Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
 {
-    if (cstrs.capacity < 1) {
-        cstrs.elems = realloc(cstrs.elems, sizeof *cstrs.elems * (cstrs.count + 10));
-        cstrs.capacity += 10;
-        if (cstrs.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-    }
+    da_append(&cstrs, cstr);
+    return cstrs;
+}
 
-    cstrs.elems[cstrs.count++] = cstr;
-    cstrs.capacity--;
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity)
+{
+    da_reserve(&cstrs, capacity);
     return cstrs;
 }
 
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs)
+{
+    if (cstrs.capacity <= cstrs.count) {
+        return cstrs;
+    }
+
+    cstrs.elems = temp_realloc(cstrs.elems, sizeof *cstrs.elems * cstrs.capacity,
+                               sizeof *cstrs.elems * cstrs.count);
+    cstrs.capacity = cstrs.count;
+    return cstrs;
+}
 
 Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
 {
@@ -149,16 +441,18 @@ Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
     }
 
     if (cstr == NULL) {
-        cstrs.elems[--cstrs.count];
-        cstrs.capacity++;
+        cstrs.count--;
         return cstrs;
     }
 
+    return cstr_array_remove_sv(cstrs, sv_from_cstr(cstr));
+}
+
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv)
+{
     // Find the index of the element to be removed
-    const size_t cstr_len = strlen(cstr);
     for (size_t i = 0; i < cstrs.count; i++) {
-        const size_t elem_len = strlen(cstrs.elems[i]);
-        if (elem_len != cstr_len || strcmp(cstrs.elems[i], cstr) != 0) {
+        if (!sv_eq_cstr(sv, cstrs.elems[i])) {
             continue;
         }
 
@@ -167,9 +461,6 @@ Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
             cstrs.elems[j] = cstrs.elems[j + 1];
         }
         cstrs.count--;
-        cstrs.capacity++;
-
-        // TODO: Might want to realloc array if capacity is too high
         return cstrs;
     }
 
@@ -179,17 +470,11 @@ Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
 
 Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
 {
-    if (cstrs_a.capacity < cstrs_b.count) {
-        cstrs_a.elems = realloc(cstrs_a.elems, sizeof *cstrs_a.elems * (cstrs_a.count + cstrs_b.count));
-        cstrs_a.capacity += cstrs_b.count;
-        if (cstrs_a.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
+    if (cstrs_b.count == 0) {
+        return cstrs_a;
     }
 
-    memcpy(cstrs_a.elems + cstrs_a.count, cstrs_b.elems, sizeof *cstrs_a.elems * cstrs_b.count);
-    cstrs_a.count += cstrs_b.count;
-    cstrs_a.capacity -= cstrs_b.count;
+    da_append_many(&cstrs_a, cstrs_b.elems, cstrs_b.count);
     return cstrs_a;
 }
 
@@ -202,119 +487,330 @@ int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
     return 0;
 }
 
-Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv)
 {
-    size_t len = strlen(cstr);
-    size_t d_len = strlen(delim);
-    size_t substr_count = 1;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (sv_eq_cstr(sv, cstrs.elems[i])) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
-        }
+Split_Iter split_iter_make(String_View sv, String_View delim)
+{
+    Split_Iter it = { .rest = sv, .delim = delim };
+    return it;
+}
 
-        if (delim_found) {
-            substr_count++;
-            i += d_len - 1;
-        }
+int split_iter_next(Split_Iter *it, String_View *piece)
+{
+    if (it->done) {
+        return 0;
     }
 
-    // if dlen == 0 or was never found
-    if (substr_count == 1) {
-        // TODO: differentiate between delim == null and delim == "" and delim not found
-        //       Split the string into an array of strings, where each string is a single character
-        return cstr_array_make(cstr);
+    // `sv_find()` jumps between candidates with memchr(), which is vectorized by the libc
+    const size_t i = it->delim.count > 0 ? sv_find(it->rest, it->delim) : it->rest.count;
+    const int found = i < it->rest.count;
+    *piece = sv_chop_left(&it->rest, i);
+    if (found) {
+        sv_chop_left(&it->rest, it->delim.count);
+    } else {
+        it->done = 1;
     }
+    return 1;
+}
 
-    Cstr_Array ret = { .count = substr_count };
-    ret.elems = malloc(sizeof(Cstr) * ret.count);
-    if (ret.elems == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+String_View_Array sv_split(String_View sv, String_View delim)
+{
+    String_View_Array result = {0};
+    Split_Iter it = split_iter_make(sv, delim);
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        da_append(&result, piece);
     }
+    return result;
+}
 
-    size_t substr_start = 0;
-    size_t substr_index = 0;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
-        }
+Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+{
+    const String_View sv = sv_from_cstr(cstr);
+    Split_Iter it = split_iter_make(sv, sv_from_cstr(delim));
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
+    // The pieces are null terminated in place in a copy of `cstr`
+    char *copy = NULL;
+    Cstr_Array result = {0};
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        if (it.done && result.count == 0) {
+            // `delim` was never found
+            return cstr_array_make(cstr, NULL);
         }
 
-        if (!delim_found) {
-            continue;
+        if (copy == NULL) {
+            copy = temp_alloc(sv.count + 1);
+            memcpy(copy, cstr, sv.count + 1);
         }
 
-        size_t substr_len = i - substr_start;
-        char *substr = calloc(substr_len + 1, sizeof(unsigned char));
-        if (substr == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        char *substr = copy + (piece.data - cstr);
+        substr[piece.count] = '\0';
+        result = cstr_array_append(result, substr);
+    }
+
+    return result;
+}
+
+Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
+{
+    if (cstrs.count == 0) {
+        return "";
+    }
+
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (i > 0) {
+            sb_append_bytes(&sb, sep, sep_len);
         }
+        sb_append_cstr(&sb, cstrs.elems[i]);
+    }
+
+    return sb_to_cstr(&sb);
+}
+
+typedef struct {
+    Cstr cstr;
+    size_t count;
+    unsigned long long hash;
+} Nobuild__Intern_Slot;
 
-        ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-        i += d_len - 1;
-        substr_start = i + 1;
+// Open addressing with linear probing, kept at most half full
+static struct {
+    Arena arena;
+    Nobuild__Intern_Slot *slots;
+    size_t count;
+    size_t capacity;
+} nobuild__intern = {0};
+static Nobuild__Lock nobuild__intern_lock = NOBUILD__LOCK_INIT;
+
+// FNV-1a
+static unsigned long long nobuild__intern_hash(String_View sv)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sv.count; ++i) {
+        hash = (hash ^ (unsigned char) sv.data[i]) * 1099511628211ULL;
     }
+    return hash;
+}
+
+// The slot that holds `sv`, or the empty slot where it belongs
+static Nobuild__Intern_Slot *nobuild__intern_probe(String_View sv, unsigned long long hash)
+{
+    const size_t mask = nobuild__intern.capacity - 1;
+    for (size_t i = (size_t) hash & mask;; i = (i + 1) & mask) {
+        Nobuild__Intern_Slot *slot = &nobuild__intern.slots[i];
+        if (slot->cstr == NULL || (slot->hash == hash && slot->count == sv.count
+                                   && memcmp(slot->cstr, sv.data, sv.count) == 0)) {
+            return slot;
+        }
+    }
+}
+
+static void nobuild__intern_grow(void)
+{
+    Nobuild__Intern_Slot *old_slots = nobuild__intern.slots;
+    const size_t old_capacity = nobuild__intern.capacity;
 
-    // Add the last substring
-    size_t substr_len = len - substr_start;
-    char *substr = malloc(substr_len * sizeof(unsigned char));
-    if (substr == NULL) {
+    nobuild__intern.capacity = old_capacity > 0 ? old_capacity * 2 : 1024;
+    nobuild__intern.slots = NOBUILD__CALLOC(nobuild__intern.capacity, sizeof(*nobuild__intern.slots));
+    if (nobuild__intern.slots == NULL) {
         PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
     }
 
-    ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-    return ret;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].cstr != NULL) {
+            String_View sv = sv_from_parts(old_slots[i].cstr, old_slots[i].count);
+            *nobuild__intern_probe(sv, old_slots[i].hash) = old_slots[i];
+        }
+    }
+    free(old_slots);
 }
 
-Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
+Cstr intern(Cstr cstr)
 {
-    if (cstrs.count == 0) {
-        return "";
+    return intern_sv(sv_from_cstr(cstr));
+}
+
+Cstr intern_sv(String_View sv)
+{
+    const unsigned long long hash = nobuild__intern_hash(sv);
+
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    if ((nobuild__intern.count + 1) * 2 > nobuild__intern.capacity) {
+        nobuild__intern_grow();
     }
 
-    const size_t sep_len = strlen(sep);
-    size_t len = 0;
+    Nobuild__Intern_Slot *slot = nobuild__intern_probe(sv, hash);
+    if (slot->cstr == NULL) {
+        char *copy = arena_alloc(&nobuild__intern.arena, sv.count + 1);
+        memcpy(copy, sv.data, sv.count);
+        copy[sv.count] = '\0';
+
+        slot->cstr = copy;
+        slot->count = sv.count;
+        slot->hash = hash;
+        nobuild__intern.count += 1;
+    }
+    Cstr result = slot->cstr;
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
+
+    return result;
+}
+
+Cstr intern_find(String_View sv)
+{
+    const unsigned long long hash = nobuild__intern_hash(sv);
+
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    Cstr result = NULL;
+    if (nobuild__intern.capacity > 0) {
+        result = nobuild__intern_probe(sv, hash)->cstr;
+    }
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
+
+    return result;
+}
+
+Cstr_Array cstr_array_intern(Cstr_Array cstrs)
+{
     for (size_t i = 0; i < cstrs.count; ++i) {
-        len += strlen(cstrs.elems[i]);
+        cstrs.elems[i] = intern(cstrs.elems[i]);
     }
+    return cstrs;
+}
 
-    const size_t result_len = (cstrs.count - 1) * sep_len + len + 1;
-    char *result = malloc(sizeof(char) * result_len);
-    if (result == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    len = 0;
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned)
+{
     for (size_t i = 0; i < cstrs.count; ++i) {
-        if (i > 0) {
-            memcpy(result + len, sep, sep_len);
-            len += sep_len;
+        if (cstrs.elems[i] == interned) {
+            memmove(cstrs.elems + i, cstrs.elems + i + 1, sizeof(*cstrs.elems) * (cstrs.count - i - 1));
+            cstrs.count--;
+            break;
         }
+    }
+    return cstrs;
+}
+
+Cstr cstr_join(Cstr sep, Cstr first, ...)
+{
+    if (first == NULL) {
+        return "";
+    }
+
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
+    sb_append_cstr(&sb, first);
+
+    va_list args;
+    va_start(args, first);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        sb_append_bytes(&sb, sep, sep_len);
+        sb_append_cstr(&sb, next);
+    }
+    va_end(args);
+
+    return sb_to_cstr(&sb);
+}
+
+static char *nobuild__sb_realloc(String_Builder *sb, size_t capacity)
+{
+    if (sb->arena != NULL) {
+        return arena_realloc(sb->arena, sb->elems, sb->capacity, capacity);
+    }
+    return temp_realloc(sb->elems, sb->capacity, capacity);
+}
+
+void sb_reserve(String_Builder *sb, size_t size)
+{
+    const size_t needed = sb->count + size + 1;
+    if (needed <= sb->capacity) {
+        return;
+    }
 
-        size_t elem_len = strlen(cstrs.elems[i]);
-        memcpy(result + len, cstrs.elems[i], elem_len);
-        len += elem_len;
+    size_t capacity = sb->capacity > 0 ? sb->capacity : 64;
+    while (capacity < needed) {
+        capacity *= 2;
     }
-    result[len] = '\0';
 
+    sb->elems = nobuild__sb_realloc(sb, capacity);
+    sb->capacity = capacity;
+}
+
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size)
+{
+    sb_reserve(sb, size);
+    memcpy(sb->elems + sb->count, bytes, size);
+    sb->count += size;
+}
+
+void sb_append_cstr(String_Builder *sb, Cstr cstr)
+{
+    sb_append_bytes(sb, cstr, strlen(cstr));
+}
+
+void sb_append_sv(String_Builder *sb, String_View sv)
+{
+    sb_append_bytes(sb, sv.data, sv.count);
+}
+
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...)
+{
+    sb_reserve(sb, 0);
+
+    // Try formatting into the capacity that is left first, and again once the size is known
+    const size_t available = sb->capacity - sb->count;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(sb->elems + sb->count, available, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        PANIC("Could not format string %s: %s", fmt, nobuild__strerror(errno));
+    }
+
+    if ((size_t) n >= available) {
+        sb_reserve(sb, (size_t) n);
+        va_start(args, fmt);
+        vsnprintf(sb->elems + sb->count, (size_t) n + 1, fmt, args);
+        va_end(args);
+    }
+    sb->count += (size_t) n;
+}
+
+Cstr sb_to_cstr(String_Builder *sb)
+{
+    sb_reserve(sb, 0);
+    sb->elems[sb->count] = '\0';
+    char *result = nobuild__sb_realloc(sb, sb->count + 1);
+
+    String_Builder empty = { .arena = sb->arena };
+    *sb = empty;
     return result;
 }
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_CSTR_I_
 #endif // NOBUILD_IMPLEMENTATION
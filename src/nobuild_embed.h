@@ -0,0 +1,1290 @@
+#ifndef NOBUILD_EMBED_H_
+#define NOBUILD_EMBED_H_
+
+#include "nobuild_cstr.h"
+
+// Layout of the source generated by `file_to_c_array_format()`. Every format
+// defines `array_name` and an `unsigned long array_name_len` holding the number
+// of elements, including the null terminator if one was requested.
+typedef enum {
+    // `array_type array_name[] = { 0x.., ... };`
+    C_ARRAY_BYTES = 0,
+    // Chunked and escaped string literals. Much cheaper for the compiler to
+    // parse than C_ARRAY_BYTES, but MSVC limits string literals to 64 KiB.
+    C_ARRAY_STRING,
+    // A top-level assembler stub that pulls the file in with `.incbin`.
+    // Requires a GNU compatible compiler and assembler.
+    C_ARRAY_INCBIN,
+    // C23 `#embed`, falling back to C_ARRAY_BYTES when the compiler does not
+    // support it.
+    C_ARRAY_EMBED,
+} C_Array_Format;
+
+void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type,  Cstr array_name, int null_term);
+#define FILE_TO_C_ARRAY(path, out_path, array_name) file_to_c_array(path, out_path, "unsigned char", array_name, 1)
+
+void file_to_c_array_format(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term, C_Array_Format format);
+#define FILE_TO_C_ARRAY_FORMAT(path, out_path, array_name, format) \
+    file_to_c_array_format(path, out_path, "unsigned char", array_name, 1, format)
+
+// Writes a relocatable ELF64 object defining `symbol` and `unsigned long symbol_len`
+// in `.rodata`, skipping the C compiler entirely. Only supported on ELF hosts.
+void file_to_object(Cstr path, Cstr out_path, Cstr symbol, int null_term);
+#define FILE_TO_OBJECT(path, out_path, symbol) file_to_object(path, out_path, symbol, 1)
+
+typedef enum {
+    PACK_DEFAULT = 0,
+    // Generate a `long pack_name_find(const char *name)` perfect hash lookup that
+    // returns the index of the entry or -1. Only available for C sources.
+    PACK_LOOKUP = 1 << 0,
+} Pack_Flags;
+
+// Packs every file under `dir_path` into a single source, or an ELF object if
+// `out_path` ends with ".o". The pack is regenerated unless `out_path` is strictly
+// newer than every file and directory under `dir_path` and was generated with the
+// same `flags` and `pack_name`. Objects do not support PACK_LOOKUP, which
+// `DIR_TO_PACK()` only asks for when generating a C source. It defines:
+//
+//   const unsigned char pack_name[];          // Members aligned to 16 bytes and null terminated
+//   const char pack_name_names[];             // Null terminated member names, '/' separated
+//   const unsigned long pack_name_entries[][4] // { name offset, name length, offset, size } sorted by name
+//   const unsigned long pack_name_count;
+void dir_to_pack(Cstr dir_path, Cstr out_path, Cstr pack_name, int flags);
+#define DIR_TO_PACK(dir_path, out_path, pack_name) \
+    dir_to_pack(dir_path, out_path, pack_name, cstr_ends_with(out_path, ".o") ? PACK_DEFAULT : PACK_LOOKUP)
+
+#endif // NOBUILD_EMBED_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_EMBED_IMPLEMENTATION
+#ifndef NOBUILD_EMBED_I_
+#define NOBUILD_EMBED_I_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	include <dirent.h>
+#else
+#	include <direct.h>
+#endif
+
+#define NOBUILD_LOG_IMPLEMENTATION
+#include "nobuild_log.h"
+
+#define NOBUILD_CSTR_IMPLEMENTATION
+#include "nobuild_cstr.h"
+
+#define NOBUILD_IO_IMPLEMENTATION
+#include "nobuild_io.h"
+
+#define NOBUILD_PATH_IMPLEMENTATION
+#include "nobuild_path.h"
+
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_EMBED
+
+// Size of the blocks read from the embedded file
+#define NOBUILD__EMBED_READ_SIZE (1024 * 1024)
+
+// Size of the buffer the generated source is formatted into before being written out
+#define NOBUILD__EMBED_WRITE_SIZE (512 * 1024)
+
+// Bytes per row of the generated array and the size of a single formatted row
+#define NOBUILD__EMBED_ROW 16
+#define NOBUILD__EMBED_CELL 6
+#define NOBUILD__EMBED_ROW_SIZE (1 + NOBUILD__EMBED_ROW * NOBUILD__EMBED_CELL + 1)
+
+// Bytes per string literal of C_ARRAY_STRING and the worst case size of a line
+#define NOBUILD__EMBED_LITERAL 64
+#define NOBUILD__EMBED_LITERAL_SIZE (2 + NOBUILD__EMBED_LITERAL * 4 + 2)
+
+typedef struct {
+    Fd fd;
+    Cstr path;
+    char *elems;
+    size_t count;
+} Nobuild__Embed_Writer;
+
+// Every byte is formatted as "0x%02x, ", so precompute all 256 cells once and
+// copy them instead of going through printf for each byte.
+static char nobuild__embed_cells[256][NOBUILD__EMBED_CELL];
+
+// Escape sequences for C_ARRAY_STRING. Octal escapes are always 3 digits wide so
+// that they can not swallow a following digit, and '?' is escaped to avoid
+// accidentally forming trigraphs.
+static char nobuild__embed_escapes[256][4];
+static unsigned char nobuild__embed_escapes_len[256];
+
+static void nobuild__embed_cells_init(void)
+{
+    static int initialized = 0;
+    if (initialized) {
+        return;
+    }
+
+    const char *digits = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+        memcpy(nobuild__embed_cells[i], "0x00, ", NOBUILD__EMBED_CELL);
+        nobuild__embed_cells[i][2] = digits[i >> 4];
+        nobuild__embed_cells[i][3] = digits[i & 0xf];
+
+        char *escape = nobuild__embed_escapes[i];
+        if (i == '"' || i == '\\' || i == '?') {
+            escape[0] = '\\';
+            escape[1] = (char) i;
+            nobuild__embed_escapes_len[i] = 2;
+        } else if (i >= 0x20 && i < 0x7f) {
+            escape[0] = (char) i;
+            nobuild__embed_escapes_len[i] = 1;
+        } else {
+            escape[0] = '\\';
+            escape[1] = (char) ('0' + ((i >> 6) & 7));
+            escape[2] = (char) ('0' + ((i >> 3) & 7));
+            escape[3] = (char) ('0' + (i & 7));
+            nobuild__embed_escapes_len[i] = 4;
+        }
+    }
+    initialized = 1;
+}
+
+static void nobuild__embed_flush(Nobuild__Embed_Writer *writer)
+{
+    size_t written = 0;
+    while (written < writer->count) {
+        size_t n = fd_write(writer->fd, writer->elems + written, (unsigned long) (writer->count - written));
+        if (n == 0) {
+            PANIC("Could not write to %s", writer->path);
+        }
+        written += n;
+    }
+    writer->count = 0;
+}
+
+static void nobuild__embed_write(Nobuild__Embed_Writer *writer, Cstr data, size_t size)
+{
+    if (writer->count + size > NOBUILD__EMBED_WRITE_SIZE) {
+        nobuild__embed_flush(writer);
+    }
+
+    if (size > NOBUILD__EMBED_WRITE_SIZE) {
+        size_t written = 0;
+        while (written < size) {
+            size_t n = fd_write(writer->fd, (void *) (data + written), (unsigned long) (size - written));
+            if (n == 0) {
+                PANIC("Could not write to %s", writer->path);
+            }
+            written += n;
+        }
+        return;
+    }
+
+    memcpy(writer->elems + writer->count, data, size);
+    writer->count += size;
+}
+
+// Formats `size` bytes as rows of hex cells. `column` carries the position in
+// the current row across calls so that short reads do not break up the rows.
+static void nobuild__embed_write_bytes(Nobuild__Embed_Writer *writer, const unsigned char *bytes, size_t size, size_t *column)
+{
+    size_t i = 0;
+    while (i < size) {
+        if (writer->count + NOBUILD__EMBED_ROW_SIZE > NOBUILD__EMBED_WRITE_SIZE) {
+            nobuild__embed_flush(writer);
+        }
+
+        char *out = writer->elems + writer->count;
+
+        // Fast path: a whole row is available
+        if (*column == 0 && size - i >= NOBUILD__EMBED_ROW) {
+            *out++ = '\t';
+            for (size_t j = 0; j < NOBUILD__EMBED_ROW; ++j) {
+                memcpy(out, nobuild__embed_cells[bytes[i + j]], NOBUILD__EMBED_CELL);
+                out += NOBUILD__EMBED_CELL;
+            }
+            *out++ = '\n';
+            writer->count += NOBUILD__EMBED_ROW_SIZE;
+            i += NOBUILD__EMBED_ROW;
+            continue;
+        }
+
+        if (*column == 0) {
+            *out++ = '\t';
+        }
+        while (i < size && *column < NOBUILD__EMBED_ROW) {
+            memcpy(out, nobuild__embed_cells[bytes[i++]], NOBUILD__EMBED_CELL);
+            out += NOBUILD__EMBED_CELL;
+            *column += 1;
+        }
+        if (*column == NOBUILD__EMBED_ROW) {
+            *out++ = '\n';
+            *column = 0;
+        }
+        writer->count = (size_t) (out - writer->elems);
+    }
+}
+
+static void nobuild__embed_write_cstr(Nobuild__Embed_Writer *writer, Cstr cstr)
+{
+    nobuild__embed_write(writer, cstr, strlen(cstr));
+}
+
+static void nobuild__embed_printf(Nobuild__Embed_Writer *writer, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+
+// Only meant for short lines, anything longer than the buffer is truncated
+static void nobuild__embed_printf(Nobuild__Embed_Writer *writer, const char *fmt, ...)
+{
+    char line[512];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        PANIC("Could not format output for %s", writer->path);
+    }
+
+    nobuild__embed_write(writer, line, (size_t) len < sizeof(line) ? (size_t) len : sizeof(line) - 1);
+}
+
+// Formats `size` bytes as chunked string literals, one per line
+static void nobuild__embed_write_literals(Nobuild__Embed_Writer *writer, const unsigned char *bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i += NOBUILD__EMBED_LITERAL) {
+        if (writer->count + NOBUILD__EMBED_LITERAL_SIZE > NOBUILD__EMBED_WRITE_SIZE) {
+            nobuild__embed_flush(writer);
+        }
+
+        char *out = writer->elems + writer->count;
+        *out++ = '\t';
+        *out++ = '"';
+        for (size_t j = i; j < size && j < i + NOBUILD__EMBED_LITERAL; ++j) {
+            memcpy(out, nobuild__embed_escapes[bytes[j]], 4);
+            out += nobuild__embed_escapes_len[bytes[j]];
+        }
+        *out++ = '"';
+        *out++ = '\n';
+        writer->count = (size_t) (out - writer->elems);
+    }
+}
+
+static unsigned long nobuild__embed_fd_size(Fd fd, Cstr path)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0) {
+        PANIC("Could not retrieve information about file %s: %s", path, nobuild__strerror(errno));
+    }
+    return (unsigned long) statbuf.st_size;
+#else
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fd, &size)) {
+        PANIC("Could not retrieve size of file %s: %s", path, nobuild__GetLastErrorAsString());
+    }
+    return (unsigned long) size.QuadPart;
+#endif // _WIN32
+}
+
+// Returns `path` as an absolute path, so that it can be referenced from a
+// generated source that lives in another directory.
+static Cstr nobuild__embed_abs_path(Cstr path)
+{
+#ifndef _WIN32
+    if (path[0] != '/') {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            PANIC("Could not retrieve current working directory: %s", nobuild__strerror(errno));
+        }
+        return PATH(cwd, path);
+    }
+#else
+    if (path[0] != '\\' && !(path[0] != '\0' && path[1] == ':')) {
+        char cwd[MAX_PATH];
+        if (_getcwd(cwd, sizeof(cwd)) == NULL) {
+            PANIC("Could not retrieve current working directory: %s", nobuild__strerror(errno));
+        }
+        return PATH(cwd, path);
+    }
+#endif // _WIN32
+
+    return path;
+}
+
+// Escapes quotes and backslashes so `cstr` can be placed inside a string literal
+static Cstr nobuild__embed_escape(Cstr cstr)
+{
+    size_t len = strlen(cstr);
+    char *escaped = temp_alloc(len * 2 + 1);
+
+    size_t count = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (cstr[i] == '"' || cstr[i] == '\\') {
+            escaped[count++] = '\\';
+        }
+        escaped[count++] = cstr[i];
+    }
+    escaped[count] = '\0';
+
+    return escaped;
+}
+
+// Streams `file` into the writer as the body of a C_ARRAY_BYTES array
+static unsigned long nobuild__embed_array_body(Nobuild__Embed_Writer *writer, Fd file, unsigned char *input, int null_term)
+{
+    unsigned long total_bytes_read = 0;
+    size_t column = 0;
+    for (;;) {
+        size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+        if (bytes_read == 0) {
+            break;
+        }
+
+        nobuild__embed_write_bytes(writer, input, bytes_read, &column);
+        total_bytes_read += (unsigned long) bytes_read;
+    }
+
+    if (column > 0) {
+        nobuild__embed_write(writer, "\n", 1);
+    }
+
+    if (null_term) {
+        nobuild__embed_write_cstr(writer, "\t0x00 /* Terminate with null */\n");
+        total_bytes_read++;
+    }
+
+    return total_bytes_read;
+}
+
+void file_to_c_array(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term)
+{
+    file_to_c_array_format(path, out_path, array_type, array_name, null_term, C_ARRAY_BYTES);
+}
+
+void file_to_c_array_format(Cstr path, Cstr out_path, Cstr array_type, Cstr array_name, int null_term, C_Array_Format format)
+{
+    nobuild__embed_cells_init();
+
+    unsigned char *input = NOBUILD__MALLOC(NOBUILD__EMBED_READ_SIZE);
+    char *output = NOBUILD__MALLOC(NOBUILD__EMBED_WRITE_SIZE);
+    if (input == NULL || output == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    Fd file = fd_open_for_read(path);
+    Atomic_File out = atomic_file_open(out_path);
+    Nobuild__Embed_Writer writer = {
+        .fd = out.fd,
+        .path = out_path,
+        .elems = output,
+    };
+
+    switch (format) {
+    case C_ARRAY_BYTES: {
+        nobuild__embed_write_cstr(&writer, JOIN(" ", array_type, CONCAT(array_name, "[] = {\n")));
+        unsigned long len = nobuild__embed_array_body(&writer, file, input, null_term);
+        nobuild__embed_write_cstr(&writer, "};\n");
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "unsigned long %s_len = %lu;\n", array_name, len);
+    }
+    break;
+
+    case C_ARRAY_STRING: {
+        // Without a null terminator the array is sized to drop the implicit one of the literal,
+        // except for an empty file where it keeps it since C has no zero length arrays
+        unsigned long size = nobuild__embed_fd_size(file, path);
+        unsigned long len = size + (null_term ? 1 : 0);
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "%s %s[%lu] =\n", array_type, array_name, len > 0 ? len : 1);
+
+        unsigned long total_bytes_read = 0;
+        for (;;) {
+            size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+            if (bytes_read == 0) {
+                break;
+            }
+
+            nobuild__embed_write_literals(&writer, input, bytes_read);
+            total_bytes_read += (unsigned long) bytes_read;
+        }
+
+        if (total_bytes_read != size) {
+            PANIC("File %s changed size while being embedded", path);
+        }
+
+        nobuild__embed_write_cstr(&writer, total_bytes_read == 0 ? "\t\"\";\n" : ";\n");
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "unsigned long %s_len = %lu;\n", array_name, len);
+    }
+    break;
+
+    case C_ARRAY_INCBIN: {
+        unsigned long size = nobuild__embed_fd_size(file, path);
+        // The path is quoted once for the assembler and once more for the C compiler
+        Cstr quoted_path = nobuild__embed_escape(nobuild__embed_escape(nobuild__embed_abs_path(path)));
+        Cstr terminator = null_term ? "    \"  .byte 0\\n\"\n" : "";
+
+        fd_printf(writer.fd,
+                  "#if defined(_MSC_VER) && !defined(__clang__)\n"
+                  "#    error \"%s: the incbin format requires a GNU compatible compiler\"\n"
+                  "#endif\n"
+                  "\n"
+                  "#ifdef __APPLE__\n"
+                  "__asm__(\n"
+                  "    \"  .pushsection __TEXT,__const\\n\"\n"
+                  "    \"  .globl _%s\\n\"\n"
+                  "    \"  .balign 16\\n\"\n"
+                  "    \"_%s:\\n\"\n"
+                  "    \"  .incbin \\\"%s\\\"\\n\"\n"
+                  "%s"
+                  "    \"  .popsection\\n\"\n"
+                  ");\n"
+                  "#else\n"
+                  "__asm__(\n"
+                  "    \"  .pushsection .rodata\\n\"\n"
+                  "    \"  .globl %s\\n\"\n"
+                  "    \"  .type %s, %%object\\n\"\n"
+                  "    \"  .size %s, %lu\\n\"\n"
+                  "    \"  .balign 16\\n\"\n"
+                  "    \"%s:\\n\"\n"
+                  "    \"  .incbin \\\"%s\\\"\\n\"\n"
+                  "%s"
+                  "    \"  .popsection\\n\"\n"
+                  ");\n"
+                  "#endif\n"
+                  "\n"
+                  "extern const %s %s[];\n"
+                  "unsigned long %s_len = %lu;\n",
+                  array_name,
+                  array_name, array_name, quoted_path, terminator,
+                  array_name, array_name, array_name, size + (null_term ? 1 : 0), array_name, quoted_path, terminator,
+                  array_type, array_name,
+                  array_name, size + (null_term ? 1 : 0));
+    }
+    break;
+
+    case C_ARRAY_EMBED: {
+        // The header name of `#embed` has no escape sequences, so the path goes in as is
+        Cstr embed_path = nobuild__embed_abs_path(path);
+        if (strpbrk(embed_path, "\"\n") != NULL) {
+            PANIC("Could not embed %s: paths with quotes or newlines cannot be used with #embed", path);
+        }
+
+        fd_printf(writer.fd,
+                  "#if defined(__has_embed)\n"
+                  "%s %s[] = {\n"
+                  "#embed \"%s\"%s\n"
+                  "%s"
+                  "};\n"
+                  "#else\n",
+                  array_type, array_name,
+                  embed_path, null_term ? " suffix(,)" : "",
+                  null_term ? "\t0x00 /* Terminate with null */\n" : "");
+
+        nobuild__embed_write_cstr(&writer, JOIN(" ", array_type, CONCAT(array_name, "[] = {\n")));
+        nobuild__embed_array_body(&writer, file, input, null_term);
+        nobuild__embed_write_cstr(&writer, "};\n#endif\n");
+        nobuild__embed_flush(&writer);
+        fd_printf(writer.fd, "unsigned long %s_len = sizeof(%s) / sizeof(%s[0]);\n", array_name, array_name, array_name);
+    }
+    break;
+
+    default: {
+        PANIC("Unknown C array format %d", (int) format);
+    }
+    }
+
+    fd_close(file);
+    atomic_file_commit(&out);
+    free(input);
+    free(output);
+}
+
+// ELF64 constants used by `file_to_object()`
+#define NOBUILD__ELF_HEADER_SIZE 64
+#define NOBUILD__ELF_SECTION_SIZE 64
+#define NOBUILD__ELF_SYMBOL_SIZE 24
+#define NOBUILD__ELF_SECTION_COUNT 6
+
+#if defined(__ELF__) && defined(__x86_64__)
+#	define NOBUILD__ELF_MACHINE 62 // EM_X86_64
+#	define NOBUILD__ELF_FLAGS 0
+#elif defined(__ELF__) && defined(__aarch64__) && !defined(__AARCH64EB__)
+#	define NOBUILD__ELF_MACHINE 183 // EM_AARCH64
+#	define NOBUILD__ELF_FLAGS 0
+#elif defined(__ELF__) && defined(__riscv) && __riscv_xlen == 64
+#	define NOBUILD__ELF_MACHINE 243 // EM_RISCV
+#	if defined(__riscv_float_abi_double)
+#		define NOBUILD__ELF_FLOAT_ABI 0x4
+#	elif defined(__riscv_float_abi_single)
+#		define NOBUILD__ELF_FLOAT_ABI 0x2
+#	else
+#		define NOBUILD__ELF_FLOAT_ABI 0x0
+#	endif
+#	if defined(__riscv_compressed)
+#		define NOBUILD__ELF_FLAGS (NOBUILD__ELF_FLOAT_ABI | 0x1)
+#	else
+#		define NOBUILD__ELF_FLAGS NOBUILD__ELF_FLOAT_ABI
+#	endif
+#else
+#	define NOBUILD__ELF_MACHINE 0
+#	define NOBUILD__ELF_FLAGS 0
+#endif
+
+// Little endian encoders for the ELF structures
+static char *nobuild__elf_u8(char *out, unsigned char value)
+{
+    *out++ = (char) value;
+    return out;
+}
+
+static char *nobuild__elf_u16(char *out, unsigned int value)
+{
+    for (int i = 0; i < 2; ++i) {
+        *out++ = (char) ((value >> (8 * i)) & 0xff);
+    }
+    return out;
+}
+
+static char *nobuild__elf_u32(char *out, unsigned long value)
+{
+    for (int i = 0; i < 4; ++i) {
+        *out++ = (char) ((value >> (8 * i)) & 0xff);
+    }
+    return out;
+}
+
+static char *nobuild__elf_u64(char *out, unsigned long long value)
+{
+    for (int i = 0; i < 8; ++i) {
+        *out++ = (char) ((value >> (8 * i)) & 0xff);
+    }
+    return out;
+}
+
+static char *nobuild__elf_section(char *out, unsigned long name, unsigned long type, unsigned long long flags,
+                                  unsigned long long offset, unsigned long long size, unsigned long link,
+                                  unsigned long info, unsigned long long align, unsigned long long entsize)
+{
+    out = nobuild__elf_u32(out, name);
+    out = nobuild__elf_u32(out, type);
+    out = nobuild__elf_u64(out, flags);
+    out = nobuild__elf_u64(out, 0); // sh_addr
+    out = nobuild__elf_u64(out, offset);
+    out = nobuild__elf_u64(out, size);
+    out = nobuild__elf_u32(out, link);
+    out = nobuild__elf_u32(out, info);
+    out = nobuild__elf_u64(out, align);
+    out = nobuild__elf_u64(out, entsize);
+    return out;
+}
+
+static char *nobuild__elf_symbol(char *out, unsigned long name, unsigned long long value, unsigned long long size)
+{
+    out = nobuild__elf_u32(out, name);
+    out = nobuild__elf_u8(out, 0x11); // STB_GLOBAL, STT_OBJECT
+    out = nobuild__elf_u8(out, 0);    // STV_DEFAULT
+    out = nobuild__elf_u16(out, 1);   // .rodata
+    out = nobuild__elf_u64(out, value);
+    out = nobuild__elf_u64(out, size);
+    return out;
+}
+
+#define NOBUILD__ALIGN(n, alignment) (((n) + (alignment) - 1) / (alignment) * (alignment))
+
+// A global object defined in the `.rodata` section of a generated object
+typedef struct {
+    Cstr name;
+    unsigned long long offset;
+    unsigned long long size;
+} Nobuild__Elf_Symbol;
+
+static const char nobuild__elf_shstrtab[] = "\0.rodata\0.note.GNU-stack\0.symtab\0.strtab\0.shstrtab";
+
+typedef struct {
+    unsigned long long rodata_size;
+    unsigned long long symtab_offset;
+    unsigned long long symtab_size;
+    unsigned long long strtab_offset;
+    unsigned long long strtab_size;
+    unsigned long long shstrtab_offset;
+    unsigned long long sections_offset;
+} Nobuild__Elf_Layout;
+
+static Nobuild__Elf_Layout nobuild__elf_layout(unsigned long long rodata_size, const Nobuild__Elf_Symbol *symbols, size_t symbols_count)
+{
+    Nobuild__Elf_Layout layout = { .rodata_size = rodata_size };
+
+    layout.strtab_size = 1;
+    for (size_t i = 0; i < symbols_count; ++i) {
+        layout.strtab_size += strlen(symbols[i].name) + 1;
+    }
+
+    layout.symtab_offset = NOBUILD__ALIGN(NOBUILD__ELF_HEADER_SIZE + rodata_size, 8);
+    layout.symtab_size = (symbols_count + 1) * NOBUILD__ELF_SYMBOL_SIZE;
+    layout.strtab_offset = layout.symtab_offset + layout.symtab_size;
+    layout.shstrtab_offset = layout.strtab_offset + layout.strtab_size;
+    layout.sections_offset = NOBUILD__ALIGN(layout.shstrtab_offset + sizeof(nobuild__elf_shstrtab), 8);
+    return layout;
+}
+
+// Writes the ELF header. The caller must then write exactly `layout.rodata_size`
+// bytes of `.rodata` contents before calling `nobuild__elf_end()`.
+static void nobuild__elf_begin(Nobuild__Embed_Writer *writer, Nobuild__Elf_Layout layout)
+{
+    if (NOBUILD__ELF_MACHINE == 0) {
+        PANIC("Could not write object file %s: ELF objects are not supported on this target", writer->path);
+    }
+
+    char header[NOBUILD__ELF_HEADER_SIZE] = {0};
+    char *out = header;
+    memcpy(out, "\x7f" "ELF", 4);
+    out += 4;
+    out = nobuild__elf_u8(out, 2); // ELFCLASS64
+    out = nobuild__elf_u8(out, 1); // ELFDATA2LSB
+    out = nobuild__elf_u8(out, 1); // EV_CURRENT
+    out += 9;                      // ELFOSABI_NONE and padding
+    out = nobuild__elf_u16(out, 1); // ET_REL
+    out = nobuild__elf_u16(out, NOBUILD__ELF_MACHINE);
+    out = nobuild__elf_u32(out, 1); // EV_CURRENT
+    out = nobuild__elf_u64(out, 0); // e_entry
+    out = nobuild__elf_u64(out, 0); // e_phoff
+    out = nobuild__elf_u64(out, layout.sections_offset);
+    out = nobuild__elf_u32(out, NOBUILD__ELF_FLAGS);
+    out = nobuild__elf_u16(out, NOBUILD__ELF_HEADER_SIZE);
+    out = nobuild__elf_u16(out, 0); // e_phentsize
+    out = nobuild__elf_u16(out, 0); // e_phnum
+    out = nobuild__elf_u16(out, NOBUILD__ELF_SECTION_SIZE);
+    out = nobuild__elf_u16(out, NOBUILD__ELF_SECTION_COUNT);
+    out = nobuild__elf_u16(out, NOBUILD__ELF_SECTION_COUNT - 1); // .shstrtab
+    nobuild__embed_write(writer, header, sizeof(header));
+}
+
+// Writes the symbol table, the string tables and the section headers
+static void nobuild__elf_end(Nobuild__Embed_Writer *writer, Nobuild__Elf_Layout layout, const Nobuild__Elf_Symbol *symbols, size_t symbols_count)
+{
+    char scratch[NOBUILD__ELF_SECTION_SIZE * NOBUILD__ELF_SECTION_COUNT] = {0};
+    nobuild__embed_write(writer, scratch, (size_t) (layout.symtab_offset - NOBUILD__ELF_HEADER_SIZE - layout.rodata_size));
+
+    // .symtab
+    nobuild__embed_write(writer, scratch, NOBUILD__ELF_SYMBOL_SIZE);
+    unsigned long name = 1;
+    for (size_t i = 0; i < symbols_count; ++i) {
+        char *out = nobuild__elf_symbol(scratch, name, symbols[i].offset, symbols[i].size);
+        nobuild__embed_write(writer, scratch, (size_t) (out - scratch));
+        name += (unsigned long) strlen(symbols[i].name) + 1;
+    }
+
+    // .strtab and .shstrtab
+    nobuild__embed_write(writer, "", 1);
+    for (size_t i = 0; i < symbols_count; ++i) {
+        nobuild__embed_write(writer, symbols[i].name, strlen(symbols[i].name) + 1);
+    }
+    nobuild__embed_write(writer, nobuild__elf_shstrtab, sizeof(nobuild__elf_shstrtab));
+    memset(scratch, 0, sizeof(scratch));
+    nobuild__embed_write(writer, scratch, (size_t) (layout.sections_offset - layout.shstrtab_offset - sizeof(nobuild__elf_shstrtab)));
+
+    // Section headers. The names are offsets into `nobuild__elf_shstrtab`
+    char *out = scratch + NOBUILD__ELF_SECTION_SIZE;
+    out = nobuild__elf_section(out, 1, 1, 0x2, NOBUILD__ELF_HEADER_SIZE, layout.rodata_size, 0, 0, 16, 0);     // .rodata: SHT_PROGBITS, SHF_ALLOC
+    out = nobuild__elf_section(out, 9, 1, 0, layout.symtab_offset, 0, 0, 0, 1, 0);                            // .note.GNU-stack
+    out = nobuild__elf_section(out, 25, 2, 0, layout.symtab_offset, layout.symtab_size, 4, 1, 8,
+                               NOBUILD__ELF_SYMBOL_SIZE);                                                      // .symtab: SHT_SYMTAB
+    out = nobuild__elf_section(out, 33, 3, 0, layout.strtab_offset, layout.strtab_size, 0, 0, 1, 0);          // .strtab: SHT_STRTAB
+    out = nobuild__elf_section(out, 41, 3, 0, layout.shstrtab_offset, sizeof(nobuild__elf_shstrtab), 0, 0, 1, 0); // .shstrtab: SHT_STRTAB
+    nobuild__embed_write(writer, scratch, (size_t) (out - scratch));
+}
+
+// Streams `file` into the writer, returning the number of bytes read
+static unsigned long long nobuild__embed_copy(Nobuild__Embed_Writer *writer, Fd file, unsigned char *input)
+{
+    unsigned long long total_bytes_read = 0;
+    for (;;) {
+        size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+        if (bytes_read == 0) {
+            break;
+        }
+
+        nobuild__embed_write(writer, (Cstr) input, bytes_read);
+        total_bytes_read += bytes_read;
+    }
+    return total_bytes_read;
+}
+
+static void nobuild__embed_zeros(Nobuild__Embed_Writer *writer, size_t count)
+{
+    static const char zeros[64] = {0};
+    while (count > 0) {
+        size_t n = count < sizeof(zeros) ? count : sizeof(zeros);
+        nobuild__embed_write(writer, zeros, n);
+        count -= n;
+    }
+}
+
+void file_to_object(Cstr path, Cstr out_path, Cstr symbol, int null_term)
+{
+    unsigned char *input = NOBUILD__MALLOC(NOBUILD__EMBED_READ_SIZE);
+    char *output = NOBUILD__MALLOC(NOBUILD__EMBED_WRITE_SIZE);
+    if (input == NULL || output == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    Fd file = fd_open_for_read(path);
+    unsigned long long size = nobuild__embed_fd_size(file, path);
+    unsigned long long len = size + (null_term ? 1 : 0);
+
+    // .rodata holds the blob followed by the 8 byte aligned `symbol_len`
+    const unsigned long long len_offset = NOBUILD__ALIGN(len, 8);
+    Nobuild__Elf_Symbol symbols[] = {
+        { .name = symbol, .offset = 0, .size = len },
+        { .name = CONCAT(symbol, "_len"), .offset = len_offset, .size = 8 },
+    };
+    Nobuild__Elf_Layout layout = nobuild__elf_layout(len_offset + 8, symbols, 2);
+
+    Atomic_File out = atomic_file_open(out_path);
+    Nobuild__Embed_Writer writer = {
+        .fd = out.fd,
+        .path = out_path,
+        .elems = output,
+    };
+
+    nobuild__elf_begin(&writer, layout);
+    if (nobuild__embed_copy(&writer, file, input) != size) {
+        PANIC("File %s changed size while being embedded", path);
+    }
+
+    char len_bytes[8];
+    nobuild__embed_zeros(&writer, (size_t) (len_offset - size));
+    nobuild__elf_u64(len_bytes, len);
+    nobuild__embed_write(&writer, len_bytes, sizeof(len_bytes));
+
+    nobuild__elf_end(&writer, layout, symbols, 2);
+    nobuild__embed_flush(&writer);
+
+    fd_close(file);
+    atomic_file_commit(&out);
+    free(input);
+    free(output);
+}
+
+#define NOBUILD__PACK_ALIGN 16
+#define NOBUILD__PACK_STAMP "// nobuild pack: flags=%d name=%s\n"
+
+typedef struct {
+    Cstr name;
+    Cstr path;
+    unsigned long long size;
+    unsigned long long offset;
+    unsigned long long name_offset;
+} Nobuild__Pack_Entry;
+
+typedef struct {
+    Nobuild__Pack_Entry *elems;
+    size_t count;
+    size_t capacity;
+} Nobuild__Pack_Entries;
+
+static int nobuild__pack_stat(Cstr path, int *is_dir, long long *mtime, unsigned long long *size)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
+        return -1;
+    }
+
+    *is_dir = S_ISDIR(statbuf.st_mode);
+    // In nanoseconds where `struct stat` has them, so an edit in the same second as
+    // the pack is still seen
+#	if defined(__APPLE__)
+    *mtime = (long long) statbuf.st_mtimespec.tv_sec * 1000000000LL + (long long) statbuf.st_mtimespec.tv_nsec;
+#	elif defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L
+    *mtime = (long long) statbuf.st_mtim.tv_sec * 1000000000LL + (long long) statbuf.st_mtim.tv_nsec;
+#	else
+    *mtime = (long long) statbuf.st_mtime * 1000000000LL;
+#	endif
+    *size = (unsigned long long) statbuf.st_size;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesExA(path, GetFileExInfoStandard, &data))) {
+        return -1;
+    }
+
+    *is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    *mtime = ((long long) data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+    *size = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+#endif // _WIN32
+
+    return 0;
+}
+
+// Collects the files under `dir_path` and the most recent modification time of
+// them and of the directories themselves, so that removing a file is noticed.
+static void nobuild__pack_collect(Nobuild__Pack_Entries *entries, Cstr dir_path, Cstr prefix, long long *mtime)
+{
+    FOREACH_FILE_IN_DIR(file, dir_path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        Cstr path = PATH(dir_path, file);
+        Cstr name = prefix ? JOIN("/", prefix, file) : CONCAT(file);
+
+        int is_dir = 0;
+        long long path_mtime = 0;
+        unsigned long long size = 0;
+        if (nobuild__pack_stat(path, &is_dir, &path_mtime, &size) < 0) {
+            PANIC("Could not retrieve information about file %s", path);
+        }
+
+        *mtime = path_mtime > *mtime ? path_mtime : *mtime;
+        if (is_dir) {
+            nobuild__pack_collect(entries, path, name, mtime);
+            continue;
+        }
+
+        da_append(entries, ((Nobuild__Pack_Entry) { .name = name, .path = path, .size = size }));
+    });
+}
+
+static int nobuild__pack_entry_compare(const void *a, const void *b)
+{
+    return strcmp(((const Nobuild__Pack_Entry *) a)->name, ((const Nobuild__Pack_Entry *) b)->name);
+}
+
+// 32 bit FNV-1a. Must match the hash emitted into the generated lookup function.
+static unsigned long nobuild__pack_hash(Cstr name, unsigned long seed)
+{
+    unsigned long hash = (2166136261ul ^ seed) & 0xfffffffful;
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash = (hash * 16777619ul) & 0xfffffffful;
+    }
+    return hash;
+}
+
+typedef struct {
+    size_t bucket;
+    size_t count;
+} Nobuild__Pack_Bucket;
+
+static int nobuild__pack_bucket_compare(const void *a, const void *b)
+{
+    const Nobuild__Pack_Bucket *x = a;
+    const Nobuild__Pack_Bucket *y = b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
+
+// Builds a minimal perfect hash with the hash and displace method. Every key
+// lands in bucket `hash(key, 0) % n`. Buckets with several keys get a seed that
+// sends all of their keys to free slots with `hash(key, seed) % n`, while single
+// key buckets store the free slot directly as `-slot - 1`.
+static void nobuild__pack_perfect_hash(const Nobuild__Pack_Entries *entries, long *seeds, unsigned long *slots)
+{
+    const size_t n = entries->count;
+    Nobuild__Pack_Bucket *buckets = NOBUILD__CALLOC(n, sizeof(*buckets));
+    size_t *starts = NOBUILD__CALLOC(n + 1, sizeof(*starts));
+    size_t *items = NOBUILD__MALLOC(sizeof(*items) * n);
+    size_t *candidates = NOBUILD__MALLOC(sizeof(*candidates) * n);
+    char *taken = NOBUILD__CALLOC(n, 1);
+    if (buckets == NULL || starts == NULL || items == NULL || candidates == NULL || taken == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        buckets[i].bucket = i;
+        starts[nobuild__pack_hash(entries->elems[i].name, 0) % n + 1] += 1;
+    }
+    for (size_t b = 0; b < n; ++b) {
+        buckets[b].count = starts[b + 1];
+        starts[b + 1] += starts[b];
+    }
+    {
+        size_t *fill = NOBUILD__CALLOC(n, sizeof(*fill));
+        if (fill == NULL) {
+            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        }
+        for (size_t i = 0; i < n; ++i) {
+            size_t b = nobuild__pack_hash(entries->elems[i].name, 0) % n;
+            items[starts[b] + fill[b]++] = i;
+        }
+        free(fill);
+    }
+
+    qsort(buckets, n, sizeof(*buckets), nobuild__pack_bucket_compare);
+
+    size_t next_free = 0;
+    for (size_t k = 0; k < n && buckets[k].count > 0; ++k) {
+        const size_t b = buckets[k].bucket;
+        const size_t *bucket_items = items + starts[b];
+
+        if (buckets[k].count == 1) {
+            while (taken[next_free]) {
+                next_free++;
+            }
+            taken[next_free] = 1;
+            slots[next_free] = (unsigned long) bucket_items[0];
+            seeds[b] = -(long) next_free - 1;
+            continue;
+        }
+
+        for (unsigned long seed = 1;; ++seed) {
+            if (seed > 0x7fffffful) {
+                PANIC("Could not build a perfect hash for %zu names", n);
+            }
+
+            size_t placed = 0;
+            for (; placed < buckets[k].count; ++placed) {
+                size_t slot = nobuild__pack_hash(entries->elems[bucket_items[placed]].name, seed) % n;
+                if (taken[slot]) {
+                    break;
+                }
+                taken[slot] = 1;
+                candidates[placed] = slot;
+            }
+
+            if (placed == buckets[k].count) {
+                for (size_t i = 0; i < placed; ++i) {
+                    slots[candidates[i]] = (unsigned long) bucket_items[i];
+                }
+                seeds[b] = (long) seed;
+                break;
+            }
+
+            for (size_t i = 0; i < placed; ++i) {
+                taken[candidates[i]] = 0;
+            }
+        }
+    }
+
+    free(buckets);
+    free(starts);
+    free(items);
+    free(candidates);
+    free(taken);
+}
+
+static void nobuild__pack_write_c(Nobuild__Embed_Writer *writer, const Nobuild__Pack_Entries *entries,
+                                  Cstr dir_path, Cstr pack_name, unsigned long long blob_size,
+                                  unsigned char *input, int flags)
+{
+    static const unsigned char zeros[NOBUILD__PACK_ALIGN] = {0};
+
+    nobuild__embed_printf(writer, NOBUILD__PACK_STAMP, flags, pack_name);
+    nobuild__embed_printf(writer, "// Generated by nobuild from %s. Do not edit.\n", dir_path);
+    if (flags & PACK_LOOKUP) {
+        nobuild__embed_write_cstr(writer, "#include <string.h>\n");
+    }
+    nobuild__embed_printf(writer,
+                          "\n"
+                          "#if defined(_MSC_VER)\n"
+                          "__declspec(align(%d))\n"
+                          "#endif\n"
+                          "const unsigned char %s[]\n"
+                          "#if defined(__GNUC__) || defined(__clang__)\n"
+                          "__attribute__((aligned(%d)))\n"
+                          "#endif\n"
+                          "= {\n",
+                          NOBUILD__PACK_ALIGN, pack_name, NOBUILD__PACK_ALIGN);
+
+    size_t column = 0;
+    unsigned long long offset = 0;
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        nobuild__embed_write_bytes(writer, zeros, (size_t) (entry->offset - offset), &column);
+
+        Fd file = fd_open_for_read(entry->path);
+        unsigned long long total_bytes_read = 0;
+        for (;;) {
+            size_t bytes_read = fd_read(file, input, NOBUILD__EMBED_READ_SIZE);
+            if (bytes_read == 0) {
+                break;
+            }
+
+            nobuild__embed_write_bytes(writer, input, bytes_read, &column);
+            total_bytes_read += bytes_read;
+        }
+        fd_close(file);
+
+        if (total_bytes_read != entry->size) {
+            PANIC("File %s changed size while being packed", entry->path);
+        }
+        offset = entry->offset + entry->size;
+    }
+    nobuild__embed_write_bytes(writer, zeros, (size_t) (blob_size - offset), &column);
+    if (blob_size == 0) {
+        nobuild__embed_write_cstr(writer, "\t0x00,\n");
+    } else if (column > 0) {
+        nobuild__embed_write(writer, "\n", 1);
+    }
+    nobuild__embed_write_cstr(writer, "};\n\n");
+
+    nobuild__embed_printf(writer, "const char %s_names[] =\n", pack_name);
+    for (size_t i = 0; i < entries->count; ++i) {
+        Cstr name = entries->elems[i].name;
+        nobuild__embed_write_literals(writer, (const unsigned char *) name, strlen(name) + (i + 1 < entries->count));
+    }
+    nobuild__embed_write_cstr(writer, entries->count == 0 ? "\t\"\";\n\n" : ";\n\n");
+
+    nobuild__embed_printf(writer, "const unsigned long %s_entries[][4] = {\n", pack_name);
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        nobuild__embed_printf(writer, "\t{ %llu, %lu, %llu, %llu },\n",
+                              entry->name_offset, (unsigned long) strlen(entry->name), entry->offset, entry->size);
+    }
+    if (entries->count == 0) {
+        nobuild__embed_write_cstr(writer, "\t{ 0, 0, 0, 0 },\n");
+    }
+    nobuild__embed_write_cstr(writer, "};\n");
+    nobuild__embed_printf(writer, "const unsigned long %s_count = %lu;\n", pack_name, (unsigned long) entries->count);
+
+    if (!(flags & PACK_LOOKUP)) {
+        return;
+    }
+
+    const size_t n = entries->count;
+    long *seeds = NOBUILD__CALLOC(n ? n : 1, sizeof(*seeds));
+    unsigned long *slots = NOBUILD__CALLOC(n ? n : 1, sizeof(*slots));
+    if (seeds == NULL || slots == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    if (n > 0) {
+        nobuild__pack_perfect_hash(entries, seeds, slots);
+    }
+
+    nobuild__embed_printf(writer, "\nstatic const long %s__seeds[] = {\n", pack_name);
+    for (size_t i = 0; i < (n ? n : 1); ++i) {
+        nobuild__embed_printf(writer, "\t%ld,\n", seeds[i]);
+    }
+    nobuild__embed_printf(writer, "};\n\nstatic const unsigned long %s__slots[] = {\n", pack_name);
+    for (size_t i = 0; i < (n ? n : 1); ++i) {
+        nobuild__embed_printf(writer, "\t%lu,\n", slots[i]);
+    }
+    nobuild__embed_write_cstr(writer, "};\n\n");
+
+    nobuild__embed_printf(writer,
+                          "static unsigned long %s__hash(const char *name, unsigned long seed)\n"
+                          "{\n"
+                          "    unsigned long hash = (2166136261ul ^ seed) & 0xfffffffful;\n"
+                          "    while (*name) {\n"
+                          "        hash ^= (unsigned char) *name++;\n"
+                          "        hash = (hash * 16777619ul) & 0xfffffffful;\n"
+                          "    }\n"
+                          "    return hash;\n"
+                          "}\n"
+                          "\n",
+                          pack_name);
+    nobuild__embed_printf(writer,
+                          "long %s_find(const char *name)\n"
+                          "{\n"
+                          "    const unsigned long n = %lu;\n"
+                          "    if (n == 0) return -1;\n"
+                          "    long seed = %s__seeds[%s__hash(name, 0) %% n];\n",
+                          pack_name, (unsigned long) n, pack_name, pack_name);
+    nobuild__embed_printf(writer,
+                          "    unsigned long slot = seed < 0 ? (unsigned long) (-seed - 1) : %s__hash(name, (unsigned long) seed) %% n;\n"
+                          "    unsigned long index = %s__slots[slot];\n"
+                          "    return strcmp(%s_names + %s_entries[index][0], name) == 0 ? (long) index : -1;\n"
+                          "}\n",
+                          pack_name, pack_name, pack_name, pack_name);
+
+    free(seeds);
+    free(slots);
+}
+
+static void nobuild__pack_write_object(Nobuild__Embed_Writer *writer, const Nobuild__Pack_Entries *entries,
+                                       Cstr pack_name, unsigned long long blob_size, unsigned long long names_size,
+                                       unsigned char *input)
+{
+    // .rodata holds the blob, the names, then the 8 byte aligned entries and count
+    const unsigned long long names_offset = blob_size;
+    const unsigned long long entries_offset = NOBUILD__ALIGN(names_offset + names_size, 8);
+    const unsigned long long entries_size = (entries->count ? entries->count : 1) * 4 * 8;
+    const unsigned long long count_offset = entries_offset + entries_size;
+
+    Nobuild__Elf_Symbol symbols[] = {
+        { .name = pack_name, .offset = 0, .size = blob_size },
+        { .name = CONCAT(pack_name, "_names"), .offset = names_offset, .size = names_size },
+        { .name = CONCAT(pack_name, "_entries"), .offset = entries_offset, .size = entries_size },
+        { .name = CONCAT(pack_name, "_count"), .offset = count_offset, .size = 8 },
+    };
+    Nobuild__Elf_Layout layout = nobuild__elf_layout(count_offset + 8, symbols, 4);
+
+    nobuild__elf_begin(writer, layout);
+
+    unsigned long long offset = 0;
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        nobuild__embed_zeros(writer, (size_t) (entry->offset - offset));
+
+        Fd file = fd_open_for_read(entry->path);
+        if (nobuild__embed_copy(writer, file, input) != entry->size) {
+            PANIC("File %s changed size while being packed", entry->path);
+        }
+        fd_close(file);
+        offset = entry->offset + entry->size;
+    }
+    nobuild__embed_zeros(writer, (size_t) (blob_size - offset));
+
+    for (size_t i = 0; i < entries->count; ++i) {
+        nobuild__embed_write(writer, entries->elems[i].name, strlen(entries->elems[i].name) + 1);
+    }
+    nobuild__embed_zeros(writer, (size_t) (entries_offset - names_offset - names_size));
+
+    char bytes[4 * 8] = {0};
+    for (size_t i = 0; i < entries->count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries->elems[i];
+        char *out = bytes;
+        out = nobuild__elf_u64(out, entry->name_offset);
+        out = nobuild__elf_u64(out, strlen(entry->name));
+        out = nobuild__elf_u64(out, entry->offset);
+        out = nobuild__elf_u64(out, entry->size);
+        nobuild__embed_write(writer, bytes, sizeof(bytes));
+    }
+    if (entries->count == 0) {
+        nobuild__embed_zeros(writer, sizeof(bytes));
+    }
+    nobuild__elf_u64(bytes, entries->count);
+    nobuild__embed_write(writer, bytes, 8);
+
+    nobuild__elf_end(writer, layout, symbols, 4);
+}
+
+static unsigned long long nobuild__pack_u64(const char *in)
+{
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | (unsigned char) in[i];
+    }
+    return value;
+}
+
+// Reads `count` bytes at `offset` of `fd`, returns whether they were all there
+static int nobuild__pack_read_at(Fd fd, unsigned long long offset, char *buf, size_t count)
+{
+#ifndef _WIN32
+    if (lseek(fd, (off_t) offset, SEEK_SET) < 0) {
+        return 0;
+    }
+#else
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG) offset;
+    if (!SetFilePointerEx(fd, position, NULL, FILE_BEGIN)) {
+        return 0;
+    }
+#endif // _WIN32
+    return fd_read(fd, buf, (unsigned long) count) == count;
+}
+
+// Whether `out_path` was generated with the same `flags` and `pack_name`. Sources
+// start with `NOBUILD__PACK_STAMP`, objects are checked through the name of their
+// first symbol since they can only be generated without flags
+static int nobuild__pack_stamp_matches(Cstr out_path, Cstr pack_name, int flags, int object)
+{
+    char expected[256];
+    int len = object ? snprintf(expected, sizeof(expected), "%s", pack_name)
+                     : snprintf(expected, sizeof(expected), NOBUILD__PACK_STAMP, flags, pack_name);
+    if (len < 0 || (size_t) len >= sizeof(expected)) {
+        return 0;
+    }
+
+    Fd fd = fd_open_for_read(out_path);
+    unsigned long long offset = 0;
+    int matches = 1;
+    if (object) {
+        // The first symbol name follows the null byte at the start of `.strtab`,
+        // the fifth section. Its terminator is compared too.
+        char header[NOBUILD__ELF_HEADER_SIZE];
+        char section[NOBUILD__ELF_SECTION_SIZE];
+        matches = nobuild__pack_read_at(fd, 0, header, sizeof(header)) && memcmp(header, "\x7f" "ELF", 4) == 0 &&
+                  nobuild__pack_read_at(fd, nobuild__pack_u64(header + 0x28) + 4 * NOBUILD__ELF_SECTION_SIZE,
+                                        section, sizeof(section));
+        offset = matches ? nobuild__pack_u64(section + 0x18) + 1 : 0;
+        len += 1;
+    }
+
+    char actual[sizeof(expected)];
+    matches = matches && nobuild__pack_read_at(fd, offset, actual, (size_t) len) && memcmp(actual, expected, (size_t) len) == 0;
+    fd_close(fd);
+    return matches;
+}
+
+void dir_to_pack(Cstr dir_path, Cstr out_path, Cstr pack_name, int flags)
+{
+    const int object = cstr_ends_with(out_path, ".o");
+    if (object && (flags & PACK_LOOKUP)) {
+        PANIC("Could not pack %s into %s: PACK_LOOKUP is only available for C sources, "
+              "use dir_to_pack() with PACK_DEFAULT for objects", dir_path, out_path);
+    }
+
+    Nobuild__Pack_Entries entries = {0};
+    long long mtime = 0;
+    unsigned long long size = 0;
+    int is_dir = 0;
+    if (nobuild__pack_stat(dir_path, &is_dir, &mtime, &size) < 0 || !is_dir) {
+        PANIC("Could not pack %s: not a directory", dir_path);
+    }
+    nobuild__pack_collect(&entries, dir_path, NULL, &mtime);
+
+    // A file with the same timestamp as the pack may have been written right after it
+    // within the resolution of the clock, so only a strictly newer pack is reused
+    long long out_mtime = 0;
+    if (nobuild__pack_stat(out_path, &is_dir, &out_mtime, &size) == 0 && out_mtime > mtime &&
+        nobuild__pack_stamp_matches(out_path, pack_name, flags, object)) {
+        da_free(&entries);
+        return;
+    }
+
+    qsort(entries.elems, entries.count, sizeof(*entries.elems), nobuild__pack_entry_compare);
+
+    unsigned long long blob_size = 0;
+    unsigned long long names_size = 0;
+    for (size_t i = 0; i < entries.count; ++i) {
+        Nobuild__Pack_Entry *entry = &entries.elems[i];
+        entry->offset = blob_size;
+        entry->name_offset = names_size;
+        blob_size = NOBUILD__ALIGN(blob_size + entry->size + 1, NOBUILD__PACK_ALIGN);
+        names_size += strlen(entry->name) + 1;
+    }
+
+    unsigned char *input = NOBUILD__MALLOC(NOBUILD__EMBED_READ_SIZE);
+    char *output = NOBUILD__MALLOC(NOBUILD__EMBED_WRITE_SIZE);
+    if (input == NULL || output == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    nobuild__embed_cells_init();
+
+    Atomic_File out = atomic_file_open(out_path);
+    Nobuild__Embed_Writer writer = {
+        .fd = out.fd,
+        .path = out_path,
+        .elems = output,
+    };
+
+    if (object) {
+        nobuild__pack_write_object(&writer, &entries, pack_name, blob_size, names_size, input);
+    } else {
+        nobuild__pack_write_c(&writer, &entries, dir_path, pack_name, blob_size, input, flags);
+    }
+    nobuild__embed_flush(&writer);
+
+    atomic_file_commit(&out);
+    da_free(&entries);
+    free(input);
+    free(output);
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+#endif // NOBUILD_EMBED_I_
+#endif // NOBUILD_EMBED_IMPLEMENTATION
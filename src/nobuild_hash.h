@@ -0,0 +1,302 @@
+#ifndef NOBUILD_HASH_H_
+#define NOBUILD_HASH_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "nobuild_log.h"
+#include "nobuild_arena.h"
+#include "nobuild_cstr.h"
+
+// Typed hash maps and sets, generated by macros for the key and value types at hand.
+// They use open addressing with linear probing, keep the hash of every entry next to
+// it and stay at most 70% full. Removing an entry shifts the ones after it back, so
+// there are no tombstones to slow lookups down.
+//
+//     HASH_SET_DEFINE(Path_Set, path_set, Cstr, hash_cstr, HASH_EQ_CSTR)
+//     HASH_MAP_DEFINE(Mtime_Map, mtime_map, Cstr, long long, hash_cstr, HASH_EQ_CSTR)
+//
+//     Path_Set compiled = {0};
+//     if (path_set_add(&compiled, source)) {
+//         CMD("cc", "-c", source);
+//     }
+//
+//     Mtime_Map mtimes = {0};
+//     mtime_map_put(&mtimes, "main.c", 42);
+//     long long *mtime = mtime_map_get(&mtimes, "main.c");
+//
+// A table allocates its storage on the heap and is freed with `<fn>_free()`. Setting
+// its `arena` before the first insertion allocates it from that arena instead, say
+// `&arena` for a private one. Keys and values are stored as they are, so strings used
+// as keys have to outlive the table.
+
+size_t hash_bytes(const void *data, size_t size);
+size_t hash_cstr(Cstr cstr);
+size_t hash_sv(String_View sv);
+size_t hash_integer(unsigned long long integer);
+size_t hash_pointer(const void *pointer);
+
+#define HASH_EQ_CSTR(a, b) (strcmp((a), (b)) == 0)
+#define HASH_EQ_SV(a, b) sv_eq((a), (b))
+#define HASH_EQ_VALUE(a, b) ((a) == (b))
+
+// What maps and sets have in common, for an `Entry` type whose first field is `key`
+#define NOBUILD__HASH_TABLE_DEFINE(Table, fn, Entry, Key, hash_fn, eq_fn)                   \
+    typedef struct {                                                                        \
+        Entry *entries;                                                                     \
+        /* The hash of the entry in every slot, 0 for an empty slot */                      \
+        size_t *hashes;                                                                     \
+        size_t count;                                                                       \
+        size_t capacity;                                                                    \
+        Arena *arena;                                                                       \
+    } Table;                                                                                \
+                                                                                            \
+    static inline size_t fn##__hash(Key key)                                                \
+    {                                                                                       \
+        size_t hash = (size_t) hash_fn(key);                                                \
+        return hash != 0 ? hash : 1;                                                        \
+    }                                                                                       \
+                                                                                            \
+    /* The slot that holds `key`, or the empty slot where it belongs */                     \
+    static inline size_t fn##__probe(const Table *table, Key key, size_t hash)              \
+    {                                                                                       \
+        const size_t mask = table->capacity - 1;                                            \
+        size_t i = hash & mask;                                                             \
+        while (table->hashes[i] != 0                                                        \
+               && !(table->hashes[i] == hash && eq_fn(table->entries[i].key, key))) {       \
+            i = (i + 1) & mask;                                                             \
+        }                                                                                   \
+        return i;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##__resize(Table *table, size_t capacity)                          \
+    {                                                                                       \
+        Table old = *table;                                                                 \
+        table->capacity = capacity;                                                         \
+        if (table->arena != NULL) {                                                         \
+            table->entries = arena_alloc(table->arena, sizeof(*table->entries) * capacity); \
+            table->hashes = arena_alloc(table->arena, sizeof(*table->hashes) * capacity);   \
+            memset(table->hashes, 0, sizeof(*table->hashes) * capacity);                    \
+        } else {                                                                            \
+            table->entries = NOBUILD__MALLOC(sizeof(*table->entries) * capacity);           \
+            table->hashes = NOBUILD__CALLOC(capacity, sizeof(*table->hashes));              \
+            if (table->entries == NULL || table->hashes == NULL) {                          \
+                PANIC("Could not allocate memory: %s", strerror(errno));                    \
+            }                                                                               \
+        }                                                                                   \
+                                                                                            \
+        for (size_t i = 0; i < old.capacity; ++i) {                                         \
+            if (old.hashes[i] == 0) {                                                       \
+                continue;                                                                   \
+            }                                                                               \
+            size_t j = old.hashes[i] & (capacity - 1);                                      \
+            while (table->hashes[j] != 0) {                                                 \
+                j = (j + 1) & (capacity - 1);                                               \
+            }                                                                               \
+            table->hashes[j] = old.hashes[i];                                               \
+            table->entries[j] = old.entries[i];                                             \
+        }                                                                                   \
+                                                                                            \
+        if (old.arena == NULL) {                                                            \
+            free(old.entries);                                                              \
+            free(old.hashes);                                                               \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* Makes room for `count` entries in total */                                           \
+    static inline void fn##_reserve(Table *table, size_t count)                             \
+    {                                                                                       \
+        size_t capacity = table->capacity > 0 ? table->capacity : 16;                       \
+        while (count * 10 > capacity * 7) {                                                 \
+            capacity *= 2;                                                                  \
+        }                                                                                   \
+        if (capacity > table->capacity) {                                                   \
+            fn##__resize(table, capacity);                                                  \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* The slot of `key`, which is added without a value when it is missing */              \
+    static inline size_t fn##__insert(Table *table, Key key, int *added)                    \
+    {                                                                                       \
+        fn##_reserve(table, table->count + 1);                                              \
+        const size_t hash = fn##__hash(key);                                                \
+        const size_t i = fn##__probe(table, key, hash);                                     \
+        *added = table->hashes[i] == 0;                                                     \
+        if (*added) {                                                                       \
+            table->hashes[i] = hash;                                                        \
+            table->entries[i].key = key;                                                    \
+            table->count += 1;                                                              \
+        }                                                                                   \
+        return i;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    static inline Entry *fn##__find(const Table *table, Key key)                            \
+    {                                                                                       \
+        if (table->count == 0) {                                                            \
+            return NULL;                                                                    \
+        }                                                                                   \
+        const size_t i = fn##__probe(table, key, fn##__hash(key));                          \
+        return table->hashes[i] != 0 ? &table->entries[i] : NULL;                           \
+    }                                                                                       \
+                                                                                            \
+    static inline int fn##_contains(const Table *table, Key key)                            \
+    {                                                                                       \
+        return fn##__find(table, key) != NULL;                                              \
+    }                                                                                       \
+                                                                                            \
+    /* Returns whether `key` was there to remove */                                         \
+    static inline int fn##_remove(Table *table, Key key)                                    \
+    {                                                                                       \
+        if (table->count == 0) {                                                            \
+            return 0;                                                                       \
+        }                                                                                   \
+                                                                                            \
+        const size_t mask = table->capacity - 1;                                            \
+        size_t i = fn##__probe(table, key, fn##__hash(key));                                \
+        if (table->hashes[i] == 0) {                                                        \
+            return 0;                                                                       \
+        }                                                                                   \
+                                                                                            \
+        /* Move back every following entry of the run that may live in the hole */          \
+        for (size_t j = i;;) {                                                              \
+            table->hashes[i] = 0;                                                           \
+            size_t home;                                                                    \
+            do {                                                                            \
+                j = (j + 1) & mask;                                                         \
+                if (table->hashes[j] == 0) {                                                \
+                    table->count -= 1;                                                      \
+                    return 1;                                                               \
+                }                                                                           \
+                home = table->hashes[j] & mask;                                             \
+            } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));           \
+                                                                                            \
+            table->hashes[i] = table->hashes[j];                                            \
+            table->entries[i] = table->entries[j];                                          \
+            i = j;                                                                          \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##_clear(Table *table)                                             \
+    {                                                                                       \
+        if (table->capacity > 0) {                                                          \
+            memset(table->hashes, 0, sizeof(*table->hashes) * table->capacity);             \
+        }                                                                                   \
+        table->count = 0;                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##_free(Table *table)                                              \
+    {                                                                                       \
+        if (table->arena == NULL) {                                                         \
+            free(table->entries);                                                           \
+            free(table->hashes);                                                            \
+        }                                                                                   \
+        Table empty = { .arena = table->arena };                                            \
+        *table = empty;                                                                     \
+    }
+
+#define HASH_MAP_DEFINE(Map, fn, Key, Value, hash_fn, eq_fn)                                \
+    typedef struct {                                                                        \
+        Key key;                                                                            \
+        Value value;                                                                        \
+    } Map##_Entry;                                                                          \
+                                                                                            \
+    NOBUILD__HASH_TABLE_DEFINE(Map, fn, Map##_Entry, Key, hash_fn, eq_fn)                   \
+                                                                                            \
+    /* The value of `key`, or NULL when there is none */                                    \
+    static inline Value *fn##_get(const Map *map, Key key)                                  \
+    {                                                                                       \
+        Map##_Entry *entry = fn##__find(map, key);                                          \
+        return entry != NULL ? &entry->value : NULL;                                        \
+    }                                                                                       \
+                                                                                            \
+    static inline void fn##_put(Map *map, Key key, Value value)                             \
+    {                                                                                       \
+        int added;                                                                          \
+        const size_t i = fn##__insert(map, key, &added);                                    \
+        map->entries[i].value = value;                                                      \
+    }
+
+#define HASH_SET_DEFINE(Set, fn, Key, hash_fn, eq_fn)                                       \
+    typedef struct {                                                                        \
+        Key key;                                                                            \
+    } Set##_Entry;                                                                          \
+                                                                                            \
+    NOBUILD__HASH_TABLE_DEFINE(Set, fn, Set##_Entry, Key, hash_fn, eq_fn)                   \
+                                                                                            \
+    /* Returns whether `key` was new to the set */                                          \
+    static inline int fn##_add(Set *set, Key key)                                           \
+    {                                                                                       \
+        int added;                                                                          \
+        fn##__insert(set, key, &added);                                                     \
+        return added;                                                                       \
+    }
+
+// Visits the entries of a map or set in no particular order
+#define HASH_FOREACH(type, entry, table, body)                                              \
+    for (size_t entry##_index = 0; entry##_index < (table).capacity; ++entry##_index) {     \
+        if ((table).hashes[entry##_index] == 0) {                                           \
+            continue;                                                                       \
+        }                                                                                   \
+        type *entry = &(table).entries[entry##_index];                                      \
+        body;                                                                               \
+    }
+
+#endif // NOBUILD_HASH_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_HASH_IMPLEMENTATION
+#ifndef NOBUILD_HASH_I_
+#define NOBUILD_HASH_I_
+
+#define NOBUILD_LOG_IMPLEMENTATION
+#include "nobuild_log.h"
+
+#define NOBUILD_ARENA_IMPLEMENTATION
+#include "nobuild_arena.h"
+
+#define NOBUILD_CSTR_IMPLEMENTATION
+#include "nobuild_cstr.h"
+
+// FNV-1a
+size_t hash_bytes(const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+size_t hash_cstr(Cstr cstr)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (; *cstr != '\0'; ++cstr) {
+        hash = (hash ^ (unsigned char) *cstr) * 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+size_t hash_sv(String_View sv)
+{
+    return hash_bytes(sv.data, sv.count);
+}
+
+// The finalizer of splitmix64, so that the low bits that pick the slot depend on all of them
+size_t hash_integer(unsigned long long integer)
+{
+    integer = (integer ^ (integer >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    integer = (integer ^ (integer >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t) (integer ^ (integer >> 31));
+}
+
+size_t hash_pointer(const void *pointer)
+{
+    return hash_integer((unsigned long long) (size_t) pointer);
+}
+
+#endif // NOBUILD_HASH_I_
+#endif // NOBUILD_HASH_IMPLEMENTATION
@@ -26,7 +26,11 @@ typedef struct {
     Fd write;
 } Pipe;
 
+// Both ends are closed on exec, so only the children they are handed to keep them open
 Pipe pipe_make(void);
+// Asks for a pipe capacity of at least `size` bytes and returns the capacity the
+// pipe ended up with, or 0 where it cannot be changed
+size_t pipe_set_size(Pipe pip, size_t size);
 
 Fd fd_open_for_read(const char *path);
 Fd fd_open_for_write(const char *path);
@@ -34,9 +38,77 @@ size_t fd_read(Fd fd, void *buf, unsigned long count);
 size_t fd_write(Fd fd, void *buf, unsigned long count);
 int fd_printf(Fd fd, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
 void fd_close(Fd fd);
+// Moves everything from `in` to `out` until the end of `in`, or until `out` is a
+// pipe without readers. Uses splice(2) when either side is a pipe on Linux.
+unsigned long long fd_pump(Fd in, Fd out);
+// Copies everything from `in` to both `out1` and `out2`, with tee(2) when `in` is
+// a pipe on Linux. An output without readers is dropped and the other one is kept.
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2);
+
+// The whole contents of a file, see `file_map()`
+typedef struct {
+    const char *data;
+    size_t size;
+    // Whether `data` is a memory mapping rather than a copy in a buffer
+    int mapped;
+} File_View;
+
+// Makes the whole file at `path` readable through `view`. Files of 64 KiB or more
+// are memory mapped for sequential access, smaller ones are read in a single read
+// into a null terminated buffer. Returns 0, or the errno of what failed.
+int file_map(const char *path, File_View *view);
+void file_unmap(File_View view);
+
+// An output that is written to `<path>.tmp.<pid>` and only renamed over `path` once
+// it is complete, so an interrupted build never leaves a truncated `path` with a
+// fresh modification time behind
+typedef struct {
+    Fd fd;
+    const char *path;
+    char *tmp_path;
+} Atomic_File;
+
+Atomic_File atomic_file_open(const char *path);
+// Closes the file and renames it over its path
+void atomic_file_commit(Atomic_File *file);
+// Closes and removes the file, leaving its path as it was
+void atomic_file_abort(Atomic_File *file);
+// Commits are not flushed to disk, which only matters if the whole system goes down.
+// With sync enabled every commit is remembered until `atomic_file_sync()` flushes
+// them and their directories at once, which also happens when the program exits.
+// Temporary files that were neither committed nor aborted are removed at exit, so a
+// PANIC in the middle of a step leaves none behind.
+void atomic_file_set_sync(int enabled);
+void atomic_file_sync(void);
 
 void pid_wait(Pid pid);
 
+// Define `NOBUILD_NO_THREADS` to build without a thread library. Threads then run
+// to completion inside `thread_create()` and mutexes do nothing.
+#if defined(NOBUILD_NO_THREADS)
+typedef int Thread;
+typedef int Mutex;
+#elif !defined(_WIN32)
+#    include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#else
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+#endif
+
+typedef void (*Thread_Fn)(void *data);
+
+Thread thread_create(Thread_Fn fn, void *data);
+void thread_join(Thread thread);
+// Number of online processors, at least 1
+size_t thread_count(void);
+
+void mutex_init(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+
 #endif  // NOBUILD_IO_H_
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -50,14 +122,31 @@ void pid_wait(Pid pid);
 #	include <sys/stat.h>
 #	include <unistd.h>
 #	include <fcntl.h>
+#	include <sys/mman.h>
 
 // Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
 char *strsignal(int sig);
+// Hidden along with the rest of the BSD extensions
+int madvise(void *addr, size_t length, int advice);
+#	ifndef MADV_SEQUENTIAL
+#		define MADV_SEQUENTIAL 2
+#	endif
+
+#	ifdef __linux__
+#		include <sys/syscall.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+#		define NOBUILD__F_SETPIPE_SZ 1031
+#		define NOBUILD__F_GETPIPE_SZ 1032
+#		define NOBUILD__SPLICE_F_MOVE 1
+#		define NOBUILD__SPLICE_F_MORE 4
+#	endif // __linux__
 #else
 #	include <assert.h>
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
@@ -65,6 +154,12 @@ char *strsignal(int sig);
 #define NOBUILD_LOG_IMPLEMENTATION
 #include "nobuild_log.h"
 
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_IO
+
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
 #define NOBUILD__GETLASTERROR
@@ -102,6 +197,9 @@ Pipe pipe_make(void)
 
     pip.read = pipefd[0];
     pip.write = pipefd[1];
+    if (fcntl(pip.read, F_SETFD, FD_CLOEXEC) < 0 || fcntl(pip.write, F_SETFD, FD_CLOEXEC) < 0) {
+        PANIC("Could not set close-on-exec on pipe: %s", strerror(errno));
+    }
 #else
     // https://docs.microsoft.com/en-us/windows/win32/ProcThread/creating-a-child-process-with-redirected-input-and-output
 
@@ -120,7 +218,7 @@ Pipe pipe_make(void)
 Fd fd_open_for_read(const char *path)
 {
 #ifndef _WIN32
-    Fd result = open(path, O_RDONLY);
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
     if (result < 0) {
         PANIC("Could not open file %s: %s", path, strerror(errno));
     }
@@ -131,14 +229,14 @@ Fd fd_open_for_read(const char *path)
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
                     path,
                     GENERIC_READ,
                     0,
                     &saAttr,
                     OPEN_EXISTING,
                     FILE_ATTRIBUTE_READONLY,
-                    NULL);
+                    NULL));
 
     if (result == INVALID_HANDLE_VALUE) {
         PANIC("Could not open file %s", path);
@@ -151,9 +249,9 @@ Fd fd_open_for_read(const char *path)
 Fd fd_open_for_write(const char *path)
 {
 #ifndef _WIN32
-    Fd result = open(path,
-                     O_WRONLY | O_CREAT | O_TRUNC,
-                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path,
+                                                     O_WRONLY | O_CREAT | O_TRUNC,
+                                                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
     if (result < 0) {
         PANIC("Could not open file %s: %s", path, strerror(errno));
     }
@@ -163,7 +261,7 @@ Fd fd_open_for_write(const char *path)
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
                     path,                  // name of the write
                     GENERIC_WRITE,         // open for writing
                     0,                     // do not share
@@ -171,7 +269,7 @@ Fd fd_open_for_write(const char *path)
                     CREATE_ALWAYS,         // Same as `O_CREAT | O_TRUNC`
                     FILE_ATTRIBUTE_NORMAL, // normal file
                     NULL                   // no attr. template
-                );
+                ));
 
     if (result == INVALID_HANDLE_VALUE) {
         PANIC("Could not open file %s: %s", path, nobuild__GetLastErrorAsString());
@@ -184,14 +282,14 @@ Fd fd_open_for_write(const char *path)
 size_t fd_read(Fd fd, void *buf, unsigned long count)
 {
 #ifndef _WIN32
-    ssize_t bytes = read(fd, buf, count);
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_READ, read(fd, buf, count));
     if (bytes == -1) {
         ERRO("Read error: %s", strerror(errno));
         return 0;
     }
 #else
     DWORD bytes;
-    if (!ReadFile(fd, buf, count, &bytes, NULL)) {
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buf, count, &bytes, NULL))) {
         ERRO("Read error: %s", nobuild__GetLastErrorAsString());
         return 0;
     }
@@ -203,14 +301,14 @@ size_t fd_read(Fd fd, void *buf, unsigned long count)
 size_t fd_write(Fd fd, void *buf, unsigned long count)
 {
 #ifndef _WIN32
-    ssize_t bytes = read(fd, buf, (size_t) count);
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buf, (size_t) count));
     if (bytes == -1) {
         ERRO("Write error: %s", strerror(errno));
         return 0;
     }
 #else
     DWORD bytes;
-    if (!WriteFile(fd, buf, count, &bytes, NULL)) {
+    if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buf, count, &bytes, NULL))) {
         ERRO("Write error: %s", nobuild__GetLastErrorAsString());
         return 0;
     }
@@ -233,7 +331,7 @@ int fd_printf(Fd fd, const char *fmt, ...) {
 #ifndef _WIN32
      char buffer[len + 1];
 #else
-     char *buffer = malloc(sizeof *buffer * (len + 1));
+     char *buffer = NOBUILD__MALLOC(sizeof *buffer * (len + 1));
 #endif
 
     va_start(args, fmt);
@@ -261,12 +359,671 @@ void fd_close(Fd fd)
 #endif // _WIN32
 }
 
+size_t pipe_set_size(Pipe pip, size_t size)
+{
+#ifdef __linux__
+    if (fcntl(pip.write, NOBUILD__F_SETPIPE_SZ, (int) size) < 0) {
+        // Above /proc/sys/fs/pipe-max-size without CAP_SYS_RESOURCE
+        WARN("Could not set pipe size to %zu bytes: %s", size, strerror(errno));
+        errno = 0;
+    }
+
+    int result = fcntl(pip.write, NOBUILD__F_GETPIPE_SZ);
+    return result > 0 ? (size_t) result : 0;
+#else
+    (void) pip;
+    (void) size;
+    return 0;
+#endif // __linux__
+}
+
+#define NOBUILD__PUMP_SIZE (1024 * 1024)
+
+// Returns 0 when `fd` is a pipe that nobody reads anymore
+static int nobuild__fd_write_all(Fd fd, const char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (size_t written = 0; written < count;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buffer + written, count - written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return 0;
+            }
+            PANIC("Could not write to file descriptor: %s", strerror(errno));
+        }
+        written += (size_t) n;
+    }
+#else
+    for (size_t written = 0; written < count;) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buffer + written, (DWORD) (count - written), &n, NULL))) {
+            if (GetLastError() == ERROR_NO_DATA || GetLastError() == ERROR_BROKEN_PIPE) {
+                return 0;
+            }
+            PANIC("Could not write to file: %s", nobuild__GetLastErrorAsString());
+        }
+        written += n;
+    }
+#endif // _WIN32
+
+    return 1;
+}
+
+// Returns 0 at the end of `fd`
+static size_t nobuild__fd_read_some(Fd fd, char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (;;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer, count));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PANIC("Could not read from file descriptor: %s", strerror(errno));
+        }
+        return (size_t) n;
+    }
+#else
+    DWORD n = 0;
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buffer, (DWORD) count, &n, NULL))) {
+        if (GetLastError() == ERROR_BROKEN_PIPE) {
+            return 0;
+        }
+        PANIC("Could not read from file: %s", nobuild__GetLastErrorAsString());
+    }
+    return n;
+#endif // _WIN32
+}
+
+#ifdef __linux__
+// Moves exactly `count` bytes from the pipe `in` to `out`. Returns 0 when `out`
+// has no readers, after dropping what is left of the `count` bytes from `in`.
+static int nobuild__fd_splice_exactly(Fd in, Fd out, size_t count)
+{
+    while (count > 0) {
+        long n = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, count, NOBUILD__SPLICE_F_MOVE));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EPIPE) {
+                PANIC("Could not splice between file descriptors: %s", strerror(errno));
+            }
+
+            errno = 0;
+            char buffer[4096];
+            while (count > 0) {
+                size_t dropped = nobuild__fd_read_some(in, buffer, count < sizeof(buffer) ? count : sizeof(buffer));
+                if (dropped == 0) {
+                    break;
+                }
+                count -= dropped;
+            }
+            return 0;
+        }
+        count -= (size_t) n;
+    }
+
+    return 1;
+}
+#endif // __linux__
+
+unsigned long long fd_pump(Fd in, Fd out)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, (size_t) NOBUILD__PUMP_SIZE,
+                                                              NOBUILD__SPLICE_F_MOVE | NOBUILD__SPLICE_F_MORE));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total;
+            }
+
+            // Neither side is a pipe, or the file does not support splicing
+            break;
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    for (;;) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0 || !nobuild__fd_write_all(out, buffer, bytes)) {
+            break;
+        }
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        // Duplicate what is buffered in `in` into `out1` without consuming it, then
+        // move the same bytes into `out2`
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_tee, in, out1, (size_t) NOBUILD__PUMP_SIZE, 0u));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total + fd_pump(in, out2);
+            }
+
+            // `in` or `out1` is not a pipe
+            break;
+        }
+
+        if (!nobuild__fd_splice_exactly(in, out2, (size_t) bytes)) {
+            return total + (unsigned long long) bytes + fd_pump(in, out1);
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    int alive1 = 1;
+    int alive2 = 1;
+    while (alive1 || alive2) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0) {
+            break;
+        }
+
+        alive1 = alive1 && nobuild__fd_write_all(out1, buffer, bytes);
+        alive2 = alive2 && nobuild__fd_write_all(out2, buffer, bytes);
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+// Mapping costs a few page faults and a TLB shootdown on unmap, which is more
+// than copying a small file
+#define NOBUILD__MAP_THRESHOLD (64 * 1024)
+
+#ifdef _WIN32
+static int nobuild__errno_from_win32(DWORD error)
+{
+    switch (error) {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+        return ENOENT;
+    case ERROR_ACCESS_DENIED:
+        return EACCES;
+    case ERROR_NOT_ENOUGH_MEMORY:
+        return ENOMEM;
+    default:
+        return EIO;
+    }
+}
+#endif // _WIN32
+
+int file_map(const char *path, File_View *view)
+{
+    view->data = NULL;
+    view->size = 0;
+    view->mapped = 0;
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        int error = errno;
+        errno = 0;
+        return error;
+    }
+
+    struct stat statbuf;
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0) {
+        int error = errno;
+        errno = 0;
+        close(fd);
+        return error;
+    }
+
+    if (S_ISDIR(statbuf.st_mode)) {
+        close(fd);
+        return EISDIR;
+    }
+
+    const size_t size = (size_t) statbuf.st_size;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            close(fd);
+            view->data = data;
+            view->size = size;
+            view->mapped = 1;
+            return 0;
+        }
+
+        // Some filesystems cannot map files, read those instead
+        errno = 0;
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        close(fd);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer + count, size - count));
+        if (n < 0 && errno == EINTR) {
+            errno = 0;
+            continue;
+        }
+
+        if (n < 0) {
+            int error = errno;
+            errno = 0;
+            free(buffer);
+            close(fd);
+            return error;
+        }
+
+        // The file shrank since fstat()
+        if (n == 0) {
+            break;
+        }
+        count += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                                                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        return nobuild__errno_from_win32(GetLastError());
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        int error = nobuild__errno_from_win32(GetLastError());
+        CloseHandle(file);
+        return error;
+    }
+
+    const size_t size = (size_t) file_size.QuadPart;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            // The view keeps the file alive on its own
+            void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (data != NULL) {
+                CloseHandle(file);
+                view->data = data;
+                view->size = size;
+                view->mapped = 1;
+                return 0;
+            }
+        }
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        CloseHandle(file);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, buffer + count, (DWORD) (size - count), &n, NULL))) {
+            int error = nobuild__errno_from_win32(GetLastError());
+            free(buffer);
+            CloseHandle(file);
+            return error;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        count += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    buffer[count] = '\0';
+    view->data = buffer;
+    view->size = count;
+    return 0;
+}
+
+void file_unmap(File_View view)
+{
+    if (!view.mapped) {
+        free((char *) view.data);
+        return;
+    }
+
+#ifndef _WIN32
+    munmap((void *) view.data, view.size);
+#else
+    UnmapViewOfFile(view.data);
+#endif // _WIN32
+}
+
+// Multiple modules could define these locks, so add a guard around them to prevent redefinition
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static struct {
+    Nobuild__Lock lock;
+    // Whether the exit handler was registered, by the process with `pid`
+    int registered;
+    unsigned long pid;
+    int sync;
+    // Committed since the last `atomic_file_sync()`
+    char **paths;
+    size_t count;
+    size_t capacity;
+    // Temporary files that were neither renamed nor removed yet
+    const char **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} nobuild__atomic = { .lock = NOBUILD__LOCK_INIT };
+
+static unsigned long nobuild__getpid(void)
+{
+#ifndef _WIN32
+    return (unsigned long) getpid();
+#else
+    return (unsigned long) GetCurrentProcessId();
+#endif // _WIN32
+}
+
+// Removes the temporary files that a failed build left behind, PANIC included, and
+// flushes the commits when sync is enabled
+static void nobuild__atomic_exit(void)
+{
+    // Forked children exit through here too, but the files belong to the parent
+    if (nobuild__getpid() != nobuild__atomic.pid) {
+        return;
+    }
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = 0; i < nobuild__atomic.pending_count; ++i) {
+        remove(nobuild__atomic.pending[i]);
+    }
+    nobuild__atomic.pending_count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+
+    atomic_file_sync();
+}
+
+// Must be called with the lock held
+static void nobuild__atomic_register(void)
+{
+    if (!nobuild__atomic.registered) {
+        nobuild__atomic.registered = 1;
+        nobuild__atomic.pid = nobuild__getpid();
+        atexit(nobuild__atomic_exit);
+    }
+}
+
+// Has `tmp_path` removed at exit unless it is forgotten before. The path is not copied.
+static void nobuild__atomic_pending_add(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    nobuild__atomic_register();
+    if (nobuild__atomic.pending_count >= nobuild__atomic.pending_capacity) {
+        nobuild__atomic.pending_capacity = nobuild__atomic.pending_capacity ? nobuild__atomic.pending_capacity * 2 : 16;
+        nobuild__atomic.pending = NOBUILD__REALLOC(nobuild__atomic.pending,
+                                                   sizeof(*nobuild__atomic.pending) * nobuild__atomic.pending_capacity);
+        if (nobuild__atomic.pending == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.pending[nobuild__atomic.pending_count++] = tmp_path;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static void nobuild__atomic_pending_remove(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = nobuild__atomic.pending_count; i-- > 0;) {
+        if (nobuild__atomic.pending[i] == tmp_path) {
+            nobuild__atomic.pending[i] = nobuild__atomic.pending[--nobuild__atomic.pending_count];
+            break;
+        }
+    }
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static int nobuild__atomic_sync_enabled(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    int enabled = nobuild__atomic.sync;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+    return enabled;
+}
+
+static char *nobuild__atomic_tmp_path(const char *path)
+{
+    unsigned long pid = nobuild__getpid();
+    size_t size = strlen(path) + 32;
+    char *tmp_path = NOBUILD__MALLOC(size);
+    if (tmp_path == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    snprintf(tmp_path, size, "%s.tmp.%lu", path, pid);
+    return tmp_path;
+}
+
+// Remembers `path` for `atomic_file_sync()` when sync is enabled
+static void nobuild__atomic_sync_push(const char *path)
+{
+    if (!nobuild__atomic_sync_enabled()) {
+        return;
+    }
+
+    size_t size = strlen(path) + 1;
+    char *copy = NOBUILD__MALLOC(size);
+    if (copy == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    memcpy(copy, path, size);
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (nobuild__atomic.count >= nobuild__atomic.capacity) {
+        nobuild__atomic.capacity = nobuild__atomic.capacity ? nobuild__atomic.capacity * 2 : 64;
+        nobuild__atomic.paths = NOBUILD__REALLOC(nobuild__atomic.paths,
+                                                 sizeof(*nobuild__atomic.paths) * nobuild__atomic.capacity);
+        if (nobuild__atomic.paths == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.paths[nobuild__atomic.count++] = copy;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+// Moves the temporary file of `file` over its path, once whoever wrote it has closed it
+static void nobuild__atomic_file_rename(Atomic_File *file)
+{
+#ifndef _WIN32
+    if (rename(file->tmp_path, file->path) < 0) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, strerror(errno));
+    }
+#else
+    if (!MoveFileExA(file->tmp_path, file->path, MOVEFILE_REPLACE_EXISTING)) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    nobuild__atomic_pending_remove(file->tmp_path);
+    nobuild__atomic_sync_push(file->path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+Atomic_File atomic_file_open(const char *path)
+{
+    Atomic_File file = {0};
+    file.path = path;
+    file.tmp_path = nobuild__atomic_tmp_path(path);
+    nobuild__atomic_pending_add(file.tmp_path);
+    file.fd = fd_open_for_write(file.tmp_path);
+    return file;
+}
+
+void atomic_file_commit(Atomic_File *file)
+{
+    fd_close(file->fd);
+    nobuild__atomic_file_rename(file);
+}
+
+void atomic_file_abort(Atomic_File *file)
+{
+    fd_close(file->fd);
+    remove(file->tmp_path);
+    nobuild__atomic_pending_remove(file->tmp_path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+void atomic_file_set_sync(int enabled)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (enabled) {
+        nobuild__atomic_register();
+    }
+    nobuild__atomic.sync = enabled;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+#ifndef _WIN32
+static void nobuild__fsync_path(const char *path)
+{
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        WARN("Could not open %s to flush it: %s", path, strerror(errno));
+        errno = 0;
+        return;
+    }
+
+    if (fsync(fd) < 0) {
+        WARN("Could not flush %s: %s", path, strerror(errno));
+        errno = 0;
+    }
+    close(fd);
+}
+#endif // _WIN32
+
+void atomic_file_sync(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (!nobuild__atomic.sync) {
+        NOBUILD__UNLOCK(&nobuild__atomic.lock);
+        return;
+    }
+
+#ifndef _WIN32
+    const char *last_dir = NULL;
+    size_t last_dir_len = 0;
+#endif // _WIN32
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        char *path = nobuild__atomic.paths[i];
+#ifndef _WIN32
+        nobuild__fsync_path(path);
+
+        // The renames live in the directories, flush each of them once in a row
+        char *sep = strrchr(path, '/');
+        size_t dir_len = sep ? (size_t) (sep - path) : 0;
+        if (last_dir == NULL || dir_len != last_dir_len || memcmp(last_dir, path, dir_len) != 0) {
+            if (dir_len == 0) {
+                nobuild__fsync_path(sep ? "/" : ".");
+            } else {
+                *sep = '\0';
+                nobuild__fsync_path(path);
+                *sep = '/';
+            }
+            last_dir = path;
+            last_dir_len = dir_len;
+        }
+#else
+        HANDLE handle = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+        if (handle == INVALID_HANDLE_VALUE || !FlushFileBuffers(handle)) {
+            WARN("Could not flush %s: %s", path, nobuild__GetLastErrorAsString());
+        }
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#endif // _WIN32
+    }
+
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        free(nobuild__atomic.paths[i]);
+    }
+    nobuild__atomic.count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
 void pid_wait(Pid pid)
 {
 #ifndef _WIN32
     for (;;) {
         int wstatus = 0;
-        if (waitpid(pid, &wstatus, 0) < 0) {
+        if (NOBUILD__STATS_CALL(STATS_WAITPID, waitpid(pid, &wstatus, 0)) < 0) {
             PANIC("Could not wait on command (pid %d): %s", pid, strerror(errno));
         }
 
@@ -284,10 +1041,10 @@ void pid_wait(Pid pid)
         }
     }
 #else
-    DWORD result = WaitForSingleObject(
+    DWORD result = (DWORD) NOBUILD__STATS_CALL(STATS_WAITPID, WaitForSingleObject(
                        pid,     // HANDLE hHandle,
                        INFINITE // DWORD  dwMilliseconds
-                   );
+                   ));
 
     if (result == WAIT_FAILED) {
         PANIC("Could not wait on child process: %s", nobuild__GetLastErrorAsString());
@@ -306,5 +1063,137 @@ void pid_wait(Pid pid)
 #endif // _WIN32
 }
 
+typedef struct {
+    Thread_Fn fn;
+    void *data;
+} Nobuild__Thread_Start;
+
+#if !defined(NOBUILD_NO_THREADS) && !defined(_WIN32)
+static void *nobuild__thread_start(void *arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return NULL;
+}
+#elif !defined(NOBUILD_NO_THREADS)
+static DWORD WINAPI nobuild__thread_start(LPVOID arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return 0;
+}
+#endif
+
+Thread thread_create(Thread_Fn fn, void *data)
+{
+#ifdef NOBUILD_NO_THREADS
+    fn(data);
+    return 0;
+#else
+    Nobuild__Thread_Start *start = NOBUILD__MALLOC(sizeof(*start));
+    if (start == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    start->fn = fn;
+    start->data = data;
+
+#	ifndef _WIN32
+    Thread thread;
+    int error = pthread_create(&thread, NULL, nobuild__thread_start, start);
+    if (error != 0) {
+        PANIC("Could not create thread: %s", strerror(error));
+    }
+#	else
+    Thread thread = CreateThread(NULL, 0, nobuild__thread_start, start, 0, NULL);
+    if (thread == NULL) {
+        PANIC("Could not create thread: %s", nobuild__GetLastErrorAsString());
+    }
+#	endif // _WIN32
+
+    return thread;
+#endif // NOBUILD_NO_THREADS
+}
+
+void thread_join(Thread thread)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) thread;
+#elif !defined(_WIN32)
+    int error = pthread_join(thread, NULL);
+    if (error != 0) {
+        PANIC("Could not join thread: %s", strerror(error));
+    }
+#else
+    if (WaitForSingleObject(thread, INFINITE) == WAIT_FAILED) {
+        PANIC("Could not join thread: %s", nobuild__GetLastErrorAsString());
+    }
+    CloseHandle(thread);
+#endif
+}
+
+size_t thread_count(void)
+{
+#ifndef _WIN32
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+#endif // _WIN32
+}
+
+void mutex_init(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    *mutex = 0;
+#elif !defined(_WIN32)
+    int error = pthread_mutex_init(mutex, NULL);
+    if (error != 0) {
+        PANIC("Could not create mutex: %s", strerror(error));
+    }
+#else
+    InitializeCriticalSection(mutex);
+#endif
+}
+
+void mutex_lock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_lock(mutex);
+#else
+    EnterCriticalSection(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_unlock(mutex);
+#else
+    LeaveCriticalSection(mutex);
+#endif
+}
+
+void mutex_destroy(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_destroy(mutex);
+#else
+    DeleteCriticalSection(mutex);
+#endif
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_IO_I_
 #endif // NOBUILD_IO_IMPLEMENTATION
@@ -1,6 +1,14 @@
 #ifndef NOBUILD_PATH_H_
 #define NOBUILD_PATH_H_
 
+// `futimens()` and the nanosecond timestamps of `struct stat` are POSIX 2008, which
+// -std=c99 hides unless a feature level is requested before the first system header
+#ifdef NOBUILD_PATH_IMPLEMENTATION
+#	if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE)
+#		define _POSIX_C_SOURCE 200809L
+#	endif
+#endif
+
 #ifndef NOBUILD__DEPRECATED
 #	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
 #		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
@@ -18,6 +26,12 @@
 #include "nobuild_cstr.h"
 
 #define PATH(...) JOIN(PATH_SEP, __VA_ARGS__)
+// A path made of string literals at compile time, see `JOIN_LIT`
+#define PATH_LIT(...) JOIN_LIT(PATH_SEP, __VA_ARGS__)
+
+// Appends `component` to the path being built, with a separator in between unless
+// the path is empty or already ends with one
+void sb_append_path(String_Builder *sb, Cstr component);
 
 Cstr path_no_ext(Cstr path);
 #define NOEXT(path) path_no_ext(path)
@@ -28,6 +42,11 @@ Cstr path_dirname(Cstr path);
 Cstr path_basename(Cstr path);
 #define BASENAME(path) path_basename(path)
 
+// Like the functions above, but the result points into `path` and nothing is allocated
+String_View path_no_ext_sv(String_View path);
+String_View path_dirname_sv(String_View path);
+String_View path_basename_sv(String_View path);
+
 int path_is_dir(Cstr path);
 #define IS_DIR(path) path_is_dir(path)
 
@@ -56,14 +75,44 @@ void path_rename(Cstr old_path, Cstr new_path);
         path_rename(old_path, new_path);              \
     } while (0)
 
+typedef enum {
+    COPY_DEFAULT = 0,
+    // Also preserve the access and modification times
+    COPY_TIMESTAMPS = 1 << 0,
+} Copy_Flags;
+
+typedef struct {
+    size_t files;
+    size_t dirs;
+    size_t symlinks;
+    // Sockets, fifos and devices are not copied
+    size_t skipped;
+    unsigned long long bytes;
+    double seconds;
+} Copy_Stats;
+
+// Copies files and directories recursively, preserving permission bits. Symbolic
+// links inside a directory are recreated instead of followed, and the files of a
+// directory are copied by a pool of `thread_count()` workers.
 void path_copy(Cstr old_path, Cstr new_path);
+Copy_Stats path_copy_ex(Cstr old_path, Cstr new_path, int flags);
 #define COPY(old_path, new_path)                    \
     do {                                            \
         INFO("COPY: %s -> %s", old_path, new_path); \
         path_copy(old_path, new_path);              \
     } while(0)
 
+typedef enum {
+    RM_DEFAULT = 0,
+    // Rename the path to a hidden trash name next to it and delete that from a
+    // detached process, so the call returns right away
+    RM_BACKGROUND = 1 << 0,
+} Rm_Flags;
+
+// Removes files and directories recursively. Symbolic links are removed, never
+// followed, and the subdirectories are deleted by a pool of `thread_count()` workers.
 void path_rm(Cstr path);
+void path_rm_ex(Cstr path, int flags);
 #define RM(path)                                \
     do {                                        \
         INFO("RM: %s", path);                   \
@@ -115,11 +164,83 @@ void path_rm(Cstr path);
 #define NOBUILD_IO_IMPLEMENTATION
 #include "nobuild_io.h"
 
+#define NOBUILD_BULK_IMPLEMENTATION
+#include "nobuild_bulk.h"
+
+#define NOBUILD_STATS_IMPLEMENTATION
+#include "nobuild_stats.h"
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_PATH
+
 #ifndef _WIN32
 #	include <sys/types.h>
 #	include <sys/stat.h>
 #	include <unistd.h>
 #	include <dirent.h>
+#	include <fcntl.h>
+#	include <sys/time.h>
+
+// Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
+int openat(int dirfd, const char *pathname, int flags, ...);
+DIR *fdopendir(int fd);
+int mkdirat(int dirfd, const char *pathname, mode_t mode);
+int fstatat(int dirfd, const char *pathname, struct stat *statbuf, int flags);
+int lstat(const char *pathname, struct stat *statbuf);
+ssize_t readlinkat(int dirfd, const char *pathname, char *buf, size_t bufsiz);
+int symlinkat(const char *target, int newdirfd, const char *linkpath);
+int unlinkat(int dirfd, const char *pathname, int flags);
+int renameat(int olddirfd, const char *oldpath, int newdirfd, const char *newpath);
+int fchmod(int fd, mode_t mode);
+
+// Timestamps are copied with nanoseconds where POSIX 2008 is available, and in whole
+// seconds through `futimes()` when a system header was included before the feature
+// level could be requested
+#	if defined(__APPLE__)
+int futimens(int fd, const struct timespec times[2]);
+#		define NOBUILD__FUTIMENS
+#		define NOBUILD__ST_ATIM(st) ((st)->st_atimespec)
+#		define NOBUILD__ST_MTIM(st) ((st)->st_mtimespec)
+#	elif defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L
+#		define NOBUILD__FUTIMENS
+#		define NOBUILD__ST_ATIM(st) ((st)->st_atim)
+#		define NOBUILD__ST_MTIM(st) ((st)->st_mtim)
+#	else
+int futimes(int fd, const struct timeval tv[2]);
+#	endif
+
+#	ifdef __linux__
+#		ifndef AT_SYMLINK_NOFOLLOW
+#			define AT_SYMLINK_NOFOLLOW 0x100
+#		endif
+#		ifndef AT_REMOVEDIR
+#			define AT_REMOVEDIR 0x200
+#		endif
+#	endif // __linux__
+
+// `d_type` is there, but its values are hidden along with the rest of POSIX 2008.
+// These are the same on Linux, macOS and the BSDs.
+#	ifndef DT_UNKNOWN
+#		define DT_UNKNOWN 0
+#		define DT_DIR 4
+#		define DT_REG 8
+#		define DT_LNK 10
+#	endif
+#	if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#		define NOBUILD__D_TYPE(dp) ((dp)->d_type)
+#	else
+#		define NOBUILD__D_TYPE(dp) DT_UNKNOWN
+#	endif
+#	ifdef __linux__
+#		include <sys/ioctl.h>
+#		include <sys/sendfile.h>
+#		include <sys/syscall.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+#		ifndef NOBUILD__FICLONE
+#			define NOBUILD__FICLONE _IOW(0x94, 9, int)
+#		endif
+#	endif // __linux__
 #else
 #	define WIN32_MEAN_AND_LEAN
 #	include <windows.h>
@@ -196,104 +317,99 @@ int nobuild__unlink(const char *pathname)
 #endif
 }
 
-Cstr path_no_ext(Cstr path)
+void sb_append_path(String_Builder *sb, Cstr component)
 {
-    size_t n = strlen(path);
-    while (n > 0 && path[n - 1] != '.') {
-        n -= 1;
+    if (sb->count > 0 && sb->elems[sb->count - 1] != *PATH_SEP) {
+        sb_append_bytes(sb, PATH_SEP, 1);
     }
+    sb_append_cstr(sb, component);
+}
 
-    if (n > 0) {
-        char *result = malloc(n);
-        memcpy(result, path, n);
-        result[n - 1] = '\0';
-
-        return result;
-    } else {
-        return path;
+String_View path_no_ext_sv(String_View path)
+{
+    const size_t dot = sv_rfind_char(path, '.');
+    if (dot < path.count) {
+        path.count = dot;
     }
+    return path;
 }
 
-Cstr path_dirname(Cstr path)
+Cstr path_no_ext(Cstr path)
+{
+    String_View sv = sv_from_cstr(path);
+    String_View no_ext = path_no_ext_sv(sv);
+    return no_ext.count < sv.count ? sv_to_cstr(no_ext) : path;
+}
+
+String_View path_dirname_sv(String_View path)
 {
     char path_sep = *PATH_SEP;
     size_t prefix_len = 0;
 
     // Get length of directory prefix
-    for (size_t i = 1; i < strlen(path); ++i) {
-        if (path[i] != path_sep && path[i-1] == path_sep) {
+    for (size_t i = 1; i < path.count; ++i) {
+        if (path.data[i] != path_sep && path.data[i-1] == path_sep) {
             prefix_len = i;
         }
     }
 
     if (prefix_len == 0) {
-        return *path == path_sep ? PATH_SEP : ".";
+        return path.count > 0 && *path.data == path_sep ? SV(PATH_SEP) : SV(".");
     }
 
     // Strip trailing slashes
-    while (prefix_len > 1 && path[prefix_len-1] == path_sep) {
+    while (prefix_len > 1 && path.data[prefix_len-1] == path_sep) {
         --prefix_len;
     }
 
-    // copy prefix
-    size_t len = prefix_len;
-    char* dirname = malloc(len+1);
-    if (dirname == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-    }
+    path.count = prefix_len;
+    return path;
+}
 
-    return dirname[len] = '\0', memcpy(dirname, path, len);
+Cstr path_dirname(Cstr path)
+{
+    String_View dirname = path_dirname_sv(sv_from_cstr(path));
+    return dirname.data == path ? sv_to_cstr(dirname) : dirname.data;
 }
 
-Cstr path_basename(Cstr path)
+String_View path_basename_sv(String_View path)
 {
     char path_sep = *PATH_SEP;
-    Cstr last_sep = strrchr(path, path_sep);
-    if (last_sep == NULL) {
-        return path;
-    }
 
-    // Last character is not a separator
-    if (*(last_sep + 1) != '\0') {
-        size_t len = strlen(last_sep + 1);
-        char* basename = malloc(len + 1);
-        if (basename == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-
-        return basename[len] = '\0', memcpy(basename, last_sep + 1, len);
-    }
-
-    // Skip consecutive seprators
-    while (last_sep > path && *(last_sep - 1) == path_sep) {
-        --last_sep;
+    // Skip trailing separators
+    size_t end = path.count;
+    while (end > 0 && path.data[end - 1] == path_sep) {
+        --end;
     }
 
-    if (last_sep == path) {
-        return PATH_SEP;
+    if (end == 0) {
+        return path.count > 0 ? SV(PATH_SEP) : path;
     }
 
     // Find the start of the basename
-    Cstr start = last_sep;
-    while (start > path && *(start - 1) != path_sep) {
+    size_t start = end;
+    while (start > 0 && path.data[start - 1] != path_sep) {
         --start;
     }
-    assert(last_sep >= start && "last_sep must never be less than start");
 
-    size_t len = (size_t)(last_sep - start);
-    char *basename = malloc(len + 1);
-    if (basename == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-    }
+    return sv_from_parts(path.data + start, end - start);
+}
 
-    return basename[len] = '\0', memcpy(basename, start, len);
+Cstr path_basename(Cstr path)
+{
+    String_View sv = sv_from_cstr(path);
+    String_View basename = path_basename_sv(sv);
+    if (basename.data == path && basename.count == sv.count) {
+        return path;
+    }
+    return basename.data[basename.count] == '\0' ? basename.data : sv_to_cstr(basename);
 }
 
 int path_is_dir(Cstr path)
 {
 #ifndef _WIN32
     struct stat statbuf = {0};
-    if (stat(path, &statbuf) < 0) {
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
         if (errno == ENOENT) {
             errno = 0;
             return 0;
@@ -305,7 +421,7 @@ int path_is_dir(Cstr path)
 
     return S_ISDIR(statbuf.st_mode);
 #else
-    DWORD dwAttrib = GetFileAttributes(path);
+    DWORD dwAttrib = (DWORD) NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributes(path));
 
     return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
             (dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
@@ -316,7 +432,7 @@ int path_is_file(Cstr path)
 {
 #ifndef _WIN32
     struct stat statbuf = {0};
-    if (stat(path, &statbuf) < 0) {
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
         if (errno == ENOENT) {
             errno = 0;
             return 0;
@@ -328,7 +444,7 @@ int path_is_file(Cstr path)
 
     return S_ISREG(statbuf.st_mode);
 #else
-    DWORD dwAttrib = GetFileAttributes(path);
+    DWORD dwAttrib = (DWORD) NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributes(path));
     return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
             !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
 #endif // _WIN32
@@ -338,7 +454,7 @@ int path_exists(Cstr path)
 {
 #ifndef _WIN32
     struct stat statbuf = {0};
-    if (stat(path, &statbuf) < 0) {
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(path, &statbuf)) < 0) {
         if (errno == ENOENT) {
             errno = 0;
             return 0;
@@ -350,7 +466,7 @@ int path_exists(Cstr path)
 
     return 1;
 #else
-    DWORD dwAttrib = GetFileAttributes(path);
+    DWORD dwAttrib = (DWORD) NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributes(path));
     return (dwAttrib != INVALID_FILE_ATTRIBUTES);
 #endif
 }
@@ -361,7 +477,61 @@ int is_path1_modified_after_path2(Cstr path1, Cstr path2)
     return path_is_newer(path1, path2);
 }
 
+#ifndef _WIN32
+typedef struct {
+    Bulk_Stat *elems;
+    size_t count;
+    size_t capacity;
+} Nobuild__Mtime_Entries;
+
+// Walks the directories readdir() already knows about right away and leaves
+// everything else to be stat'ed in one batch
+static void nobuild__mtime_collect(Nobuild__Mtime_Entries *entries, Cstr dir_path)
+{
+    FOREACH_FILE_IN_DIR(file, dir_path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        if (NOBUILD__D_TYPE(dp) == DT_DIR) {
+            nobuild__mtime_collect(entries, PATH(dir_path, file));
+        } else {
+            da_append(entries, ((Bulk_Stat) { .path = PATH(dir_path, file) }));
+        }
+    });
+}
+#endif // _WIN32
+
 long long nobuild__get_modification_time(Cstr path) {
+#ifndef _WIN32
+    Nobuild__Mtime_Entries entries = {0};
+    da_append(&entries, ((Bulk_Stat) { .path = path }));
+
+    long long mod_time = -1;
+    size_t begin = 0;
+    // Directories behind symbolic links only turn up once they are stat'ed
+    while (begin < entries.count) {
+        const size_t end = entries.count;
+        bulk_stat(entries.elems + begin, end - begin);
+
+        for (size_t i = begin; i < end; ++i) {
+            Bulk_Stat entry = entries.elems[i];
+            if (entry.error) {
+                PANIC("Could not stat %s: %s\n", entry.path, nobuild__strerror(entry.error));
+            }
+
+            if (entry.is_dir) {
+                nobuild__mtime_collect(&entries, entry.path);
+            } else {
+                mod_time = entry.mtime > mod_time ? entry.mtime : mod_time;
+            }
+        }
+        begin = end;
+    }
+
+    da_free(&entries);
+    return mod_time;
+#else
     if (IS_DIR(path)) {
         long long mod_time = -1;
         FOREACH_FILE_IN_DIR(file, path, {
@@ -374,14 +544,6 @@ long long nobuild__get_modification_time(Cstr path) {
         });
         return mod_time;
     } else {
-#ifndef _WIN32
-        struct stat statbuf = {0};
-
-        if (stat(path, &statbuf) < 0) {
-            PANIC("Could not stat %s: %s\n", path, nobuild__strerror(errno));
-        }
-        return (long long) statbuf.st_mtime;
-#else
         FILETIME path_time;
         Fd path_fd = fd_open_for_read(path);
         if (!GetFileTime(path_fd, NULL, NULL, &path_time)) {
@@ -389,8 +551,8 @@ long long nobuild__get_modification_time(Cstr path) {
         }
         fd_close(path_fd);
         return ((long long) path_time.dwHighDateTime) << 32 | path_time.dwLowDateTime;
-#endif
     }
+#endif
 }
 
 int path_is_newer(Cstr path1, Cstr path2)
@@ -422,7 +584,7 @@ void path_mkdirs(Cstr_Array path)
     size_t seps_count = path.count - 1;
     const size_t sep_len = strlen(PATH_SEP);
 
-    char *result = malloc(len + seps_count * sep_len + 1);
+    char *result = temp_alloc(len + seps_count * sep_len + 1);
 
     len = 0;
     for (size_t i = 0; i < path.count; ++i) {
@@ -464,99 +626,842 @@ void path_rename(Cstr old_path, Cstr new_path)
 #endif // _WIN32
 }
 
-void path_copy(Cstr old_path, Cstr new_path) {
-    if (IS_DIR(old_path)) {
-        path_mkdirs(cstr_array_make(new_path, NULL));
-        FOREACH_FILE_IN_DIR(file, old_path, {
-            if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+#define NOBUILD__COPY_BUFFER_SIZE (1024 * 1024)
+#define NOBUILD__COPY_CHUNK_SIZE (1024 * 1024 * 1024)
+
+// Wall clock seconds, only used for reporting
+static double nobuild__now(void)
+{
+#ifndef _WIN32
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#else
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+// Copies the rest of `in` into `out`. Every method advances the file offsets, so
+// when one is not supported the next one continues from where it stopped.
+static unsigned long long nobuild__copy_fd(Fd in, Fd out, Cstr old_path, Cstr new_path)
+{
+    unsigned long long copied = 0;
+
+#ifdef __linux__
+    // Share the extents on filesystems that support reflinks
+    if (ioctl(out, NOBUILD__FICLONE, in) == 0) {
+        struct stat statbuf = {0};
+        if (NOBUILD__STATS_CALL(STATS_STAT, fstat(in, &statbuf)) < 0) {
+            PANIC("Could not retrieve information about file %s: %s", old_path, nobuild__strerror(errno));
+        }
+        return (unsigned long long) statbuf.st_size;
+    }
+    errno = 0;
+
+#ifdef SYS_copy_file_range
+    for (;;) {
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_copy_file_range, in, NULL, out, NULL, (size_t) NOBUILD__COPY_CHUNK_SIZE, 0u));
+        if (bytes == 0) {
+            return copied;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
                 continue;
             }
+            break;
+        }
+        copied += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // SYS_copy_file_range
 
-            path_copy(PATH(old_path, file), PATH(new_path, file));
-        });
-    } else {
-        Fd f1 = fd_open_for_read(old_path);
-        Fd f2 = fd_open_for_write(new_path);
+    for (;;) {
+        ssize_t bytes = NOBUILD__STATS_CALL(STATS_WRITE, sendfile(out, in, NULL, NOBUILD__COPY_CHUNK_SIZE));
+        if (bytes == 0) {
+            return copied;
+        }
 
-        unsigned char buffer[4096];
-        while (1) {
-#ifndef _WIN32
-            ssize_t bytes = read(f1, buffer, sizeof buffer);
-            if (bytes == -1) {
-                ERRO("Could not copy %s to %s due to read error: %s", old_path, new_path, nobuild__strerror(errno));
-                break;
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            break;
+        }
+        copied += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    unsigned char *buffer = NOBUILD__MALLOC(NOBUILD__COPY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
 
-            if (bytes == 0) {
-                break;
+    for (;;) {
+        ssize_t bytes = NOBUILD__STATS_CALL(STATS_READ, read(in, buffer, NOBUILD__COPY_BUFFER_SIZE));
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            PANIC("Could not copy %s to %s due to read error: %s", old_path, new_path, nobuild__strerror(errno));
+        }
+
+        if (bytes == 0) {
+            break;
+        }
 
-            bytes = write(f2, buffer, (size_t)bytes);
-            if (bytes == -1) {
-                ERRO("Could not copy %s to %s due to write error: %s", old_path, new_path, nobuild__strerror(errno));
-                break;
+        // Writes to regular files can still be cut short, e.g. by a signal or a full disk
+        for (ssize_t written = 0; written < bytes;) {
+            ssize_t n = NOBUILD__STATS_CALL(STATS_WRITE, write(out, buffer + written, (size_t) (bytes - written)));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                PANIC("Could not copy %s to %s due to write error: %s", old_path, new_path, nobuild__strerror(errno));
             }
 
-            if (bytes == 0) {
-                break;
+            if (n == 0) {
+                PANIC("Could not copy %s to %s: no bytes were written", old_path, new_path);
             }
+            written += n;
+        }
+        copied += (unsigned long long) bytes;
+    }
+
+    free(buffer);
+    return copied;
+}
+
+static void nobuild__copy_metadata(Fd fd, Cstr path, const struct stat *statbuf, int flags)
+{
+    if (fchmod(fd, statbuf->st_mode & 07777) < 0) {
+        PANIC("Could not set the permissions of %s: %s", path, nobuild__strerror(errno));
+    }
+
+    if (flags & COPY_TIMESTAMPS) {
+#	ifdef NOBUILD__FUTIMENS
+        const struct timespec times[2] = { NOBUILD__ST_ATIM(statbuf), NOBUILD__ST_MTIM(statbuf) };
+        if (futimens(fd, times) < 0) {
+#	else
+        struct timeval times[2] = {{0}};
+        times[0].tv_sec = statbuf->st_atime;
+        times[1].tv_sec = statbuf->st_mtime;
+        if (futimes(fd, times) < 0) {
+#	endif
+            PANIC("Could not set the timestamps of %s: %s", path, nobuild__strerror(errno));
+        }
+    }
+}
+#endif // _WIN32
+
+static unsigned long long nobuild__copy_file(Cstr old_path, Cstr new_path, int flags)
+{
+    double start = log_enabled(LOG_TRACE) ? nobuild__now() : 0.0;
+
+#ifndef _WIN32
+    Fd in = fd_open_for_read(old_path);
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(in, &statbuf)) < 0) {
+        PANIC("Could not retrieve information about file %s: %s", old_path, nobuild__strerror(errno));
+    }
+
+    Atomic_File out = atomic_file_open(new_path);
+    unsigned long long copied = nobuild__copy_fd(in, out.fd, old_path, new_path);
+    nobuild__copy_metadata(out.fd, new_path, &statbuf, flags);
+    fd_close(in);
+    atomic_file_commit(&out);
 #else
-            DWORD bytes;
-            if (!ReadFile(f1, buffer, sizeof buffer, &bytes, NULL)) {
-                ERRO("Could not copy %s to %s due to read error: %s", old_path, new_path, nobuild__GetLastErrorAsString());
-                break;
+    // `CopyFile` already keeps the attributes and the modification time
+    (void) flags;
+    Atomic_File out = atomic_file_open(new_path);
+    fd_close(out.fd);
+    if (!CopyFile(old_path, out.tmp_path, FALSE)) {
+        PANIC("Could not copy %s to %s: %s", old_path, new_path, nobuild__GetLastErrorAsString());
+    }
+    nobuild__atomic_file_rename(&out);
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    unsigned long long copied = 0;
+    if (NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesEx(new_path, GetFileExInfoStandard, &data))) {
+        copied = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    }
+#endif // _WIN32
+
+    if (log_enabled(LOG_TRACE)) {
+        double secs = nobuild__now() - start;
+        TRACE("Copied %llu bytes from %s to %s in %.3fs (%.1f MiB/s)", copied, old_path, new_path,
+              secs, secs > 0 ? (double) copied / (1024.0 * 1024.0) / secs : 0.0);
+    }
 
+    NOBUILD__STATS_COPIED(copied);
+    return copied;
+}
+
+#ifndef _WIN32
+// Number of files a worker takes from the queue at once
+#define NOBUILD__COPY_BATCH 16
+
+typedef struct {
+    Cstr path;
+    struct stat statbuf;
+} Nobuild__Copy_Dir;
+
+typedef struct {
+    Fd src_root;
+    Fd dst_root;
+    Cstr old_path;
+    Cstr new_path;
+    int flags;
+    // Names the temporary files of the copies
+    unsigned long pid;
+
+    // Paths relative to both roots
+    Cstr_Array files;
+    Nobuild__Copy_Dir *dirs;
+    size_t dirs_count;
+    size_t dirs_capacity;
+
+    Mutex mutex;
+    size_t next;
+    unsigned long long bytes;
+} Nobuild__Copy_Tree;
+
+static void nobuild__copy_tree_dir(Nobuild__Copy_Tree *tree, Cstr path, Fd fd)
+{
+    if (tree->dirs_count >= tree->dirs_capacity) {
+        tree->dirs_capacity = tree->dirs_capacity ? tree->dirs_capacity * 2 : 64;
+        tree->dirs = NOBUILD__REALLOC(tree->dirs, sizeof(*tree->dirs) * tree->dirs_capacity);
+        if (tree->dirs == NULL) {
+            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        }
+    }
+
+    Nobuild__Copy_Dir *dir = &tree->dirs[tree->dirs_count++];
+    dir->path = path;
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &dir->statbuf)) < 0) {
+        PANIC("Could not retrieve information about directory %s: %s",
+              PATH(tree->old_path, path), nobuild__strerror(errno));
+    }
+}
+
+static void nobuild__copy_tree_link(Nobuild__Copy_Tree *tree, Fd src_dir, Fd dst_dir, Cstr name, Cstr path)
+{
+    size_t size = 256;
+    char *target = NULL;
+    for (;;) {
+        target = NOBUILD__REALLOC(target, size);
+        if (target == NULL) {
+            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        }
+
+        ssize_t len = readlinkat(src_dir, name, target, size);
+        if (len < 0) {
+            PANIC("Could not read symbolic link %s: %s", PATH(tree->old_path, path), nobuild__strerror(errno));
+        }
+
+        if ((size_t) len < size) {
+            target[len] = '\0';
+            break;
+        }
+        size *= 2;
+    }
+
+    if (symlinkat(target, dst_dir, name) < 0) {
+        if (errno != EEXIST || unlinkat(dst_dir, name, 0) < 0 || symlinkat(target, dst_dir, name) < 0) {
+            PANIC("Could not create symbolic link %s: %s", path, nobuild__strerror(errno));
+        }
+    }
+    errno = 0;
+    free(target);
+}
+
+// Creates the directories and links up front and queues the regular files. Takes
+// ownership of both directory fds.
+static void nobuild__copy_tree_walk(Nobuild__Copy_Tree *tree, Fd src_dir, Fd dst_dir, Cstr prefix, Copy_Stats *stats)
+{
+    DIR *dir = fdopendir(src_dir);
+    if (dir == NULL) {
+        PANIC("Could not open directory %s: %s", PATH(tree->old_path, prefix), nobuild__strerror(errno));
+    }
+
+    struct dirent *dp = NULL;
+    errno = 0;
+    while ((dp = readdir(dir))) {
+        Cstr name = dp->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        Cstr path = strcmp(prefix, ".") == 0 ? CONCAT(name) : JOIN("/", prefix, name);
+        int type = NOBUILD__D_TYPE(dp);
+        if (type == DT_UNKNOWN) {
+            struct stat statbuf = {0};
+            if (NOBUILD__STATS_CALL(STATS_STAT, fstatat(src_dir, name, &statbuf, AT_SYMLINK_NOFOLLOW)) < 0) {
+                PANIC("Could not retrieve information about file %s: %s",
+                      PATH(tree->old_path, path), nobuild__strerror(errno));
             }
 
-            if (bytes == 0) {
-                break;
+            type = S_ISDIR(statbuf.st_mode) ? DT_DIR
+                 : S_ISREG(statbuf.st_mode) ? DT_REG
+                 : S_ISLNK(statbuf.st_mode) ? DT_LNK
+                 : -1;
+        }
+
+        if (type == DT_DIR) {
+            // Owner access is required to fill the directory, the real mode is set once it is full
+            if (mkdirat(dst_dir, name, 0700) < 0 && errno != EEXIST) {
+                PANIC("Could not create directory %s: %s", path, nobuild__strerror(errno));
             }
 
-            if (!WriteFile(f2, buffer, bytes, &bytes, NULL)) {
-                ERRO("Could not copy %s to %s due to write error: %s", old_path, new_path, nobuild__GetLastErrorAsString());
-                break;
+            Fd src_child = NOBUILD__STATS_CALL(STATS_OPEN, openat(src_dir, name, O_RDONLY));
+            Fd dst_child = src_child < 0 ? -1 : NOBUILD__STATS_CALL(STATS_OPEN, openat(dst_dir, name, O_RDONLY));
+            if (src_child < 0 || dst_child < 0) {
+                PANIC("Could not open directory %s: %s", path, nobuild__strerror(errno));
             }
 
-            if (bytes == 0) {
-                break;
+            nobuild__copy_tree_dir(tree, path, src_child);
+            stats->dirs += 1;
+            nobuild__copy_tree_walk(tree, src_child, dst_child, path, stats);
+        } else if (type == DT_REG) {
+            tree->files = cstr_array_append(tree->files, path);
+            stats->files += 1;
+        } else if (type == DT_LNK) {
+            nobuild__copy_tree_link(tree, src_dir, dst_dir, name, path);
+            stats->symlinks += 1;
+        } else {
+            WARN("Skipping %s: not a regular file, directory or symbolic link", PATH(tree->old_path, path));
+            stats->skipped += 1;
+        }
+        errno = 0;
+    }
+
+    if (errno > 0) {
+        PANIC("Could not read directory %s: %s", PATH(tree->old_path, prefix), nobuild__strerror(errno));
+    }
+
+    closedir(dir);
+    close(dst_dir);
+}
+
+static void nobuild__copy_tree_worker(void *data)
+{
+    Nobuild__Copy_Tree *tree = data;
+    unsigned long long bytes = 0;
+
+    for (;;) {
+        mutex_lock(&tree->mutex);
+        size_t begin = tree->next;
+        size_t end = begin + NOBUILD__COPY_BATCH < tree->files.count ? begin + NOBUILD__COPY_BATCH : tree->files.count;
+        tree->next = end;
+        mutex_unlock(&tree->mutex);
+
+        if (begin >= end) {
+            break;
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            Cstr path = tree->files.elems[i];
+            Fd in = NOBUILD__STATS_CALL(STATS_OPEN, openat(tree->src_root, path, O_RDONLY));
+            if (in < 0) {
+                PANIC("Could not open file %s: %s", PATH(tree->old_path, path), nobuild__strerror(errno));
+            }
+
+            struct stat statbuf = {0};
+            if (NOBUILD__STATS_CALL(STATS_STAT, fstat(in, &statbuf)) < 0) {
+                PANIC("Could not retrieve information about file %s: %s",
+                      PATH(tree->old_path, path), nobuild__strerror(errno));
+            }
+
+            // Like `atomic_file_open()`, but relative to the destination directory
+            char tmp_path[4096];
+            if ((size_t) snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%lu", path, tree->pid) >= sizeof(tmp_path)) {
+                PANIC("Path is too long: %s", path);
+            }
+            // Removed at exit when the copy panics before the rename
+            Cstr pending = PATH(tree->new_path, tmp_path);
+            nobuild__atomic_pending_add(pending);
+
+            Fd out = NOBUILD__STATS_CALL(STATS_OPEN, openat(tree->dst_root, tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600));
+            if (out < 0) {
+                PANIC("Could not open file %s: %s", tmp_path, nobuild__strerror(errno));
+            }
+
+            bytes += nobuild__copy_fd(in, out, path, path);
+            nobuild__copy_metadata(out, path, &statbuf, tree->flags);
+            close(in);
+            close(out);
+
+            if (renameat(tree->dst_root, tmp_path, tree->dst_root, path) < 0) {
+                PANIC("Could not rename %s to %s: %s", tmp_path, path, nobuild__strerror(errno));
+            }
+            nobuild__atomic_pending_remove(pending);
+            if (nobuild__atomic_sync_enabled()) {
+                nobuild__atomic_sync_push(PATH(tree->new_path, path));
             }
-#endif
         }
+    }
 
-        fd_close(f1);
-        fd_close(f2);
+    mutex_lock(&tree->mutex);
+    tree->bytes += bytes;
+    mutex_unlock(&tree->mutex);
+    NOBUILD__STATS_COPIED(bytes);
+}
+
+static void nobuild__copy_tree(Cstr old_path, Cstr new_path, int flags, Copy_Stats *stats)
+{
+    if (nobuild__mkdir(new_path, 0700) < 0 && errno != EEXIST) {
+        PANIC("Could not create directory %s: %s", new_path, nobuild__strerror(errno));
+    }
+    errno = 0;
+
+    Nobuild__Copy_Tree tree = {0};
+    tree.old_path = old_path;
+    tree.new_path = new_path;
+    tree.flags = flags;
+    tree.pid = (unsigned long) getpid();
+    tree.src_root = NOBUILD__STATS_CALL(STATS_OPEN, open(old_path, O_RDONLY));
+    tree.dst_root = NOBUILD__STATS_CALL(STATS_OPEN, open(new_path, O_RDONLY));
+    if (tree.src_root < 0 || tree.dst_root < 0) {
+        PANIC("Could not open directory %s: %s", tree.src_root < 0 ? old_path : new_path, nobuild__strerror(errno));
+    }
+
+    nobuild__copy_tree_dir(&tree, ".", tree.src_root);
+    stats->dirs += 1;
+    nobuild__copy_tree_walk(&tree, dup(tree.src_root), dup(tree.dst_root), ".", stats);
+
+    size_t batches = (tree.files.count + NOBUILD__COPY_BATCH - 1) / NOBUILD__COPY_BATCH;
+    size_t workers = thread_count() < batches ? thread_count() : batches;
+    Thread *threads = NOBUILD__MALLOC(sizeof(*threads) * (workers ? workers : 1));
+    if (threads == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    mutex_init(&tree.mutex);
+    for (size_t i = 0; i < workers; ++i) {
+        threads[i] = thread_create(nobuild__copy_tree_worker, &tree);
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        thread_join(threads[i]);
     }
+    mutex_destroy(&tree.mutex);
+    stats->bytes += tree.bytes;
+
+    // Children before parents, so read-only directories are locked only once they are full
+    for (size_t i = tree.dirs_count; i-- > 0;) {
+        Nobuild__Copy_Dir *dir = &tree.dirs[i];
+        Fd fd = NOBUILD__STATS_CALL(STATS_OPEN, openat(tree.dst_root, dir->path, O_RDONLY));
+        if (fd < 0) {
+            PANIC("Could not open directory %s: %s", PATH(new_path, dir->path), nobuild__strerror(errno));
+        }
+        nobuild__copy_metadata(fd, dir->path, &dir->statbuf, flags);
+        close(fd);
+    }
+
+    close(tree.src_root);
+    close(tree.dst_root);
+    free(threads);
+    free(tree.dirs);
 }
+#else
+static void nobuild__copy_tree(Cstr old_path, Cstr new_path, int flags, Copy_Stats *stats)
+{
+    if (nobuild__mkdir(new_path, 0755) < 0 && errno != EEXIST) {
+        PANIC("Could not create directory %s: %s", new_path, nobuild__strerror(errno));
+    }
+    errno = 0;
+    stats->dirs += 1;
 
-void path_rm(Cstr path)
+    FOREACH_FILE_IN_DIR(file, old_path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        Cstr old_child = PATH(old_path, file);
+        Cstr new_child = PATH(new_path, file);
+        if (IS_DIR(old_child)) {
+            nobuild__copy_tree(old_child, new_child, flags, stats);
+        } else {
+            stats->bytes += nobuild__copy_file(old_child, new_child, flags);
+            stats->files += 1;
+        }
+    });
+}
+#endif // _WIN32
+
+void path_copy(Cstr old_path, Cstr new_path)
 {
-    if (IS_DIR(path)) {
-        FOREACH_FILE_IN_DIR(file, path, {
-            if (strcmp(file, ".") != 0 && strcmp(file, "..") != 0)
-            {
-                path_rm(PATH(path, file));
+    path_copy_ex(old_path, new_path, COPY_DEFAULT);
+}
+
+Copy_Stats path_copy_ex(Cstr old_path, Cstr new_path, int flags)
+{
+    Copy_Stats stats = {0};
+    double start = nobuild__now();
+
+    if (!IS_DIR(old_path)) {
+        stats.bytes = nobuild__copy_file(old_path, new_path, flags);
+        stats.files = 1;
+        stats.seconds = nobuild__now() - start;
+        return stats;
+    }
+
+    nobuild__copy_tree(old_path, new_path, flags, &stats);
+    stats.seconds = nobuild__now() - start;
+    TRACE("Copied %zu files, %zu directories and %zu symbolic links (%llu bytes) from %s to %s in %.3fs (%.1f MiB/s)",
+          stats.files, stats.dirs, stats.symlinks, stats.bytes, old_path, new_path, stats.seconds,
+          stats.seconds > 0 ? (double) stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0.0);
+
+    return stats;
+}
+
+static void nobuild__rm_missing(Cstr path, int is_dir)
+{
+    if (errno != ENOENT) {
+        PANIC("Could not remove %s %s: %s", is_dir ? "directory" : "file", path, nobuild__strerror(errno));
+    }
+
+    errno = 0;
+    WARN("%s %s does not exist", is_dir ? "Directory" : "File", path);
+}
+
+// Numbers the trash names of `RM_BACKGROUND`, which only the pid would not keep apart
+static unsigned long nobuild__rm_trash_count = 0;
+static Nobuild__Lock nobuild__rm_trash_lock = NOBUILD__LOCK_INIT;
+
+#ifndef _WIN32
+// The frontier is grown until it has this many directories per worker
+#define NOBUILD__RM_SPLIT 4
+#define NOBUILD__RM_SPLIT_DEPTH 3
+
+typedef struct {
+    Cstr_Array dirs;
+    size_t next;
+    Mutex mutex;
+} Nobuild__Rm_Tree;
+
+static int nobuild__rm_type(Fd dir_fd, struct dirent *dp, Cstr path)
+{
+    int type = NOBUILD__D_TYPE(dp);
+    if (type != DT_UNKNOWN) {
+        return type;
+    }
+
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstatat(dir_fd, dp->d_name, &statbuf, AT_SYMLINK_NOFOLLOW)) < 0) {
+        PANIC("Could not retrieve information about file %s: %s", PATH(path, dp->d_name), nobuild__strerror(errno));
+    }
+    return S_ISDIR(statbuf.st_mode) ? DT_DIR : DT_REG;
+}
+
+// Empties the directory `fd` opened at `path` and closes it. Subdirectories are
+// either removed in place or, when `subdirs` is given, only collected into it.
+static void nobuild__rm_contents(Fd fd, Cstr path, Cstr_Array *subdirs)
+{
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        PANIC("Could not open directory %s: %s", path, nobuild__strerror(errno));
+    }
+
+    struct dirent *dp = NULL;
+    errno = 0;
+    while ((dp = readdir(dir))) {
+        Cstr name = dp->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        if (nobuild__rm_type(fd, dp, path) != DT_DIR) {
+            if (unlinkat(fd, name, 0) < 0 && errno != ENOENT) {
+                PANIC("Could not remove file %s: %s", PATH(path, name), nobuild__strerror(errno));
+            }
+        } else if (subdirs != NULL) {
+            *subdirs = cstr_array_append(*subdirs, PATH(path, name));
+        } else {
+            Cstr child_path = PATH(path, name);
+            Fd child = NOBUILD__STATS_CALL(STATS_OPEN, openat(fd, name, O_RDONLY));
+            if (child < 0) {
+                PANIC("Could not open directory %s: %s", child_path, nobuild__strerror(errno));
             }
-        });
 
-        if (nobuild__rmdir(path) < 0) {
-            if (errno == ENOENT) {
-                errno = 0;
-                WARN("Directory %s does not exist", path);
-            } else {
-                PANIC("Could not remove directory %s: %s", path, nobuild__strerror(errno));
+            nobuild__rm_contents(child, child_path, NULL);
+            if (unlinkat(fd, name, AT_REMOVEDIR) < 0 && errno != ENOENT) {
+                PANIC("Could not remove directory %s: %s", child_path, nobuild__strerror(errno));
             }
         }
-    } else {
-        if (nobuild__unlink(path) < 0) {
-            if (errno == ENOENT) {
-                errno = 0;
-                WARN("File %s does not exist", path);
-            } else {
-                PANIC("Could not remove file %s: %s", path, nobuild__strerror(errno));
+        errno = 0;
+    }
+
+    if (errno > 0) {
+        PANIC("Could not read directory %s: %s", path, nobuild__strerror(errno));
+    }
+    closedir(dir);
+}
+
+static void nobuild__rm_worker(void *data)
+{
+    Nobuild__Rm_Tree *tree = data;
+    for (;;) {
+        mutex_lock(&tree->mutex);
+        size_t i = tree->next++;
+        mutex_unlock(&tree->mutex);
+
+        if (i >= tree->dirs.count) {
+            break;
+        }
+
+        Cstr path = tree->dirs.elems[i];
+        Fd fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+        if (fd < 0) {
+            PANIC("Could not open directory %s: %s", path, nobuild__strerror(errno));
+        }
+
+        nobuild__rm_contents(fd, path, NULL);
+        if (nobuild__rmdir(path) < 0 && errno != ENOENT) {
+            PANIC("Could not remove directory %s: %s", path, nobuild__strerror(errno));
+        }
+    }
+}
+
+static void nobuild__rm_tree(Cstr path)
+{
+    const size_t workers = thread_count();
+
+    // Split the top of the tree into enough directories to keep the workers busy,
+    // deleting the files found on the way. The split directories are removed last.
+    Cstr_Array split = {0};
+    Cstr_Array frontier = cstr_array_make(path, NULL);
+    for (size_t depth = 0; depth < NOBUILD__RM_SPLIT_DEPTH && frontier.count > 0
+         && frontier.count < workers * NOBUILD__RM_SPLIT; ++depth) {
+        Cstr_Array next = {0};
+        for (size_t i = 0; i < frontier.count; ++i) {
+            Fd fd = NOBUILD__STATS_CALL(STATS_OPEN, open(frontier.elems[i], O_RDONLY));
+            if (fd < 0) {
+                PANIC("Could not open directory %s: %s", frontier.elems[i], nobuild__strerror(errno));
             }
+
+            nobuild__rm_contents(fd, frontier.elems[i], &next);
+            split = cstr_array_append(split, frontier.elems[i]);
+        }
+
+        frontier = next;
+    }
+
+    Nobuild__Rm_Tree tree = {0};
+    tree.dirs = frontier;
+    size_t count = workers < frontier.count ? workers : frontier.count;
+    Thread *threads = NOBUILD__MALLOC(sizeof(*threads) * (count ? count : 1));
+    if (threads == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    mutex_init(&tree.mutex);
+    for (size_t i = 0; i < count; ++i) {
+        threads[i] = thread_create(nobuild__rm_worker, &tree);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        thread_join(threads[i]);
+    }
+    mutex_destroy(&tree.mutex);
+
+    for (size_t i = split.count; i-- > 0;) {
+        if (nobuild__rmdir(split.elems[i]) < 0 && errno != ENOENT) {
+            PANIC("Could not remove directory %s: %s", split.elems[i], nobuild__strerror(errno));
         }
     }
+    errno = 0;
+
+    free(threads);
 }
 
+// Points the standard streams at /dev/null and closes every other descriptor, so
+// that the background deleter does not keep the pipes of its parent open and
+// `./nobuild | cat` returns without waiting for the delete
+static void nobuild__rm_detach_fds(void)
+{
+    Fd null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO) {
+            close(null_fd);
+        }
+    }
+
+#	ifdef __linux__
+    Fd fds_fd = open("/proc/self/fd", O_RDONLY);
+    DIR *fds = fds_fd >= 0 ? fdopendir(fds_fd) : NULL;
+    if (fds != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(fds)) != NULL) {
+            int fd = atoi(entry->d_name);
+            if (fd > STDERR_FILENO && fd != fds_fd) {
+                close(fd);
+            }
+        }
+        closedir(fds);
+        return;
+    }
+#	endif
+
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    for (long fd = STDERR_FILENO + 1; fd < max_fd; ++fd) {
+        close((int) fd);
+    }
+}
+
+static void nobuild__rm_background(Cstr path)
+{
+    // Stay on the same filesystem so the rename cannot fail with EXDEV. A name left
+    // behind by an earlier process with the same pid is skipped.
+    Cstr trash = NULL;
+    struct stat statbuf = {0};
+    for (;;) {
+        NOBUILD__LOCK(&nobuild__rm_trash_lock);
+        unsigned long count = nobuild__rm_trash_count++;
+        NOBUILD__UNLOCK(&nobuild__rm_trash_lock);
+
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".trash.%ld.%lu", (long) getpid(), count);
+        trash = PATH(DIRNAME(path), CONCAT(".", BASENAME(path), suffix));
+        if (NOBUILD__STATS_CALL(STATS_STAT, lstat(trash, &statbuf)) == 0) {
+            continue;
+        }
+        if (rename(path, trash) == 0) {
+            break;
+        }
+        if (errno == ENOTEMPTY || errno == EEXIST) {
+            continue;
+        }
+        if (errno == ENOENT) {
+            nobuild__rm_missing(path, 0);
+            return;
+        }
+        PANIC("Could not rename %s to %s: %s", path, trash, nobuild__strerror(errno));
+    }
+
+    // Fork twice so the process deleting the trash is adopted by init and never
+    // has to be waited for
+    Pid child = NOBUILD__STATS_CALL(STATS_FORK, fork());
+    if (child < 0) {
+        WARN("Could not fork a background process to delete %s: %s", trash, nobuild__strerror(errno));
+        errno = 0;
+        path_rm_ex(trash, RM_DEFAULT);
+        return;
+    }
+
+    if (child == 0) {
+        if (NOBUILD__STATS_CALL(STATS_FORK, fork()) == 0) {
+            setsid();
+            nobuild__rm_detach_fds();
+            log_set_level(LOG_ERRO);
+            path_rm_ex(trash, RM_DEFAULT);
+        }
+        _exit(0);
+    }
+
+    pid_wait(child);
+}
+#else
+static void nobuild__rm_tree(Cstr path)
+{
+    FOREACH_FILE_IN_DIR(file, path, {
+        if (strcmp(file, ".") == 0 || strcmp(file, "..") == 0) {
+            continue;
+        }
+
+        Cstr child = PATH(path, file);
+        if (IS_DIR(child)) {
+            nobuild__rm_tree(child);
+        } else if (nobuild__unlink(child) < 0) {
+            nobuild__rm_missing(child, 0);
+        }
+    });
+
+    if (nobuild__rmdir(path) < 0) {
+        nobuild__rm_missing(path, 1);
+    }
+}
+
+static void nobuild__rm_background(Cstr path)
+{
+    // Without MOVEFILE_REPLACE_EXISTING the move fails on a name that is taken, and
+    // the next one is tried
+    Cstr trash = NULL;
+    for (;;) {
+        NOBUILD__LOCK(&nobuild__rm_trash_lock);
+        unsigned long count = nobuild__rm_trash_count++;
+        NOBUILD__UNLOCK(&nobuild__rm_trash_lock);
+
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".trash.%lu.%lu", (unsigned long) GetCurrentProcessId(), count);
+        trash = PATH(DIRNAME(path), CONCAT(".", BASENAME(path), suffix));
+        if (MoveFileEx(path, trash, 0)) {
+            break;
+        }
+        if (GetLastError() != ERROR_ALREADY_EXISTS) {
+            PANIC("Could not rename %s to %s: %s", path, trash, nobuild__GetLastErrorAsString());
+        }
+    }
+
+    Cstr command = IS_DIR(trash) ? CONCAT("cmd /c rmdir /s /q \"", trash, "\"")
+                                 : CONCAT("cmd /c del /f /q \"", trash, "\"");
+
+    STARTUPINFO siStartInfo;
+    ZeroMemory(&siStartInfo, sizeof(siStartInfo));
+    siStartInfo.cb = sizeof(STARTUPINFO);
+    PROCESS_INFORMATION piProcInfo;
+    ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
+
+    if (!NOBUILD__STATS_CALL(STATS_FORK, CreateProcess(NULL, (LPSTR) command, NULL, NULL, FALSE, DETACHED_PROCESS | CREATE_NO_WINDOW,
+                                                       NULL, NULL, &siStartInfo, &piProcInfo))) {
+        WARN("Could not start a background process to delete %s: %s", trash, nobuild__GetLastErrorAsString());
+        path_rm_ex(trash, RM_DEFAULT);
+        return;
+    }
+
+    CloseHandle(piProcInfo.hThread);
+    CloseHandle(piProcInfo.hProcess);
+}
+#endif // _WIN32
+
+void path_rm(Cstr path)
+{
+    path_rm_ex(path, RM_DEFAULT);
+}
+
+void path_rm_ex(Cstr path, int flags)
+{
+    if (flags & RM_BACKGROUND) {
+        nobuild__rm_background(path);
+        return;
+    }
+
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, lstat(path, &statbuf)) < 0) {
+        nobuild__rm_missing(path, 0);
+        return;
+    }
+    int is_dir = S_ISDIR(statbuf.st_mode);
+#else
+    int is_dir = IS_DIR(path);
+#endif // _WIN32
+
+    if (is_dir) {
+        nobuild__rm_tree(path);
+    } else if (nobuild__unlink(path) < 0) {
+        nobuild__rm_missing(path, 0);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_PATH_I_
 #endif // NOBUILD_PATH_IMPLEMENTATION
@@ -0,0 +1,395 @@
+#ifndef NOBUILD_STATS_H_
+#define NOBUILD_STATS_H_
+
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+#ifdef NOBUILD_STATS_IMPLEMENTATION
+#	if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE)
+#		define _POSIX_C_SOURCE 200809L
+#	endif
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+#endif // NOBUILD_STATS_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_STATS_IMPLEMENTATION
+#ifndef NOBUILD_STATS_I_
+#define NOBUILD_STATS_I_
+
+#ifdef NOBUILD_STATS
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+#define NOBUILD_LOG_IMPLEMENTATION
+#include "nobuild_log.h"
+
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
+#else
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#endif
+
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
+
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
+
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
+
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
+
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
+}
+
+static void nobuild__stats_report(void)
+{
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
+    }
+#endif // _WIN32
+
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
+    }
+}
+
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
+{
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
+    }
+
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
+}
+
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
+
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
+
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
+}
+
+void nobuild__stats_temp(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
+
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
+}
+
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
+}
+
+void nobuild__stats_copied(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
+
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
+}
+
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
+    }
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
+    }
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
+    }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
+}
+
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
+{
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
+
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
+    }
+
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
+    }
+
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
+}
+
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+}
+
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+#endif // NOBUILD_STATS
+
+#endif // NOBUILD_STATS_I_
+#endif // NOBUILD_STATS_IMPLEMENTATION
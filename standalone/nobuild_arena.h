@@ -0,0 +1,997 @@
+#ifndef NOBUILD_ARENA_H_
+#define NOBUILD_ARENA_H_
+
+#include <stddef.h>
+#include <string.h>
+
+
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Region based allocation. An arena hands out memory from a list of large regions
+// and takes all of it back at once, so a lot of small allocations that die together
+// cost a pointer bump each and a single rewind in the end.
+
+typedef struct Arena_Region Arena_Region;
+
+typedef struct {
+    Arena_Region *begin;
+    // The region allocations are served from. The ones after it are empty.
+    Arena_Region *end;
+} Arena;
+
+// A position in an arena to rewind to
+typedef struct {
+    Arena_Region *region;
+    size_t count;
+} Arena_Mark;
+
+// Never returns NULL, panics when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// Resizes `old`, which was allocated with `old_size` bytes. It is resized in place
+// when it is the last allocation of the arena, and copied otherwise.
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *cstr);
+
+Arena_Mark arena_mark(Arena *arena);
+// Releases everything allocated since `mark` was taken. The regions are kept around
+// for the allocations that follow.
+void arena_rewind(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+// Gives the regions back to the system
+void arena_free(Arena *arena);
+// Number of bytes currently allocated from `arena`
+size_t arena_used(const Arena *arena);
+
+// Every string, array and chain that nobuild returns is allocated from the temporary
+// arena and is never freed on its own. Code that creates garbage on every iteration
+// of a loop can release it in O(1) by resetting to a mark taken at the start:
+//
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         Arena_Mark mark = temp_mark();
+//         if (ENDS_WITH(file, ".c")) {
+//             CMD("cc", "-c", PATH("src", file), "-o", CONCAT(NOEXT(file), ".o"));
+//         }
+//         temp_reset(mark);
+//     });
+//
+// Everything returned since the mark is gone after the reset, including the storage
+// of arrays that were grown in between. The arena is shared by all threads and none
+// of them may be using it while it is reset.
+void *temp_alloc(size_t size);
+void *temp_realloc(void *old, size_t old_size, size_t new_size);
+char *temp_strdup(const char *cstr);
+Arena_Mark temp_mark(void);
+void temp_reset(Arena_Mark mark);
+size_t temp_used(void);
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size);
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size);
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr);
+// Counts the allocation for the module that makes it
+#	define temp_alloc(size) nobuild__stats_temp_alloc(NOBUILD__STATS_MODULE, (size))
+#	define temp_realloc(old, old_size, new_size) \
+    nobuild__stats_temp_realloc(NOBUILD__STATS_MODULE, (old), (old_size), (new_size))
+#	define temp_strdup(cstr) nobuild__stats_temp_strdup(NOBUILD__STATS_MODULE, (cstr))
+#endif // NOBUILD_STATS
+
+// Dynamic arrays, for any struct with an `elems` pointer and `count` and `capacity`
+// fields. Their storage comes from the temporary arena and doubles when it is full,
+// so appending costs O(1) amortized, and a single allocation when nothing else was
+// allocated since the last append.
+//
+//     typedef struct {
+//         Cmd *elems;
+//         size_t count;
+//         size_t capacity;
+//     } Cmd_Array;
+//
+//     Cmd_Array cmds = {0};
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", file) }));
+//     });
+//     FOREACH_ARRAY(Cmd, cmd, cmds, cmd_run_sync(*cmd));
+//
+// Arrays with a `capacity` below their `count` wrap storage that nobuild did not
+// allocate, like `argv`, which is copied on the first append. The macros evaluate
+// `da` more than once.
+
+// Makes room for `n` elements in total
+#define da_reserve(da, n)                                                                  \
+    ((da)->elems = nobuild__da_reserve((da)->elems, sizeof(*(da)->elems), (da)->count,     \
+                                       &(da)->capacity, (n)))
+
+#define da_append(da, elem)                                                                \
+    ((da)->count >= (da)->capacity                                                         \
+         ? (void) ((da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems),       \
+                                                  (da)->count, &(da)->capacity,            \
+                                                  (da)->count + 1))                        \
+         : (void) 0,                                                                       \
+     (void) ((da)->elems[(da)->count++] = (elem)))
+
+// Appends the `n` elements that `new_elems` points to
+#define da_append_many(da, new_elems, n)                                                   \
+    do {                                                                                   \
+        const size_t nobuild__da_n = (n);                                                  \
+        /* Only compiles when the elements have the same type */                           \
+        (void) sizeof(*(da)->elems = *(new_elems));                                        \
+        if (nobuild__da_n > 0) {                                                           \
+            (da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems), (da)->count, \
+                                           &(da)->capacity, (da)->count + nobuild__da_n);  \
+            memcpy((da)->elems + (da)->count, (new_elems),                                 \
+                   sizeof(*(da)->elems) * nobuild__da_n);                                  \
+            (da)->count += nobuild__da_n;                                                  \
+        }                                                                                  \
+    } while (0)
+
+// Removes the last element and returns it. The array must not be empty.
+#define da_pop(da) ((da)->elems[--(da)->count])
+
+// Leaves the array empty. The storage only goes back to the arena when it is the last
+// allocation, the rest waits for the next `temp_reset()`.
+#define da_free(da)                                                                        \
+    do {                                                                                   \
+        nobuild__da_free((da)->elems, sizeof(*(da)->elems), (da)->count, (da)->capacity);  \
+        (da)->elems = NULL;                                                                \
+        (da)->count = 0;                                                                   \
+        (da)->capacity = 0;                                                                \
+    } while (0)
+
+// Visits the elements of an array in order
+#define FOREACH_ARRAY(type, elem, array, body)                                             \
+    for (size_t elem_##index = 0; elem_##index < (array).count; ++elem_##index) {         \
+        type *elem = &(array).elems[elem_##index];                                         \
+        body;                                                                              \
+    }
+
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity);
+
+#endif // NOBUILD_ARENA_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_ARENA_IMPLEMENTATION
+#ifndef NOBUILD_ARENA_I_
+#define NOBUILD_ARENA_I_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
+#ifndef NOBUILD__DEPRECATED
+#	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
+#		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
+#	elif defined(_MSC_VER)
+#		define NOBUILD__DEPRECATED(func) __declspec (deprecated) func
+#	endif
+#endif
+
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
+NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
+
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void warn(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define WARN(fmt, ...) warn("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void erro(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define ERRO(fmt, ...) erro("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void panic(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define PANIC(fmt, ...) panic("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void todo(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TODO(fmt, ...) todo("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TODO_SAFE(fmt, ...) todo_safe("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
+void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
+{
+    fprintf(stream, "[%s] ", tag);
+    vfprintf(stream, fmt, args);
+    fprintf(stream, "\n");
+}
+
+void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
+{
+    WARN("This function is deprecated.");
+    nobuild__vlog(stream, tag, fmt, args);
+}
+
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
+void info(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "INFO", fmt, args);
+    va_end(args);
+}
+
+void warn(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "WARN", fmt, args);
+    va_end(args);
+}
+
+void erro(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "ERRO", fmt, args);
+    va_end(args);
+}
+
+void panic(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "ERRO", fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+void todo(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TODO", fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+void todo_safe(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TODO", fmt, args);
+    va_end(args);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef NOBUILD_STATS
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
+#else
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#endif
+
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
+
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
+
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
+
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
+
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
+}
+
+static void nobuild__stats_report(void)
+{
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
+    }
+#endif // _WIN32
+
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
+    }
+}
+
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
+{
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
+    }
+
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
+}
+
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
+
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
+
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
+}
+
+void nobuild__stats_temp(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
+
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
+}
+
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
+}
+
+void nobuild__stats_copied(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
+
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
+}
+
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
+    }
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
+    }
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
+    }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
+}
+
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
+{
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
+
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
+    }
+
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
+    }
+
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
+}
+
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+}
+
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+#endif // NOBUILD_STATS
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_ARENA
+
+#if defined(NOBUILD_NO_THREADS)
+#elif !defined(_WIN32)
+#	include <pthread.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+// Words of a region that is not made larger by a single big allocation
+#ifndef NOBUILD_ARENA_REGION_WORDS
+#	define NOBUILD_ARENA_REGION_WORDS (8 * 1024)
+#endif
+
+// Allocations are made in whole words, which keeps all of them suitably aligned
+typedef union {
+    void *pointer;
+    long long integer;
+    double real;
+} Nobuild__Arena_Word;
+
+struct Arena_Region {
+    Arena_Region *next;
+    size_t count;
+    size_t capacity;
+    Nobuild__Arena_Word data[];
+};
+
+static size_t nobuild__arena_words(size_t size)
+{
+    return (size + sizeof(Nobuild__Arena_Word) - 1) / sizeof(Nobuild__Arena_Word);
+}
+
+static Arena_Region *nobuild__arena_region_new(size_t words)
+{
+    size_t capacity = words > NOBUILD_ARENA_REGION_WORDS ? words : NOBUILD_ARENA_REGION_WORDS;
+    Arena_Region *region = NOBUILD__MALLOC(sizeof(*region) + sizeof(Nobuild__Arena_Word) * capacity);
+    if (region == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    region->next = NULL;
+    region->count = 0;
+    region->capacity = capacity;
+    return region;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t words = nobuild__arena_words(size);
+    if (arena->end == NULL) {
+        arena->begin = arena->end = nobuild__arena_region_new(words);
+    }
+
+    // Regions emptied by a rewind are reused before new ones are made
+    while (arena->end->count + words > arena->end->capacity && arena->end->next != NULL) {
+        arena->end = arena->end->next;
+    }
+
+    if (arena->end->count + words > arena->end->capacity) {
+        arena->end->next = nobuild__arena_region_new(words);
+        arena->end = arena->end->next;
+    }
+
+    void *result = &arena->end->data[arena->end->count];
+    arena->end->count += words;
+    return result;
+}
+
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size)
+{
+    if (old == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+
+    size_t old_words = nobuild__arena_words(old_size);
+    size_t new_words = nobuild__arena_words(new_size);
+    Arena_Region *end = arena->end;
+    if (end != NULL && (Nobuild__Arena_Word *) old + old_words == &end->data[end->count]
+        && end->count - old_words + new_words <= end->capacity) {
+        end->count = end->count - old_words + new_words;
+        return old;
+    }
+
+    if (new_size <= old_size) {
+        return old;
+    }
+
+    void *result = arena_alloc(arena, new_size);
+    memcpy(result, old, old_size);
+    return result;
+}
+
+char *arena_strdup(Arena *arena, const char *cstr)
+{
+    size_t size = strlen(cstr) + 1;
+    return memcpy(arena_alloc(arena, size), cstr, size);
+}
+
+Arena_Mark arena_mark(Arena *arena)
+{
+    Arena_Mark mark = { .region = arena->end };
+    if (arena->end != NULL) {
+        mark.count = arena->end->count;
+    }
+    return mark;
+}
+
+void arena_rewind(Arena *arena, Arena_Mark mark)
+{
+    if (mark.region == NULL) {
+        arena_reset(arena);
+        return;
+    }
+
+    mark.region->count = mark.count;
+    for (Arena_Region *region = mark.region->next; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = mark.region;
+}
+
+void arena_reset(Arena *arena)
+{
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = arena->begin;
+}
+
+void arena_free(Arena *arena)
+{
+    Arena_Region *region = arena->begin;
+    while (region != NULL) {
+        Arena_Region *next = region->next;
+        free(region);
+        region = next;
+    }
+    arena->begin = arena->end = NULL;
+}
+
+size_t arena_used(const Arena *arena)
+{
+    size_t words = 0;
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        words += region->count;
+    }
+    return words * sizeof(Nobuild__Arena_Word);
+}
+
+// Locks for global state, which are initialized statically so that they are ready
+// before any thread exists. Multiple modules could define them, so add a guard
+// around them to prevent redefinition.
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static Arena nobuild__temp = {0};
+static Nobuild__Lock nobuild__temp_lock = NOBUILD__LOCK_INIT;
+
+// The names are in parentheses, which keeps the macros of `NOBUILD_STATS` out of them
+void *(temp_alloc)(size_t size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_alloc(&nobuild__temp, size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+void *(temp_realloc)(void *old, size_t old_size, size_t new_size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_realloc(&nobuild__temp, old, old_size, new_size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+char *(temp_strdup)(const char *cstr)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    char *result = arena_strdup(&nobuild__temp, cstr);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+Arena_Mark temp_mark(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    Arena_Mark mark = arena_mark(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return mark;
+}
+
+void temp_reset(Arena_Mark mark)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    arena_rewind(&nobuild__temp, mark);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+}
+
+size_t temp_used(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    size_t used = arena_used(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return used;
+}
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_temp(module, size);
+    return (temp_alloc)(size);
+}
+
+// Releases and shrinks are not allocations
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size)
+{
+    if (new_size > old_size) {
+        nobuild__stats_temp(module, new_size);
+    }
+    return (temp_realloc)(old, old_size, new_size);
+}
+
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr)
+{
+    nobuild__stats_temp(module, strlen(cstr) + 1);
+    return (temp_strdup)(cstr);
+}
+#endif // NOBUILD_STATS
+
+// Resizes storage with room for `*capacity` elements of which `count` are used to
+// room for exactly `n` when that is more
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    // Storage that was not allocated by nobuild has `count` elements to copy
+    const size_t old_capacity = *capacity > count ? *capacity : count;
+    elems = temp_realloc(elems, elem_size * old_capacity, elem_size * n);
+    *capacity = n;
+    return elems;
+}
+
+// Like `nobuild__da_reserve()`, but doubles the capacity until `n` elements fit
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    while (new_capacity < n) {
+        new_capacity *= 2;
+    }
+    return nobuild__da_reserve(elems, elem_size, count, capacity, new_capacity);
+}
+
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity)
+{
+    if (elems != NULL && capacity > 0 && capacity >= count) {
+        temp_realloc(elems, elem_size * capacity, 0);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+#endif // NOBUILD_ARENA_I_
+#endif // NOBUILD_ARENA_IMPLEMENTATION
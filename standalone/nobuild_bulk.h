@@ -0,0 +1,1534 @@
+#ifndef NOBUILD_BULK_H_
+#define NOBUILD_BULK_H_
+
+#include <stddef.h>
+
+
+#include <stddef.h>
+
+
+#include <stddef.h>
+#include <string.h>
+
+
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Region based allocation. An arena hands out memory from a list of large regions
+// and takes all of it back at once, so a lot of small allocations that die together
+// cost a pointer bump each and a single rewind in the end.
+
+typedef struct Arena_Region Arena_Region;
+
+typedef struct {
+    Arena_Region *begin;
+    // The region allocations are served from. The ones after it are empty.
+    Arena_Region *end;
+} Arena;
+
+// A position in an arena to rewind to
+typedef struct {
+    Arena_Region *region;
+    size_t count;
+} Arena_Mark;
+
+// Never returns NULL, panics when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// Resizes `old`, which was allocated with `old_size` bytes. It is resized in place
+// when it is the last allocation of the arena, and copied otherwise.
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *cstr);
+
+Arena_Mark arena_mark(Arena *arena);
+// Releases everything allocated since `mark` was taken. The regions are kept around
+// for the allocations that follow.
+void arena_rewind(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+// Gives the regions back to the system
+void arena_free(Arena *arena);
+// Number of bytes currently allocated from `arena`
+size_t arena_used(const Arena *arena);
+
+// Every string, array and chain that nobuild returns is allocated from the temporary
+// arena and is never freed on its own. Code that creates garbage on every iteration
+// of a loop can release it in O(1) by resetting to a mark taken at the start:
+//
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         Arena_Mark mark = temp_mark();
+//         if (ENDS_WITH(file, ".c")) {
+//             CMD("cc", "-c", PATH("src", file), "-o", CONCAT(NOEXT(file), ".o"));
+//         }
+//         temp_reset(mark);
+//     });
+//
+// Everything returned since the mark is gone after the reset, including the storage
+// of arrays that were grown in between. The arena is shared by all threads and none
+// of them may be using it while it is reset.
+void *temp_alloc(size_t size);
+void *temp_realloc(void *old, size_t old_size, size_t new_size);
+char *temp_strdup(const char *cstr);
+Arena_Mark temp_mark(void);
+void temp_reset(Arena_Mark mark);
+size_t temp_used(void);
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size);
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size);
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr);
+// Counts the allocation for the module that makes it
+#	define temp_alloc(size) nobuild__stats_temp_alloc(NOBUILD__STATS_MODULE, (size))
+#	define temp_realloc(old, old_size, new_size) \
+    nobuild__stats_temp_realloc(NOBUILD__STATS_MODULE, (old), (old_size), (new_size))
+#	define temp_strdup(cstr) nobuild__stats_temp_strdup(NOBUILD__STATS_MODULE, (cstr))
+#endif // NOBUILD_STATS
+
+// Dynamic arrays, for any struct with an `elems` pointer and `count` and `capacity`
+// fields. Their storage comes from the temporary arena and doubles when it is full,
+// so appending costs O(1) amortized, and a single allocation when nothing else was
+// allocated since the last append.
+//
+//     typedef struct {
+//         Cmd *elems;
+//         size_t count;
+//         size_t capacity;
+//     } Cmd_Array;
+//
+//     Cmd_Array cmds = {0};
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", file) }));
+//     });
+//     FOREACH_ARRAY(Cmd, cmd, cmds, cmd_run_sync(*cmd));
+//
+// Arrays with a `capacity` below their `count` wrap storage that nobuild did not
+// allocate, like `argv`, which is copied on the first append. The macros evaluate
+// `da` more than once.
+
+// Makes room for `n` elements in total
+#define da_reserve(da, n)                                                                  \
+    ((da)->elems = nobuild__da_reserve((da)->elems, sizeof(*(da)->elems), (da)->count,     \
+                                       &(da)->capacity, (n)))
+
+#define da_append(da, elem)                                                                \
+    ((da)->count >= (da)->capacity                                                         \
+         ? (void) ((da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems),       \
+                                                  (da)->count, &(da)->capacity,            \
+                                                  (da)->count + 1))                        \
+         : (void) 0,                                                                       \
+     (void) ((da)->elems[(da)->count++] = (elem)))
+
+// Appends the `n` elements that `new_elems` points to
+#define da_append_many(da, new_elems, n)                                                   \
+    do {                                                                                   \
+        const size_t nobuild__da_n = (n);                                                  \
+        /* Only compiles when the elements have the same type */                           \
+        (void) sizeof(*(da)->elems = *(new_elems));                                        \
+        if (nobuild__da_n > 0) {                                                           \
+            (da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems), (da)->count, \
+                                           &(da)->capacity, (da)->count + nobuild__da_n);  \
+            memcpy((da)->elems + (da)->count, (new_elems),                                 \
+                   sizeof(*(da)->elems) * nobuild__da_n);                                  \
+            (da)->count += nobuild__da_n;                                                  \
+        }                                                                                  \
+    } while (0)
+
+// Removes the last element and returns it. The array must not be empty.
+#define da_pop(da) ((da)->elems[--(da)->count])
+
+// Leaves the array empty. The storage only goes back to the arena when it is the last
+// allocation, the rest waits for the next `temp_reset()`.
+#define da_free(da)                                                                        \
+    do {                                                                                   \
+        nobuild__da_free((da)->elems, sizeof(*(da)->elems), (da)->count, (da)->capacity);  \
+        (da)->elems = NULL;                                                                \
+        (da)->count = 0;                                                                   \
+        (da)->capacity = 0;                                                                \
+    } while (0)
+
+// Visits the elements of an array in order
+#define FOREACH_ARRAY(type, elem, array, body)                                             \
+    for (size_t elem_##index = 0; elem_##index < (array).count; ++elem_##index) {         \
+        type *elem = &(array).elems[elem_##index];                                         \
+        body;                                                                              \
+    }
+
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
+#ifndef NOBUILD__DEPRECATED
+#	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
+#		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
+#	elif defined(_MSC_VER)
+#		define NOBUILD__DEPRECATED(func) __declspec (deprecated) func
+#	endif
+#endif
+
+typedef const char * Cstr;
+
+int cstr_ends_with(Cstr cstr, Cstr postfix);
+#define ENDS_WITH(cstr, postfix) cstr_ends_with(cstr, postfix)
+
+int cstr_starts_with(Cstr cstr, Cstr prefix);
+#define STARTS_WITH(cstr, prefix) cstr_starts_with(cstr, prefix)
+
+// A string that carries its length, so it never has to be measured again. The data
+// is not null terminated, unless it comes straight from a `Cstr`.
+typedef struct {
+    const char *data;
+    size_t count;
+} String_View;
+
+// Only for string literals, whose length is known at compile time
+#define SV(cstr_lit) ((String_View) { (cstr_lit), sizeof(cstr_lit) - 1 })
+// printf("name: "SV_FMT"\n", SV_ARG(name));
+#define SV_FMT "%.*s"
+#define SV_ARG(sv) (int) (sv).count, (sv).data
+
+String_View sv_from_cstr(Cstr cstr);
+String_View sv_from_parts(const char *data, size_t count);
+// Copies the view into the temporary arena with a null terminator
+Cstr sv_to_cstr(String_View sv);
+
+int sv_eq(String_View a, String_View b);
+// Compares without measuring `cstr` first
+int sv_eq_cstr(String_View sv, Cstr cstr);
+int sv_starts_with(String_View sv, String_View prefix);
+int sv_ends_with(String_View sv, String_View suffix);
+// Index of the first occurrence of `needle`, or `sv.count` when there is none
+size_t sv_find(String_View sv, String_View needle);
+// Index of the last occurrence of `c`, or `sv.count` when there is none
+size_t sv_rfind_char(String_View sv, char c);
+String_View sv_trim(String_View sv);
+
+// Cut `n` bytes off the front or the back of `sv` and return them
+String_View sv_chop_left(String_View *sv, size_t n);
+String_View sv_chop_right(String_View *sv, size_t n);
+// Returns everything before the first `delim` and leaves `sv` with everything after
+// it, or returns all of `sv` and leaves it empty when there is no `delim`
+String_View sv_chop_by_delim(String_View *sv, char delim);
+
+typedef struct {
+    Cstr *elems;
+    size_t count;
+    // Number of elements `elems` has room for. Arrays that wrap storage nobuild did
+    // not allocate, like `argv`, leave it at 0 and are copied on the first append.
+    size_t capacity;
+} Cstr_Array;
+
+Cstr_Array cstr_array_make(Cstr first, ...);
+#define CSTR_ARRAY_MAKE(first, ...) cstr_array_make(first, ##__VA_ARGS__, NULL)
+// An array of the arguments whose storage lives until the end of the enclosing block,
+// without counting them at runtime or allocating. It has no capacity, so appending
+// to it copies it into the temporary arena first.
+#define CSTR_ARRAY_LOCAL(...)                                        \
+    ((Cstr_Array) {                                                  \
+        .elems = (Cstr[]) { __VA_ARGS__ },                           \
+        .count = sizeof((Cstr[]) { __VA_ARGS__ }) / sizeof(Cstr)     \
+    })
+
+// Appending to a full array doubles its capacity
+Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr);
+
+// Makes room for at least `capacity` elements in total
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity);
+// Drops the capacity beyond `count`. The memory only goes back to the arena when the
+// array is its last allocation.
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs);
+
+Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr);
+
+Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b);
+
+int cstr_array_contains(Cstr_Array cstrs, Cstr cstr);
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv);
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv);
+
+// Splits `cstr` at every `delim` in a single pass. The pieces are cut out of one copy
+// of `cstr`, and an empty `delim` leaves it whole.
+Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim);
+#define SPLIT(cstr, delim) cstr_array_from_cstr(cstr, delim)
+
+typedef struct {
+    String_View *elems;
+    size_t count;
+    size_t capacity;
+} String_View_Array;
+
+// Like `SPLIT()`, but the pieces are views into `sv` and only the array is allocated
+String_View_Array sv_split(String_View sv, String_View delim);
+
+// Hands out the pieces of a split one at a time, without allocating anything:
+//
+//     Split_Iter it = split_iter_make(sv_from_cstr(output), SV("\n"));
+//     String_View line;
+//     while (split_iter_next(&it, &line)) { ... }
+typedef struct {
+    String_View rest;
+    String_View delim;
+    int done;
+} Split_Iter;
+
+Split_Iter split_iter_make(String_View sv, String_View delim);
+// Stores the next piece in `piece`, or returns 0 when there are no more
+int split_iter_next(Split_Iter *it, String_View *piece);
+
+Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
+
+// Returns the single copy that is kept of every distinct string, so that interned
+// strings are equal exactly when their pointers are. The copies are kept in a hash
+// set for the whole process, in an arena of their own that `temp_reset()` leaves alone.
+Cstr intern(Cstr cstr);
+Cstr intern_sv(String_View sv);
+// The interned copy of `sv`, or NULL when it was never interned
+Cstr intern_find(String_View sv);
+
+// Interns every element of `cstrs` in place
+Cstr_Array cstr_array_intern(Cstr_Array cstrs);
+// Compare pointers instead of strings, for arrays and strings that are all interned
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned);
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned);
+
+// Joins the strings up to the NULL that terminates them, without building an array
+Cstr cstr_join(Cstr sep, Cstr first, ...);
+#define JOIN(sep, ...) cstr_join(sep, __VA_ARGS__, NULL)
+#define CONCAT(...) JOIN("", __VA_ARGS__)
+
+// Like `JOIN` and `CONCAT`, but for string literals only, which the compiler pastes
+// together into a single literal. Anything else fails to compile. Takes up to 16 of them.
+#define JOIN_LIT(sep, ...) "" NOBUILD__CAT(NOBUILD__JOIN_LIT_, NOBUILD__NARGS(__VA_ARGS__))(sep, __VA_ARGS__)
+#define CONCAT_LIT(...) JOIN_LIT("", __VA_ARGS__)
+
+#define NOBUILD__CAT(a, b) NOBUILD__CAT_(a, b)
+#define NOBUILD__CAT_(a, b) a##b
+#define NOBUILD__NARGS(...) NOBUILD__NARGS_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NOBUILD__NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+#define NOBUILD__JOIN_LIT_1(sep, lit) lit ""
+#define NOBUILD__JOIN_LIT_2(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_1(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_3(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_2(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_4(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_3(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_5(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_4(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_6(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_5(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_7(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_6(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_8(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_7(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_9(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_8(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_10(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_9(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_11(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_10(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_12(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_11(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_13(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_12(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_14(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_13(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_15(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_14(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_16(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_15(sep, __VA_ARGS__)
+
+// A growable string. The buffer comes from `arena`, or from the temporary arena when
+// it is NULL, and doubles when it runs out. The last allocation of an arena grows in
+// place, so a string built in one go usually costs a single allocation.
+typedef struct {
+    char *elems;
+    size_t count;
+    size_t capacity;
+    Arena *arena;
+} String_Builder;
+
+// Makes room for `size` more bytes and a null terminator
+void sb_reserve(String_Builder *sb, size_t size);
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size);
+void sb_append_cstr(String_Builder *sb, Cstr cstr);
+void sb_append_sv(String_Builder *sb, String_View sv);
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+// Null terminates the string, gives back the capacity it does not use and returns
+// it. The builder is left empty for the next string.
+Cstr sb_to_cstr(String_Builder *sb);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Batched filesystem operations for work that touches many independent files.
+// Define `NOBUILD_IO_URING` on Linux to queue them on an io_uring, so that a whole
+// batch costs a single `io_uring_enter()` instead of a syscall per file and the
+// kernel works on all of them at once. That pays off when every file is a round
+// trip, like on network filesystems. With a local filesystem the kernel hands path
+// lookups to worker threads, which makes it slower than plain syscalls. Those are
+// used one by one by default, and when the kernel or a seccomp filter refuses to
+// set up a ring.
+
+typedef struct {
+    Cstr path;
+    // 0 on success, the errno of the failed operation otherwise
+    int error;
+    int is_dir;
+    unsigned long long size;
+    // Seconds since the epoch, or the FILETIME on Windows, like `path_is_newer()`
+    long long mtime;
+} Bulk_Stat;
+
+// Stats the `path` of every element, following symbolic links
+void bulk_stat(Bulk_Stat *stats, size_t count);
+
+typedef struct {
+    Cstr path;
+    int error;
+    // The whole file with a null terminator after it, to be freed by the caller.
+    // As much as the file had when it was stat'ed is read.
+    char *data;
+    size_t size;
+} Bulk_Read;
+
+// Reads every `path` into memory
+void bulk_read(Bulk_Read *reads, size_t count);
+
+// Whether the bulk operations go through io_uring in this process
+int bulk_uses_io_uring(void);
+
+#endif // NOBUILD_BULK_H_
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NOBUILD_BULK_IMPLEMENTATION
+#ifndef NOBUILD_BULK_I_
+#define NOBUILD_BULK_I_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
+#ifndef NOBUILD__DEPRECATED
+#	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
+#		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
+#	elif defined(_MSC_VER)
+#		define NOBUILD__DEPRECATED(func) __declspec (deprecated) func
+#	endif
+#endif
+
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
+NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
+
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void warn(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define WARN(fmt, ...) warn("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void erro(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define ERRO(fmt, ...) erro("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void panic(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define PANIC(fmt, ...) panic("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void todo(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TODO(fmt, ...) todo("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TODO_SAFE(fmt, ...) todo_safe("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
+void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
+{
+    fprintf(stream, "[%s] ", tag);
+    vfprintf(stream, fmt, args);
+    fprintf(stream, "\n");
+}
+
+void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
+{
+    WARN("This function is deprecated.");
+    nobuild__vlog(stream, tag, fmt, args);
+}
+
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
+void info(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "INFO", fmt, args);
+    va_end(args);
+}
+
+void warn(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "WARN", fmt, args);
+    va_end(args);
+}
+
+void erro(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "ERRO", fmt, args);
+    va_end(args);
+}
+
+void panic(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "ERRO", fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+void todo(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TODO", fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+void todo_safe(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TODO", fmt, args);
+    va_end(args);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef NOBUILD_STATS
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
+#else
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#endif
+
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
+
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
+
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
+
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
+
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
+}
+
+static void nobuild__stats_report(void)
+{
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
+    }
+#endif // _WIN32
+
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
+    }
+}
+
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
+{
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
+    }
+
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
+}
+
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
+
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
+
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
+}
+
+void nobuild__stats_temp(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
+
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
+}
+
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
+}
+
+void nobuild__stats_copied(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
+
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
+}
+
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
+    }
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
+    }
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
+    }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
+}
+
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
+{
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
+
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
+    }
+
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
+    }
+
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
+}
+
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+}
+
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+#endif // NOBUILD_STATS
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_BULK
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif // _WIN32
+
+// The ring is driven with GCC atomics and the raw syscalls, so there is no liburing to link
+#if defined(__linux__) && defined(NOBUILD_IO_URING) && (defined(__GNUC__) || defined(__clang__))
+#	define NOBUILD__BULK_URING 1
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <linux/io_uring.h>
+#	include <linux/stat.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+// New syscalls have the same number on every architecture
+#	ifndef __NR_io_uring_setup
+#		define __NR_io_uring_setup 425
+#	endif
+#	ifndef __NR_io_uring_enter
+#		define __NR_io_uring_enter 426
+#	endif
+#	define NOBUILD__AT_FDCWD -100
+#	ifdef O_CLOEXEC
+#		define NOBUILD__O_CLOEXEC O_CLOEXEC
+#	else
+#		define NOBUILD__O_CLOEXEC 02000000
+#	endif
+// Large enough to keep the kernel busy without holding too many files open at once
+#	define NOBUILD__BULK_RING_ENTRIES 256
+#else
+#	define NOBUILD__BULK_URING 0
+#endif
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+static void nobuild__bulk_stat_sync(Bulk_Stat *stat_)
+{
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    if (NOBUILD__STATS_CALL(STATS_STAT, stat(stat_->path, &statbuf)) < 0) {
+        stat_->error = errno;
+        errno = 0;
+        return;
+    }
+
+    stat_->error = 0;
+    stat_->is_dir = S_ISDIR(statbuf.st_mode);
+    stat_->size = (unsigned long long) statbuf.st_size;
+    stat_->mtime = (long long) statbuf.st_mtime;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!NOBUILD__STATS_CALL(STATS_STAT, GetFileAttributesExA(stat_->path, GetFileExInfoStandard, &data))) {
+        stat_->error = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        return;
+    }
+
+    stat_->error = 0;
+    stat_->is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    stat_->size = ((unsigned long long) data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    stat_->mtime = ((long long) data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#endif // _WIN32
+}
+
+static void nobuild__bulk_read_sync(Bulk_Read *read_)
+{
+    Bulk_Stat stat_ = { .path = read_->path };
+    nobuild__bulk_stat_sync(&stat_);
+    read_->data = NULL;
+    read_->size = 0;
+    read_->error = stat_.error;
+    if (read_->error) {
+        return;
+    }
+
+    if (stat_.is_dir) {
+        read_->error = EISDIR;
+        return;
+    }
+
+    read_->data = NOBUILD__MALLOC((size_t) stat_.size + 1);
+    if (read_->data == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(read_->path, O_RDONLY));
+    if (fd < 0) {
+        read_->error = errno;
+        errno = 0;
+        free(read_->data);
+        read_->data = NULL;
+        return;
+    }
+
+    while (read_->size < stat_.size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, read_->data + read_->size, (size_t) stat_.size - read_->size));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0) {
+            read_->error = errno;
+            errno = 0;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        read_->size += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(read_->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        read_->error = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        free(read_->data);
+        read_->data = NULL;
+        return;
+    }
+
+    while (read_->size < stat_.size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, read_->data + read_->size, (DWORD) (stat_.size - read_->size), &n, NULL))) {
+            read_->error = EIO;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        read_->size += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    if (read_->error) {
+        free(read_->data);
+        read_->data = NULL;
+        read_->size = 0;
+        return;
+    }
+    read_->data[read_->size] = '\0';
+}
+
+#if NOBUILD__BULK_URING
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Nobuild__Uring;
+
+// Returns 0 when io_uring cannot be used
+static int nobuild__uring_init(Nobuild__Uring *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, NOBUILD__BULK_RING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        errno = 0;
+        return 0;
+    }
+
+    // Statx, openat, read and close are all there by the time fast poll is
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        close(ring->fd);
+        return 0;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    const int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        errno = 0;
+        return 0;
+    }
+
+    ring->cq_ring = ring->sq_ring;
+    if (!single_mmap) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            errno = 0;
+            return 0;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (!single_mmap) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        errno = 0;
+        return 0;
+    }
+
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return 1;
+}
+
+static void nobuild__uring_destroy(Nobuild__Uring *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Fills `sqe` for element `index`, or returns 0 to skip it
+typedef int (*Nobuild__Uring_Prep)(struct io_uring_sqe *sqe, size_t index, void *data);
+// Receives the result of the operation of element `index`, a negated errno on failure
+typedef void (*Nobuild__Uring_Done)(size_t index, int res, void *data);
+
+// Runs one operation for each of `count` elements, a ring full at a time
+static void nobuild__uring_run(Nobuild__Uring *ring, size_t count, Nobuild__Uring_Prep prep, Nobuild__Uring_Done done, void *data)
+{
+    const unsigned mask = *ring->sq_mask;
+    size_t next = 0;
+    while (next < count) {
+        const unsigned tail = *ring->sq_tail;
+        unsigned queued = 0;
+        for (; next < count && queued < ring->entries; ++next) {
+            const unsigned slot = (tail + queued) & mask;
+            struct io_uring_sqe *sqe = &ring->sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            if (!prep(sqe, next, data)) {
+                continue;
+            }
+
+            sqe->user_data = next;
+            ring->sq_array[slot] = slot;
+            queued += 1;
+        }
+
+        if (queued == 0) {
+            break;
+        }
+        __atomic_store_n(ring->sq_tail, tail + queued, __ATOMIC_RELEASE);
+
+        unsigned to_submit = queued;
+        unsigned completed = 0;
+        while (completed < queued) {
+            long n = syscall(__NR_io_uring_enter, ring->fd, to_submit, queued - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    errno = 0;
+                    continue;
+                }
+                PANIC("Could not submit to io_uring: %s", nobuild__strerror(errno));
+            }
+            to_submit -= (unsigned) n;
+
+            unsigned head = *ring->cq_head;
+            const unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; ++head) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                done((size_t) cqe->user_data, cqe->res, data);
+                completed += 1;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+typedef struct {
+    Bulk_Stat *stats;
+    struct statx *buffers;
+} Nobuild__Bulk_Stat_Batch;
+
+static int nobuild__bulk_stat_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Stat_Batch *batch = data;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = NOBUILD__AT_FDCWD;
+    sqe->addr = (unsigned long long) (size_t) batch->stats[index].path;
+    sqe->len = STATX_TYPE | STATX_MTIME | STATX_SIZE;
+    sqe->off = (unsigned long long) (size_t) &batch->buffers[index];
+    return 1;
+}
+
+static void nobuild__bulk_stat_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Stat_Batch *batch = data;
+    Bulk_Stat *stat_ = &batch->stats[index];
+    if (res < 0) {
+        stat_->error = -res;
+        return;
+    }
+
+    const struct statx *buffer = &batch->buffers[index];
+    stat_->error = 0;
+    stat_->is_dir = (buffer->stx_mode & 0170000) == 0040000;
+    stat_->size = buffer->stx_size;
+    stat_->mtime = buffer->stx_mtime.tv_sec;
+}
+
+// Reading a file takes a statx, an open, as many reads as it needs and a close,
+// and each of these steps is one submission for the whole batch
+typedef struct {
+    Bulk_Read *reads;
+    Bulk_Stat *stats;
+    int *fds;
+} Nobuild__Bulk_Read_Batch;
+
+static int nobuild__bulk_open_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (batch->reads[index].error) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = NOBUILD__AT_FDCWD;
+    sqe->addr = (unsigned long long) (size_t) batch->reads[index].path;
+    // Commands started by other threads must not inherit the files
+    sqe->open_flags = O_RDONLY | NOBUILD__O_CLOEXEC;
+    return 1;
+}
+
+static void nobuild__bulk_open_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (res < 0) {
+        batch->reads[index].error = -res;
+        return;
+    }
+    batch->fds[index] = res;
+}
+
+static int nobuild__bulk_read_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    Bulk_Read *read_ = &batch->reads[index];
+    if (read_->error || batch->fds[index] < 0 || read_->size >= batch->stats[index].size) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = batch->fds[index];
+    sqe->addr = (unsigned long long) (size_t) (read_->data + read_->size);
+    const unsigned long long left = batch->stats[index].size - read_->size;
+    sqe->len = left < (1u << 30) ? (unsigned) left : (1u << 30);
+    sqe->off = read_->size;
+    return 1;
+}
+
+static void nobuild__bulk_read_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    Bulk_Read *read_ = &batch->reads[index];
+    if (res < 0) {
+        read_->error = -res;
+        return;
+    }
+
+    if (res == 0) {
+        // The file shrank since it was stat'ed
+        batch->stats[index].size = read_->size;
+        return;
+    }
+    read_->size += (size_t) res;
+}
+
+static int nobuild__bulk_close_prep(struct io_uring_sqe *sqe, size_t index, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    if (batch->fds[index] < 0) {
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = batch->fds[index];
+    return 1;
+}
+
+static void nobuild__bulk_close_done(size_t index, int res, void *data)
+{
+    Nobuild__Bulk_Read_Batch *batch = data;
+    (void) res;
+    batch->fds[index] = -1;
+}
+
+static void nobuild__bulk_stat_ring(Nobuild__Uring *ring, Bulk_Stat *stats, size_t count)
+{
+    Nobuild__Bulk_Stat_Batch batch = {
+        .stats = stats,
+        .buffers = NOBUILD__MALLOC(count * sizeof(struct statx)),
+    };
+    if (batch.buffers == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_stat_prep, nobuild__bulk_stat_done, &batch);
+    free(batch.buffers);
+}
+
+static void nobuild__bulk_read_batch(Nobuild__Uring *ring, Bulk_Read *reads, size_t count)
+{
+    Nobuild__Bulk_Read_Batch batch = {
+        .reads = reads,
+        .stats = NOBUILD__CALLOC(count, sizeof(Bulk_Stat)),
+        .fds = NOBUILD__MALLOC(count * sizeof(int)),
+    };
+    if (batch.stats == NULL || batch.fds == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        batch.stats[i].path = reads[i].path;
+        batch.fds[i] = -1;
+    }
+    nobuild__bulk_stat_ring(ring, batch.stats, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        reads[i].data = NULL;
+        reads[i].size = 0;
+        reads[i].error = batch.stats[i].error;
+        if (reads[i].error == 0 && batch.stats[i].is_dir) {
+            reads[i].error = EISDIR;
+        }
+
+        if (reads[i].error == 0) {
+            reads[i].data = NOBUILD__MALLOC((size_t) batch.stats[i].size + 1);
+            if (reads[i].data == NULL) {
+                PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+            }
+        }
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_open_prep, nobuild__bulk_open_done, &batch);
+
+    // Regular files are read in one go, anything short is picked up by another round
+    for (;;) {
+        size_t pending = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!reads[i].error && batch.fds[i] >= 0 && reads[i].size < batch.stats[i].size) {
+                pending += 1;
+            }
+        }
+
+        if (pending == 0) {
+            break;
+        }
+        nobuild__uring_run(ring, count, nobuild__bulk_read_prep, nobuild__bulk_read_done, &batch);
+    }
+
+    nobuild__uring_run(ring, count, nobuild__bulk_close_prep, nobuild__bulk_close_done, &batch);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (reads[i].error) {
+            free(reads[i].data);
+            reads[i].data = NULL;
+            reads[i].size = 0;
+            continue;
+        }
+        reads[i].data[reads[i].size] = '\0';
+    }
+
+    free(batch.stats);
+    free(batch.fds);
+}
+#endif // NOBUILD__BULK_URING
+
+int bulk_uses_io_uring(void)
+{
+#if NOBUILD__BULK_URING
+    // Probed once, a race between threads only probes twice
+    static int available = -1;
+    if (available < 0) {
+        Nobuild__Uring ring;
+        available = nobuild__uring_init(&ring);
+        if (available) {
+            nobuild__uring_destroy(&ring);
+        }
+    }
+    return available;
+#else
+    return 0;
+#endif // NOBUILD__BULK_URING
+}
+
+void bulk_stat(Bulk_Stat *stats, size_t count)
+{
+#if NOBUILD__BULK_URING
+    Nobuild__Uring ring;
+    if (count > 1 && bulk_uses_io_uring() && nobuild__uring_init(&ring)) {
+        nobuild__bulk_stat_ring(&ring, stats, count);
+        nobuild__uring_destroy(&ring);
+        return;
+    }
+#endif // NOBUILD__BULK_URING
+
+    for (size_t i = 0; i < count; ++i) {
+        nobuild__bulk_stat_sync(&stats[i]);
+    }
+}
+
+void bulk_read(Bulk_Read *reads, size_t count)
+{
+#if NOBUILD__BULK_URING
+    Nobuild__Uring ring;
+    if (count > 1 && bulk_uses_io_uring() && nobuild__uring_init(&ring)) {
+        // Every file of a batch is open at the same time, so keep the batches small
+        for (size_t i = 0; i < count; i += ring.entries) {
+            const size_t n = count - i < ring.entries ? count - i : ring.entries;
+            nobuild__bulk_read_batch(&ring, reads + i, n);
+        }
+        nobuild__uring_destroy(&ring);
+        return;
+    }
+#endif // NOBUILD__BULK_URING
+
+    for (size_t i = 0; i < count; ++i) {
+        nobuild__bulk_read_sync(&reads[i]);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+#endif // NOBUILD_BULK_I_
+#endif // NOBUILD_BULK_IMPLEMENTATION
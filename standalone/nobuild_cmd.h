@@ -15,6 +15,277 @@ typedef HANDLE Fd;
 
 #include <stddef.h>
 
+
+#include <stddef.h>
+#include <string.h>
+
+
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Region based allocation. An arena hands out memory from a list of large regions
+// and takes all of it back at once, so a lot of small allocations that die together
+// cost a pointer bump each and a single rewind in the end.
+
+typedef struct Arena_Region Arena_Region;
+
+typedef struct {
+    Arena_Region *begin;
+    // The region allocations are served from. The ones after it are empty.
+    Arena_Region *end;
+} Arena;
+
+// A position in an arena to rewind to
+typedef struct {
+    Arena_Region *region;
+    size_t count;
+} Arena_Mark;
+
+// Never returns NULL, panics when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// Resizes `old`, which was allocated with `old_size` bytes. It is resized in place
+// when it is the last allocation of the arena, and copied otherwise.
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *cstr);
+
+Arena_Mark arena_mark(Arena *arena);
+// Releases everything allocated since `mark` was taken. The regions are kept around
+// for the allocations that follow.
+void arena_rewind(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+// Gives the regions back to the system
+void arena_free(Arena *arena);
+// Number of bytes currently allocated from `arena`
+size_t arena_used(const Arena *arena);
+
+// Every string, array and chain that nobuild returns is allocated from the temporary
+// arena and is never freed on its own. Code that creates garbage on every iteration
+// of a loop can release it in O(1) by resetting to a mark taken at the start:
+//
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         Arena_Mark mark = temp_mark();
+//         if (ENDS_WITH(file, ".c")) {
+//             CMD("cc", "-c", PATH("src", file), "-o", CONCAT(NOEXT(file), ".o"));
+//         }
+//         temp_reset(mark);
+//     });
+//
+// Everything returned since the mark is gone after the reset, including the storage
+// of arrays that were grown in between. The arena is shared by all threads and none
+// of them may be using it while it is reset.
+void *temp_alloc(size_t size);
+void *temp_realloc(void *old, size_t old_size, size_t new_size);
+char *temp_strdup(const char *cstr);
+Arena_Mark temp_mark(void);
+void temp_reset(Arena_Mark mark);
+size_t temp_used(void);
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size);
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size);
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr);
+// Counts the allocation for the module that makes it
+#	define temp_alloc(size) nobuild__stats_temp_alloc(NOBUILD__STATS_MODULE, (size))
+#	define temp_realloc(old, old_size, new_size) \
+    nobuild__stats_temp_realloc(NOBUILD__STATS_MODULE, (old), (old_size), (new_size))
+#	define temp_strdup(cstr) nobuild__stats_temp_strdup(NOBUILD__STATS_MODULE, (cstr))
+#endif // NOBUILD_STATS
+
+// Dynamic arrays, for any struct with an `elems` pointer and `count` and `capacity`
+// fields. Their storage comes from the temporary arena and doubles when it is full,
+// so appending costs O(1) amortized, and a single allocation when nothing else was
+// allocated since the last append.
+//
+//     typedef struct {
+//         Cmd *elems;
+//         size_t count;
+//         size_t capacity;
+//     } Cmd_Array;
+//
+//     Cmd_Array cmds = {0};
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", file) }));
+//     });
+//     FOREACH_ARRAY(Cmd, cmd, cmds, cmd_run_sync(*cmd));
+//
+// Arrays with a `capacity` below their `count` wrap storage that nobuild did not
+// allocate, like `argv`, which is copied on the first append. The macros evaluate
+// `da` more than once.
+
+// Makes room for `n` elements in total
+#define da_reserve(da, n)                                                                  \
+    ((da)->elems = nobuild__da_reserve((da)->elems, sizeof(*(da)->elems), (da)->count,     \
+                                       &(da)->capacity, (n)))
+
+#define da_append(da, elem)                                                                \
+    ((da)->count >= (da)->capacity                                                         \
+         ? (void) ((da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems),       \
+                                                  (da)->count, &(da)->capacity,            \
+                                                  (da)->count + 1))                        \
+         : (void) 0,                                                                       \
+     (void) ((da)->elems[(da)->count++] = (elem)))
+
+// Appends the `n` elements that `new_elems` points to
+#define da_append_many(da, new_elems, n)                                                   \
+    do {                                                                                   \
+        const size_t nobuild__da_n = (n);                                                  \
+        /* Only compiles when the elements have the same type */                           \
+        (void) sizeof(*(da)->elems = *(new_elems));                                        \
+        if (nobuild__da_n > 0) {                                                           \
+            (da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems), (da)->count, \
+                                           &(da)->capacity, (da)->count + nobuild__da_n);  \
+            memcpy((da)->elems + (da)->count, (new_elems),                                 \
+                   sizeof(*(da)->elems) * nobuild__da_n);                                  \
+            (da)->count += nobuild__da_n;                                                  \
+        }                                                                                  \
+    } while (0)
+
+// Removes the last element and returns it. The array must not be empty.
+#define da_pop(da) ((da)->elems[--(da)->count])
+
+// Leaves the array empty. The storage only goes back to the arena when it is the last
+// allocation, the rest waits for the next `temp_reset()`.
+#define da_free(da)                                                                        \
+    do {                                                                                   \
+        nobuild__da_free((da)->elems, sizeof(*(da)->elems), (da)->count, (da)->capacity);  \
+        (da)->elems = NULL;                                                                \
+        (da)->count = 0;                                                                   \
+        (da)->capacity = 0;                                                                \
+    } while (0)
+
+// Visits the elements of an array in order
+#define FOREACH_ARRAY(type, elem, array, body)                                             \
+    for (size_t elem_##index = 0; elem_##index < (array).count; ++elem_##index) {         \
+        type *elem = &(array).elems[elem_##index];                                         \
+        body;                                                                              \
+    }
+
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
 #ifndef NOBUILD__DEPRECATED
 #	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
 #		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
@@ -31,30 +302,174 @@ int cstr_ends_with(Cstr cstr, Cstr postfix);
 int cstr_starts_with(Cstr cstr, Cstr prefix);
 #define STARTS_WITH(cstr, prefix) cstr_starts_with(cstr, prefix)
 
+// A string that carries its length, so it never has to be measured again. The data
+// is not null terminated, unless it comes straight from a `Cstr`.
+typedef struct {
+    const char *data;
+    size_t count;
+} String_View;
+
+// Only for string literals, whose length is known at compile time
+#define SV(cstr_lit) ((String_View) { (cstr_lit), sizeof(cstr_lit) - 1 })
+// printf("name: "SV_FMT"\n", SV_ARG(name));
+#define SV_FMT "%.*s"
+#define SV_ARG(sv) (int) (sv).count, (sv).data
+
+String_View sv_from_cstr(Cstr cstr);
+String_View sv_from_parts(const char *data, size_t count);
+// Copies the view into the temporary arena with a null terminator
+Cstr sv_to_cstr(String_View sv);
+
+int sv_eq(String_View a, String_View b);
+// Compares without measuring `cstr` first
+int sv_eq_cstr(String_View sv, Cstr cstr);
+int sv_starts_with(String_View sv, String_View prefix);
+int sv_ends_with(String_View sv, String_View suffix);
+// Index of the first occurrence of `needle`, or `sv.count` when there is none
+size_t sv_find(String_View sv, String_View needle);
+// Index of the last occurrence of `c`, or `sv.count` when there is none
+size_t sv_rfind_char(String_View sv, char c);
+String_View sv_trim(String_View sv);
+
+// Cut `n` bytes off the front or the back of `sv` and return them
+String_View sv_chop_left(String_View *sv, size_t n);
+String_View sv_chop_right(String_View *sv, size_t n);
+// Returns everything before the first `delim` and leaves `sv` with everything after
+// it, or returns all of `sv` and leaves it empty when there is no `delim`
+String_View sv_chop_by_delim(String_View *sv, char delim);
+
 typedef struct {
     Cstr *elems;
     size_t count;
+    // Number of elements `elems` has room for. Arrays that wrap storage nobuild did
+    // not allocate, like `argv`, leave it at 0 and are copied on the first append.
     size_t capacity;
 } Cstr_Array;
 
 Cstr_Array cstr_array_make(Cstr first, ...);
 #define CSTR_ARRAY_MAKE(first, ...) cstr_array_make(first, ##__VA_ARGS__, NULL)
-
+// An array of the arguments whose storage lives until the end of the enclosing block,
+// without counting them at runtime or allocating. It has no capacity, so appending
+// to it copies it into the temporary arena first.
+#define CSTR_ARRAY_LOCAL(...)                                        \
+    ((Cstr_Array) {                                                  \
+        .elems = (Cstr[]) { __VA_ARGS__ },                           \
+        .count = sizeof((Cstr[]) { __VA_ARGS__ }) / sizeof(Cstr)     \
+    })
+
+// Appending to a full array doubles its capacity
 Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr);
 
+// Makes room for at least `capacity` elements in total
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity);
+// Drops the capacity beyond `count`. The memory only goes back to the arena when the
+// array is its last allocation.
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs);
+
 Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr);
 
 Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b);
 
 int cstr_array_contains(Cstr_Array cstrs, Cstr cstr);
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv);
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv);
 
+// Splits `cstr` at every `delim` in a single pass. The pieces are cut out of one copy
+// of `cstr`, and an empty `delim` leaves it whole.
 Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim);
 #define SPLIT(cstr, delim) cstr_array_from_cstr(cstr, delim)
 
+typedef struct {
+    String_View *elems;
+    size_t count;
+    size_t capacity;
+} String_View_Array;
+
+// Like `SPLIT()`, but the pieces are views into `sv` and only the array is allocated
+String_View_Array sv_split(String_View sv, String_View delim);
+
+// Hands out the pieces of a split one at a time, without allocating anything:
+//
+//     Split_Iter it = split_iter_make(sv_from_cstr(output), SV("\n"));
+//     String_View line;
+//     while (split_iter_next(&it, &line)) { ... }
+typedef struct {
+    String_View rest;
+    String_View delim;
+    int done;
+} Split_Iter;
+
+Split_Iter split_iter_make(String_View sv, String_View delim);
+// Stores the next piece in `piece`, or returns 0 when there are no more
+int split_iter_next(Split_Iter *it, String_View *piece);
+
 Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
-#define JOIN(sep, ...) cstr_array_join(sep, cstr_array_make(__VA_ARGS__, NULL))
+
+// Returns the single copy that is kept of every distinct string, so that interned
+// strings are equal exactly when their pointers are. The copies are kept in a hash
+// set for the whole process, in an arena of their own that `temp_reset()` leaves alone.
+Cstr intern(Cstr cstr);
+Cstr intern_sv(String_View sv);
+// The interned copy of `sv`, or NULL when it was never interned
+Cstr intern_find(String_View sv);
+
+// Interns every element of `cstrs` in place
+Cstr_Array cstr_array_intern(Cstr_Array cstrs);
+// Compare pointers instead of strings, for arrays and strings that are all interned
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned);
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned);
+
+// Joins the strings up to the NULL that terminates them, without building an array
+Cstr cstr_join(Cstr sep, Cstr first, ...);
+#define JOIN(sep, ...) cstr_join(sep, __VA_ARGS__, NULL)
 #define CONCAT(...) JOIN("", __VA_ARGS__)
 
+// Like `JOIN` and `CONCAT`, but for string literals only, which the compiler pastes
+// together into a single literal. Anything else fails to compile. Takes up to 16 of them.
+#define JOIN_LIT(sep, ...) "" NOBUILD__CAT(NOBUILD__JOIN_LIT_, NOBUILD__NARGS(__VA_ARGS__))(sep, __VA_ARGS__)
+#define CONCAT_LIT(...) JOIN_LIT("", __VA_ARGS__)
+
+#define NOBUILD__CAT(a, b) NOBUILD__CAT_(a, b)
+#define NOBUILD__CAT_(a, b) a##b
+#define NOBUILD__NARGS(...) NOBUILD__NARGS_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NOBUILD__NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+#define NOBUILD__JOIN_LIT_1(sep, lit) lit ""
+#define NOBUILD__JOIN_LIT_2(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_1(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_3(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_2(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_4(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_3(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_5(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_4(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_6(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_5(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_7(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_6(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_8(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_7(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_9(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_8(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_10(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_9(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_11(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_10(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_12(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_11(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_13(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_12(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_14(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_13(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_15(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_14(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_16(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_15(sep, __VA_ARGS__)
+
+// A growable string. The buffer comes from `arena`, or from the temporary arena when
+// it is NULL, and doubles when it runs out. The last allocation of an arena grows in
+// place, so a string built in one go usually costs a single allocation.
+typedef struct {
+    char *elems;
+    size_t count;
+    size_t capacity;
+    Arena *arena;
+} String_Builder;
+
+// Makes room for `size` more bytes and a null terminator
+void sb_reserve(String_Builder *sb, size_t size);
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size);
+void sb_append_cstr(String_Builder *sb, Cstr cstr);
+void sb_append_sv(String_Builder *sb, String_View sv);
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+// Null terminates the string, gives back the capacity it does not use and returns
+// it. The builder is left empty for the next string.
+Cstr sb_to_cstr(String_Builder *sb);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -65,35 +480,60 @@ typedef struct {
 
 Cstr cmd_show(Cmd cmd);
 Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout);
+// Like cmd_run_async() but also redirects stderr when `fderr` is given
+Pid cmd_run_async_ex(Cmd cmd, Fd *fdin, Fd *fdout, Fd *fderr);
 void cmd_run_sync(Cmd cmd);
 
+// The arguments are counted at compile time and stay on the stack, and the line is
+// only formatted when INFO messages are printed
+//
 // TODO(#1): no way to disable echo in nobuild scripts
 // TODO(#2): no way to ignore fails
 #define CMD(...)                                        \
     do {                                                \
         Cmd cmd = {                                     \
-            .line = cstr_array_make(__VA_ARGS__, NULL)  \
+            .line = CSTR_ARRAY_LOCAL(__VA_ARGS__)       \
         };                                              \
-        INFO("CMD: %s", cmd_show(cmd));                 \
+        if (log_enabled(LOG_INFO)) {                    \
+            INFO("CMD: %s", cmd_show(cmd));             \
+        }                                               \
         cmd_run_sync(cmd);                              \
     } while (0)
 
+// Grows with `da_append()` and the other `da_*()` macros
 typedef struct {
     Cmd *elems;
     size_t count;
+    size_t capacity;
 } Cmd_Array;
 
 typedef enum {
     CHAIN_TOKEN_END = 0,
     CHAIN_TOKEN_IN,
     CHAIN_TOKEN_OUT,
-    CHAIN_TOKEN_CMD
+    CHAIN_TOKEN_CMD,
+    CHAIN_TOKEN_PIPE_SIZE,
+    CHAIN_TOKEN_TEE,
+    CHAIN_TOKEN_FN,
+    CHAIN_TOKEN_ERR,
+    CHAIN_TOKEN_MERGE_ERR
 } Chain_Token_Type;
 
+struct Chain;
+
+// A chain stage that runs on a thread inside nobuild instead of in a child process.
+// It reads its input from `in` until the end and writes its output to `out`, both
+// of which are closed once it returns. Anything but 0 fails the chain.
+typedef int (*Chain_Fn)(Fd in, Fd out, void *data);
+
 // A single token for the CHAIN(...) DSL syntax
 typedef struct {
     Chain_Token_Type type;
     Cstr_Array args;
+    size_t size;
+    struct Chain *chain;
+    Chain_Fn fn;
+    void *data;
 } Chain_Token;
 
 #define CHAIN_IN(path)                      \
@@ -114,15 +554,101 @@ typedef struct {
         .args = cstr_array_make(__VA_ARGS__, NULL) \
     }
 
-// TODO(#20): pipes do not allow redirecting stderr
+// Sends the stderr of every command of the chain and of its branches to `path`,
+// unless a branch has a CHAIN_ERR of its own
+#define CHAIN_ERR(path)                     \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_ERR,            \
+        .args = cstr_array_make(path, NULL) \
+    }
+
+// Sends the stderr of the CHAIN_CMD right before it down the chain along with its
+// stdout, like `2>&1` in a shell
+#define CHAIN_MERGE_ERR                     \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_MERGE_ERR       \
+    }
+
+// Runs `fn(in, out, data)` as a stage of the chain, without a fork and exec. A stage
+// that passes its data on with `fd_pump()` never copies it through user space and
+// beats a command. One that reads and writes through a buffer streams about as fast
+// as a command doing the same, and only saves starting the process, which matters
+// for short inputs and many small chains.
+#define CHAIN_FN(fn_, data_)                 \
+    (Chain_Token) {                          \
+        .type = CHAIN_TOKEN_FN,              \
+        .args = cstr_array_make(#fn_, NULL), \
+        .fn = (fn_),                         \
+        .data = (data_)                      \
+    }
+
+// Raises the capacity of the pipes between the commands to `size` bytes. Regular
+// input and output files are still handed to the commands, which read and write them
+// directly. Anything else, like a fifo or a device, is pumped through a pipe of that
+// size by nobuild itself, with splice(2) on Linux.
+#define CHAIN_PIPE_SIZE(n)                  \
+    (Chain_Token) {                         \
+        .type = CHAIN_TOKEN_PIPE_SIZE,      \
+        .size = (n)                         \
+    }
+
+// Sends a copy of the stream at this point of the chain into a branch chain made of
+// the given CHAIN_CMD, CHAIN_OUT, CHAIN_PIPE_SIZE and CHAIN_TEE tokens, while the
+// stream itself continues down the chain. A branch without an output writes to
+// stdout. The stream is duplicated with tee(2) on Linux.
+#define CHAIN_TEE(...)                                                                 \
+    (Chain_Token) {                                                                    \
+        .type = CHAIN_TOKEN_TEE,                                                       \
+        .chain = chain_branch(chain_build_from_tokens(__VA_ARGS__, (Chain_Token) {0})) \
+    }
+
+typedef struct {
+    // Number of commands of the chain in front of the tee
+    size_t position;
+    struct Chain *chain;
+} Chain_Tee;
+
+typedef struct {
+    Chain_Tee *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Tee_Array;
+
+typedef struct {
+    // Index of the stage among the commands of the chain
+    size_t position;
+    Chain_Fn fn;
+    void *data;
+} Chain_Fn_Stage;
+
+typedef struct {
+    Chain_Fn_Stage *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Fn_Stage_Array;
+
 typedef struct {
+    size_t *elems;
+    size_t count;
+    size_t capacity;
+} Chain_Position_Array;
+
+typedef struct Chain {
     Cstr input_filepath;
     Cmd_Array cmds;
     Cstr output_filepath;
+    Cstr error_filepath;
+    size_t pipe_size;
+    Chain_Tee_Array tees;
+    Chain_Fn_Stage_Array fns;
+    // Indices of the commands whose stderr goes down the chain
+    Chain_Position_Array merged_err;
 } Chain;
 
 Chain chain_build_from_tokens(Chain_Token first, ...);
+Chain *chain_branch(Chain chain);
 void chain_run_sync(Chain chain);
+// Prints the chain when INFO messages are printed
 void chain_echo(Chain chain);
 
 // TODO(#15): PIPE does not report where exactly a syntactic error has happened
@@ -147,14 +673,17 @@ void chain_echo(Chain chain);
 #include <stdarg.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
 
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 
 
@@ -178,8 +707,22 @@ void chain_echo(Chain chain);
 #	endif
 #endif
 
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
 NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
 
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
 void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 #define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
 
@@ -204,6 +747,18 @@ void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 
 #include <stdlib.h>
 
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
 void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
 {
     fprintf(stream, "[%s] ", tag);
@@ -217,8 +772,24 @@ void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
     nobuild__vlog(stream, tag, fmt, args);
 }
 
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
 void info(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "INFO", fmt, args);
@@ -227,6 +798,10 @@ void info(const char *fmt, ...)
 
 void warn(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "WARN", fmt, args);
@@ -235,6 +810,10 @@ void warn(const char *fmt, ...)
 
 void erro(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "ERRO", fmt, args);
@@ -268,227 +847,921 @@ void todo_safe(const char *fmt, ...)
 }
 
 
-// Multiple modules could define this function, so add a guard around it to prevent redefinition
-#ifndef NOBUILD__STRERROR
-#define NOBUILD__STRERROR
-Cstr nobuild__strerror(int errnum)
-{
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef NOBUILD_STATS
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
 #ifndef _WIN32
-    return strerror(errnum);
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
 #else
-    static char buffer[1024];
-    strerror_s(buffer, 1024, errnum);
-    return buffer;
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
 #endif
-}
-#endif // NOBUILD__STRERROR
 
-int cstr_ends_with(Cstr cstr, Cstr postfix)
-{
-    const size_t cstr_len = strlen(cstr);
-    const size_t postfix_len = strlen(postfix);
-    return postfix_len <= cstr_len
-           && strcmp(cstr + cstr_len - postfix_len, postfix) == 0;
-}
 
-int cstr_starts_with(Cstr cstr, Cstr prefix)
-{
-    const size_t cstr_len = strlen(cstr);
-    const size_t prefix_len = strlen(prefix);
-    return prefix_len <= cstr_len && strncmp(cstr, prefix, prefix_len) == 0;
-}
+////////////////////////////////////////////////////////////////////////////////
 
-Cstr_Array cstr_array_make(Cstr first, ...)
-{
-    Cstr_Array result = {0};
 
-    if (first == NULL) {
-        return result;
-    }
-    result.count += 1;
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
+#else
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#endif
 
-    va_list args;
-    va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.count += 1;
-    }
-    va_end(args);
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
 
-    result.elems = malloc(sizeof *result.elems * result.count);
-    if (result.elems == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
-    }
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
 
-    result.count = 0;
-    result.elems[result.count++] = first;
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
 
-    va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.elems[result.count++] = next;
-    }
-    va_end(args);
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
 
-    return result;
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
 }
 
-Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
+static void nobuild__stats_report(void)
 {
-    if (cstrs.capacity < 1) {
-        cstrs.elems = realloc(cstrs.elems, sizeof *cstrs.elems * (cstrs.count + 10));
-        cstrs.capacity += 10;
-        if (cstrs.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
     }
+#endif // _WIN32
 
-    cstrs.elems[cstrs.count++] = cstr;
-    cstrs.capacity--;
-    return cstrs;
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
+    }
 }
 
-
-Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
 {
-    if (cstrs.count == 0) {
-        return cstrs;
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
     }
 
-    if (cstr == NULL) {
-        cstrs.elems[--cstrs.count];
-        cstrs.capacity++;
-        return cstrs;
-    }
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
+}
 
-    // Find the index of the element to be removed
-    const size_t cstr_len = strlen(cstr);
-    for (size_t i = 0; i < cstrs.count; i++) {
-        const size_t elem_len = strlen(cstrs.elems[i]);
-        if (elem_len != cstr_len || strcmp(cstrs.elems[i], cstr) != 0) {
-            continue;
-        }
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
 
-        // Shift elements left if found the cstr
-        for (size_t j = i; j < cstrs.count - 1; j++) {
-            cstrs.elems[j] = cstrs.elems[j + 1];
-        }
-        cstrs.count--;
-        cstrs.capacity++;
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
 
-        // TODO: Might want to realloc array if capacity is too high
-        return cstrs;
-    }
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
 
-    // The string was not found
-    return cstrs;
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
 }
 
-Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
+void nobuild__stats_temp(Stats_Module module, size_t size)
 {
-    if (cstrs_a.capacity < cstrs_b.count) {
-        cstrs_a.elems = realloc(cstrs_a.elems, sizeof *cstrs_a.elems * (cstrs_a.count + cstrs_b.count));
-        cstrs_a.capacity += cstrs_b.count;
-        if (cstrs_a.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-    }
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
 
-    memcpy(cstrs_a.elems + cstrs_a.count, cstrs_b.elems, sizeof *cstrs_a.elems * cstrs_b.count);
-    cstrs_a.count += cstrs_b.count;
-    cstrs_a.capacity -= cstrs_b.count;
-    return cstrs_a;
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
 }
 
-int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
-    for (size_t i = 0; i < cstrs.count; ++i) {
-        if (strcmp(cstr, cstrs.elems[i]) == 0) {
-            return 1;
-        }
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
+}
+
+void nobuild__stats_copied(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
+
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
+}
+
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
     }
-    return 0;
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
+    }
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
+    }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
 }
 
-Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
 {
-    size_t len = strlen(cstr);
-    size_t d_len = strlen(delim);
-    size_t substr_count = 1;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
+
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
+            continue;
         }
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
+    }
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
         }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
+    }
+
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
+}
 
-        if (delim_found) {
-            substr_count++;
-            i += d_len - 1;
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+}
+
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
         }
+        return 0;
     }
+    return 1;
+}
+
+#endif // NOBUILD_STATS
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_ARENA
+
+#if defined(NOBUILD_NO_THREADS)
+#elif !defined(_WIN32)
+#	include <pthread.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+// Words of a region that is not made larger by a single big allocation
+#ifndef NOBUILD_ARENA_REGION_WORDS
+#	define NOBUILD_ARENA_REGION_WORDS (8 * 1024)
+#endif
+
+// Allocations are made in whole words, which keeps all of them suitably aligned
+typedef union {
+    void *pointer;
+    long long integer;
+    double real;
+} Nobuild__Arena_Word;
 
-    // if dlen == 0 or was never found
-    if (substr_count == 1) {
-        // TODO: differentiate between delim == null and delim == "" and delim not found
-        //       Split the string into an array of strings, where each string is a single character
-        return cstr_array_make(cstr);
+struct Arena_Region {
+    Arena_Region *next;
+    size_t count;
+    size_t capacity;
+    Nobuild__Arena_Word data[];
+};
+
+static size_t nobuild__arena_words(size_t size)
+{
+    return (size + sizeof(Nobuild__Arena_Word) - 1) / sizeof(Nobuild__Arena_Word);
+}
+
+static Arena_Region *nobuild__arena_region_new(size_t words)
+{
+    size_t capacity = words > NOBUILD_ARENA_REGION_WORDS ? words : NOBUILD_ARENA_REGION_WORDS;
+    Arena_Region *region = NOBUILD__MALLOC(sizeof(*region) + sizeof(Nobuild__Arena_Word) * capacity);
+    if (region == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
     }
 
-    Cstr_Array ret = { .count = substr_count };
-    ret.elems = malloc(sizeof(Cstr) * ret.count);
-    if (ret.elems == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    region->next = NULL;
+    region->count = 0;
+    region->capacity = capacity;
+    return region;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t words = nobuild__arena_words(size);
+    if (arena->end == NULL) {
+        arena->begin = arena->end = nobuild__arena_region_new(words);
     }
 
-    size_t substr_start = 0;
-    size_t substr_index = 0;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
+    // Regions emptied by a rewind are reused before new ones are made
+    while (arena->end->count + words > arena->end->capacity && arena->end->next != NULL) {
+        arena->end = arena->end->next;
+    }
+
+    if (arena->end->count + words > arena->end->capacity) {
+        arena->end->next = nobuild__arena_region_new(words);
+        arena->end = arena->end->next;
+    }
+
+    void *result = &arena->end->data[arena->end->count];
+    arena->end->count += words;
+    return result;
+}
+
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size)
+{
+    if (old == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+
+    size_t old_words = nobuild__arena_words(old_size);
+    size_t new_words = nobuild__arena_words(new_size);
+    Arena_Region *end = arena->end;
+    if (end != NULL && (Nobuild__Arena_Word *) old + old_words == &end->data[end->count]
+        && end->count - old_words + new_words <= end->capacity) {
+        end->count = end->count - old_words + new_words;
+        return old;
+    }
+
+    if (new_size <= old_size) {
+        return old;
+    }
+
+    void *result = arena_alloc(arena, new_size);
+    memcpy(result, old, old_size);
+    return result;
+}
+
+char *arena_strdup(Arena *arena, const char *cstr)
+{
+    size_t size = strlen(cstr) + 1;
+    return memcpy(arena_alloc(arena, size), cstr, size);
+}
+
+Arena_Mark arena_mark(Arena *arena)
+{
+    Arena_Mark mark = { .region = arena->end };
+    if (arena->end != NULL) {
+        mark.count = arena->end->count;
+    }
+    return mark;
+}
+
+void arena_rewind(Arena *arena, Arena_Mark mark)
+{
+    if (mark.region == NULL) {
+        arena_reset(arena);
+        return;
+    }
+
+    mark.region->count = mark.count;
+    for (Arena_Region *region = mark.region->next; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = mark.region;
+}
+
+void arena_reset(Arena *arena)
+{
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = arena->begin;
+}
+
+void arena_free(Arena *arena)
+{
+    Arena_Region *region = arena->begin;
+    while (region != NULL) {
+        Arena_Region *next = region->next;
+        free(region);
+        region = next;
+    }
+    arena->begin = arena->end = NULL;
+}
+
+size_t arena_used(const Arena *arena)
+{
+    size_t words = 0;
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        words += region->count;
+    }
+    return words * sizeof(Nobuild__Arena_Word);
+}
+
+// Locks for global state, which are initialized statically so that they are ready
+// before any thread exists. Multiple modules could define them, so add a guard
+// around them to prevent redefinition.
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static Arena nobuild__temp = {0};
+static Nobuild__Lock nobuild__temp_lock = NOBUILD__LOCK_INIT;
+
+// The names are in parentheses, which keeps the macros of `NOBUILD_STATS` out of them
+void *(temp_alloc)(size_t size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_alloc(&nobuild__temp, size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+void *(temp_realloc)(void *old, size_t old_size, size_t new_size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_realloc(&nobuild__temp, old, old_size, new_size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+char *(temp_strdup)(const char *cstr)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    char *result = arena_strdup(&nobuild__temp, cstr);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+Arena_Mark temp_mark(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    Arena_Mark mark = arena_mark(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return mark;
+}
+
+void temp_reset(Arena_Mark mark)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    arena_rewind(&nobuild__temp, mark);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+}
+
+size_t temp_used(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    size_t used = arena_used(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return used;
+}
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_temp(module, size);
+    return (temp_alloc)(size);
+}
+
+// Releases and shrinks are not allocations
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size)
+{
+    if (new_size > old_size) {
+        nobuild__stats_temp(module, new_size);
+    }
+    return (temp_realloc)(old, old_size, new_size);
+}
+
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr)
+{
+    nobuild__stats_temp(module, strlen(cstr) + 1);
+    return (temp_strdup)(cstr);
+}
+#endif // NOBUILD_STATS
+
+// Resizes storage with room for `*capacity` elements of which `count` are used to
+// room for exactly `n` when that is more
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    // Storage that was not allocated by nobuild has `count` elements to copy
+    const size_t old_capacity = *capacity > count ? *capacity : count;
+    elems = temp_realloc(elems, elem_size * old_capacity, elem_size * n);
+    *capacity = n;
+    return elems;
+}
+
+// Like `nobuild__da_reserve()`, but doubles the capacity until `n` elements fit
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    while (new_capacity < n) {
+        new_capacity *= 2;
+    }
+    return nobuild__da_reserve(elems, elem_size, count, capacity, new_capacity);
+}
+
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity)
+{
+    if (elems != NULL && capacity > 0 && capacity >= count) {
+        temp_realloc(elems, elem_size * capacity, 0);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CSTR
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+int cstr_ends_with(Cstr cstr, Cstr postfix)
+{
+    return sv_ends_with(sv_from_cstr(cstr), sv_from_cstr(postfix));
+}
+
+int cstr_starts_with(Cstr cstr, Cstr prefix)
+{
+    // Stops at the first difference instead of measuring `cstr`
+    for (; *prefix != '\0'; ++prefix, ++cstr) {
+        if (*cstr != *prefix) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+String_View sv_from_cstr(Cstr cstr)
+{
+    return sv_from_parts(cstr, strlen(cstr));
+}
+
+String_View sv_from_parts(const char *data, size_t count)
+{
+    String_View sv = { .data = data, .count = count };
+    return sv;
+}
+
+Cstr sv_to_cstr(String_View sv)
+{
+    char *result = temp_alloc(sv.count + 1);
+    memcpy(result, sv.data, sv.count);
+    result[sv.count] = '\0';
+    return result;
+}
+
+int sv_eq(String_View a, String_View b)
+{
+    return a.count == b.count && memcmp(a.data, b.data, a.count) == 0;
+}
+
+int sv_eq_cstr(String_View sv, Cstr cstr)
+{
+    for (size_t i = 0; i < sv.count; ++i) {
+        if (cstr[i] == '\0' || cstr[i] != sv.data[i]) {
+            return 0;
+        }
+    }
+    return cstr[sv.count] == '\0';
+}
+
+int sv_starts_with(String_View sv, String_View prefix)
+{
+    return prefix.count <= sv.count && memcmp(sv.data, prefix.data, prefix.count) == 0;
+}
+
+int sv_ends_with(String_View sv, String_View suffix)
+{
+    return suffix.count <= sv.count
+           && memcmp(sv.data + sv.count - suffix.count, suffix.data, suffix.count) == 0;
+}
+
+size_t sv_find(String_View sv, String_View needle)
+{
+    if (needle.count == 0) {
+        return 0;
+    }
+
+    // Jump between candidates for the first byte and compare the rest there
+    size_t i = 0;
+    while (needle.count <= sv.count - i) {
+        const char *first = memchr(sv.data + i, needle.data[0], sv.count - i - needle.count + 1);
+        if (first == NULL) {
             break;
         }
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
+        i = (size_t) (first - sv.data);
+        if (memcmp(first + 1, needle.data + 1, needle.count - 1) == 0) {
+            return i;
+        }
+        i += 1;
+    }
+    return sv.count;
+}
+
+size_t sv_rfind_char(String_View sv, char c)
+{
+    for (size_t i = sv.count; i-- > 0;) {
+        if (sv.data[i] == c) {
+            return i;
         }
+    }
+    return sv.count;
+}
+
+String_View sv_trim(String_View sv)
+{
+    while (sv.count > 0 && isspace((unsigned char) sv.data[0])) {
+        sv.data += 1;
+        sv.count -= 1;
+    }
+    while (sv.count > 0 && isspace((unsigned char) sv.data[sv.count - 1])) {
+        sv.count -= 1;
+    }
+    return sv;
+}
+
+String_View sv_chop_left(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
+    }
+
+    String_View result = sv_from_parts(sv->data, n);
+    sv->data += n;
+    sv->count -= n;
+    return result;
+}
+
+String_View sv_chop_right(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
+    }
+
+    sv->count -= n;
+    return sv_from_parts(sv->data + sv->count, n);
+}
+
+String_View sv_chop_by_delim(String_View *sv, char delim)
+{
+    const char *found = sv->count > 0 ? memchr(sv->data, delim, sv->count) : NULL;
+    if (found == NULL) {
+        return sv_chop_left(sv, sv->count);
+    }
+
+    String_View result = sv_chop_left(sv, (size_t) (found - sv->data));
+    sv_chop_left(sv, 1);
+    return result;
+}
+
+Cstr_Array cstr_array_make(Cstr first, ...)
+{
+    Cstr_Array result = {0};
+
+    if (first == NULL) {
+        return result;
+    }
+
+    // Counting the arguments first sizes the array exactly with a single allocation
+    size_t count = 1;
+    va_list args;
+    va_start(args, first);
+    while (va_arg(args, Cstr) != NULL) {
+        count += 1;
+    }
+    va_end(args);
+
+    da_reserve(&result, count);
+    result.elems[result.count++] = first;
+    va_start(args, first);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        result.elems[result.count++] = next;
+    }
+    va_end(args);
+
+    return result;
+}
+
+Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
+{
+    da_append(&cstrs, cstr);
+    return cstrs;
+}
 
-        if (!delim_found) {
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity)
+{
+    da_reserve(&cstrs, capacity);
+    return cstrs;
+}
+
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs)
+{
+    if (cstrs.capacity <= cstrs.count) {
+        return cstrs;
+    }
+
+    cstrs.elems = temp_realloc(cstrs.elems, sizeof *cstrs.elems * cstrs.capacity,
+                               sizeof *cstrs.elems * cstrs.count);
+    cstrs.capacity = cstrs.count;
+    return cstrs;
+}
+
+Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
+{
+    if (cstrs.count == 0) {
+        return cstrs;
+    }
+
+    if (cstr == NULL) {
+        cstrs.count--;
+        return cstrs;
+    }
+
+    return cstr_array_remove_sv(cstrs, sv_from_cstr(cstr));
+}
+
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv)
+{
+    // Find the index of the element to be removed
+    for (size_t i = 0; i < cstrs.count; i++) {
+        if (!sv_eq_cstr(sv, cstrs.elems[i])) {
             continue;
         }
 
-        size_t substr_len = i - substr_start;
-        char *substr = calloc(substr_len + 1, sizeof(unsigned char));
-        if (substr == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+        // Shift elements left if found the cstr
+        for (size_t j = i; j < cstrs.count - 1; j++) {
+            cstrs.elems[j] = cstrs.elems[j + 1];
+        }
+        cstrs.count--;
+        return cstrs;
+    }
+
+    // The string was not found
+    return cstrs;
+}
+
+Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
+{
+    if (cstrs_b.count == 0) {
+        return cstrs_a;
+    }
+
+    da_append_many(&cstrs_a, cstrs_b.elems, cstrs_b.count);
+    return cstrs_a;
+}
+
+int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (strcmp(cstr, cstrs.elems[i]) == 0) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-        i += d_len - 1;
-        substr_start = i + 1;
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (sv_eq_cstr(sv, cstrs.elems[i])) {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    // Add the last substring
-    size_t substr_len = len - substr_start;
-    char *substr = malloc(substr_len * sizeof(unsigned char));
-    if (substr == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+Split_Iter split_iter_make(String_View sv, String_View delim)
+{
+    Split_Iter it = { .rest = sv, .delim = delim };
+    return it;
+}
+
+int split_iter_next(Split_Iter *it, String_View *piece)
+{
+    if (it->done) {
+        return 0;
+    }
+
+    // `sv_find()` jumps between candidates with memchr(), which is vectorized by the libc
+    const size_t i = it->delim.count > 0 ? sv_find(it->rest, it->delim) : it->rest.count;
+    const int found = i < it->rest.count;
+    *piece = sv_chop_left(&it->rest, i);
+    if (found) {
+        sv_chop_left(&it->rest, it->delim.count);
+    } else {
+        it->done = 1;
+    }
+    return 1;
+}
+
+String_View_Array sv_split(String_View sv, String_View delim)
+{
+    String_View_Array result = {0};
+    Split_Iter it = split_iter_make(sv, delim);
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        da_append(&result, piece);
+    }
+    return result;
+}
+
+Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+{
+    const String_View sv = sv_from_cstr(cstr);
+    Split_Iter it = split_iter_make(sv, sv_from_cstr(delim));
+
+    // The pieces are null terminated in place in a copy of `cstr`
+    char *copy = NULL;
+    Cstr_Array result = {0};
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        if (it.done && result.count == 0) {
+            // `delim` was never found
+            return cstr_array_make(cstr, NULL);
+        }
+
+        if (copy == NULL) {
+            copy = temp_alloc(sv.count + 1);
+            memcpy(copy, cstr, sv.count + 1);
+        }
+
+        char *substr = copy + (piece.data - cstr);
+        substr[piece.count] = '\0';
+        result = cstr_array_append(result, substr);
     }
 
-    ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-    return ret;
+    return result;
 }
 
 Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
@@ -498,33 +1771,251 @@ Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
     }
 
     const size_t sep_len = strlen(sep);
-    size_t len = 0;
+    String_Builder sb = {0};
     for (size_t i = 0; i < cstrs.count; ++i) {
-        len += strlen(cstrs.elems[i]);
+        if (i > 0) {
+            sb_append_bytes(&sb, sep, sep_len);
+        }
+        sb_append_cstr(&sb, cstrs.elems[i]);
     }
 
-    const size_t result_len = (cstrs.count - 1) * sep_len + len + 1;
-    char *result = malloc(sizeof(char) * result_len);
-    if (result == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
+    return sb_to_cstr(&sb);
+}
+
+typedef struct {
+    Cstr cstr;
+    size_t count;
+    unsigned long long hash;
+} Nobuild__Intern_Slot;
+
+// Open addressing with linear probing, kept at most half full
+static struct {
+    Arena arena;
+    Nobuild__Intern_Slot *slots;
+    size_t count;
+    size_t capacity;
+} nobuild__intern = {0};
+static Nobuild__Lock nobuild__intern_lock = NOBUILD__LOCK_INIT;
+
+// FNV-1a
+static unsigned long long nobuild__intern_hash(String_View sv)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sv.count; ++i) {
+        hash = (hash ^ (unsigned char) sv.data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The slot that holds `sv`, or the empty slot where it belongs
+static Nobuild__Intern_Slot *nobuild__intern_probe(String_View sv, unsigned long long hash)
+{
+    const size_t mask = nobuild__intern.capacity - 1;
+    for (size_t i = (size_t) hash & mask;; i = (i + 1) & mask) {
+        Nobuild__Intern_Slot *slot = &nobuild__intern.slots[i];
+        if (slot->cstr == NULL || (slot->hash == hash && slot->count == sv.count
+                                   && memcmp(slot->cstr, sv.data, sv.count) == 0)) {
+            return slot;
+        }
+    }
+}
+
+static void nobuild__intern_grow(void)
+{
+    Nobuild__Intern_Slot *old_slots = nobuild__intern.slots;
+    const size_t old_capacity = nobuild__intern.capacity;
+
+    nobuild__intern.capacity = old_capacity > 0 ? old_capacity * 2 : 1024;
+    nobuild__intern.slots = NOBUILD__CALLOC(nobuild__intern.capacity, sizeof(*nobuild__intern.slots));
+    if (nobuild__intern.slots == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
     }
 
-    len = 0;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].cstr != NULL) {
+            String_View sv = sv_from_parts(old_slots[i].cstr, old_slots[i].count);
+            *nobuild__intern_probe(sv, old_slots[i].hash) = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+Cstr intern(Cstr cstr)
+{
+    return intern_sv(sv_from_cstr(cstr));
+}
+
+Cstr intern_sv(String_View sv)
+{
+    const unsigned long long hash = nobuild__intern_hash(sv);
+
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    if ((nobuild__intern.count + 1) * 2 > nobuild__intern.capacity) {
+        nobuild__intern_grow();
+    }
+
+    Nobuild__Intern_Slot *slot = nobuild__intern_probe(sv, hash);
+    if (slot->cstr == NULL) {
+        char *copy = arena_alloc(&nobuild__intern.arena, sv.count + 1);
+        memcpy(copy, sv.data, sv.count);
+        copy[sv.count] = '\0';
+
+        slot->cstr = copy;
+        slot->count = sv.count;
+        slot->hash = hash;
+        nobuild__intern.count += 1;
+    }
+    Cstr result = slot->cstr;
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
+
+    return result;
+}
+
+Cstr intern_find(String_View sv)
+{
+    const unsigned long long hash = nobuild__intern_hash(sv);
+
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    Cstr result = NULL;
+    if (nobuild__intern.capacity > 0) {
+        result = nobuild__intern_probe(sv, hash)->cstr;
+    }
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
+
+    return result;
+}
+
+Cstr_Array cstr_array_intern(Cstr_Array cstrs)
+{
     for (size_t i = 0; i < cstrs.count; ++i) {
-        if (i > 0) {
-            memcpy(result + len, sep, sep_len);
-            len += sep_len;
+        cstrs.elems[i] = intern(cstrs.elems[i]);
+    }
+    return cstrs;
+}
+
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        size_t elem_len = strlen(cstrs.elems[i]);
-        memcpy(result + len, cstrs.elems[i], elem_len);
-        len += elem_len;
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            memmove(cstrs.elems + i, cstrs.elems + i + 1, sizeof(*cstrs.elems) * (cstrs.count - i - 1));
+            cstrs.count--;
+            break;
+        }
     }
-    result[len] = '\0';
+    return cstrs;
+}
 
+Cstr cstr_join(Cstr sep, Cstr first, ...)
+{
+    if (first == NULL) {
+        return "";
+    }
+
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
+    sb_append_cstr(&sb, first);
+
+    va_list args;
+    va_start(args, first);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        sb_append_bytes(&sb, sep, sep_len);
+        sb_append_cstr(&sb, next);
+    }
+    va_end(args);
+
+    return sb_to_cstr(&sb);
+}
+
+static char *nobuild__sb_realloc(String_Builder *sb, size_t capacity)
+{
+    if (sb->arena != NULL) {
+        return arena_realloc(sb->arena, sb->elems, sb->capacity, capacity);
+    }
+    return temp_realloc(sb->elems, sb->capacity, capacity);
+}
+
+void sb_reserve(String_Builder *sb, size_t size)
+{
+    const size_t needed = sb->count + size + 1;
+    if (needed <= sb->capacity) {
+        return;
+    }
+
+    size_t capacity = sb->capacity > 0 ? sb->capacity : 64;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    sb->elems = nobuild__sb_realloc(sb, capacity);
+    sb->capacity = capacity;
+}
+
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size)
+{
+    sb_reserve(sb, size);
+    memcpy(sb->elems + sb->count, bytes, size);
+    sb->count += size;
+}
+
+void sb_append_cstr(String_Builder *sb, Cstr cstr)
+{
+    sb_append_bytes(sb, cstr, strlen(cstr));
+}
+
+void sb_append_sv(String_Builder *sb, String_View sv)
+{
+    sb_append_bytes(sb, sv.data, sv.count);
+}
+
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...)
+{
+    sb_reserve(sb, 0);
+
+    // Try formatting into the capacity that is left first, and again once the size is known
+    const size_t available = sb->capacity - sb->count;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(sb->elems + sb->count, available, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        PANIC("Could not format string %s: %s", fmt, nobuild__strerror(errno));
+    }
+
+    if ((size_t) n >= available) {
+        sb_reserve(sb, (size_t) n);
+        va_start(args, fmt);
+        vsnprintf(sb->elems + sb->count, (size_t) n + 1, fmt, args);
+        va_end(args);
+    }
+    sb->count += (size_t) n;
+}
+
+Cstr sb_to_cstr(String_Builder *sb)
+{
+    sb_reserve(sb, 0);
+    sb->elems[sb->count] = '\0';
+    char *result = nobuild__sb_realloc(sb, sb->count + 1);
+
+    String_Builder empty = { .arena = sb->arena };
+    *sb = empty;
     return result;
 }
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -556,7 +2047,11 @@ typedef struct {
     Fd write;
 } Pipe;
 
+// Both ends are closed on exec, so only the children they are handed to keep them open
 Pipe pipe_make(void);
+// Asks for a pipe capacity of at least `size` bytes and returns the capacity the
+// pipe ended up with, or 0 where it cannot be changed
+size_t pipe_set_size(Pipe pip, size_t size);
 
 Fd fd_open_for_read(const char *path);
 Fd fd_open_for_write(const char *path);
@@ -564,9 +2059,77 @@ size_t fd_read(Fd fd, void *buf, unsigned long count);
 size_t fd_write(Fd fd, void *buf, unsigned long count);
 int fd_printf(Fd fd, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
 void fd_close(Fd fd);
+// Moves everything from `in` to `out` until the end of `in`, or until `out` is a
+// pipe without readers. Uses splice(2) when either side is a pipe on Linux.
+unsigned long long fd_pump(Fd in, Fd out);
+// Copies everything from `in` to both `out1` and `out2`, with tee(2) when `in` is
+// a pipe on Linux. An output without readers is dropped and the other one is kept.
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2);
+
+// The whole contents of a file, see `file_map()`
+typedef struct {
+    const char *data;
+    size_t size;
+    // Whether `data` is a memory mapping rather than a copy in a buffer
+    int mapped;
+} File_View;
+
+// Makes the whole file at `path` readable through `view`. Files of 64 KiB or more
+// are memory mapped for sequential access, smaller ones are read in a single read
+// into a null terminated buffer. Returns 0, or the errno of what failed.
+int file_map(const char *path, File_View *view);
+void file_unmap(File_View view);
+
+// An output that is written to `<path>.tmp.<pid>` and only renamed over `path` once
+// it is complete, so an interrupted build never leaves a truncated `path` with a
+// fresh modification time behind
+typedef struct {
+    Fd fd;
+    const char *path;
+    char *tmp_path;
+} Atomic_File;
+
+Atomic_File atomic_file_open(const char *path);
+// Closes the file and renames it over its path
+void atomic_file_commit(Atomic_File *file);
+// Closes and removes the file, leaving its path as it was
+void atomic_file_abort(Atomic_File *file);
+// Commits are not flushed to disk, which only matters if the whole system goes down.
+// With sync enabled every commit is remembered until `atomic_file_sync()` flushes
+// them and their directories at once, which also happens when the program exits.
+// Temporary files that were neither committed nor aborted are removed at exit, so a
+// PANIC in the middle of a step leaves none behind.
+void atomic_file_set_sync(int enabled);
+void atomic_file_sync(void);
 
 void pid_wait(Pid pid);
 
+// Define `NOBUILD_NO_THREADS` to build without a thread library. Threads then run
+// to completion inside `thread_create()` and mutexes do nothing.
+#if defined(NOBUILD_NO_THREADS)
+typedef int Thread;
+typedef int Mutex;
+#elif !defined(_WIN32)
+#    include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#else
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+#endif
+
+typedef void (*Thread_Fn)(void *data);
+
+Thread thread_create(Thread_Fn fn, void *data);
+void thread_join(Thread thread);
+// Number of online processors, at least 1
+size_t thread_count(void);
+
+void mutex_init(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -576,14 +2139,31 @@ void pid_wait(Pid pid);
 #	include <sys/stat.h>
 #	include <unistd.h>
 #	include <fcntl.h>
+#	include <sys/mman.h>
 
 // Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
 char *strsignal(int sig);
+// Hidden along with the rest of the BSD extensions
+int madvise(void *addr, size_t length, int advice);
+#	ifndef MADV_SEQUENTIAL
+#		define MADV_SEQUENTIAL 2
+#	endif
+
+#	ifdef __linux__
+#		include <sys/syscall.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+#		define NOBUILD__F_SETPIPE_SZ 1031
+#		define NOBUILD__F_GETPIPE_SZ 1032
+#		define NOBUILD__SPLICE_F_MOVE 1
+#		define NOBUILD__SPLICE_F_MORE 4
+#	endif // __linux__
 #else
 #	include <assert.h>
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
@@ -592,6 +2172,13 @@ char *strsignal(int sig);
 ////////////////////////////////////////////////////////////////////////////////
 
 
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_IO
+
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
 #define NOBUILD__GETLASTERROR
@@ -629,6 +2216,9 @@ Pipe pipe_make(void)
 
     pip.read = pipefd[0];
     pip.write = pipefd[1];
+    if (fcntl(pip.read, F_SETFD, FD_CLOEXEC) < 0 || fcntl(pip.write, F_SETFD, FD_CLOEXEC) < 0) {
+        PANIC("Could not set close-on-exec on pipe: %s", strerror(errno));
+    }
 #else
     // https://docs.microsoft.com/en-us/windows/win32/ProcThread/creating-a-child-process-with-redirected-input-and-output
 
@@ -647,7 +2237,7 @@ Pipe pipe_make(void)
 Fd fd_open_for_read(const char *path)
 {
 #ifndef _WIN32
-    Fd result = open(path, O_RDONLY);
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
     if (result < 0) {
         PANIC("Could not open file %s: %s", path, strerror(errno));
     }
@@ -658,14 +2248,14 @@ Fd fd_open_for_read(const char *path)
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
                     path,
                     GENERIC_READ,
                     0,
                     &saAttr,
                     OPEN_EXISTING,
                     FILE_ATTRIBUTE_READONLY,
-                    NULL);
+                    NULL));
 
     if (result == INVALID_HANDLE_VALUE) {
         PANIC("Could not open file %s", path);
@@ -678,9 +2268,9 @@ Fd fd_open_for_read(const char *path)
 Fd fd_open_for_write(const char *path)
 {
 #ifndef _WIN32
-    Fd result = open(path,
-                     O_WRONLY | O_CREAT | O_TRUNC,
-                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path,
+                                                     O_WRONLY | O_CREAT | O_TRUNC,
+                                                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
     if (result < 0) {
         PANIC("Could not open file %s: %s", path, strerror(errno));
     }
@@ -690,7 +2280,7 @@ Fd fd_open_for_write(const char *path)
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
                     path,                  // name of the write
                     GENERIC_WRITE,         // open for writing
                     0,                     // do not share
@@ -698,7 +2288,7 @@ Fd fd_open_for_write(const char *path)
                     CREATE_ALWAYS,         // Same as `O_CREAT | O_TRUNC`
                     FILE_ATTRIBUTE_NORMAL, // normal file
                     NULL                   // no attr. template
-                );
+                ));
 
     if (result == INVALID_HANDLE_VALUE) {
         PANIC("Could not open file %s: %s", path, nobuild__GetLastErrorAsString());
@@ -711,14 +2301,14 @@ Fd fd_open_for_write(const char *path)
 size_t fd_read(Fd fd, void *buf, unsigned long count)
 {
 #ifndef _WIN32
-    ssize_t bytes = read(fd, buf, count);
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_READ, read(fd, buf, count));
     if (bytes == -1) {
         ERRO("Read error: %s", strerror(errno));
         return 0;
     }
 #else
     DWORD bytes;
-    if (!ReadFile(fd, buf, count, &bytes, NULL)) {
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buf, count, &bytes, NULL))) {
         ERRO("Read error: %s", nobuild__GetLastErrorAsString());
         return 0;
     }
@@ -730,14 +2320,14 @@ size_t fd_read(Fd fd, void *buf, unsigned long count)
 size_t fd_write(Fd fd, void *buf, unsigned long count)
 {
 #ifndef _WIN32
-    ssize_t bytes = read(fd, buf, (size_t) count);
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buf, (size_t) count));
     if (bytes == -1) {
         ERRO("Write error: %s", strerror(errno));
         return 0;
     }
 #else
     DWORD bytes;
-    if (!WriteFile(fd, buf, count, &bytes, NULL)) {
+    if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buf, count, &bytes, NULL))) {
         ERRO("Write error: %s", nobuild__GetLastErrorAsString());
         return 0;
     }
@@ -760,7 +2350,7 @@ int fd_printf(Fd fd, const char *fmt, ...) {
 #ifndef _WIN32
      char buffer[len + 1];
 #else
-     char *buffer = malloc(sizeof *buffer * (len + 1));
+     char *buffer = NOBUILD__MALLOC(sizeof *buffer * (len + 1));
 #endif
 
     va_start(args, fmt);
@@ -788,12 +2378,671 @@ void fd_close(Fd fd)
 #endif // _WIN32
 }
 
+size_t pipe_set_size(Pipe pip, size_t size)
+{
+#ifdef __linux__
+    if (fcntl(pip.write, NOBUILD__F_SETPIPE_SZ, (int) size) < 0) {
+        // Above /proc/sys/fs/pipe-max-size without CAP_SYS_RESOURCE
+        WARN("Could not set pipe size to %zu bytes: %s", size, strerror(errno));
+        errno = 0;
+    }
+
+    int result = fcntl(pip.write, NOBUILD__F_GETPIPE_SZ);
+    return result > 0 ? (size_t) result : 0;
+#else
+    (void) pip;
+    (void) size;
+    return 0;
+#endif // __linux__
+}
+
+#define NOBUILD__PUMP_SIZE (1024 * 1024)
+
+// Returns 0 when `fd` is a pipe that nobody reads anymore
+static int nobuild__fd_write_all(Fd fd, const char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (size_t written = 0; written < count;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buffer + written, count - written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return 0;
+            }
+            PANIC("Could not write to file descriptor: %s", strerror(errno));
+        }
+        written += (size_t) n;
+    }
+#else
+    for (size_t written = 0; written < count;) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buffer + written, (DWORD) (count - written), &n, NULL))) {
+            if (GetLastError() == ERROR_NO_DATA || GetLastError() == ERROR_BROKEN_PIPE) {
+                return 0;
+            }
+            PANIC("Could not write to file: %s", nobuild__GetLastErrorAsString());
+        }
+        written += n;
+    }
+#endif // _WIN32
+
+    return 1;
+}
+
+// Returns 0 at the end of `fd`
+static size_t nobuild__fd_read_some(Fd fd, char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (;;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer, count));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PANIC("Could not read from file descriptor: %s", strerror(errno));
+        }
+        return (size_t) n;
+    }
+#else
+    DWORD n = 0;
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buffer, (DWORD) count, &n, NULL))) {
+        if (GetLastError() == ERROR_BROKEN_PIPE) {
+            return 0;
+        }
+        PANIC("Could not read from file: %s", nobuild__GetLastErrorAsString());
+    }
+    return n;
+#endif // _WIN32
+}
+
+#ifdef __linux__
+// Moves exactly `count` bytes from the pipe `in` to `out`. Returns 0 when `out`
+// has no readers, after dropping what is left of the `count` bytes from `in`.
+static int nobuild__fd_splice_exactly(Fd in, Fd out, size_t count)
+{
+    while (count > 0) {
+        long n = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, count, NOBUILD__SPLICE_F_MOVE));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EPIPE) {
+                PANIC("Could not splice between file descriptors: %s", strerror(errno));
+            }
+
+            errno = 0;
+            char buffer[4096];
+            while (count > 0) {
+                size_t dropped = nobuild__fd_read_some(in, buffer, count < sizeof(buffer) ? count : sizeof(buffer));
+                if (dropped == 0) {
+                    break;
+                }
+                count -= dropped;
+            }
+            return 0;
+        }
+        count -= (size_t) n;
+    }
+
+    return 1;
+}
+#endif // __linux__
+
+unsigned long long fd_pump(Fd in, Fd out)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, (size_t) NOBUILD__PUMP_SIZE,
+                                                              NOBUILD__SPLICE_F_MOVE | NOBUILD__SPLICE_F_MORE));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total;
+            }
+
+            // Neither side is a pipe, or the file does not support splicing
+            break;
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    for (;;) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0 || !nobuild__fd_write_all(out, buffer, bytes)) {
+            break;
+        }
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        // Duplicate what is buffered in `in` into `out1` without consuming it, then
+        // move the same bytes into `out2`
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_tee, in, out1, (size_t) NOBUILD__PUMP_SIZE, 0u));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total + fd_pump(in, out2);
+            }
+
+            // `in` or `out1` is not a pipe
+            break;
+        }
+
+        if (!nobuild__fd_splice_exactly(in, out2, (size_t) bytes)) {
+            return total + (unsigned long long) bytes + fd_pump(in, out1);
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    int alive1 = 1;
+    int alive2 = 1;
+    while (alive1 || alive2) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0) {
+            break;
+        }
+
+        alive1 = alive1 && nobuild__fd_write_all(out1, buffer, bytes);
+        alive2 = alive2 && nobuild__fd_write_all(out2, buffer, bytes);
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+// Mapping costs a few page faults and a TLB shootdown on unmap, which is more
+// than copying a small file
+#define NOBUILD__MAP_THRESHOLD (64 * 1024)
+
+#ifdef _WIN32
+static int nobuild__errno_from_win32(DWORD error)
+{
+    switch (error) {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+        return ENOENT;
+    case ERROR_ACCESS_DENIED:
+        return EACCES;
+    case ERROR_NOT_ENOUGH_MEMORY:
+        return ENOMEM;
+    default:
+        return EIO;
+    }
+}
+#endif // _WIN32
+
+int file_map(const char *path, File_View *view)
+{
+    view->data = NULL;
+    view->size = 0;
+    view->mapped = 0;
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        int error = errno;
+        errno = 0;
+        return error;
+    }
+
+    struct stat statbuf;
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0) {
+        int error = errno;
+        errno = 0;
+        close(fd);
+        return error;
+    }
+
+    if (S_ISDIR(statbuf.st_mode)) {
+        close(fd);
+        return EISDIR;
+    }
+
+    const size_t size = (size_t) statbuf.st_size;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            close(fd);
+            view->data = data;
+            view->size = size;
+            view->mapped = 1;
+            return 0;
+        }
+
+        // Some filesystems cannot map files, read those instead
+        errno = 0;
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        close(fd);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer + count, size - count));
+        if (n < 0 && errno == EINTR) {
+            errno = 0;
+            continue;
+        }
+
+        if (n < 0) {
+            int error = errno;
+            errno = 0;
+            free(buffer);
+            close(fd);
+            return error;
+        }
+
+        // The file shrank since fstat()
+        if (n == 0) {
+            break;
+        }
+        count += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                                                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        return nobuild__errno_from_win32(GetLastError());
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        int error = nobuild__errno_from_win32(GetLastError());
+        CloseHandle(file);
+        return error;
+    }
+
+    const size_t size = (size_t) file_size.QuadPart;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            // The view keeps the file alive on its own
+            void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (data != NULL) {
+                CloseHandle(file);
+                view->data = data;
+                view->size = size;
+                view->mapped = 1;
+                return 0;
+            }
+        }
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        CloseHandle(file);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, buffer + count, (DWORD) (size - count), &n, NULL))) {
+            int error = nobuild__errno_from_win32(GetLastError());
+            free(buffer);
+            CloseHandle(file);
+            return error;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        count += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    buffer[count] = '\0';
+    view->data = buffer;
+    view->size = count;
+    return 0;
+}
+
+void file_unmap(File_View view)
+{
+    if (!view.mapped) {
+        free((char *) view.data);
+        return;
+    }
+
+#ifndef _WIN32
+    munmap((void *) view.data, view.size);
+#else
+    UnmapViewOfFile(view.data);
+#endif // _WIN32
+}
+
+// Multiple modules could define these locks, so add a guard around them to prevent redefinition
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static struct {
+    Nobuild__Lock lock;
+    // Whether the exit handler was registered, by the process with `pid`
+    int registered;
+    unsigned long pid;
+    int sync;
+    // Committed since the last `atomic_file_sync()`
+    char **paths;
+    size_t count;
+    size_t capacity;
+    // Temporary files that were neither renamed nor removed yet
+    const char **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} nobuild__atomic = { .lock = NOBUILD__LOCK_INIT };
+
+static unsigned long nobuild__getpid(void)
+{
+#ifndef _WIN32
+    return (unsigned long) getpid();
+#else
+    return (unsigned long) GetCurrentProcessId();
+#endif // _WIN32
+}
+
+// Removes the temporary files that a failed build left behind, PANIC included, and
+// flushes the commits when sync is enabled
+static void nobuild__atomic_exit(void)
+{
+    // Forked children exit through here too, but the files belong to the parent
+    if (nobuild__getpid() != nobuild__atomic.pid) {
+        return;
+    }
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = 0; i < nobuild__atomic.pending_count; ++i) {
+        remove(nobuild__atomic.pending[i]);
+    }
+    nobuild__atomic.pending_count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+
+    atomic_file_sync();
+}
+
+// Must be called with the lock held
+static void nobuild__atomic_register(void)
+{
+    if (!nobuild__atomic.registered) {
+        nobuild__atomic.registered = 1;
+        nobuild__atomic.pid = nobuild__getpid();
+        atexit(nobuild__atomic_exit);
+    }
+}
+
+// Has `tmp_path` removed at exit unless it is forgotten before. The path is not copied.
+static void nobuild__atomic_pending_add(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    nobuild__atomic_register();
+    if (nobuild__atomic.pending_count >= nobuild__atomic.pending_capacity) {
+        nobuild__atomic.pending_capacity = nobuild__atomic.pending_capacity ? nobuild__atomic.pending_capacity * 2 : 16;
+        nobuild__atomic.pending = NOBUILD__REALLOC(nobuild__atomic.pending,
+                                                   sizeof(*nobuild__atomic.pending) * nobuild__atomic.pending_capacity);
+        if (nobuild__atomic.pending == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.pending[nobuild__atomic.pending_count++] = tmp_path;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static void nobuild__atomic_pending_remove(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = nobuild__atomic.pending_count; i-- > 0;) {
+        if (nobuild__atomic.pending[i] == tmp_path) {
+            nobuild__atomic.pending[i] = nobuild__atomic.pending[--nobuild__atomic.pending_count];
+            break;
+        }
+    }
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static int nobuild__atomic_sync_enabled(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    int enabled = nobuild__atomic.sync;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+    return enabled;
+}
+
+static char *nobuild__atomic_tmp_path(const char *path)
+{
+    unsigned long pid = nobuild__getpid();
+    size_t size = strlen(path) + 32;
+    char *tmp_path = NOBUILD__MALLOC(size);
+    if (tmp_path == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    snprintf(tmp_path, size, "%s.tmp.%lu", path, pid);
+    return tmp_path;
+}
+
+// Remembers `path` for `atomic_file_sync()` when sync is enabled
+static void nobuild__atomic_sync_push(const char *path)
+{
+    if (!nobuild__atomic_sync_enabled()) {
+        return;
+    }
+
+    size_t size = strlen(path) + 1;
+    char *copy = NOBUILD__MALLOC(size);
+    if (copy == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    memcpy(copy, path, size);
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (nobuild__atomic.count >= nobuild__atomic.capacity) {
+        nobuild__atomic.capacity = nobuild__atomic.capacity ? nobuild__atomic.capacity * 2 : 64;
+        nobuild__atomic.paths = NOBUILD__REALLOC(nobuild__atomic.paths,
+                                                 sizeof(*nobuild__atomic.paths) * nobuild__atomic.capacity);
+        if (nobuild__atomic.paths == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.paths[nobuild__atomic.count++] = copy;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+// Moves the temporary file of `file` over its path, once whoever wrote it has closed it
+static void nobuild__atomic_file_rename(Atomic_File *file)
+{
+#ifndef _WIN32
+    if (rename(file->tmp_path, file->path) < 0) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, strerror(errno));
+    }
+#else
+    if (!MoveFileExA(file->tmp_path, file->path, MOVEFILE_REPLACE_EXISTING)) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    nobuild__atomic_pending_remove(file->tmp_path);
+    nobuild__atomic_sync_push(file->path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+Atomic_File atomic_file_open(const char *path)
+{
+    Atomic_File file = {0};
+    file.path = path;
+    file.tmp_path = nobuild__atomic_tmp_path(path);
+    nobuild__atomic_pending_add(file.tmp_path);
+    file.fd = fd_open_for_write(file.tmp_path);
+    return file;
+}
+
+void atomic_file_commit(Atomic_File *file)
+{
+    fd_close(file->fd);
+    nobuild__atomic_file_rename(file);
+}
+
+void atomic_file_abort(Atomic_File *file)
+{
+    fd_close(file->fd);
+    remove(file->tmp_path);
+    nobuild__atomic_pending_remove(file->tmp_path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+void atomic_file_set_sync(int enabled)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (enabled) {
+        nobuild__atomic_register();
+    }
+    nobuild__atomic.sync = enabled;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+#ifndef _WIN32
+static void nobuild__fsync_path(const char *path)
+{
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        WARN("Could not open %s to flush it: %s", path, strerror(errno));
+        errno = 0;
+        return;
+    }
+
+    if (fsync(fd) < 0) {
+        WARN("Could not flush %s: %s", path, strerror(errno));
+        errno = 0;
+    }
+    close(fd);
+}
+#endif // _WIN32
+
+void atomic_file_sync(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (!nobuild__atomic.sync) {
+        NOBUILD__UNLOCK(&nobuild__atomic.lock);
+        return;
+    }
+
+#ifndef _WIN32
+    const char *last_dir = NULL;
+    size_t last_dir_len = 0;
+#endif // _WIN32
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        char *path = nobuild__atomic.paths[i];
+#ifndef _WIN32
+        nobuild__fsync_path(path);
+
+        // The renames live in the directories, flush each of them once in a row
+        char *sep = strrchr(path, '/');
+        size_t dir_len = sep ? (size_t) (sep - path) : 0;
+        if (last_dir == NULL || dir_len != last_dir_len || memcmp(last_dir, path, dir_len) != 0) {
+            if (dir_len == 0) {
+                nobuild__fsync_path(sep ? "/" : ".");
+            } else {
+                *sep = '\0';
+                nobuild__fsync_path(path);
+                *sep = '/';
+            }
+            last_dir = path;
+            last_dir_len = dir_len;
+        }
+#else
+        HANDLE handle = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+        if (handle == INVALID_HANDLE_VALUE || !FlushFileBuffers(handle)) {
+            WARN("Could not flush %s: %s", path, nobuild__GetLastErrorAsString());
+        }
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#endif // _WIN32
+    }
+
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        free(nobuild__atomic.paths[i]);
+    }
+    nobuild__atomic.count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
 void pid_wait(Pid pid)
 {
 #ifndef _WIN32
     for (;;) {
         int wstatus = 0;
-        if (waitpid(pid, &wstatus, 0) < 0) {
+        if (NOBUILD__STATS_CALL(STATS_WAITPID, waitpid(pid, &wstatus, 0)) < 0) {
             PANIC("Could not wait on command (pid %d): %s", pid, strerror(errno));
         }
 
@@ -811,10 +3060,10 @@ void pid_wait(Pid pid)
         }
     }
 #else
-    DWORD result = WaitForSingleObject(
+    DWORD result = (DWORD) NOBUILD__STATS_CALL(STATS_WAITPID, WaitForSingleObject(
                        pid,     // HANDLE hHandle,
                        INFINITE // DWORD  dwMilliseconds
-                   );
+                   ));
 
     if (result == WAIT_FAILED) {
         PANIC("Could not wait on child process: %s", nobuild__GetLastErrorAsString());
@@ -833,6 +3082,145 @@ void pid_wait(Pid pid)
 #endif // _WIN32
 }
 
+typedef struct {
+    Thread_Fn fn;
+    void *data;
+} Nobuild__Thread_Start;
+
+#if !defined(NOBUILD_NO_THREADS) && !defined(_WIN32)
+static void *nobuild__thread_start(void *arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return NULL;
+}
+#elif !defined(NOBUILD_NO_THREADS)
+static DWORD WINAPI nobuild__thread_start(LPVOID arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return 0;
+}
+#endif
+
+Thread thread_create(Thread_Fn fn, void *data)
+{
+#ifdef NOBUILD_NO_THREADS
+    fn(data);
+    return 0;
+#else
+    Nobuild__Thread_Start *start = NOBUILD__MALLOC(sizeof(*start));
+    if (start == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    start->fn = fn;
+    start->data = data;
+
+#	ifndef _WIN32
+    Thread thread;
+    int error = pthread_create(&thread, NULL, nobuild__thread_start, start);
+    if (error != 0) {
+        PANIC("Could not create thread: %s", strerror(error));
+    }
+#	else
+    Thread thread = CreateThread(NULL, 0, nobuild__thread_start, start, 0, NULL);
+    if (thread == NULL) {
+        PANIC("Could not create thread: %s", nobuild__GetLastErrorAsString());
+    }
+#	endif // _WIN32
+
+    return thread;
+#endif // NOBUILD_NO_THREADS
+}
+
+void thread_join(Thread thread)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) thread;
+#elif !defined(_WIN32)
+    int error = pthread_join(thread, NULL);
+    if (error != 0) {
+        PANIC("Could not join thread: %s", strerror(error));
+    }
+#else
+    if (WaitForSingleObject(thread, INFINITE) == WAIT_FAILED) {
+        PANIC("Could not join thread: %s", nobuild__GetLastErrorAsString());
+    }
+    CloseHandle(thread);
+#endif
+}
+
+size_t thread_count(void)
+{
+#ifndef _WIN32
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+#endif // _WIN32
+}
+
+void mutex_init(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    *mutex = 0;
+#elif !defined(_WIN32)
+    int error = pthread_mutex_init(mutex, NULL);
+    if (error != 0) {
+        PANIC("Could not create mutex: %s", strerror(error));
+    }
+#else
+    InitializeCriticalSection(mutex);
+#endif
+}
+
+void mutex_lock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_lock(mutex);
+#else
+    EnterCriticalSection(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_unlock(mutex);
+#else
+    LeaveCriticalSection(mutex);
+#endif
+}
+
+void mutex_destroy(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_destroy(mutex);
+#else
+    DeleteCriticalSection(mutex);
+#endif
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CMD
 
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #ifndef NOBUILD__STRERROR
@@ -840,7 +3228,7 @@ void pid_wait(Pid pid)
 Cstr nobuild__strerror(int errnum)
 {
 #ifndef _WIN32
-    return nobuild__strerror(errnum);
+    return strerror(errnum);
 #else
     static char buffer[1024];
     strerror_s(buffer, 1024, errnum);
@@ -884,21 +3272,29 @@ Cstr cmd_show(Cmd cmd)
 }
 
 Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
+{
+    return cmd_run_async_ex(cmd, fdin, fdout, NULL);
+}
+
+Pid cmd_run_async_ex(Cmd cmd, Fd *fdin, Fd *fdout, Fd *fderr)
 {
 #ifndef _WIN32
-    pid_t cpid = fork();
+#ifdef NOBUILD_STATS
+    // Both ends are closed on exec, which is what reading from it waits for
+    Pipe exec_pipe = pipe_make();
+#endif // NOBUILD_STATS
+
+    pid_t cpid = NOBUILD__STATS_CALL(STATS_FORK, fork());
     if (cpid < 0) {
         PANIC("Could not fork child process: %s: %s",
               cmd_show(cmd), nobuild__strerror(errno));
     }
 
     if (cpid == 0) {
-        Cstr_Array args = {
-            .count = cmd.line.count
-        };
-        args.elems = malloc(sizeof(Cstr) * args.count+1);
-        memcpy(args.elems, cmd.line.elems, args.count * sizeof(Cstr));
-        args.elems[args.count++] = NULL;
+        // The child is about to exec, so the terminated copy of the line can live on its stack
+        Cstr argv[cmd.line.count + 1];
+        memcpy(argv, cmd.line.elems, sizeof(Cstr) * cmd.line.count);
+        argv[cmd.line.count] = NULL;
 
         if (fdin) {
             if (dup2(*fdin, STDIN_FILENO) < 0) {
@@ -912,12 +3308,28 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
             }
         }
 
-        if (execvp(args.elems[0], (char * const*) args.elems) < 0) {
+        if (fderr) {
+            if (dup2(*fderr, STDERR_FILENO) < 0) {
+                PANIC("Could not setup stderr for child process: %s", nobuild__strerror(errno));
+            }
+        }
+
+        // The parent ignores SIGPIPE while pumping a chain, and ignored signals survive exec
+        signal(SIGPIPE, SIG_DFL);
+
+        if (execvp(argv[0], (char * const*) argv) < 0) {
             PANIC("Could not exec child process: %s: %s",
                   cmd_show(cmd), nobuild__strerror(errno));
         }
     }
 
+#ifdef NOBUILD_STATS
+    fd_close(exec_pipe.write);
+    char byte;
+    (void) NOBUILD__STATS_CALL(STATS_EXEC, read(exec_pipe.read, &byte, 1));
+    fd_close(exec_pipe.read);
+#endif // NOBUILD_STATS
+
     return cpid;
 #else
     // https://docs.microsoft.com/en-us/windows/win32/procthread/creating-a-child-process-with-redirected-input-and-output
@@ -927,7 +3339,7 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
     siStartInfo.cb = sizeof(STARTUPINFO);
     // NOTE: theoretically setting NULL to std handles should not be a problem
     // https://docs.microsoft.com/en-us/windows/console/getstdhandle?redirectedfrom=MSDN#attachdetach-behavior
-    siStartInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    siStartInfo.hStdError = fderr ? *fderr : GetStdHandle(STD_ERROR_HANDLE);
     // TODO(#32): check for errors in GetStdHandle
     siStartInfo.hStdOutput = fdout ? *fdout : GetStdHandle(STD_OUTPUT_HANDLE);
     siStartInfo.hStdInput = fdin ? *fdin : GetStdHandle(STD_INPUT_HANDLE);
@@ -937,7 +3349,7 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
     ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
 
     BOOL bSuccess =
-        CreateProcess(
+        NOBUILD__STATS_CALL(STATS_FORK, CreateProcess(
             NULL,
             // TODO(#33): cmd_run_async on Windows does not render command line properly
             // It may require wrapping some arguments with double-quotes if they contains spaces, etc.
@@ -950,7 +3362,7 @@ Pid cmd_run_async(Cmd cmd, Fd *fdin, Fd *fdout)
             NULL,
             &siStartInfo,
             &piProcInfo
-        );
+        ));
 
     if (!bSuccess) {
         PANIC("Could not create child process %s: %s\n",
@@ -968,11 +3380,25 @@ void cmd_run_sync(Cmd cmd)
     pid_wait(cmd_run_async(cmd, NULL, NULL));
 }
 
-static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token token)
+static void chain_push_token(Chain *chain, Chain_Token token)
 {
     switch (token.type) {
     case CHAIN_TOKEN_CMD: {
-        chain->cmds.count += 1;
+        da_append(&chain->cmds, ((Cmd) {
+            .line = token.args
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_FN: {
+        da_append(&chain->fns, ((Chain_Fn_Stage) {
+            .position = chain->cmds.count,
+            .fn = token.fn,
+            .data = token.data
+        }));
+        da_append(&chain->cmds, ((Cmd) {
+            .line = token.args
+        }));
     }
     break;
 
@@ -994,6 +3420,50 @@ static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token
     }
     break;
 
+    case CHAIN_TOKEN_ERR: {
+        if (chain->error_filepath) {
+            PANIC("Error file path was already set to %s", chain->error_filepath);
+        }
+
+        chain->error_filepath = token.args.elems[0];
+    }
+    break;
+
+    case CHAIN_TOKEN_MERGE_ERR: {
+        if (chain->cmds.count == 0) {
+            PANIC("CHAIN_MERGE_ERR has to follow a CHAIN_CMD, but comes before stage %zu", chain->cmds.count);
+        }
+
+        const size_t position = chain->cmds.count - 1;
+        if (chain->fns.count > 0 && chain->fns.elems[chain->fns.count - 1].position == position) {
+            PANIC("CHAIN_MERGE_ERR has to follow a CHAIN_CMD, not CHAIN_FN(%s)", chain->cmds.elems[position].line.elems[0]);
+        }
+        da_append(&chain->merged_err, position);
+    }
+    break;
+
+    case CHAIN_TOKEN_TEE: {
+        if (token.chain->input_filepath) {
+            PANIC("A CHAIN_TEE branch reads the stream of its chain and cannot have an input file %s",
+                  token.chain->input_filepath);
+        }
+
+        da_append(&chain->tees, ((Chain_Tee) {
+            .position = chain->cmds.count,
+            .chain = token.chain
+        }));
+    }
+    break;
+
+    case CHAIN_TOKEN_PIPE_SIZE: {
+        if (chain->pipe_size) {
+            PANIC("Pipe size was already set to %zu", chain->pipe_size);
+        }
+
+        chain->pipe_size = token.size;
+    }
+    break;
+
     case CHAIN_TOKEN_END:
     default: {
         assert(0 && "unreachable");
@@ -1002,122 +3472,470 @@ static void chain_set_input_output_files_or_count_cmds(Chain *chain, Chain_Token
     }
 }
 
-static void chain_push_cmd(Chain *chain, Chain_Token token)
-{
-    if (token.type == CHAIN_TOKEN_CMD) {
-        chain->cmds.elems[chain->cmds.count++] = (Cmd) {
-            .line = token.args
-        };
-    }
-}
-
 Chain chain_build_from_tokens(Chain_Token first, ...)
 {
     Chain result = {0};
 
-    chain_set_input_output_files_or_count_cmds(&result, first);
+    chain_push_token(&result, first);
     va_list args;
     va_start(args, first);
-    Chain_Token next = va_arg(args, Chain_Token);
-    while (next.type != CHAIN_TOKEN_END) {
-        chain_set_input_output_files_or_count_cmds(&result, next);
-        next = va_arg(args, Chain_Token);
+    for (Chain_Token next = va_arg(args, Chain_Token);
+            next.type != CHAIN_TOKEN_END;
+            next = va_arg(args, Chain_Token)) {
+        chain_push_token(&result, next);
     }
     va_end(args);
 
-    result.cmds.elems = malloc(sizeof(result.cmds.elems[0]) * result.cmds.count);
-    if (result.cmds.elems == NULL) {
+    return result;
+}
+
+Chain *chain_branch(Chain chain)
+{
+    Chain *result = temp_alloc(sizeof(*result));
+    *result = chain;
+    return result;
+}
+
+// Pumps between the chain files and the pipes run on threads, which would block
+// forever when they run inline
+#if !defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__CHAIN_CAN_PUMP 1
+#else
+#	define NOBUILD__CHAIN_CAN_PUMP 0
+#endif
+
+typedef struct {
+    Fd in;
+    Fd out;
+    // Only set for tees
+    Fd branch;
+    int tee;
+} Nobuild__Chain_Pump;
+
+typedef struct {
+    Chain_Fn fn;
+    void *data;
+    Cstr name;
+    Fd in;
+    Fd out;
+    Thread thread;
+    int result;
+} Nobuild__Chain_Stage;
+
+// Everything a running chain and its branches have to be waited for
+typedef struct {
+    struct {
+        Pid *elems;
+        size_t count;
+        size_t capacity;
+    } pids;
+    struct {
+        Thread *elems;
+        size_t count;
+        size_t capacity;
+    } pumps;
+    struct {
+        Nobuild__Chain_Stage **elems;
+        size_t count;
+        size_t capacity;
+    } stages;
+    // Replace their paths once everything above is done
+    struct {
+        Atomic_File *elems;
+        size_t count;
+        size_t capacity;
+    } outputs;
+} Nobuild__Chain_Jobs;
+
+static void nobuild__chain_pump(void *data)
+{
+    Nobuild__Chain_Pump *pump = data;
+    unsigned long long bytes;
+    if (pump->tee) {
+        bytes = fd_tee(pump->in, pump->branch, pump->out);
+        fd_close(pump->branch);
+    } else {
+        bytes = fd_pump(pump->in, pump->out);
+    }
+    NOBUILD__STATS_PIPED(bytes);
+    fd_close(pump->in);
+    fd_close(pump->out);
+    free(pump);
+}
+
+static void nobuild__chain_pump_start(Nobuild__Chain_Jobs *jobs, Nobuild__Chain_Pump pump)
+{
+    Nobuild__Chain_Pump *data = NOBUILD__MALLOC(sizeof(*data));
+    if (data == NULL) {
         PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
     }
-    result.cmds.count = 0;
+    *data = pump;
+    da_append(&jobs->pumps, thread_create(nobuild__chain_pump, data));
+}
 
-    chain_push_cmd(&result, first);
+static void nobuild__chain_pid_push(Nobuild__Chain_Jobs *jobs, Pid pid)
+{
+    da_append(&jobs->pids, pid);
+}
 
-    va_start(args, first);
-    next = va_arg(args, Chain_Token);
-    while (next.type != CHAIN_TOKEN_END) {
-        chain_push_cmd(&result, next);
-        next = va_arg(args, Chain_Token);
+static void nobuild__chain_stage(void *data)
+{
+    Nobuild__Chain_Stage *stage = data;
+    stage->result = stage->fn(stage->in, stage->out, stage->data);
+    fd_close(stage->in);
+    fd_close(stage->out);
+}
+
+static const Chain_Fn_Stage *nobuild__chain_fn_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.fns.count; ++i) {
+        if (chain.fns.elems[i].position == position) {
+            return &chain.fns.elems[i];
+        }
     }
-    va_end(args);
+    return NULL;
+}
 
-    return result;
+// Stages and pumps close what they are given, so they get their own copy of the
+// standard streams of nobuild
+static Fd nobuild__chain_dup_std(int output)
+{
+#ifndef _WIN32
+    Fd fd = dup(output ? STDOUT_FILENO : STDIN_FILENO);
+    if (fd < 0) {
+        PANIC("Could not duplicate %s: %s", output ? "stdout" : "stdin", nobuild__strerror(errno));
+    }
+#else
+    Fd fd = GetStdHandle(output ? STD_OUTPUT_HANDLE : STD_INPUT_HANDLE);
+    if (!DuplicateHandle(GetCurrentProcess(), fd, GetCurrentProcess(), &fd, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+        PANIC("Could not duplicate %s: %s", output ? "stdout" : "stdin", nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    return fd;
 }
 
-void chain_run_sync(Chain chain)
+static int nobuild__chain_merges_err_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.merged_err.count; ++i) {
+        if (chain.merged_err.elems[i] == position) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Starts the command or function at `index` of `chain` between `fdin` and `fdout`,
+// where NULL stands for the standard streams. Both are owned by the stage afterwards.
+// Commands write their stderr to `fderr` when it is given.
+static void nobuild__chain_stage_start(Chain chain, size_t index, Fd *fdin, Fd *fdout, Fd *fderr, Nobuild__Chain_Jobs *jobs)
 {
-    if (chain.cmds.count == 0) {
+    const Chain_Fn_Stage *fn = nobuild__chain_fn_at(chain, index);
+    if (fn == NULL) {
+        if (nobuild__chain_merges_err_at(chain, index)) {
+            Fd fdstd = fdout ? *fdout : nobuild__chain_dup_std(1);
+            nobuild__chain_pid_push(jobs, cmd_run_async_ex(chain.cmds.elems[index], fdin, &fdstd, &fdstd));
+            if (!fdout) fd_close(fdstd);
+        } else {
+            nobuild__chain_pid_push(jobs, cmd_run_async_ex(chain.cmds.elems[index], fdin, fdout, fderr));
+        }
+        if (fdin) fd_close(*fdin);
+        if (fdout) fd_close(*fdout);
         return;
     }
 
-    Pid *cpids = malloc(sizeof(Pid) * chain.cmds.count);
+    if (!NOBUILD__CHAIN_CAN_PUMP) {
+        PANIC("CHAIN_FN(%s) needs threads, which are disabled by NOBUILD_NO_THREADS", chain.cmds.elems[index].line.elems[0]);
+    }
+
+    Nobuild__Chain_Stage *stage = NOBUILD__MALLOC(sizeof(*stage));
+    if (stage == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+    *stage = (Nobuild__Chain_Stage) {
+        .fn = fn->fn,
+        .data = fn->data,
+        .name = chain.cmds.elems[index].line.elems[0],
+        .in = fdin ? *fdin : nobuild__chain_dup_std(0),
+        .out = fdout ? *fdout : nobuild__chain_dup_std(1)
+    };
+    da_append(&jobs->stages, stage);
+    stage->thread = thread_create(nobuild__chain_stage, stage);
+}
+
+// Opens the output file of a chain, which is handed to a stage or a pump that closes it
+static Fd nobuild__chain_output_open(Nobuild__Chain_Jobs *jobs, Cstr path)
+{
+    da_append(&jobs->outputs, atomic_file_open(path));
+    return jobs->outputs.elems[jobs->outputs.count - 1].fd;
+}
+
+static Pipe nobuild__chain_pipe(Chain chain)
+{
+    Pipe pip = pipe_make();
+    if (chain.pipe_size) {
+        pipe_set_size(pip, chain.pipe_size);
+    }
+    return pip;
+}
+
+// Whether the input or output `fd` of `chain` is pumped through a pipe of the chain's
+// size. Regular files are not, since a pump only adds a thread and a copy to them.
+static int nobuild__chain_pumps(Chain chain, Fd fd)
+{
+    if (chain.pipe_size == 0 || !NOBUILD__CHAIN_CAN_PUMP) {
+        return 0;
+    }
+
+#ifndef _WIN32
+    struct stat statbuf = {0};
+    return NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0 || !S_ISREG(statbuf.st_mode);
+#else
+    return GetFileType(fd) != FILE_TYPE_DISK;
+#endif // _WIN32
+}
+
+static int nobuild__chain_has_tee_at(Chain chain, size_t position)
+{
+    for (size_t i = 0; i < chain.tees.count; ++i) {
+        if (chain.tees.elems[i].position == position) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void nobuild__chain_start(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs);
+
+// Splits the stream `*fdprev` into every branch that sits at `position` and
+// points `fdprev` at the copy that continues down the chain
+static Fd *nobuild__chain_start_tees(Chain chain, size_t position, Fd *fdprev, Fd *fdin, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    for (size_t i = 0; i < chain.tees.count; ++i) {
+        Chain_Tee tee = chain.tees.elems[i];
+        if (tee.position != position) {
+            continue;
+        }
+
+        if (fdprev == NULL) {
+            PANIC("CHAIN_TEE in front of command %zu has no stream to copy, add a CHAIN_IN or a CHAIN_CMD before it", position);
+        }
+
+        if (!NOBUILD__CHAIN_CAN_PUMP) {
+            PANIC("CHAIN_TEE in front of command %zu needs threads, which are disabled by NOBUILD_NO_THREADS", position);
+        }
+
+        if (tee.chain->pipe_size == 0) {
+            tee.chain->pipe_size = chain.pipe_size;
+        }
+
+        Pipe branch = nobuild__chain_pipe(chain);
+        Pipe next = nobuild__chain_pipe(chain);
+        nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+            .in = *fdprev,
+            .out = next.write,
+            .branch = branch.write,
+            .tee = 1
+        });
+
+        nobuild__chain_start(*tee.chain, &branch.read, fderr, jobs);
+        *fdin = next.read;
+        fdprev = fdin;
+    }
+
+    return fdprev;
+}
 
+static void nobuild__chain_start_stages(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
     Pipe pip = {0};
     Fd fdin = 0;
     Fd *fdprev = NULL;
 
-    if (chain.input_filepath) {
+    if (input) {
+        fdin = *input;
+        fdprev = &fdin;
+    } else if (chain.input_filepath) {
         fdin = fd_open_for_read(chain.input_filepath);
+        // A function stage reads the file itself just as fast as a pump would
+        if (!nobuild__chain_fn_at(chain, 0) && nobuild__chain_pumps(chain, fdin)) {
+            pip = nobuild__chain_pipe(chain);
+            nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+                .in = fdin,
+                .out = pip.write
+            });
+            fdin = pip.read;
+        }
         fdprev = &fdin;
     }
 
-    for (size_t i = 0; i < chain.cmds.count - 1; ++i) {
-        pip = pipe_make();
-
-        cpids[i] = cmd_run_async(
-                       chain.cmds.elems[i],
-                       fdprev,
-                       &pip.write);
+    // The last command only writes to the output directly when no tee follows it
+    const int tail = nobuild__chain_has_tee_at(chain, chain.cmds.count);
+    for (size_t i = 0; i < chain.cmds.count; ++i) {
+        fdprev = nobuild__chain_start_tees(chain, i, fdprev, &fdin, fderr, jobs);
 
-        if (fdprev) fd_close(*fdprev);
-        fd_close(pip.write);
-        fdprev = &fdin;
-        fdin = pip.read;
-    }
+        if (i + 1 < chain.cmds.count || tail) {
+            pip = nobuild__chain_pipe(chain);
+            nobuild__chain_stage_start(chain, i, fdprev, &pip.write, fderr, jobs);
+            fdin = pip.read;
+            fdprev = &fdin;
+            continue;
+        }
 
-    {
         Fd fdout = 0;
         Fd *fdnext = NULL;
 
         if (chain.output_filepath) {
-            fdout = fd_open_for_write(chain.output_filepath);
+            fdout = nobuild__chain_output_open(jobs, chain.output_filepath);
+            if (!nobuild__chain_fn_at(chain, i) && nobuild__chain_pumps(chain, fdout)) {
+                pip = nobuild__chain_pipe(chain);
+                nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+                    .in = pip.read,
+                    .out = fdout
+                });
+                fdout = pip.write;
+            }
             fdnext = &fdout;
         }
 
-        const size_t last = chain.cmds.count - 1;
-        cpids[last] =
-            cmd_run_async(
-                chain.cmds.elems[last],
-                fdprev,
-                fdnext);
+        nobuild__chain_stage_start(chain, i, fdprev, fdnext, fderr, jobs);
+        return;
+    }
+
+    // The stream is left after the trailing tees, or the chain had no commands at all
+    fdprev = nobuild__chain_start_tees(chain, chain.cmds.count, fdprev, &fdin, fderr, jobs);
+    if (fdprev == NULL) {
+        return;
+    }
 
-        if (fdprev) fd_close(*fdprev);
-        if (fdnext) fd_close(*fdnext);
+    if (!NOBUILD__CHAIN_CAN_PUMP) {
+        PANIC("Chain of %zu commands needs threads to pump its output, which are disabled by NOBUILD_NO_THREADS", chain.cmds.count);
     }
 
-    for (size_t i = 0; i < chain.cmds.count; ++i) {
-        pid_wait(cpids[i]);
+    Fd fdout = chain.output_filepath ? nobuild__chain_output_open(jobs, chain.output_filepath) : nobuild__chain_dup_std(1);
+
+    nobuild__chain_pump_start(jobs, (Nobuild__Chain_Pump) {
+        .in = *fdprev,
+        .out = fdout
+    });
+}
+
+// Starts the commands of `chain` reading from `input` when it is given, which is
+// then owned by the chain. Commands write their stderr to the error file of the
+// chain, or to `fderr` when it has none.
+static void nobuild__chain_start(Chain chain, Fd *input, Fd *fderr, Nobuild__Chain_Jobs *jobs)
+{
+    // The commands keep their own copies, so the file is closed as soon as they run
+    Fd fdfile = 0;
+    if (chain.error_filepath) {
+        fdfile = fd_open_for_write(chain.error_filepath);
+        fderr = &fdfile;
+    }
+
+    nobuild__chain_start_stages(chain, input, fderr, jobs);
+
+    if (chain.error_filepath) {
+        fd_close(fdfile);
     }
 }
 
-void chain_echo(Chain chain)
+void chain_run_sync(Chain chain)
+{
+    if (chain.cmds.count == 0 && chain.tees.count == 0) {
+        return;
+    }
+
+    Nobuild__Chain_Jobs jobs = {0};
+    const int pump = (chain.pipe_size > 0 || chain.tees.count > 0 || chain.fns.count > 0) && NOBUILD__CHAIN_CAN_PUMP;
+#ifndef _WIN32
+    // A command that stops reading early must not take nobuild down with it, since
+    // pumps and function stages write to it from inside nobuild
+    void (*sigpipe)(int) = pump ? signal(SIGPIPE, SIG_IGN) : SIG_DFL;
+#endif // _WIN32
+
+    nobuild__chain_start(chain, NULL, NULL, &jobs);
+
+    FOREACH_ARRAY(Pid, pid, jobs.pids, pid_wait(*pid));
+    FOREACH_ARRAY(Thread, thread, jobs.pumps, thread_join(*thread));
+    FOREACH_ARRAY(Nobuild__Chain_Stage *, stage, jobs.stages, thread_join((*stage)->thread));
+
+#ifndef _WIN32
+    if (pump) {
+        signal(SIGPIPE, sigpipe);
+    }
+#endif // _WIN32
+
+    for (size_t i = 0; i < jobs.stages.count; ++i) {
+        Nobuild__Chain_Stage *stage = jobs.stages.elems[i];
+        if (stage->result != 0) {
+            PANIC("CHAIN_FN(%s) failed with %d", stage->name, stage->result);
+        }
+        free(stage);
+    }
+
+    // A failed chain has panicked by now and left the previous outputs in place
+    FOREACH_ARRAY(Atomic_File, output, jobs.outputs, nobuild__atomic_file_rename(output));
+
+    da_free(&jobs.outputs);
+    da_free(&jobs.stages);
+    da_free(&jobs.pumps);
+    da_free(&jobs.pids);
+}
+
+// `sep` goes in front of the first command, branches start without one
+static void nobuild__chain_echo(Chain chain, Cstr sep)
 {
-    printf("[INFO] CHAIN:");
     if (chain.input_filepath) {
         printf(" %s", chain.input_filepath);
+        sep = " |> ";
     }
 
-    for (size_t cmd_index = 0; cmd_index < chain.cmds.count; ++cmd_index) {
-        Cmd *cmd = &chain.cmds.elems[cmd_index];
-        printf(" |> %s", cmd_show(*cmd));
+    for (size_t cmd_index = 0; cmd_index <= chain.cmds.count; ++cmd_index) {
+        for (size_t i = 0; i < chain.tees.count; ++i) {
+            if (chain.tees.elems[i].position == cmd_index) {
+                printf("%stee(", sep);
+                nobuild__chain_echo(*chain.tees.elems[i].chain, "");
+                printf(")");
+                sep = " |> ";
+            }
+        }
+
+        if (cmd_index < chain.cmds.count) {
+            Cmd *cmd = &chain.cmds.elems[cmd_index];
+            if (nobuild__chain_fn_at(chain, cmd_index)) {
+                printf("%s%s()", sep, cmd->line.elems[0]);
+            } else {
+                printf("%s%s", sep, cmd_show(*cmd));
+            }
+            if (nobuild__chain_merges_err_at(chain, cmd_index)) {
+                printf(" 2>&1");
+            }
+            sep = " |> ";
+        }
     }
 
     if (chain.output_filepath) {
-        printf(" |> %s", chain.output_filepath);
+        printf("%s%s", sep, chain.output_filepath);
+    }
+
+    if (chain.error_filepath) {
+        printf(" 2> %s", chain.error_filepath);
+    }
+}
+
+void chain_echo(Chain chain)
+{
+    if (!log_enabled(LOG_INFO)) {
+        return;
     }
 
+    printf("[INFO] CHAIN:");
+    nobuild__chain_echo(chain, " |> ");
     printf("\n");
 }
 
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_CMD_I_
 #endif // NOBUILD_CMD_IMPLEMENTATION
@@ -3,6 +3,277 @@
 
 #include <stddef.h>
 
+
+#include <stddef.h>
+#include <string.h>
+
+
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Region based allocation. An arena hands out memory from a list of large regions
+// and takes all of it back at once, so a lot of small allocations that die together
+// cost a pointer bump each and a single rewind in the end.
+
+typedef struct Arena_Region Arena_Region;
+
+typedef struct {
+    Arena_Region *begin;
+    // The region allocations are served from. The ones after it are empty.
+    Arena_Region *end;
+} Arena;
+
+// A position in an arena to rewind to
+typedef struct {
+    Arena_Region *region;
+    size_t count;
+} Arena_Mark;
+
+// Never returns NULL, panics when the system is out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// Resizes `old`, which was allocated with `old_size` bytes. It is resized in place
+// when it is the last allocation of the arena, and copied otherwise.
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *cstr);
+
+Arena_Mark arena_mark(Arena *arena);
+// Releases everything allocated since `mark` was taken. The regions are kept around
+// for the allocations that follow.
+void arena_rewind(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+// Gives the regions back to the system
+void arena_free(Arena *arena);
+// Number of bytes currently allocated from `arena`
+size_t arena_used(const Arena *arena);
+
+// Every string, array and chain that nobuild returns is allocated from the temporary
+// arena and is never freed on its own. Code that creates garbage on every iteration
+// of a loop can release it in O(1) by resetting to a mark taken at the start:
+//
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         Arena_Mark mark = temp_mark();
+//         if (ENDS_WITH(file, ".c")) {
+//             CMD("cc", "-c", PATH("src", file), "-o", CONCAT(NOEXT(file), ".o"));
+//         }
+//         temp_reset(mark);
+//     });
+//
+// Everything returned since the mark is gone after the reset, including the storage
+// of arrays that were grown in between. The arena is shared by all threads and none
+// of them may be using it while it is reset.
+void *temp_alloc(size_t size);
+void *temp_realloc(void *old, size_t old_size, size_t new_size);
+char *temp_strdup(const char *cstr);
+Arena_Mark temp_mark(void);
+void temp_reset(Arena_Mark mark);
+size_t temp_used(void);
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size);
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size);
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr);
+// Counts the allocation for the module that makes it
+#	define temp_alloc(size) nobuild__stats_temp_alloc(NOBUILD__STATS_MODULE, (size))
+#	define temp_realloc(old, old_size, new_size) \
+    nobuild__stats_temp_realloc(NOBUILD__STATS_MODULE, (old), (old_size), (new_size))
+#	define temp_strdup(cstr) nobuild__stats_temp_strdup(NOBUILD__STATS_MODULE, (cstr))
+#endif // NOBUILD_STATS
+
+// Dynamic arrays, for any struct with an `elems` pointer and `count` and `capacity`
+// fields. Their storage comes from the temporary arena and doubles when it is full,
+// so appending costs O(1) amortized, and a single allocation when nothing else was
+// allocated since the last append.
+//
+//     typedef struct {
+//         Cmd *elems;
+//         size_t count;
+//         size_t capacity;
+//     } Cmd_Array;
+//
+//     Cmd_Array cmds = {0};
+//     FOREACH_FILE_IN_DIR(file, "src", {
+//         da_append(&cmds, ((Cmd) { .line = CSTR_ARRAY_MAKE("cc", "-c", file) }));
+//     });
+//     FOREACH_ARRAY(Cmd, cmd, cmds, cmd_run_sync(*cmd));
+//
+// Arrays with a `capacity` below their `count` wrap storage that nobuild did not
+// allocate, like `argv`, which is copied on the first append. The macros evaluate
+// `da` more than once.
+
+// Makes room for `n` elements in total
+#define da_reserve(da, n)                                                                  \
+    ((da)->elems = nobuild__da_reserve((da)->elems, sizeof(*(da)->elems), (da)->count,     \
+                                       &(da)->capacity, (n)))
+
+#define da_append(da, elem)                                                                \
+    ((da)->count >= (da)->capacity                                                         \
+         ? (void) ((da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems),       \
+                                                  (da)->count, &(da)->capacity,            \
+                                                  (da)->count + 1))                        \
+         : (void) 0,                                                                       \
+     (void) ((da)->elems[(da)->count++] = (elem)))
+
+// Appends the `n` elements that `new_elems` points to
+#define da_append_many(da, new_elems, n)                                                   \
+    do {                                                                                   \
+        const size_t nobuild__da_n = (n);                                                  \
+        /* Only compiles when the elements have the same type */                           \
+        (void) sizeof(*(da)->elems = *(new_elems));                                        \
+        if (nobuild__da_n > 0) {                                                           \
+            (da)->elems = nobuild__da_grow((da)->elems, sizeof(*(da)->elems), (da)->count, \
+                                           &(da)->capacity, (da)->count + nobuild__da_n);  \
+            memcpy((da)->elems + (da)->count, (new_elems),                                 \
+                   sizeof(*(da)->elems) * nobuild__da_n);                                  \
+            (da)->count += nobuild__da_n;                                                  \
+        }                                                                                  \
+    } while (0)
+
+// Removes the last element and returns it. The array must not be empty.
+#define da_pop(da) ((da)->elems[--(da)->count])
+
+// Leaves the array empty. The storage only goes back to the arena when it is the last
+// allocation, the rest waits for the next `temp_reset()`.
+#define da_free(da)                                                                        \
+    do {                                                                                   \
+        nobuild__da_free((da)->elems, sizeof(*(da)->elems), (da)->count, (da)->capacity);  \
+        (da)->elems = NULL;                                                                \
+        (da)->count = 0;                                                                   \
+        (da)->capacity = 0;                                                                \
+    } while (0)
+
+// Visits the elements of an array in order
+#define FOREACH_ARRAY(type, elem, array, body)                                             \
+    for (size_t elem_##index = 0; elem_##index < (array).count; ++elem_##index) {         \
+        type *elem = &(array).elems[elem_##index];                                         \
+        body;                                                                              \
+    }
+
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n);
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity);
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef NOBUILD_PRINTF_FORMAT
+#	if defined(__GNUC__) || defined(__clang__)
+#		// https://gcc.gnu.org/onlinedocs/gcc-4.7.2/gcc/Function-Attributes.html
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK) __attribute__ ((format (printf, STRING_INDEX, FIRST_TO_CHECK)))
+#	else
+#		define NOBUILD_PRINTF_FORMAT(STRING_INDEX, FIRST_TO_CHECK)
+#	endif
+#endif
+
 #ifndef NOBUILD__DEPRECATED
 #	if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
 #		define NOBUILD__DEPRECATED(func) __attribute__ ((deprecated)) func
@@ -19,30 +290,174 @@ int cstr_ends_with(Cstr cstr, Cstr postfix);
 int cstr_starts_with(Cstr cstr, Cstr prefix);
 #define STARTS_WITH(cstr, prefix) cstr_starts_with(cstr, prefix)
 
+// A string that carries its length, so it never has to be measured again. The data
+// is not null terminated, unless it comes straight from a `Cstr`.
+typedef struct {
+    const char *data;
+    size_t count;
+} String_View;
+
+// Only for string literals, whose length is known at compile time
+#define SV(cstr_lit) ((String_View) { (cstr_lit), sizeof(cstr_lit) - 1 })
+// printf("name: "SV_FMT"\n", SV_ARG(name));
+#define SV_FMT "%.*s"
+#define SV_ARG(sv) (int) (sv).count, (sv).data
+
+String_View sv_from_cstr(Cstr cstr);
+String_View sv_from_parts(const char *data, size_t count);
+// Copies the view into the temporary arena with a null terminator
+Cstr sv_to_cstr(String_View sv);
+
+int sv_eq(String_View a, String_View b);
+// Compares without measuring `cstr` first
+int sv_eq_cstr(String_View sv, Cstr cstr);
+int sv_starts_with(String_View sv, String_View prefix);
+int sv_ends_with(String_View sv, String_View suffix);
+// Index of the first occurrence of `needle`, or `sv.count` when there is none
+size_t sv_find(String_View sv, String_View needle);
+// Index of the last occurrence of `c`, or `sv.count` when there is none
+size_t sv_rfind_char(String_View sv, char c);
+String_View sv_trim(String_View sv);
+
+// Cut `n` bytes off the front or the back of `sv` and return them
+String_View sv_chop_left(String_View *sv, size_t n);
+String_View sv_chop_right(String_View *sv, size_t n);
+// Returns everything before the first `delim` and leaves `sv` with everything after
+// it, or returns all of `sv` and leaves it empty when there is no `delim`
+String_View sv_chop_by_delim(String_View *sv, char delim);
+
 typedef struct {
     Cstr *elems;
     size_t count;
+    // Number of elements `elems` has room for. Arrays that wrap storage nobuild did
+    // not allocate, like `argv`, leave it at 0 and are copied on the first append.
     size_t capacity;
 } Cstr_Array;
 
 Cstr_Array cstr_array_make(Cstr first, ...);
 #define CSTR_ARRAY_MAKE(first, ...) cstr_array_make(first, ##__VA_ARGS__, NULL)
-
+// An array of the arguments whose storage lives until the end of the enclosing block,
+// without counting them at runtime or allocating. It has no capacity, so appending
+// to it copies it into the temporary arena first.
+#define CSTR_ARRAY_LOCAL(...)                                        \
+    ((Cstr_Array) {                                                  \
+        .elems = (Cstr[]) { __VA_ARGS__ },                           \
+        .count = sizeof((Cstr[]) { __VA_ARGS__ }) / sizeof(Cstr)     \
+    })
+
+// Appending to a full array doubles its capacity
 Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr);
 
+// Makes room for at least `capacity` elements in total
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity);
+// Drops the capacity beyond `count`. The memory only goes back to the arena when the
+// array is its last allocation.
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs);
+
 Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr);
 
 Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b);
 
 int cstr_array_contains(Cstr_Array cstrs, Cstr cstr);
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv);
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv);
 
+// Splits `cstr` at every `delim` in a single pass. The pieces are cut out of one copy
+// of `cstr`, and an empty `delim` leaves it whole.
 Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim);
 #define SPLIT(cstr, delim) cstr_array_from_cstr(cstr, delim)
 
+typedef struct {
+    String_View *elems;
+    size_t count;
+    size_t capacity;
+} String_View_Array;
+
+// Like `SPLIT()`, but the pieces are views into `sv` and only the array is allocated
+String_View_Array sv_split(String_View sv, String_View delim);
+
+// Hands out the pieces of a split one at a time, without allocating anything:
+//
+//     Split_Iter it = split_iter_make(sv_from_cstr(output), SV("\n"));
+//     String_View line;
+//     while (split_iter_next(&it, &line)) { ... }
+typedef struct {
+    String_View rest;
+    String_View delim;
+    int done;
+} Split_Iter;
+
+Split_Iter split_iter_make(String_View sv, String_View delim);
+// Stores the next piece in `piece`, or returns 0 when there are no more
+int split_iter_next(Split_Iter *it, String_View *piece);
+
 Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
-#define JOIN(sep, ...) cstr_array_join(sep, cstr_array_make(__VA_ARGS__, NULL))
+
+// Returns the single copy that is kept of every distinct string, so that interned
+// strings are equal exactly when their pointers are. The copies are kept in a hash
+// set for the whole process, in an arena of their own that `temp_reset()` leaves alone.
+Cstr intern(Cstr cstr);
+Cstr intern_sv(String_View sv);
+// The interned copy of `sv`, or NULL when it was never interned
+Cstr intern_find(String_View sv);
+
+// Interns every element of `cstrs` in place
+Cstr_Array cstr_array_intern(Cstr_Array cstrs);
+// Compare pointers instead of strings, for arrays and strings that are all interned
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned);
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned);
+
+// Joins the strings up to the NULL that terminates them, without building an array
+Cstr cstr_join(Cstr sep, Cstr first, ...);
+#define JOIN(sep, ...) cstr_join(sep, __VA_ARGS__, NULL)
 #define CONCAT(...) JOIN("", __VA_ARGS__)
 
+// Like `JOIN` and `CONCAT`, but for string literals only, which the compiler pastes
+// together into a single literal. Anything else fails to compile. Takes up to 16 of them.
+#define JOIN_LIT(sep, ...) "" NOBUILD__CAT(NOBUILD__JOIN_LIT_, NOBUILD__NARGS(__VA_ARGS__))(sep, __VA_ARGS__)
+#define CONCAT_LIT(...) JOIN_LIT("", __VA_ARGS__)
+
+#define NOBUILD__CAT(a, b) NOBUILD__CAT_(a, b)
+#define NOBUILD__CAT_(a, b) a##b
+#define NOBUILD__NARGS(...) NOBUILD__NARGS_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NOBUILD__NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+#define NOBUILD__JOIN_LIT_1(sep, lit) lit ""
+#define NOBUILD__JOIN_LIT_2(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_1(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_3(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_2(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_4(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_3(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_5(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_4(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_6(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_5(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_7(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_6(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_8(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_7(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_9(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_8(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_10(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_9(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_11(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_10(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_12(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_11(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_13(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_12(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_14(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_13(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_15(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_14(sep, __VA_ARGS__)
+#define NOBUILD__JOIN_LIT_16(sep, lit, ...) lit sep NOBUILD__JOIN_LIT_15(sep, __VA_ARGS__)
+
+// A growable string. The buffer comes from `arena`, or from the temporary arena when
+// it is NULL, and doubles when it runs out. The last allocation of an arena grows in
+// place, so a string built in one go usually costs a single allocation.
+typedef struct {
+    char *elems;
+    size_t count;
+    size_t capacity;
+    Arena *arena;
+} String_Builder;
+
+// Makes room for `size` more bytes and a null terminator
+void sb_reserve(String_Builder *sb, size_t size);
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size);
+void sb_append_cstr(String_Builder *sb, Cstr cstr);
+void sb_append_sv(String_Builder *sb, String_View sv);
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
+// Null terminates the string, gives back the capacity it does not use and returns
+// it. The builder is left empty for the next string.
+Cstr sb_to_cstr(String_Builder *sb);
+
 #endif  // NOBUILD_CSTR_H_
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -51,9 +466,11 @@ Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
 #ifndef NOBUILD_CSTR_I_
 #define NOBUILD_CSTR_I_
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 
 
@@ -77,8 +494,22 @@ Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs);
 #	endif
 #endif
 
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
 NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
 
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
 void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 #define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
 
@@ -103,6 +534,18 @@ void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 
 #include <stdlib.h>
 
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
 void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
 {
     fprintf(stream, "[%s] ", tag);
@@ -116,8 +559,24 @@ void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
     nobuild__vlog(stream, tag, fmt, args);
 }
 
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
 void info(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "INFO", fmt, args);
@@ -126,6 +585,10 @@ void info(const char *fmt, ...)
 
 void warn(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "WARN", fmt, args);
@@ -134,6 +597,10 @@ void warn(const char *fmt, ...)
 
 void erro(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "ERRO", fmt, args);
@@ -167,262 +634,1174 @@ void todo_safe(const char *fmt, ...)
 }
 
 
-// Multiple modules could define this function, so add a guard around it to prevent redefinition
-#ifndef NOBUILD__STRERROR
-#define NOBUILD__STRERROR
-Cstr nobuild__strerror(int errnum)
-{
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef NOBUILD_STATS
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
 #ifndef _WIN32
-    return strerror(errnum);
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
 #else
-    static char buffer[1024];
-    strerror_s(buffer, 1024, errnum);
-    return buffer;
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
 #endif
-}
-#endif // NOBUILD__STRERROR
 
-int cstr_ends_with(Cstr cstr, Cstr postfix)
-{
-    const size_t cstr_len = strlen(cstr);
-    const size_t postfix_len = strlen(postfix);
-    return postfix_len <= cstr_len
-           && strcmp(cstr + cstr_len - postfix_len, postfix) == 0;
-}
 
-int cstr_starts_with(Cstr cstr, Cstr prefix)
-{
-    const size_t cstr_len = strlen(cstr);
-    const size_t prefix_len = strlen(prefix);
-    return prefix_len <= cstr_len && strncmp(cstr, prefix, prefix_len) == 0;
-}
+////////////////////////////////////////////////////////////////////////////////
 
-Cstr_Array cstr_array_make(Cstr first, ...)
-{
-    Cstr_Array result = {0};
 
-    if (first == NULL) {
-        return result;
-    }
-    result.count += 1;
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
+#else
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#endif
 
-    va_list args;
-    va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.count += 1;
-    }
-    va_end(args);
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
 
-    result.elems = malloc(sizeof *result.elems * result.count);
-    if (result.elems == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
-    }
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
 
-    result.count = 0;
-    result.elems[result.count++] = first;
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
 
-    va_start(args, first);
-    for (Cstr next = va_arg(args, Cstr);
-            next != NULL;
-            next = va_arg(args, Cstr)) {
-        result.elems[result.count++] = next;
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
+
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
+}
+
+static void nobuild__stats_report(void)
+{
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
     }
-    va_end(args);
+#endif // _WIN32
 
-    return result;
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
+    }
 }
 
-Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
 {
-    if (cstrs.capacity < 1) {
-        cstrs.elems = realloc(cstrs.elems, sizeof *cstrs.elems * (cstrs.count + 10));
-        cstrs.capacity += 10;
-        if (cstrs.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
     }
 
-    cstrs.elems[cstrs.count++] = cstr;
-    cstrs.capacity--;
-    return cstrs;
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
 }
 
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
 
-Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
 {
-    if (cstrs.count == 0) {
-        return cstrs;
-    }
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
 
-    if (cstr == NULL) {
-        cstrs.elems[--cstrs.count];
-        cstrs.capacity++;
-        return cstrs;
-    }
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
 
-    // Find the index of the element to be removed
-    const size_t cstr_len = strlen(cstr);
-    for (size_t i = 0; i < cstrs.count; i++) {
-        const size_t elem_len = strlen(cstrs.elems[i]);
-        if (elem_len != cstr_len || strcmp(cstrs.elems[i], cstr) != 0) {
-            continue;
-        }
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
+}
 
-        // Shift elements left if found the cstr
-        for (size_t j = i; j < cstrs.count - 1; j++) {
-            cstrs.elems[j] = cstrs.elems[j + 1];
-        }
-        cstrs.count--;
-        cstrs.capacity++;
+void nobuild__stats_temp(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
 
-        // TODO: Might want to realloc array if capacity is too high
-        return cstrs;
-    }
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
+}
 
-    // The string was not found
-    return cstrs;
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
 }
 
-Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
+void nobuild__stats_copied(unsigned long long bytes)
 {
-    if (cstrs_a.capacity < cstrs_b.count) {
-        cstrs_a.elems = realloc(cstrs_a.elems, sizeof *cstrs_a.elems * (cstrs_a.count + cstrs_b.count));
-        cstrs_a.capacity += cstrs_b.count;
-        if (cstrs_a.elems == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
-    }
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
 
-    memcpy(cstrs_a.elems + cstrs_a.count, cstrs_b.elems, sizeof *cstrs_a.elems * cstrs_b.count);
-    cstrs_a.count += cstrs_b.count;
-    cstrs_a.capacity -= cstrs_b.count;
-    return cstrs_a;
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
 }
 
-int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
-    for (size_t i = 0; i < cstrs.count; ++i) {
-        if (strcmp(cstr, cstrs.elems[i]) == 0) {
-            return 1;
-        }
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
     }
-    return 0;
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
+    }
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
+    }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
 }
 
-Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
 {
-    size_t len = strlen(cstr);
-    size_t d_len = strlen(delim);
-    size_t substr_count = 1;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
-        }
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
+            continue;
         }
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
+    }
 
-        if (delim_found) {
-            substr_count++;
-            i += d_len - 1;
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
         }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
     }
 
-    // if dlen == 0 or was never found
-    if (substr_count == 1) {
-        // TODO: differentiate between delim == null and delim == "" and delim not found
-        //       Split the string into an array of strings, where each string is a single character
-        return cstr_array_make(cstr);
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
+}
+
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
     }
+    fprintf(file, "  },\n");
+}
 
-    Cstr_Array ret = { .count = substr_count };
-    ret.elems = malloc(sizeof(Cstr) * ret.count);
-    if (ret.elems == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
     }
 
-    size_t substr_start = 0;
-    size_t substr_index = 0;
-    for (size_t i = 0; i < len; ++i) {
-        if ((len - i) < d_len) {
-            break;
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
         }
+        return 0;
+    }
+    return 1;
+}
 
-        size_t delim_found = 0;
-        for (size_t j = 0; j < d_len; ++j) {
-            if (cstr[i+j] != delim[j]) {
-                delim_found = 0;
-                break;
-            }
-            delim_found = 1;
-        }
+#endif // NOBUILD_STATS
 
-        if (!delim_found) {
-            continue;
-        }
 
-        size_t substr_len = i - substr_start;
-        char *substr = calloc(substr_len + 1, sizeof(unsigned char));
-        if (substr == NULL) {
-            PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
-        }
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_ARENA
 
-        ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-        i += d_len - 1;
-        substr_start = i + 1;
-    }
+#if defined(NOBUILD_NO_THREADS)
+#elif !defined(_WIN32)
+#	include <pthread.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
 
-    // Add the last substring
-    size_t substr_len = len - substr_start;
-    char *substr = malloc(substr_len * sizeof(unsigned char));
-    if (substr == NULL) {
-        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+// Words of a region that is not made larger by a single big allocation
+#ifndef NOBUILD_ARENA_REGION_WORDS
+#	define NOBUILD_ARENA_REGION_WORDS (8 * 1024)
+#endif
+
+// Allocations are made in whole words, which keeps all of them suitably aligned
+typedef union {
+    void *pointer;
+    long long integer;
+    double real;
+} Nobuild__Arena_Word;
+
+struct Arena_Region {
+    Arena_Region *next;
+    size_t count;
+    size_t capacity;
+    Nobuild__Arena_Word data[];
+};
+
+static size_t nobuild__arena_words(size_t size)
+{
+    return (size + sizeof(Nobuild__Arena_Word) - 1) / sizeof(Nobuild__Arena_Word);
+}
+
+static Arena_Region *nobuild__arena_region_new(size_t words)
+{
+    size_t capacity = words > NOBUILD_ARENA_REGION_WORDS ? words : NOBUILD_ARENA_REGION_WORDS;
+    Arena_Region *region = NOBUILD__MALLOC(sizeof(*region) + sizeof(Nobuild__Arena_Word) * capacity);
+    if (region == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
     }
 
-    ret.elems[substr_index++] = memcpy(substr, (cstr+substr_start), substr_len * sizeof(unsigned char));
-    return ret;
+    region->next = NULL;
+    region->count = 0;
+    region->capacity = capacity;
+    return region;
 }
 
-Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
+void *arena_alloc(Arena *arena, size_t size)
 {
-    if (cstrs.count == 0) {
-        return "";
+    size_t words = nobuild__arena_words(size);
+    if (arena->end == NULL) {
+        arena->begin = arena->end = nobuild__arena_region_new(words);
     }
 
-    const size_t sep_len = strlen(sep);
-    size_t len = 0;
-    for (size_t i = 0; i < cstrs.count; ++i) {
-        len += strlen(cstrs.elems[i]);
+    // Regions emptied by a rewind are reused before new ones are made
+    while (arena->end->count + words > arena->end->capacity && arena->end->next != NULL) {
+        arena->end = arena->end->next;
     }
 
-    const size_t result_len = (cstrs.count - 1) * sep_len + len + 1;
-    char *result = malloc(sizeof(char) * result_len);
-    if (result == NULL) {
-        PANIC("could not allocate memory: %s", nobuild__strerror(errno));
+    if (arena->end->count + words > arena->end->capacity) {
+        arena->end->next = nobuild__arena_region_new(words);
+        arena->end = arena->end->next;
     }
 
-    len = 0;
+    void *result = &arena->end->data[arena->end->count];
+    arena->end->count += words;
+    return result;
+}
+
+void *arena_realloc(Arena *arena, void *old, size_t old_size, size_t new_size)
+{
+    if (old == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+
+    size_t old_words = nobuild__arena_words(old_size);
+    size_t new_words = nobuild__arena_words(new_size);
+    Arena_Region *end = arena->end;
+    if (end != NULL && (Nobuild__Arena_Word *) old + old_words == &end->data[end->count]
+        && end->count - old_words + new_words <= end->capacity) {
+        end->count = end->count - old_words + new_words;
+        return old;
+    }
+
+    if (new_size <= old_size) {
+        return old;
+    }
+
+    void *result = arena_alloc(arena, new_size);
+    memcpy(result, old, old_size);
+    return result;
+}
+
+char *arena_strdup(Arena *arena, const char *cstr)
+{
+    size_t size = strlen(cstr) + 1;
+    return memcpy(arena_alloc(arena, size), cstr, size);
+}
+
+Arena_Mark arena_mark(Arena *arena)
+{
+    Arena_Mark mark = { .region = arena->end };
+    if (arena->end != NULL) {
+        mark.count = arena->end->count;
+    }
+    return mark;
+}
+
+void arena_rewind(Arena *arena, Arena_Mark mark)
+{
+    if (mark.region == NULL) {
+        arena_reset(arena);
+        return;
+    }
+
+    mark.region->count = mark.count;
+    for (Arena_Region *region = mark.region->next; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = mark.region;
+}
+
+void arena_reset(Arena *arena)
+{
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        region->count = 0;
+    }
+    arena->end = arena->begin;
+}
+
+void arena_free(Arena *arena)
+{
+    Arena_Region *region = arena->begin;
+    while (region != NULL) {
+        Arena_Region *next = region->next;
+        free(region);
+        region = next;
+    }
+    arena->begin = arena->end = NULL;
+}
+
+size_t arena_used(const Arena *arena)
+{
+    size_t words = 0;
+    for (Arena_Region *region = arena->begin; region != NULL; region = region->next) {
+        words += region->count;
+    }
+    return words * sizeof(Nobuild__Arena_Word);
+}
+
+// Locks for global state, which are initialized statically so that they are ready
+// before any thread exists. Multiple modules could define them, so add a guard
+// around them to prevent redefinition.
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static Arena nobuild__temp = {0};
+static Nobuild__Lock nobuild__temp_lock = NOBUILD__LOCK_INIT;
+
+// The names are in parentheses, which keeps the macros of `NOBUILD_STATS` out of them
+void *(temp_alloc)(size_t size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_alloc(&nobuild__temp, size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+void *(temp_realloc)(void *old, size_t old_size, size_t new_size)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    void *result = arena_realloc(&nobuild__temp, old, old_size, new_size);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+char *(temp_strdup)(const char *cstr)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    char *result = arena_strdup(&nobuild__temp, cstr);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return result;
+}
+
+Arena_Mark temp_mark(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    Arena_Mark mark = arena_mark(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return mark;
+}
+
+void temp_reset(Arena_Mark mark)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    arena_rewind(&nobuild__temp, mark);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+}
+
+size_t temp_used(void)
+{
+    NOBUILD__LOCK(&nobuild__temp_lock);
+    size_t used = arena_used(&nobuild__temp);
+    NOBUILD__UNLOCK(&nobuild__temp_lock);
+    return used;
+}
+
+#ifdef NOBUILD_STATS
+void *nobuild__stats_temp_alloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_temp(module, size);
+    return (temp_alloc)(size);
+}
+
+// Releases and shrinks are not allocations
+void *nobuild__stats_temp_realloc(Stats_Module module, void *old, size_t old_size, size_t new_size)
+{
+    if (new_size > old_size) {
+        nobuild__stats_temp(module, new_size);
+    }
+    return (temp_realloc)(old, old_size, new_size);
+}
+
+char *nobuild__stats_temp_strdup(Stats_Module module, const char *cstr)
+{
+    nobuild__stats_temp(module, strlen(cstr) + 1);
+    return (temp_strdup)(cstr);
+}
+#endif // NOBUILD_STATS
+
+// Resizes storage with room for `*capacity` elements of which `count` are used to
+// room for exactly `n` when that is more
+void *nobuild__da_reserve(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    // Storage that was not allocated by nobuild has `count` elements to copy
+    const size_t old_capacity = *capacity > count ? *capacity : count;
+    elems = temp_realloc(elems, elem_size * old_capacity, elem_size * n);
+    *capacity = n;
+    return elems;
+}
+
+// Like `nobuild__da_reserve()`, but doubles the capacity until `n` elements fit
+void *nobuild__da_grow(void *elems, size_t elem_size, size_t count, size_t *capacity, size_t n)
+{
+    if (n <= *capacity) {
+        return elems;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    while (new_capacity < n) {
+        new_capacity *= 2;
+    }
+    return nobuild__da_reserve(elems, elem_size, count, capacity, new_capacity);
+}
+
+void nobuild__da_free(void *elems, size_t elem_size, size_t count, size_t capacity)
+{
+    if (elems != NULL && capacity > 0 && capacity >= count) {
+        temp_realloc(elems, elem_size * capacity, 0);
+    }
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_CSTR
+
+// Multiple modules could define this function, so add a guard around it to prevent redefinition
+#ifndef NOBUILD__STRERROR
+#define NOBUILD__STRERROR
+Cstr nobuild__strerror(int errnum)
+{
+#ifndef _WIN32
+    return strerror(errnum);
+#else
+    static char buffer[1024];
+    strerror_s(buffer, 1024, errnum);
+    return buffer;
+#endif
+}
+#endif // NOBUILD__STRERROR
+
+int cstr_ends_with(Cstr cstr, Cstr postfix)
+{
+    return sv_ends_with(sv_from_cstr(cstr), sv_from_cstr(postfix));
+}
+
+int cstr_starts_with(Cstr cstr, Cstr prefix)
+{
+    // Stops at the first difference instead of measuring `cstr`
+    for (; *prefix != '\0'; ++prefix, ++cstr) {
+        if (*cstr != *prefix) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+String_View sv_from_cstr(Cstr cstr)
+{
+    return sv_from_parts(cstr, strlen(cstr));
+}
+
+String_View sv_from_parts(const char *data, size_t count)
+{
+    String_View sv = { .data = data, .count = count };
+    return sv;
+}
+
+Cstr sv_to_cstr(String_View sv)
+{
+    char *result = temp_alloc(sv.count + 1);
+    memcpy(result, sv.data, sv.count);
+    result[sv.count] = '\0';
+    return result;
+}
+
+int sv_eq(String_View a, String_View b)
+{
+    return a.count == b.count && memcmp(a.data, b.data, a.count) == 0;
+}
+
+int sv_eq_cstr(String_View sv, Cstr cstr)
+{
+    for (size_t i = 0; i < sv.count; ++i) {
+        if (cstr[i] == '\0' || cstr[i] != sv.data[i]) {
+            return 0;
+        }
+    }
+    return cstr[sv.count] == '\0';
+}
+
+int sv_starts_with(String_View sv, String_View prefix)
+{
+    return prefix.count <= sv.count && memcmp(sv.data, prefix.data, prefix.count) == 0;
+}
+
+int sv_ends_with(String_View sv, String_View suffix)
+{
+    return suffix.count <= sv.count
+           && memcmp(sv.data + sv.count - suffix.count, suffix.data, suffix.count) == 0;
+}
+
+size_t sv_find(String_View sv, String_View needle)
+{
+    if (needle.count == 0) {
+        return 0;
+    }
+
+    // Jump between candidates for the first byte and compare the rest there
+    size_t i = 0;
+    while (needle.count <= sv.count - i) {
+        const char *first = memchr(sv.data + i, needle.data[0], sv.count - i - needle.count + 1);
+        if (first == NULL) {
+            break;
+        }
+
+        i = (size_t) (first - sv.data);
+        if (memcmp(first + 1, needle.data + 1, needle.count - 1) == 0) {
+            return i;
+        }
+        i += 1;
+    }
+    return sv.count;
+}
+
+size_t sv_rfind_char(String_View sv, char c)
+{
+    for (size_t i = sv.count; i-- > 0;) {
+        if (sv.data[i] == c) {
+            return i;
+        }
+    }
+    return sv.count;
+}
+
+String_View sv_trim(String_View sv)
+{
+    while (sv.count > 0 && isspace((unsigned char) sv.data[0])) {
+        sv.data += 1;
+        sv.count -= 1;
+    }
+    while (sv.count > 0 && isspace((unsigned char) sv.data[sv.count - 1])) {
+        sv.count -= 1;
+    }
+    return sv;
+}
+
+String_View sv_chop_left(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
+    }
+
+    String_View result = sv_from_parts(sv->data, n);
+    sv->data += n;
+    sv->count -= n;
+    return result;
+}
+
+String_View sv_chop_right(String_View *sv, size_t n)
+{
+    if (n > sv->count) {
+        n = sv->count;
+    }
+
+    sv->count -= n;
+    return sv_from_parts(sv->data + sv->count, n);
+}
+
+String_View sv_chop_by_delim(String_View *sv, char delim)
+{
+    const char *found = sv->count > 0 ? memchr(sv->data, delim, sv->count) : NULL;
+    if (found == NULL) {
+        return sv_chop_left(sv, sv->count);
+    }
+
+    String_View result = sv_chop_left(sv, (size_t) (found - sv->data));
+    sv_chop_left(sv, 1);
+    return result;
+}
+
+Cstr_Array cstr_array_make(Cstr first, ...)
+{
+    Cstr_Array result = {0};
+
+    if (first == NULL) {
+        return result;
+    }
+
+    // Counting the arguments first sizes the array exactly with a single allocation
+    size_t count = 1;
+    va_list args;
+    va_start(args, first);
+    while (va_arg(args, Cstr) != NULL) {
+        count += 1;
+    }
+    va_end(args);
+
+    da_reserve(&result, count);
+    result.elems[result.count++] = first;
+    va_start(args, first);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        result.elems[result.count++] = next;
+    }
+    va_end(args);
+
+    return result;
+}
+
+Cstr_Array cstr_array_append(Cstr_Array cstrs, Cstr cstr)
+{
+    da_append(&cstrs, cstr);
+    return cstrs;
+}
+
+Cstr_Array cstr_array_reserve(Cstr_Array cstrs, size_t capacity)
+{
+    da_reserve(&cstrs, capacity);
+    return cstrs;
+}
+
+Cstr_Array cstr_array_shrink_to_fit(Cstr_Array cstrs)
+{
+    if (cstrs.capacity <= cstrs.count) {
+        return cstrs;
+    }
+
+    cstrs.elems = temp_realloc(cstrs.elems, sizeof *cstrs.elems * cstrs.capacity,
+                               sizeof *cstrs.elems * cstrs.count);
+    cstrs.capacity = cstrs.count;
+    return cstrs;
+}
+
+Cstr_Array cstr_array_remove(Cstr_Array cstrs, Cstr cstr)
+{
+    if (cstrs.count == 0) {
+        return cstrs;
+    }
+
+    if (cstr == NULL) {
+        cstrs.count--;
+        return cstrs;
+    }
+
+    return cstr_array_remove_sv(cstrs, sv_from_cstr(cstr));
+}
+
+Cstr_Array cstr_array_remove_sv(Cstr_Array cstrs, String_View sv)
+{
+    // Find the index of the element to be removed
+    for (size_t i = 0; i < cstrs.count; i++) {
+        if (!sv_eq_cstr(sv, cstrs.elems[i])) {
+            continue;
+        }
+
+        // Shift elements left if found the cstr
+        for (size_t j = i; j < cstrs.count - 1; j++) {
+            cstrs.elems[j] = cstrs.elems[j + 1];
+        }
+        cstrs.count--;
+        return cstrs;
+    }
+
+    // The string was not found
+    return cstrs;
+}
+
+Cstr_Array cstr_array_concat(Cstr_Array cstrs_a, Cstr_Array cstrs_b)
+{
+    if (cstrs_b.count == 0) {
+        return cstrs_a;
+    }
+
+    da_append_many(&cstrs_a, cstrs_b.elems, cstrs_b.count);
+    return cstrs_a;
+}
+
+int cstr_array_contains(Cstr_Array cstrs, Cstr cstr) {
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (strcmp(cstr, cstrs.elems[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int cstr_array_contains_sv(Cstr_Array cstrs, String_View sv)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (sv_eq_cstr(sv, cstrs.elems[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+Split_Iter split_iter_make(String_View sv, String_View delim)
+{
+    Split_Iter it = { .rest = sv, .delim = delim };
+    return it;
+}
+
+int split_iter_next(Split_Iter *it, String_View *piece)
+{
+    if (it->done) {
+        return 0;
+    }
+
+    // `sv_find()` jumps between candidates with memchr(), which is vectorized by the libc
+    const size_t i = it->delim.count > 0 ? sv_find(it->rest, it->delim) : it->rest.count;
+    const int found = i < it->rest.count;
+    *piece = sv_chop_left(&it->rest, i);
+    if (found) {
+        sv_chop_left(&it->rest, it->delim.count);
+    } else {
+        it->done = 1;
+    }
+    return 1;
+}
+
+String_View_Array sv_split(String_View sv, String_View delim)
+{
+    String_View_Array result = {0};
+    Split_Iter it = split_iter_make(sv, delim);
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        da_append(&result, piece);
+    }
+    return result;
+}
+
+Cstr_Array cstr_array_from_cstr(Cstr cstr, Cstr delim)
+{
+    const String_View sv = sv_from_cstr(cstr);
+    Split_Iter it = split_iter_make(sv, sv_from_cstr(delim));
+
+    // The pieces are null terminated in place in a copy of `cstr`
+    char *copy = NULL;
+    Cstr_Array result = {0};
+    String_View piece;
+    while (split_iter_next(&it, &piece)) {
+        if (it.done && result.count == 0) {
+            // `delim` was never found
+            return cstr_array_make(cstr, NULL);
+        }
+
+        if (copy == NULL) {
+            copy = temp_alloc(sv.count + 1);
+            memcpy(copy, cstr, sv.count + 1);
+        }
+
+        char *substr = copy + (piece.data - cstr);
+        substr[piece.count] = '\0';
+        result = cstr_array_append(result, substr);
+    }
+
+    return result;
+}
+
+Cstr cstr_array_join(Cstr sep, Cstr_Array cstrs)
+{
+    if (cstrs.count == 0) {
+        return "";
+    }
+
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
     for (size_t i = 0; i < cstrs.count; ++i) {
         if (i > 0) {
-            memcpy(result + len, sep, sep_len);
-            len += sep_len;
+            sb_append_bytes(&sb, sep, sep_len);
+        }
+        sb_append_cstr(&sb, cstrs.elems[i]);
+    }
+
+    return sb_to_cstr(&sb);
+}
+
+typedef struct {
+    Cstr cstr;
+    size_t count;
+    unsigned long long hash;
+} Nobuild__Intern_Slot;
+
+// Open addressing with linear probing, kept at most half full
+static struct {
+    Arena arena;
+    Nobuild__Intern_Slot *slots;
+    size_t count;
+    size_t capacity;
+} nobuild__intern = {0};
+static Nobuild__Lock nobuild__intern_lock = NOBUILD__LOCK_INIT;
+
+// FNV-1a
+static unsigned long long nobuild__intern_hash(String_View sv)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sv.count; ++i) {
+        hash = (hash ^ (unsigned char) sv.data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The slot that holds `sv`, or the empty slot where it belongs
+static Nobuild__Intern_Slot *nobuild__intern_probe(String_View sv, unsigned long long hash)
+{
+    const size_t mask = nobuild__intern.capacity - 1;
+    for (size_t i = (size_t) hash & mask;; i = (i + 1) & mask) {
+        Nobuild__Intern_Slot *slot = &nobuild__intern.slots[i];
+        if (slot->cstr == NULL || (slot->hash == hash && slot->count == sv.count
+                                   && memcmp(slot->cstr, sv.data, sv.count) == 0)) {
+            return slot;
         }
+    }
+}
+
+static void nobuild__intern_grow(void)
+{
+    Nobuild__Intern_Slot *old_slots = nobuild__intern.slots;
+    const size_t old_capacity = nobuild__intern.capacity;
+
+    nobuild__intern.capacity = old_capacity > 0 ? old_capacity * 2 : 1024;
+    nobuild__intern.slots = NOBUILD__CALLOC(nobuild__intern.capacity, sizeof(*nobuild__intern.slots));
+    if (nobuild__intern.slots == NULL) {
+        PANIC("Could not allocate memory: %s", nobuild__strerror(errno));
+    }
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].cstr != NULL) {
+            String_View sv = sv_from_parts(old_slots[i].cstr, old_slots[i].count);
+            *nobuild__intern_probe(sv, old_slots[i].hash) = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+Cstr intern(Cstr cstr)
+{
+    return intern_sv(sv_from_cstr(cstr));
+}
+
+Cstr intern_sv(String_View sv)
+{
+    const unsigned long long hash = nobuild__intern_hash(sv);
+
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    if ((nobuild__intern.count + 1) * 2 > nobuild__intern.capacity) {
+        nobuild__intern_grow();
+    }
+
+    Nobuild__Intern_Slot *slot = nobuild__intern_probe(sv, hash);
+    if (slot->cstr == NULL) {
+        char *copy = arena_alloc(&nobuild__intern.arena, sv.count + 1);
+        memcpy(copy, sv.data, sv.count);
+        copy[sv.count] = '\0';
+
+        slot->cstr = copy;
+        slot->count = sv.count;
+        slot->hash = hash;
+        nobuild__intern.count += 1;
+    }
+    Cstr result = slot->cstr;
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
 
-        size_t elem_len = strlen(cstrs.elems[i]);
-        memcpy(result + len, cstrs.elems[i], elem_len);
-        len += elem_len;
+    return result;
+}
+
+Cstr intern_find(String_View sv)
+{
+    const unsigned long long hash = nobuild__intern_hash(sv);
+
+    NOBUILD__LOCK(&nobuild__intern_lock);
+    Cstr result = NULL;
+    if (nobuild__intern.capacity > 0) {
+        result = nobuild__intern_probe(sv, hash)->cstr;
     }
-    result[len] = '\0';
+    NOBUILD__UNLOCK(&nobuild__intern_lock);
 
     return result;
 }
 
+Cstr_Array cstr_array_intern(Cstr_Array cstrs)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        cstrs.elems[i] = intern(cstrs.elems[i]);
+    }
+    return cstrs;
+}
+
+int cstr_array_contains_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+Cstr_Array cstr_array_remove_interned(Cstr_Array cstrs, Cstr interned)
+{
+    for (size_t i = 0; i < cstrs.count; ++i) {
+        if (cstrs.elems[i] == interned) {
+            memmove(cstrs.elems + i, cstrs.elems + i + 1, sizeof(*cstrs.elems) * (cstrs.count - i - 1));
+            cstrs.count--;
+            break;
+        }
+    }
+    return cstrs;
+}
+
+Cstr cstr_join(Cstr sep, Cstr first, ...)
+{
+    if (first == NULL) {
+        return "";
+    }
+
+    const size_t sep_len = strlen(sep);
+    String_Builder sb = {0};
+    sb_append_cstr(&sb, first);
+
+    va_list args;
+    va_start(args, first);
+    for (Cstr next = va_arg(args, Cstr);
+            next != NULL;
+            next = va_arg(args, Cstr)) {
+        sb_append_bytes(&sb, sep, sep_len);
+        sb_append_cstr(&sb, next);
+    }
+    va_end(args);
+
+    return sb_to_cstr(&sb);
+}
+
+static char *nobuild__sb_realloc(String_Builder *sb, size_t capacity)
+{
+    if (sb->arena != NULL) {
+        return arena_realloc(sb->arena, sb->elems, sb->capacity, capacity);
+    }
+    return temp_realloc(sb->elems, sb->capacity, capacity);
+}
+
+void sb_reserve(String_Builder *sb, size_t size)
+{
+    const size_t needed = sb->count + size + 1;
+    if (needed <= sb->capacity) {
+        return;
+    }
+
+    size_t capacity = sb->capacity > 0 ? sb->capacity : 64;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    sb->elems = nobuild__sb_realloc(sb, capacity);
+    sb->capacity = capacity;
+}
+
+void sb_append_bytes(String_Builder *sb, const void *bytes, size_t size)
+{
+    sb_reserve(sb, size);
+    memcpy(sb->elems + sb->count, bytes, size);
+    sb->count += size;
+}
+
+void sb_append_cstr(String_Builder *sb, Cstr cstr)
+{
+    sb_append_bytes(sb, cstr, strlen(cstr));
+}
+
+void sb_append_sv(String_Builder *sb, String_View sv)
+{
+    sb_append_bytes(sb, sv.data, sv.count);
+}
+
+void sb_append_fmt(String_Builder *sb, const char *fmt, ...)
+{
+    sb_reserve(sb, 0);
+
+    // Try formatting into the capacity that is left first, and again once the size is known
+    const size_t available = sb->capacity - sb->count;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(sb->elems + sb->count, available, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        PANIC("Could not format string %s: %s", fmt, nobuild__strerror(errno));
+    }
+
+    if ((size_t) n >= available) {
+        sb_reserve(sb, (size_t) n);
+        va_start(args, fmt);
+        vsnprintf(sb->elems + sb->count, (size_t) n + 1, fmt, args);
+        va_end(args);
+    }
+    sb->count += (size_t) n;
+}
+
+Cstr sb_to_cstr(String_Builder *sb)
+{
+    sb_reserve(sb, 0);
+    sb->elems[sb->count] = '\0';
+    char *result = nobuild__sb_realloc(sb, sb->count + 1);
+
+    String_Builder empty = { .arena = sb->arena };
+    *sb = empty;
+    return result;
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_CSTR_I_
 #endif // NOBUILD_IMPLEMENTATION
@@ -26,7 +26,11 @@ typedef struct {
     Fd write;
 } Pipe;
 
+// Both ends are closed on exec, so only the children they are handed to keep them open
 Pipe pipe_make(void);
+// Asks for a pipe capacity of at least `size` bytes and returns the capacity the
+// pipe ended up with, or 0 where it cannot be changed
+size_t pipe_set_size(Pipe pip, size_t size);
 
 Fd fd_open_for_read(const char *path);
 Fd fd_open_for_write(const char *path);
@@ -34,9 +38,77 @@ size_t fd_read(Fd fd, void *buf, unsigned long count);
 size_t fd_write(Fd fd, void *buf, unsigned long count);
 int fd_printf(Fd fd, const char *fmt, ...) NOBUILD_PRINTF_FORMAT(2, 3);
 void fd_close(Fd fd);
+// Moves everything from `in` to `out` until the end of `in`, or until `out` is a
+// pipe without readers. Uses splice(2) when either side is a pipe on Linux.
+unsigned long long fd_pump(Fd in, Fd out);
+// Copies everything from `in` to both `out1` and `out2`, with tee(2) when `in` is
+// a pipe on Linux. An output without readers is dropped and the other one is kept.
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2);
+
+// The whole contents of a file, see `file_map()`
+typedef struct {
+    const char *data;
+    size_t size;
+    // Whether `data` is a memory mapping rather than a copy in a buffer
+    int mapped;
+} File_View;
+
+// Makes the whole file at `path` readable through `view`. Files of 64 KiB or more
+// are memory mapped for sequential access, smaller ones are read in a single read
+// into a null terminated buffer. Returns 0, or the errno of what failed.
+int file_map(const char *path, File_View *view);
+void file_unmap(File_View view);
+
+// An output that is written to `<path>.tmp.<pid>` and only renamed over `path` once
+// it is complete, so an interrupted build never leaves a truncated `path` with a
+// fresh modification time behind
+typedef struct {
+    Fd fd;
+    const char *path;
+    char *tmp_path;
+} Atomic_File;
+
+Atomic_File atomic_file_open(const char *path);
+// Closes the file and renames it over its path
+void atomic_file_commit(Atomic_File *file);
+// Closes and removes the file, leaving its path as it was
+void atomic_file_abort(Atomic_File *file);
+// Commits are not flushed to disk, which only matters if the whole system goes down.
+// With sync enabled every commit is remembered until `atomic_file_sync()` flushes
+// them and their directories at once, which also happens when the program exits.
+// Temporary files that were neither committed nor aborted are removed at exit, so a
+// PANIC in the middle of a step leaves none behind.
+void atomic_file_set_sync(int enabled);
+void atomic_file_sync(void);
 
 void pid_wait(Pid pid);
 
+// Define `NOBUILD_NO_THREADS` to build without a thread library. Threads then run
+// to completion inside `thread_create()` and mutexes do nothing.
+#if defined(NOBUILD_NO_THREADS)
+typedef int Thread;
+typedef int Mutex;
+#elif !defined(_WIN32)
+#    include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#else
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+#endif
+
+typedef void (*Thread_Fn)(void *data);
+
+Thread thread_create(Thread_Fn fn, void *data);
+void thread_join(Thread thread);
+// Number of online processors, at least 1
+size_t thread_count(void);
+
+void mutex_init(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+
 #endif  // NOBUILD_IO_H_
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -50,14 +122,31 @@ void pid_wait(Pid pid);
 #	include <sys/stat.h>
 #	include <unistd.h>
 #	include <fcntl.h>
+#	include <sys/mman.h>
 
 // Avoid requiring the user to define `_POSIX_C_SOURCE` as `200809L`
 char *strsignal(int sig);
+// Hidden along with the rest of the BSD extensions
+int madvise(void *addr, size_t length, int advice);
+#	ifndef MADV_SEQUENTIAL
+#		define MADV_SEQUENTIAL 2
+#	endif
+
+#	ifdef __linux__
+#		include <sys/syscall.h>
+// Avoid requiring the user to define `_GNU_SOURCE`
+long syscall(long number, ...);
+#		define NOBUILD__F_SETPIPE_SZ 1031
+#		define NOBUILD__F_GETPIPE_SZ 1032
+#		define NOBUILD__SPLICE_F_MOVE 1
+#		define NOBUILD__SPLICE_F_MORE 4
+#	endif // __linux__
 #else
 #	include <assert.h>
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
@@ -83,8 +172,22 @@ char *strsignal(int sig);
 #	endif
 #endif
 
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
 NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
 
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
 void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 #define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
 
@@ -109,6 +212,18 @@ void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 
 #include <stdlib.h>
 
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
 void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
 {
     fprintf(stream, "[%s] ", tag);
@@ -122,8 +237,24 @@ void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
     nobuild__vlog(stream, tag, fmt, args);
 }
 
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
 void info(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "INFO", fmt, args);
@@ -132,6 +263,10 @@ void info(const char *fmt, ...)
 
 void warn(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "WARN", fmt, args);
@@ -140,6 +275,10 @@ void warn(const char *fmt, ...)
 
 void erro(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "ERRO", fmt, args);
@@ -173,6 +312,396 @@ void todo_safe(const char *fmt, ...)
 }
 
 
+
+// Request POSIX 2008 for `clock_gettime()` under -std=c99, which has to happen before
+// the first system header is included
+#	if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE)
+#		define _POSIX_C_SOURCE 200809L
+#	endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accounting of where a build spends its memory and time. When `NOBUILD_STATS` is
+// defined before nobuild is included it counts
+//
+//   - the heap and temporary arena allocations of every module and of the user's code,
+//   - the stat, open, read, write, fork, exec and waitpid calls and the time spent in them,
+//   - the bytes copied by `path_copy()` and pumped through chains by nobuild,
+//
+// and prints a summary to stderr when the program exits, or writes it as JSON to the
+// file that the `NOBUILD_STATS_JSON` environment variable names. Without the define
+// all of it compiles away.
+//
+//     $ cc -DNOBUILD_STATS -o nobuild nobuild.c && NOBUILD_STATS_JSON=stats.json ./nobuild
+//
+// What a module allocates for its caller, like the string that `PATH()` returns, is
+// counted for the module, and the storage of the `da_*` arrays for the arena. Exec is
+// the time from the fork until the child runs the command, which `cmd_run_async()`
+// waits for while counting. Windows has no such split and counts `CreateProcess()` as
+// a fork. Times are taken from the monotonic clock, or from the wall clock when a
+// system header was included before nobuild under -std=c99.
+
+typedef enum {
+    STATS_USER = 0,
+    STATS_ARENA,
+    STATS_CSTR,
+    STATS_IO,
+    STATS_CMD,
+    STATS_BULK,
+    STATS_PATH,
+    STATS_EMBED,
+    STATS_MODULE_COUNT,
+} Stats_Module;
+
+typedef enum {
+    STATS_STAT = 0,
+    STATS_OPEN,
+    STATS_READ,
+    STATS_WRITE,
+    STATS_FORK,
+    STATS_EXEC,
+    STATS_WAITPID,
+    STATS_CALL_COUNT,
+} Stats_Call;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} Stats_Allocs;
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long nanos;
+} Stats_Calls;
+
+typedef struct {
+    // Since the first counted event
+    unsigned long long nanos;
+    Stats_Allocs heap[STATS_MODULE_COUNT];
+    Stats_Allocs temp[STATS_MODULE_COUNT];
+    Stats_Calls calls[STATS_CALL_COUNT];
+    unsigned long long copied_bytes;
+    unsigned long long piped_bytes;
+} Stats;
+
+// The module that the code which follows counts its allocations for
+#ifndef NOBUILD__STATS_MODULE
+#	define NOBUILD__STATS_MODULE STATS_USER
+#endif
+
+#ifdef NOBUILD_STATS
+
+Stats stats_get(void);
+void stats_print(FILE *stream);
+// Returns 0 and sets errno when `path` could not be written
+int stats_write_json(const char *path);
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size);
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size);
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size);
+void nobuild__stats_temp(Stats_Module module, size_t size);
+void nobuild__stats_begin(void);
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result);
+void nobuild__stats_copied(unsigned long long bytes);
+void nobuild__stats_piped(unsigned long long bytes);
+
+#	define NOBUILD__MALLOC(size) nobuild__stats_malloc(NOBUILD__STATS_MODULE, (size))
+#	define NOBUILD__CALLOC(count, size) nobuild__stats_calloc(NOBUILD__STATS_MODULE, (count), (size))
+#	define NOBUILD__REALLOC(pointer, size) nobuild__stats_realloc(NOBUILD__STATS_MODULE, (pointer), (size))
+// Evaluates to the result of `expr` as an `intptr_t`, which fits the numbers and
+// handles that system calls return. The call is counted and timed as `call`.
+#	define NOBUILD__STATS_CALL(call, expr) (nobuild__stats_begin(), nobuild__stats_end((call), (intptr_t) (expr)))
+#	define NOBUILD__STATS_COPIED(bytes) nobuild__stats_copied((unsigned long long) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) nobuild__stats_piped((unsigned long long) (bytes))
+#else
+#	define NOBUILD__MALLOC(size) malloc(size)
+#	define NOBUILD__CALLOC(count, size) calloc((count), (size))
+#	define NOBUILD__REALLOC(pointer, size) realloc((pointer), (size))
+#	define NOBUILD__STATS_CALL(call, expr) (expr)
+#	define NOBUILD__STATS_COPIED(bytes) ((void) (bytes))
+#	define NOBUILD__STATS_PIPED(bytes) ((void) (bytes))
+#endif // NOBUILD_STATS
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef NOBUILD_STATS
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#	include <sys/types.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include <sys/time.h>
+#else
+#	define WIN32_MEAN_AND_LEAN
+#	include <windows.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The counters are shared by all threads and only ever added to. The start flag is
+// claimed with `ONCE` and set with `PUBLISH` once what it guards is written, which
+// readers see by checking it with `ACQUIRE`.
+#if defined(NOBUILD_NO_THREADS)
+#	define NOBUILD__STATS_THREAD_LOCAL
+#	define NOBUILD__STATS_ADD(counter, n) (void) ((counter) += (n))
+#	define NOBUILD__STATS_LOAD(counter) (counter)
+#	define NOBUILD__STATS_ONCE(flag) ((flag) == 0 ? ((flag) = 1) : 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) ((flag) = (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) (flag)
+#elif defined(_MSC_VER)
+#	define NOBUILD__STATS_THREAD_LOCAL __declspec(thread)
+#	define NOBUILD__STATS_ADD(counter, n) (void) InterlockedExchangeAdd64((volatile LONG64 *) &(counter), (LONG64) (n))
+#	define NOBUILD__STATS_LOAD(counter) (unsigned long long) InterlockedCompareExchange64((volatile LONG64 *) &(counter), 0, 0)
+#	define NOBUILD__STATS_ONCE(flag) (InterlockedCompareExchange64((volatile LONG64 *) &(flag), 1, 0) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) (void) InterlockedExchange64((volatile LONG64 *) &(flag), (LONG64) (value))
+#	define NOBUILD__STATS_ACQUIRE(flag) NOBUILD__STATS_LOAD(flag)
+#else
+#	define NOBUILD__STATS_THREAD_LOCAL __thread
+#	define NOBUILD__STATS_ADD(counter, n) (void) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#	define NOBUILD__STATS_ONCE(flag) (__atomic_exchange_n(&(flag), 1, __ATOMIC_RELAXED) == 0)
+#	define NOBUILD__STATS_PUBLISH(flag, value) __atomic_store_n(&(flag), (value), __ATOMIC_RELEASE)
+#	define NOBUILD__STATS_ACQUIRE(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#endif
+
+static const char *const nobuild__stats_module_names[STATS_MODULE_COUNT] = {
+    "user", "arena", "cstr", "io", "cmd", "bulk", "path", "embed",
+};
+
+static const char *const nobuild__stats_call_names[STATS_CALL_COUNT] = {
+    "stat", "open", "read", "write", "fork", "exec", "waitpid",
+};
+
+static Stats nobuild__stats = {0};
+// 0 before the first event, 1 while its thread starts the clock and 2 once the start
+// time and the pid are written
+static unsigned long long nobuild__stats_started = 0;
+static unsigned long long nobuild__stats_start_nanos = 0;
+#ifndef _WIN32
+// Forked children inherit the exit handler, but the report is only for the parent
+static pid_t nobuild__stats_pid = 0;
+#endif
+
+static NOBUILD__STATS_THREAD_LOCAL unsigned long long nobuild__stats_call_nanos = 0;
+
+static unsigned long long nobuild__stats_now(void)
+{
+#ifndef _WIN32
+#	ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#	else
+    // The monotonic clock is hidden when a system header came before nobuild
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + (unsigned long long) tv.tv_usec * 1000ULL;
+#	endif
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long) ((double) counter.QuadPart / (double) frequency.QuadPart * 1e9);
+#endif // _WIN32
+}
+
+static void nobuild__stats_report(void)
+{
+#ifndef _WIN32
+    if (getpid() != nobuild__stats_pid) {
+        return;
+    }
+#endif // _WIN32
+
+    const char *path = getenv("NOBUILD_STATS_JSON");
+    if (path == NULL || *path == '\0') {
+        stats_print(stderr);
+    } else if (!stats_write_json(path)) {
+        ERRO("Could not write the stats to %s: %s", path, strerror(errno));
+    }
+}
+
+// Starts the clock and registers the report on the first event
+static void nobuild__stats_start(void)
+{
+    if (NOBUILD__STATS_LOAD(nobuild__stats_started) != 0 || !NOBUILD__STATS_ONCE(nobuild__stats_started)) {
+        return;
+    }
+
+    nobuild__stats_start_nanos = nobuild__stats_now();
+#ifndef _WIN32
+    nobuild__stats_pid = getpid();
+#endif // _WIN32
+    NOBUILD__STATS_PUBLISH(nobuild__stats_started, 2);
+    atexit(nobuild__stats_report);
+}
+
+static void nobuild__stats_count(Stats_Allocs *allocs, size_t size)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(allocs->count, 1);
+    NOBUILD__STATS_ADD(allocs->bytes, size);
+}
+
+void *nobuild__stats_malloc(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return malloc(size);
+}
+
+void *nobuild__stats_calloc(Stats_Module module, size_t count, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], count * size);
+    return calloc(count, size);
+}
+
+void *nobuild__stats_realloc(Stats_Module module, void *pointer, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.heap[module], size);
+    return realloc(pointer, size);
+}
+
+void nobuild__stats_temp(Stats_Module module, size_t size)
+{
+    nobuild__stats_count(&nobuild__stats.temp[module], size);
+}
+
+void nobuild__stats_begin(void)
+{
+    nobuild__stats_call_nanos = nobuild__stats_now();
+}
+
+intptr_t nobuild__stats_end(Stats_Call call, intptr_t result)
+{
+    // The caller may look at the errno of the call
+    const int error = errno;
+    const unsigned long long nanos = nobuild__stats_now() - nobuild__stats_call_nanos;
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].count, 1);
+    NOBUILD__STATS_ADD(nobuild__stats.calls[call].nanos, nanos);
+    errno = error;
+    return result;
+}
+
+void nobuild__stats_copied(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.copied_bytes, bytes);
+}
+
+void nobuild__stats_piped(unsigned long long bytes)
+{
+    nobuild__stats_start();
+    NOBUILD__STATS_ADD(nobuild__stats.piped_bytes, bytes);
+}
+
+Stats stats_get(void)
+{
+    Stats stats = {0};
+    if (NOBUILD__STATS_ACQUIRE(nobuild__stats_started) == 2) {
+        stats.nanos = nobuild__stats_now() - nobuild__stats_start_nanos;
+    }
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        stats.heap[i].count = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].count);
+        stats.heap[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.heap[i].bytes);
+        stats.temp[i].count = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].count);
+        stats.temp[i].bytes = NOBUILD__STATS_LOAD(nobuild__stats.temp[i].bytes);
+    }
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        stats.calls[i].count = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].count);
+        stats.calls[i].nanos = NOBUILD__STATS_LOAD(nobuild__stats.calls[i].nanos);
+    }
+    stats.copied_bytes = NOBUILD__STATS_LOAD(nobuild__stats.copied_bytes);
+    stats.piped_bytes = NOBUILD__STATS_LOAD(nobuild__stats.piped_bytes);
+    return stats;
+}
+
+// Modules and calls that never came up are left out
+void stats_print(FILE *stream)
+{
+    const Stats stats = stats_get();
+    fprintf(stream, "[INFO] STATS: %.3fs\n", (double) stats.nanos / 1e9);
+
+    fprintf(stream, "    %-8s %12s %14s %12s %14s\n", "module", "heap allocs", "heap bytes", "temp allocs", "temp bytes");
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        if (stats.heap[i].count == 0 && stats.temp[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14llu %12llu %14llu\n", nobuild__stats_module_names[i],
+                stats.heap[i].count, stats.heap[i].bytes, stats.temp[i].count, stats.temp[i].bytes);
+    }
+
+    fprintf(stream, "    %-8s %12s %14s\n", "call", "count", "seconds");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        if (stats.calls[i].count == 0) {
+            continue;
+        }
+        fprintf(stream, "    %-8s %12llu %14.6f\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9);
+    }
+
+    fprintf(stream, "    %llu bytes copied, %llu bytes piped\n", stats.copied_bytes, stats.piped_bytes);
+}
+
+static void nobuild__stats_write_allocs(FILE *file, const char *name, const Stats_Allocs *allocs)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    for (size_t i = 0; i < STATS_MODULE_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"bytes\": %llu }%s\n", nobuild__stats_module_names[i],
+                allocs[i].count, allocs[i].bytes, i + 1 < STATS_MODULE_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+}
+
+int stats_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    const Stats stats = stats_get();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seconds\": %.6f,\n", (double) stats.nanos / 1e9);
+    nobuild__stats_write_allocs(file, "heap", stats.heap);
+    nobuild__stats_write_allocs(file, "temp", stats.temp);
+    fprintf(file, "  \"calls\": {\n");
+    for (size_t i = 0; i < STATS_CALL_COUNT; ++i) {
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"seconds\": %.6f }%s\n", nobuild__stats_call_names[i],
+                stats.calls[i].count, (double) stats.calls[i].nanos / 1e9, i + 1 < STATS_CALL_COUNT ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"copied_bytes\": %llu,\n", stats.copied_bytes);
+    fprintf(file, "  \"piped_bytes\": %llu\n", stats.piped_bytes);
+    fprintf(file, "}\n");
+
+    const int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        if (errno == 0) {
+            errno = EIO;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+#endif // NOBUILD_STATS
+
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_IO
+
 // Multiple modules could define this function, so add a guard around it to prevent redefinition
 #if defined(_WIN32) && !defined(NOBUILD__GETLASTERROR)
 #define NOBUILD__GETLASTERROR
@@ -210,6 +739,9 @@ Pipe pipe_make(void)
 
     pip.read = pipefd[0];
     pip.write = pipefd[1];
+    if (fcntl(pip.read, F_SETFD, FD_CLOEXEC) < 0 || fcntl(pip.write, F_SETFD, FD_CLOEXEC) < 0) {
+        PANIC("Could not set close-on-exec on pipe: %s", strerror(errno));
+    }
 #else
     // https://docs.microsoft.com/en-us/windows/win32/ProcThread/creating-a-child-process-with-redirected-input-and-output
 
@@ -228,7 +760,7 @@ Pipe pipe_make(void)
 Fd fd_open_for_read(const char *path)
 {
 #ifndef _WIN32
-    Fd result = open(path, O_RDONLY);
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
     if (result < 0) {
         PANIC("Could not open file %s: %s", path, strerror(errno));
     }
@@ -239,14 +771,14 @@ Fd fd_open_for_read(const char *path)
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
                     path,
                     GENERIC_READ,
                     0,
                     &saAttr,
                     OPEN_EXISTING,
                     FILE_ATTRIBUTE_READONLY,
-                    NULL);
+                    NULL));
 
     if (result == INVALID_HANDLE_VALUE) {
         PANIC("Could not open file %s", path);
@@ -259,9 +791,9 @@ Fd fd_open_for_read(const char *path)
 Fd fd_open_for_write(const char *path)
 {
 #ifndef _WIN32
-    Fd result = open(path,
-                     O_WRONLY | O_CREAT | O_TRUNC,
-                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    Fd result = NOBUILD__STATS_CALL(STATS_OPEN, open(path,
+                                                     O_WRONLY | O_CREAT | O_TRUNC,
+                                                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
     if (result < 0) {
         PANIC("Could not open file %s: %s", path, strerror(errno));
     }
@@ -271,7 +803,7 @@ Fd fd_open_for_write(const char *path)
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
 
-    Fd result = CreateFile(
+    Fd result = (Fd) NOBUILD__STATS_CALL(STATS_OPEN, CreateFile(
                     path,                  // name of the write
                     GENERIC_WRITE,         // open for writing
                     0,                     // do not share
@@ -279,7 +811,7 @@ Fd fd_open_for_write(const char *path)
                     CREATE_ALWAYS,         // Same as `O_CREAT | O_TRUNC`
                     FILE_ATTRIBUTE_NORMAL, // normal file
                     NULL                   // no attr. template
-                );
+                ));
 
     if (result == INVALID_HANDLE_VALUE) {
         PANIC("Could not open file %s: %s", path, nobuild__GetLastErrorAsString());
@@ -292,14 +824,14 @@ Fd fd_open_for_write(const char *path)
 size_t fd_read(Fd fd, void *buf, unsigned long count)
 {
 #ifndef _WIN32
-    ssize_t bytes = read(fd, buf, count);
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_READ, read(fd, buf, count));
     if (bytes == -1) {
         ERRO("Read error: %s", strerror(errno));
         return 0;
     }
 #else
     DWORD bytes;
-    if (!ReadFile(fd, buf, count, &bytes, NULL)) {
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buf, count, &bytes, NULL))) {
         ERRO("Read error: %s", nobuild__GetLastErrorAsString());
         return 0;
     }
@@ -311,14 +843,14 @@ size_t fd_read(Fd fd, void *buf, unsigned long count)
 size_t fd_write(Fd fd, void *buf, unsigned long count)
 {
 #ifndef _WIN32
-    ssize_t bytes = read(fd, buf, (size_t) count);
+    ssize_t bytes = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buf, (size_t) count));
     if (bytes == -1) {
         ERRO("Write error: %s", strerror(errno));
         return 0;
     }
 #else
     DWORD bytes;
-    if (!WriteFile(fd, buf, count, &bytes, NULL)) {
+    if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buf, count, &bytes, NULL))) {
         ERRO("Write error: %s", nobuild__GetLastErrorAsString());
         return 0;
     }
@@ -341,7 +873,7 @@ int fd_printf(Fd fd, const char *fmt, ...) {
 #ifndef _WIN32
      char buffer[len + 1];
 #else
-     char *buffer = malloc(sizeof *buffer * (len + 1));
+     char *buffer = NOBUILD__MALLOC(sizeof *buffer * (len + 1));
 #endif
 
     va_start(args, fmt);
@@ -369,12 +901,671 @@ void fd_close(Fd fd)
 #endif // _WIN32
 }
 
+size_t pipe_set_size(Pipe pip, size_t size)
+{
+#ifdef __linux__
+    if (fcntl(pip.write, NOBUILD__F_SETPIPE_SZ, (int) size) < 0) {
+        // Above /proc/sys/fs/pipe-max-size without CAP_SYS_RESOURCE
+        WARN("Could not set pipe size to %zu bytes: %s", size, strerror(errno));
+        errno = 0;
+    }
+
+    int result = fcntl(pip.write, NOBUILD__F_GETPIPE_SZ);
+    return result > 0 ? (size_t) result : 0;
+#else
+    (void) pip;
+    (void) size;
+    return 0;
+#endif // __linux__
+}
+
+#define NOBUILD__PUMP_SIZE (1024 * 1024)
+
+// Returns 0 when `fd` is a pipe that nobody reads anymore
+static int nobuild__fd_write_all(Fd fd, const char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (size_t written = 0; written < count;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_WRITE, write(fd, buffer + written, count - written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return 0;
+            }
+            PANIC("Could not write to file descriptor: %s", strerror(errno));
+        }
+        written += (size_t) n;
+    }
+#else
+    for (size_t written = 0; written < count;) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_WRITE, WriteFile(fd, buffer + written, (DWORD) (count - written), &n, NULL))) {
+            if (GetLastError() == ERROR_NO_DATA || GetLastError() == ERROR_BROKEN_PIPE) {
+                return 0;
+            }
+            PANIC("Could not write to file: %s", nobuild__GetLastErrorAsString());
+        }
+        written += n;
+    }
+#endif // _WIN32
+
+    return 1;
+}
+
+// Returns 0 at the end of `fd`
+static size_t nobuild__fd_read_some(Fd fd, char *buffer, size_t count)
+{
+#ifndef _WIN32
+    for (;;) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer, count));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PANIC("Could not read from file descriptor: %s", strerror(errno));
+        }
+        return (size_t) n;
+    }
+#else
+    DWORD n = 0;
+    if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(fd, buffer, (DWORD) count, &n, NULL))) {
+        if (GetLastError() == ERROR_BROKEN_PIPE) {
+            return 0;
+        }
+        PANIC("Could not read from file: %s", nobuild__GetLastErrorAsString());
+    }
+    return n;
+#endif // _WIN32
+}
+
+#ifdef __linux__
+// Moves exactly `count` bytes from the pipe `in` to `out`. Returns 0 when `out`
+// has no readers, after dropping what is left of the `count` bytes from `in`.
+static int nobuild__fd_splice_exactly(Fd in, Fd out, size_t count)
+{
+    while (count > 0) {
+        long n = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, count, NOBUILD__SPLICE_F_MOVE));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EPIPE) {
+                PANIC("Could not splice between file descriptors: %s", strerror(errno));
+            }
+
+            errno = 0;
+            char buffer[4096];
+            while (count > 0) {
+                size_t dropped = nobuild__fd_read_some(in, buffer, count < sizeof(buffer) ? count : sizeof(buffer));
+                if (dropped == 0) {
+                    break;
+                }
+                count -= dropped;
+            }
+            return 0;
+        }
+        count -= (size_t) n;
+    }
+
+    return 1;
+}
+#endif // __linux__
+
+unsigned long long fd_pump(Fd in, Fd out)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_splice, in, NULL, out, NULL, (size_t) NOBUILD__PUMP_SIZE,
+                                                              NOBUILD__SPLICE_F_MOVE | NOBUILD__SPLICE_F_MORE));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total;
+            }
+
+            // Neither side is a pipe, or the file does not support splicing
+            break;
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    for (;;) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0 || !nobuild__fd_write_all(out, buffer, bytes)) {
+            break;
+        }
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+unsigned long long fd_tee(Fd in, Fd out1, Fd out2)
+{
+    unsigned long long total = 0;
+
+#ifdef __linux__
+    for (;;) {
+        // Duplicate what is buffered in `in` into `out1` without consuming it, then
+        // move the same bytes into `out2`
+        long bytes = NOBUILD__STATS_CALL(STATS_WRITE, syscall(SYS_tee, in, out1, (size_t) NOBUILD__PUMP_SIZE, 0u));
+        if (bytes == 0) {
+            return total;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                errno = 0;
+                return total + fd_pump(in, out2);
+            }
+
+            // `in` or `out1` is not a pipe
+            break;
+        }
+
+        if (!nobuild__fd_splice_exactly(in, out2, (size_t) bytes)) {
+            return total + (unsigned long long) bytes + fd_pump(in, out1);
+        }
+        total += (unsigned long long) bytes;
+    }
+    errno = 0;
+#endif // __linux__
+
+    char *buffer = NOBUILD__MALLOC(NOBUILD__PUMP_SIZE);
+    if (buffer == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+
+    int alive1 = 1;
+    int alive2 = 1;
+    while (alive1 || alive2) {
+        size_t bytes = nobuild__fd_read_some(in, buffer, NOBUILD__PUMP_SIZE);
+        if (bytes == 0) {
+            break;
+        }
+
+        alive1 = alive1 && nobuild__fd_write_all(out1, buffer, bytes);
+        alive2 = alive2 && nobuild__fd_write_all(out2, buffer, bytes);
+        total += bytes;
+    }
+
+    free(buffer);
+    return total;
+}
+
+// Mapping costs a few page faults and a TLB shootdown on unmap, which is more
+// than copying a small file
+#define NOBUILD__MAP_THRESHOLD (64 * 1024)
+
+#ifdef _WIN32
+static int nobuild__errno_from_win32(DWORD error)
+{
+    switch (error) {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+        return ENOENT;
+    case ERROR_ACCESS_DENIED:
+        return EACCES;
+    case ERROR_NOT_ENOUGH_MEMORY:
+        return ENOMEM;
+    default:
+        return EIO;
+    }
+}
+#endif // _WIN32
+
+int file_map(const char *path, File_View *view)
+{
+    view->data = NULL;
+    view->size = 0;
+    view->mapped = 0;
+
+#ifndef _WIN32
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        int error = errno;
+        errno = 0;
+        return error;
+    }
+
+    struct stat statbuf;
+    if (NOBUILD__STATS_CALL(STATS_STAT, fstat(fd, &statbuf)) < 0) {
+        int error = errno;
+        errno = 0;
+        close(fd);
+        return error;
+    }
+
+    if (S_ISDIR(statbuf.st_mode)) {
+        close(fd);
+        return EISDIR;
+    }
+
+    const size_t size = (size_t) statbuf.st_size;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            close(fd);
+            view->data = data;
+            view->size = size;
+            view->mapped = 1;
+            return 0;
+        }
+
+        // Some filesystems cannot map files, read those instead
+        errno = 0;
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        close(fd);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        ssize_t n = NOBUILD__STATS_CALL(STATS_READ, read(fd, buffer + count, size - count));
+        if (n < 0 && errno == EINTR) {
+            errno = 0;
+            continue;
+        }
+
+        if (n < 0) {
+            int error = errno;
+            errno = 0;
+            free(buffer);
+            close(fd);
+            return error;
+        }
+
+        // The file shrank since fstat()
+        if (n == 0) {
+            break;
+        }
+        count += (size_t) n;
+    }
+    close(fd);
+#else
+    HANDLE file = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                                                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (file == INVALID_HANDLE_VALUE) {
+        return nobuild__errno_from_win32(GetLastError());
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        int error = nobuild__errno_from_win32(GetLastError());
+        CloseHandle(file);
+        return error;
+    }
+
+    const size_t size = (size_t) file_size.QuadPart;
+    if (size >= NOBUILD__MAP_THRESHOLD) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            // The view keeps the file alive on its own
+            void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (data != NULL) {
+                CloseHandle(file);
+                view->data = data;
+                view->size = size;
+                view->mapped = 1;
+                return 0;
+            }
+        }
+    }
+
+    char *buffer = NOBUILD__MALLOC(size + 1);
+    if (buffer == NULL) {
+        CloseHandle(file);
+        return ENOMEM;
+    }
+
+    size_t count = 0;
+    while (count < size) {
+        DWORD n = 0;
+        if (!NOBUILD__STATS_CALL(STATS_READ, ReadFile(file, buffer + count, (DWORD) (size - count), &n, NULL))) {
+            int error = nobuild__errno_from_win32(GetLastError());
+            free(buffer);
+            CloseHandle(file);
+            return error;
+        }
+
+        if (n == 0) {
+            break;
+        }
+        count += n;
+    }
+    CloseHandle(file);
+#endif // _WIN32
+
+    buffer[count] = '\0';
+    view->data = buffer;
+    view->size = count;
+    return 0;
+}
+
+void file_unmap(File_View view)
+{
+    if (!view.mapped) {
+        free((char *) view.data);
+        return;
+    }
+
+#ifndef _WIN32
+    munmap((void *) view.data, view.size);
+#else
+    UnmapViewOfFile(view.data);
+#endif // _WIN32
+}
+
+// Multiple modules could define these locks, so add a guard around them to prevent redefinition
+#ifndef NOBUILD__LOCK_INIT
+#if defined(NOBUILD_NO_THREADS)
+typedef int Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT 0
+#	define NOBUILD__LOCK(lock) (void) (lock)
+#	define NOBUILD__UNLOCK(lock) (void) (lock)
+#elif !defined(_WIN32)
+typedef pthread_mutex_t Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#	define NOBUILD__LOCK(lock) pthread_mutex_lock(lock)
+#	define NOBUILD__UNLOCK(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK Nobuild__Lock;
+#	define NOBUILD__LOCK_INIT SRWLOCK_INIT
+#	define NOBUILD__LOCK(lock) AcquireSRWLockExclusive(lock)
+#	define NOBUILD__UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#endif
+#endif // NOBUILD__LOCK_INIT
+
+static struct {
+    Nobuild__Lock lock;
+    // Whether the exit handler was registered, by the process with `pid`
+    int registered;
+    unsigned long pid;
+    int sync;
+    // Committed since the last `atomic_file_sync()`
+    char **paths;
+    size_t count;
+    size_t capacity;
+    // Temporary files that were neither renamed nor removed yet
+    const char **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} nobuild__atomic = { .lock = NOBUILD__LOCK_INIT };
+
+static unsigned long nobuild__getpid(void)
+{
+#ifndef _WIN32
+    return (unsigned long) getpid();
+#else
+    return (unsigned long) GetCurrentProcessId();
+#endif // _WIN32
+}
+
+// Removes the temporary files that a failed build left behind, PANIC included, and
+// flushes the commits when sync is enabled
+static void nobuild__atomic_exit(void)
+{
+    // Forked children exit through here too, but the files belong to the parent
+    if (nobuild__getpid() != nobuild__atomic.pid) {
+        return;
+    }
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = 0; i < nobuild__atomic.pending_count; ++i) {
+        remove(nobuild__atomic.pending[i]);
+    }
+    nobuild__atomic.pending_count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+
+    atomic_file_sync();
+}
+
+// Must be called with the lock held
+static void nobuild__atomic_register(void)
+{
+    if (!nobuild__atomic.registered) {
+        nobuild__atomic.registered = 1;
+        nobuild__atomic.pid = nobuild__getpid();
+        atexit(nobuild__atomic_exit);
+    }
+}
+
+// Has `tmp_path` removed at exit unless it is forgotten before. The path is not copied.
+static void nobuild__atomic_pending_add(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    nobuild__atomic_register();
+    if (nobuild__atomic.pending_count >= nobuild__atomic.pending_capacity) {
+        nobuild__atomic.pending_capacity = nobuild__atomic.pending_capacity ? nobuild__atomic.pending_capacity * 2 : 16;
+        nobuild__atomic.pending = NOBUILD__REALLOC(nobuild__atomic.pending,
+                                                   sizeof(*nobuild__atomic.pending) * nobuild__atomic.pending_capacity);
+        if (nobuild__atomic.pending == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.pending[nobuild__atomic.pending_count++] = tmp_path;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static void nobuild__atomic_pending_remove(const char *tmp_path)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    for (size_t i = nobuild__atomic.pending_count; i-- > 0;) {
+        if (nobuild__atomic.pending[i] == tmp_path) {
+            nobuild__atomic.pending[i] = nobuild__atomic.pending[--nobuild__atomic.pending_count];
+            break;
+        }
+    }
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+static int nobuild__atomic_sync_enabled(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    int enabled = nobuild__atomic.sync;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+    return enabled;
+}
+
+static char *nobuild__atomic_tmp_path(const char *path)
+{
+    unsigned long pid = nobuild__getpid();
+    size_t size = strlen(path) + 32;
+    char *tmp_path = NOBUILD__MALLOC(size);
+    if (tmp_path == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    snprintf(tmp_path, size, "%s.tmp.%lu", path, pid);
+    return tmp_path;
+}
+
+// Remembers `path` for `atomic_file_sync()` when sync is enabled
+static void nobuild__atomic_sync_push(const char *path)
+{
+    if (!nobuild__atomic_sync_enabled()) {
+        return;
+    }
+
+    size_t size = strlen(path) + 1;
+    char *copy = NOBUILD__MALLOC(size);
+    if (copy == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    memcpy(copy, path, size);
+
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (nobuild__atomic.count >= nobuild__atomic.capacity) {
+        nobuild__atomic.capacity = nobuild__atomic.capacity ? nobuild__atomic.capacity * 2 : 64;
+        nobuild__atomic.paths = NOBUILD__REALLOC(nobuild__atomic.paths,
+                                                 sizeof(*nobuild__atomic.paths) * nobuild__atomic.capacity);
+        if (nobuild__atomic.paths == NULL) {
+            PANIC("Could not allocate memory: %s", strerror(errno));
+        }
+    }
+    nobuild__atomic.paths[nobuild__atomic.count++] = copy;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+// Moves the temporary file of `file` over its path, once whoever wrote it has closed it
+static void nobuild__atomic_file_rename(Atomic_File *file)
+{
+#ifndef _WIN32
+    if (rename(file->tmp_path, file->path) < 0) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, strerror(errno));
+    }
+#else
+    if (!MoveFileExA(file->tmp_path, file->path, MOVEFILE_REPLACE_EXISTING)) {
+        PANIC("Could not rename %s to %s: %s", file->tmp_path, file->path, nobuild__GetLastErrorAsString());
+    }
+#endif // _WIN32
+
+    nobuild__atomic_pending_remove(file->tmp_path);
+    nobuild__atomic_sync_push(file->path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+Atomic_File atomic_file_open(const char *path)
+{
+    Atomic_File file = {0};
+    file.path = path;
+    file.tmp_path = nobuild__atomic_tmp_path(path);
+    nobuild__atomic_pending_add(file.tmp_path);
+    file.fd = fd_open_for_write(file.tmp_path);
+    return file;
+}
+
+void atomic_file_commit(Atomic_File *file)
+{
+    fd_close(file->fd);
+    nobuild__atomic_file_rename(file);
+}
+
+void atomic_file_abort(Atomic_File *file)
+{
+    fd_close(file->fd);
+    remove(file->tmp_path);
+    nobuild__atomic_pending_remove(file->tmp_path);
+    free(file->tmp_path);
+    file->tmp_path = NULL;
+}
+
+void atomic_file_set_sync(int enabled)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (enabled) {
+        nobuild__atomic_register();
+    }
+    nobuild__atomic.sync = enabled;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
+#ifndef _WIN32
+static void nobuild__fsync_path(const char *path)
+{
+    int fd = NOBUILD__STATS_CALL(STATS_OPEN, open(path, O_RDONLY));
+    if (fd < 0) {
+        WARN("Could not open %s to flush it: %s", path, strerror(errno));
+        errno = 0;
+        return;
+    }
+
+    if (fsync(fd) < 0) {
+        WARN("Could not flush %s: %s", path, strerror(errno));
+        errno = 0;
+    }
+    close(fd);
+}
+#endif // _WIN32
+
+void atomic_file_sync(void)
+{
+    NOBUILD__LOCK(&nobuild__atomic.lock);
+    if (!nobuild__atomic.sync) {
+        NOBUILD__UNLOCK(&nobuild__atomic.lock);
+        return;
+    }
+
+#ifndef _WIN32
+    const char *last_dir = NULL;
+    size_t last_dir_len = 0;
+#endif // _WIN32
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        char *path = nobuild__atomic.paths[i];
+#ifndef _WIN32
+        nobuild__fsync_path(path);
+
+        // The renames live in the directories, flush each of them once in a row
+        char *sep = strrchr(path, '/');
+        size_t dir_len = sep ? (size_t) (sep - path) : 0;
+        if (last_dir == NULL || dir_len != last_dir_len || memcmp(last_dir, path, dir_len) != 0) {
+            if (dir_len == 0) {
+                nobuild__fsync_path(sep ? "/" : ".");
+            } else {
+                *sep = '\0';
+                nobuild__fsync_path(path);
+                *sep = '/';
+            }
+            last_dir = path;
+            last_dir_len = dir_len;
+        }
+#else
+        HANDLE handle = (HANDLE) NOBUILD__STATS_CALL(STATS_OPEN, CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                                                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+        if (handle == INVALID_HANDLE_VALUE || !FlushFileBuffers(handle)) {
+            WARN("Could not flush %s: %s", path, nobuild__GetLastErrorAsString());
+        }
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#endif // _WIN32
+    }
+
+    for (size_t i = 0; i < nobuild__atomic.count; ++i) {
+        free(nobuild__atomic.paths[i]);
+    }
+    nobuild__atomic.count = 0;
+    NOBUILD__UNLOCK(&nobuild__atomic.lock);
+}
+
 void pid_wait(Pid pid)
 {
 #ifndef _WIN32
     for (;;) {
         int wstatus = 0;
-        if (waitpid(pid, &wstatus, 0) < 0) {
+        if (NOBUILD__STATS_CALL(STATS_WAITPID, waitpid(pid, &wstatus, 0)) < 0) {
             PANIC("Could not wait on command (pid %d): %s", pid, strerror(errno));
         }
 
@@ -392,10 +1583,10 @@ void pid_wait(Pid pid)
         }
     }
 #else
-    DWORD result = WaitForSingleObject(
+    DWORD result = (DWORD) NOBUILD__STATS_CALL(STATS_WAITPID, WaitForSingleObject(
                        pid,     // HANDLE hHandle,
                        INFINITE // DWORD  dwMilliseconds
-                   );
+                   ));
 
     if (result == WAIT_FAILED) {
         PANIC("Could not wait on child process: %s", nobuild__GetLastErrorAsString());
@@ -414,5 +1605,137 @@ void pid_wait(Pid pid)
 #endif // _WIN32
 }
 
+typedef struct {
+    Thread_Fn fn;
+    void *data;
+} Nobuild__Thread_Start;
+
+#if !defined(NOBUILD_NO_THREADS) && !defined(_WIN32)
+static void *nobuild__thread_start(void *arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return NULL;
+}
+#elif !defined(NOBUILD_NO_THREADS)
+static DWORD WINAPI nobuild__thread_start(LPVOID arg)
+{
+    Nobuild__Thread_Start start = *(Nobuild__Thread_Start *) arg;
+    free(arg);
+    start.fn(start.data);
+    return 0;
+}
+#endif
+
+Thread thread_create(Thread_Fn fn, void *data)
+{
+#ifdef NOBUILD_NO_THREADS
+    fn(data);
+    return 0;
+#else
+    Nobuild__Thread_Start *start = NOBUILD__MALLOC(sizeof(*start));
+    if (start == NULL) {
+        PANIC("Could not allocate memory: %s", strerror(errno));
+    }
+    start->fn = fn;
+    start->data = data;
+
+#	ifndef _WIN32
+    Thread thread;
+    int error = pthread_create(&thread, NULL, nobuild__thread_start, start);
+    if (error != 0) {
+        PANIC("Could not create thread: %s", strerror(error));
+    }
+#	else
+    Thread thread = CreateThread(NULL, 0, nobuild__thread_start, start, 0, NULL);
+    if (thread == NULL) {
+        PANIC("Could not create thread: %s", nobuild__GetLastErrorAsString());
+    }
+#	endif // _WIN32
+
+    return thread;
+#endif // NOBUILD_NO_THREADS
+}
+
+void thread_join(Thread thread)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) thread;
+#elif !defined(_WIN32)
+    int error = pthread_join(thread, NULL);
+    if (error != 0) {
+        PANIC("Could not join thread: %s", strerror(error));
+    }
+#else
+    if (WaitForSingleObject(thread, INFINITE) == WAIT_FAILED) {
+        PANIC("Could not join thread: %s", nobuild__GetLastErrorAsString());
+    }
+    CloseHandle(thread);
+#endif
+}
+
+size_t thread_count(void)
+{
+#ifndef _WIN32
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+#endif // _WIN32
+}
+
+void mutex_init(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    *mutex = 0;
+#elif !defined(_WIN32)
+    int error = pthread_mutex_init(mutex, NULL);
+    if (error != 0) {
+        PANIC("Could not create mutex: %s", strerror(error));
+    }
+#else
+    InitializeCriticalSection(mutex);
+#endif
+}
+
+void mutex_lock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_lock(mutex);
+#else
+    EnterCriticalSection(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_unlock(mutex);
+#else
+    LeaveCriticalSection(mutex);
+#endif
+}
+
+void mutex_destroy(Mutex *mutex)
+{
+#if defined(NOBUILD_NO_THREADS)
+    (void) mutex;
+#elif !defined(_WIN32)
+    pthread_mutex_destroy(mutex);
+#else
+    DeleteCriticalSection(mutex);
+#endif
+}
+
+#undef NOBUILD__STATS_MODULE
+#define NOBUILD__STATS_MODULE STATS_USER
+
 #endif // NOBUILD_IO_I_
 #endif // NOBUILD_IO_IMPLEMENTATION
@@ -21,8 +21,22 @@
 #	endif
 #endif
 
+typedef enum {
+    LOG_TRACE = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERRO,
+} Log_Level;
+
+// Messages below `level` are not printed. Defaults to `LOG_INFO`. Panics are always printed.
+void log_set_level(Log_Level level);
+int log_enabled(Log_Level level);
+
 NOBUILD__DEPRECATED(void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args));
 
+void trace(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
+#define TRACE(fmt, ...) trace("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+
 void info(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 #define INFO(fmt, ...) info("%s:%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
 
@@ -51,6 +65,18 @@ void todo_safe(const char *fmt, ...) NOBUILD_PRINTF_FORMAT(1, 2);
 
 #include <stdlib.h>
 
+static Log_Level nobuild__log_level = LOG_INFO;
+
+void log_set_level(Log_Level level)
+{
+    nobuild__log_level = level;
+}
+
+int log_enabled(Log_Level level)
+{
+    return level >= nobuild__log_level;
+}
+
 void nobuild__vlog(FILE *stream, const char *tag, const char *fmt, va_list args)
 {
     fprintf(stream, "[%s] ", tag);
@@ -64,8 +90,24 @@ void VLOG(FILE *stream, const char *tag, const char *fmt, va_list args)
     nobuild__vlog(stream, tag, fmt, args);
 }
 
+void trace(const char *fmt, ...)
+{
+    if (!log_enabled(LOG_TRACE)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    nobuild__vlog(stderr, "TRCE", fmt, args);
+    va_end(args);
+}
+
 void info(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "INFO", fmt, args);
@@ -74,6 +116,10 @@ void info(const char *fmt, ...)
 
 void warn(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_WARN)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "WARN", fmt, args);
@@ -82,6 +128,10 @@ void warn(const char *fmt, ...)
 
 void erro(const char *fmt, ...)
 {
+    if (!log_enabled(LOG_ERRO)) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
     nobuild__vlog(stderr, "ERRO", fmt, args);
@@ -1,29 +1,15 @@
-#include <assert.h>
 #include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <stdint.h>
 
-#define COLUMNS 16
-#define PADDING 6
+#include "./hex.h"
 
-uint8_t buffer[COLUMNS];
+uint8_t buffer[HEX_COLUMNS];
+char line[HEX_LINE_SIZE];
 
 int main(void)
 {
     while (!feof(stdin)) {
-        size_t n = fread(buffer, sizeof(buffer[0]), COLUMNS, stdin);
-
-        for (size_t i = 0; i < n; ++i) {
-            printf("%02X ", buffer[i]);
-            if (!isprint(buffer[i])) buffer[i] = '.';
-        }
-
-        assert(n <= COLUMNS);
-        printf("%*s", (int) (PADDING + (COLUMNS - n) * 3), "");
-
-        fwrite(buffer, sizeof(buffer[0]), n, stdout);
-        printf("\n");
+        size_t n = fread(buffer, sizeof(buffer[0]), HEX_COLUMNS, stdin);
+        fwrite(line, sizeof(line[0]), hex_line(buffer, n, line), stdout);
     }
 
     return 0;
@@ -0,0 +1,42 @@
+#ifndef HEX_H_
+#define HEX_H_
+
+#include <assert.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HEX_COLUMNS 16
+#define HEX_PADDING 6
+// Longest line hex_line() produces, including the newline
+#define HEX_LINE_SIZE (HEX_COLUMNS * 3 + HEX_PADDING + HEX_COLUMNS + 1)
+
+// Formats up to HEX_COLUMNS bytes as one line of the dump into `line` and
+// returns its length
+static size_t hex_line(const uint8_t *bytes, size_t n, char *line)
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    assert(n <= HEX_COLUMNS);
+
+    size_t len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        line[len++] = digits[bytes[i] >> 4];
+        line[len++] = digits[bytes[i] & 0xF];
+        line[len++] = ' ';
+    }
+
+    size_t padding = HEX_PADDING + (HEX_COLUMNS - n) * 3;
+    memset(line + len, ' ', padding);
+    len += padding;
+
+    for (size_t i = 0; i < n; ++i) {
+        line[len++] = isprint(bytes[i]) ? (char) bytes[i] : '.';
+    }
+    line[len++] = '\n';
+
+    return len;
+}
+
+#endif // HEX_H_
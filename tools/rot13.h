@@ -0,0 +1,20 @@
+#ifndef ROT13_H_
+#define ROT13_H_
+
+#include <stddef.h>
+
+static char rot13(char x)
+{
+    if ('a' <= x && x <= 'z') return ((x - 'a') + 13) % 26 + 'a';
+    if ('A' <= x && x <= 'Z') return ((x - 'A') + 13) % 26 + 'A';
+    return x;
+}
+
+static void rot13_buffer(char *buffer, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        buffer[i] = rot13(buffer[i]);
+    }
+}
+
+#endif // ROT13_H_